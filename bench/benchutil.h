@@ -0,0 +1,24 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+
+// Runs "f" "iterations" times and returns the best wall time in seconds.
+// Best-of timing filters out the page cache / scheduler noise which
+// otherwise dominates the small inputs we have.
+template<class Func>
+double BestOfSeconds(uint32_t iterations, Func&& f)
+{
+    using Clock = std::chrono::steady_clock;
+    double best = std::numeric_limits<double>::max();
+    for(uint32_t i = 0; i < iterations; i++)
+    {
+        auto start = Clock::now();
+        f();
+        auto end = Clock::now();
+        best = std::min(best, std::chrono::duration<double>(end - start).count());
+    }
+    return best;
+}
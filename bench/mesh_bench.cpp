@@ -0,0 +1,775 @@
+/*
+    Mesh loading micro benchmarks.
+    Run from the "working_dir", every obj in "meshes/" is measured.
+*/
+#include "benchutil.h"
+#include "objparser.h"
+#include "meshcache.h"
+#include "threadpool.h"
+#include "objkeytable.h"
+#include "meshopt.h"
+#include "spheregen.h"
+#include "meshlet.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cassert>
+#include <cstring>
+#include <cmath>
+#include <charconv>
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+// ============================================================================
+// REFERENCE LOADER
+// Previous getline/sscanf loader of MeshGL, kept verbatim (minus GL upload)
+// so that new paths can be compared against it.
+// ============================================================================
+namespace Legacy
+{
+
+struct ObjKeyType
+{
+    uint32_t posIndex;
+    uint32_t uvIndex;
+    uint32_t normalIndex;
+
+    bool operator==(const ObjKeyType& other) const
+    {
+        return (posIndex == other.posIndex &&
+                uvIndex == other.uvIndex &&
+                normalIndex == other.normalIndex);
+    }
+};
+
+struct ObjKeyHash
+{
+    std::size_t operator()(const ObjKeyType& k) const
+    {
+        return (k.posIndex * 7741ull +
+                k.normalIndex * 5113ull +
+                k.uvIndex * 9157ull);
+    }
+};
+
+bool LoadObj(MeshData& out, const std::string& objPath)
+{
+    std::from_chars_result result;
+    std::ifstream file(objPath);
+    if(!file) return false;
+    //
+    std::vector<glm::vec3> positions; positions.reserve(512);
+    std::vector<glm::vec3> normals;   normals.reserve(512);
+    std::vector<glm::vec2> uvs;       uvs.reserve(512);
+    std::vector<uint32_t> indices;    indices.reserve(512);
+    //
+    std::unordered_map<ObjKeyType, uint32_t, ObjKeyHash> indexHashes;
+    indexHashes.reserve(1024 * 1024);
+
+    uint32_t indexCounter = 0;
+    std::string line;
+    while(std::getline(file, line))
+    {
+        if(line.size() >= 2 && line[0] == 'v' && line[1] == ' ')
+        {
+            glm::vec3 pos;
+            if(sscanf(line.c_str(), "v %f %f %f", &pos[0], &pos[1], &pos[2]) == 3)
+                positions.push_back(pos);
+        }
+        else if(line.size() >= 2 && line[0] == 'f' && line[1] == ' ')
+        {
+            auto ParseTriplet = [&](const std::string& l, size_t start, size_t end) -> ObjKeyType
+            {
+                std::string localView = l.substr(start, end - start);
+                const char* ptr = localView.c_str();
+                size_t s0 = 0;
+                size_t s1 = localView.find_first_of('/', s0);
+                size_t s2 = (s1 != std::string::npos) ? localView.find_first_of('/', s1 + 1) : std::string::npos;
+                size_t s3 = end - start;
+
+                uint32_t pId = std::numeric_limits<uint32_t>::max();
+                uint32_t uvId = std::numeric_limits<uint32_t>::max();
+                uint32_t nId = std::numeric_limits<uint32_t>::max();
+
+                if(s1 != std::string::npos)
+                    result = std::from_chars(ptr + s0, ptr + s1, pId);
+                else
+                    result = std::from_chars(ptr + s0, ptr + s3, pId);
+                if(s1 != std::string::npos && s2 != std::string::npos && s2 > s1 + 1)
+                    result = std::from_chars(ptr + s1 + 1, ptr + s2, uvId);
+                if(s2 != std::string::npos && s2 + 1 < s3)
+                    result = std::from_chars(ptr + s2 + 1, ptr + s3, nId);
+                return ObjKeyType{pId - 1, uvId - 1, nId - 1};
+            };
+
+            size_t s0 = line.find_first_of(' ') + 1;
+            size_t s1 = line.find_first_of(' ', s0);
+            size_t s2 = (s1 != std::string::npos) ? line.find_first_of(' ', s1 + 1) : std::string::npos;
+            size_t s3 = line.size();
+            if(s1 == std::string::npos) continue;
+
+            auto pack0 = ParseTriplet(line, s0, s1);
+            auto pack1 = ParseTriplet(line, s1 + 1, (s2 != std::string::npos) ? s2 : s3);
+            ObjKeyType pack2 = {};
+            if(s2 != std::string::npos) pack2 = ParseTriplet(line, s2 + 1, s3);
+
+            auto insertR = indexHashes.emplace(pack0, indexCounter);
+            if(insertR.second) indexCounter++;
+            indices.push_back(insertR.first->second);
+            insertR = indexHashes.emplace(pack1, indexCounter);
+            if(insertR.second) indexCounter++;
+            indices.push_back(insertR.first->second);
+            if(s2 != std::string::npos)
+            {
+                insertR = indexHashes.emplace(pack2, indexCounter);
+                if(insertR.second) indexCounter++;
+                indices.push_back(insertR.first->second);
+            }
+        }
+        else if(line.size() >= 3 && line[0] == 'v' && line[1] == 't' && line[2] == ' ')
+        {
+            glm::vec2 uv;
+            if(sscanf(line.c_str(), "vt %f %f", &uv[0], &uv[1]) == 2)
+                uvs.push_back(uv);
+        }
+        else if(line.size() >= 3 && line[0] == 'v' && line[1] == 'n' && line[2] == ' ')
+        {
+            glm::vec3 normal;
+            if(sscanf(line.c_str(), "vn %f %f %f", &normal[0], &normal[1], &normal[2]) == 3)
+                normals.push_back(normal);
+        }
+    }
+
+    out = MeshData();
+    out.positions.resize(indexHashes.size());
+    out.normals.resize(indexHashes.size());
+    out.uvs.resize(indexHashes.size());
+    for(const auto& entry : indexHashes)
+    {
+        uint32_t i = entry.second;
+        out.positions[i] = positions[entry.first.posIndex];
+        out.uvs[i] = (entry.first.uvIndex != std::numeric_limits<uint32_t>::max())
+                        ? uvs[entry.first.uvIndex] : glm::vec2(0);
+        out.normals[i] = (entry.first.normalIndex != std::numeric_limits<uint32_t>::max())
+                        ? normals[entry.first.normalIndex] : glm::vec3(0);
+    }
+    out.indices = std::move(indices);
+    return true;
+}
+
+}
+
+bool SameMesh(const MeshData& a, const MeshData& b)
+{
+    return (a.positions == b.positions &&
+            a.normals == b.normals &&
+            a.uvs == b.uvs &&
+            a.indices == b.indices);
+}
+
+// ============================================================================
+// BENCHMARKS
+// ============================================================================
+void BenchParse(const std::vector<std::string>& meshPaths)
+{
+    std::printf("== OBJ parse (best of N, ms) ==\n");
+    std::printf("%-24s %10s %10s %10s %8s\n",
+                "mesh", "triangles", "legacy", "mmap", "speedup");
+    for(const std::string& path : meshPaths)
+    {
+        MeshData legacyMesh, newMesh;
+        if(!Legacy::LoadObj(legacyMesh, path) || !ParseObj(newMesh, path))
+        {
+            std::fprintf(stderr, "Unable to load \"%s\"\n", path.c_str());
+            std::exit(EXIT_FAILURE);
+        }
+        if(!SameMesh(legacyMesh, newMesh))
+        {
+            std::fprintf(stderr, "Output mismatch on \"%s\"\n", path.c_str());
+            std::exit(EXIT_FAILURE);
+        }
+
+        constexpr uint32_t ITERATIONS = 20;
+        double tLegacy = BestOfSeconds(ITERATIONS, [&]()
+        {
+            Legacy::LoadObj(legacyMesh, path);
+        });
+        double tNew = BestOfSeconds(ITERATIONS, [&]()
+        {
+            ParseObj(newMesh, path);
+        });
+        std::printf("%-24s %10zu %10.3f %10.3f %7.2fx\n",
+                    std::filesystem::path(path).filename().string().c_str(),
+                    newMesh.indices.size() / 3,
+                    tLegacy * 1000.0, tNew * 1000.0, tLegacy / tNew);
+    }
+    std::printf("\n");
+}
+
+void BenchCache(const std::vector<std::string>& meshPaths)
+{
+    std::printf("== Binary cache load vs OBJ parse (best of N, ms) ==\n");
+    std::printf("%-24s %10s %10s %8s\n",
+                "mesh", "parse", "meshbin", "speedup");
+    auto tmpDir = std::filesystem::temp_directory_path();
+    for(const std::string& path : meshPaths)
+    {
+        MeshData mesh;
+        ParseObj(mesh, path);
+        MeshLayout layout = ComputeMeshLayout(mesh, MeshLayout::FLOAT32);
+        std::vector<std::byte> vertexData = PackVertexBuffer(mesh, layout);
+        std::vector<std::byte> indexData = PackIndexBuffer(mesh, layout);
+
+        std::string name = std::filesystem::path(path).filename().string();
+        std::string cachePath = (tmpDir / (name + ".meshbin")).string();
+        if(!WriteMeshCache(cachePath, path, layout, 0, MeshOptStats{},
+                           vertexData.data(), indexData.data(), {}))
+        {
+            std::fprintf(stderr, "Unable to write \"%s\"\n", cachePath.c_str());
+            std::exit(EXIT_FAILURE);
+        }
+
+        // Round trip check
+        MeshCache cache;
+        if(!LoadMeshCache(cache, cachePath, path) ||
+           std::memcmp(cache.vertexData, vertexData.data(), vertexData.size()) != 0 ||
+           std::memcmp(cache.indexData, indexData.data(), indexData.size()) != 0)
+        {
+            std::fprintf(stderr, "Cache round trip failed on \"%s\"\n", path.c_str());
+            std::exit(EXIT_FAILURE);
+        }
+
+        constexpr uint32_t ITERATIONS = 20;
+        double tParse = BestOfSeconds(ITERATIONS, [&]()
+        {
+            ParseObj(mesh, path);
+            layout = ComputeMeshLayout(mesh, MeshLayout::FLOAT32);
+            vertexData = PackVertexBuffer(mesh, layout);
+            indexData = PackIndexBuffer(mesh, layout);
+        });
+        // Touch every page so that the mapping cost is not hidden
+        volatile uint64_t sink = 0;
+        double tCache = BestOfSeconds(ITERATIONS, [&]()
+        {
+            MeshCache c;
+            LoadMeshCache(c, cachePath, path);
+            sink = sink + HashBytes(c.file.data, c.file.size);
+        });
+        std::filesystem::remove(cachePath);
+        std::printf("%-24s %10.3f %10.3f %7.2fx\n", name.c_str(),
+                    tParse * 1000.0, tCache * 1000.0, tParse / tCache);
+    }
+    std::printf("\n");
+}
+
+// Triangles as position triples, sorted; used to check that
+// reordering passes keep the exact same triangle set and winding
+std::vector<std::array<float, 9>> TriangleSet(const MeshData& mesh)
+{
+    std::vector<std::array<float, 9>> tris(mesh.indices.size() / 3);
+    for(size_t t = 0; t < tris.size(); t++)
+    for(size_t c = 0; c < 3; c++)
+    {
+        const glm::vec3& p = mesh.positions[mesh.indices[t * 3 + c]];
+        tris[t][c * 3 + 0] = p.x;
+        tris[t][c * 3 + 1] = p.y;
+        tris[t][c * 3 + 2] = p.z;
+    }
+    std::sort(tris.begin(), tris.end());
+    return tris;
+}
+
+void BenchOptimize(const std::vector<std::string>& meshPaths)
+{
+    std::printf("== Vertex cache / overdraw / fetch optimization "
+                "(FIFO-16 ACMR, ATVR) ==\n");
+    std::printf("%-24s %8s %8s %8s %8s %9s %10s\n", "mesh", "ACMR", "ACMR'",
+                "ATVR", "ATVR'", "clusters", "time(ms)");
+    for(const std::string& path : meshPaths)
+    {
+        MeshData mesh;
+        ParseObj(mesh, path);
+        MeshData optimized = mesh;
+        MeshOptStats stats = OptimizeMesh(optimized);
+        if(TriangleSet(mesh) != TriangleSet(optimized))
+        {
+            std::fprintf(stderr, "Optimization changed the triangles "
+                         "of \"%s\"\n", path.c_str());
+            std::exit(EXIT_FAILURE);
+        }
+
+        constexpr uint32_t ITERATIONS = 10;
+        double t = BestOfSeconds(ITERATIONS, [&]()
+        {
+            optimized = mesh;
+            OptimizeMesh(optimized);
+        });
+        std::printf("%-24s %8.3f %8.3f %8.3f %8.3f %9u %10.3f\n",
+                    std::filesystem::path(path).filename().string().c_str(),
+                    double(stats.before.acmr), double(stats.after.acmr),
+                    double(stats.before.atvr), double(stats.after.atvr),
+                    stats.clusterCount, t * 1000.0);
+    }
+    std::printf("\n");
+}
+
+void BenchVertexFormat(const std::vector<std::string>& meshPaths)
+{
+    std::printf("== Vertex format FLOAT32 vs QUANTIZED (optimized meshes) ==\n");
+    std::printf("%-24s %8s %10s %10s %11s %11s %9s %9s %9s %9s %9s\n", "mesh", "verts",
+                "f32(KiB)", "q16(KiB)", "f32 fetch", "q16 fetch",
+                "pos err", "nrm err", "uv err", "u32 idx", "idx(KiB)");
+    auto Snorm = [](const std::byte* p)
+    {
+        int16_t v;
+        std::memcpy(&v, p, sizeof(int16_t));
+        return std::max(float(v) / 32767.0f, -1.0f);
+    };
+    auto Unorm = [](const std::byte* p)
+    {
+        uint16_t v;
+        std::memcpy(&v, p, sizeof(uint16_t));
+        return float(v) / 65535.0f;
+    };
+    for(const std::string& path : meshPaths)
+    {
+        MeshData mesh;
+        ParseObj(mesh, path);
+        OptimizeMesh(mesh);
+        MeshLayout fLayout = ComputeMeshLayout(mesh, MeshLayout::FLOAT32);
+        MeshLayout qLayout = ComputeMeshLayout(mesh, MeshLayout::QUANTIZED);
+        if(qLayout.format != MeshLayout::QUANTIZED)
+        {
+            std::printf("%-24s (uvs out of range, not quantized)\n",
+                        std::filesystem::path(path).filename().string().c_str());
+            continue;
+        }
+        std::vector<std::byte> qData = PackVertexBuffer(mesh, qLayout);
+
+        // Decode back the way the shaders do
+        float posErr = 0.0f, normalErr = 0.0f, uvErr = 0.0f;
+        float radius = glm::length(qLayout.posScale);
+        for(size_t i = 0; i < mesh.positions.size(); i++)
+        {
+            const std::byte* v = qData.data() + i * qLayout.attribStrides[0];
+            const std::byte* p = v + qLayout.attribOffsets[0];
+            const std::byte* n = v + qLayout.attribOffsets[1];
+            const std::byte* t = v + qLayout.attribOffsets[2];
+            glm::vec3 pos = glm::vec3(Snorm(p), Snorm(p + 2), Snorm(p + 4));
+            pos = pos * qLayout.posScale + qLayout.posOffset;
+            glm::vec3 normal = OctDecode(glm::vec2(Snorm(n), Snorm(n + 2)));
+            glm::vec2 uv = glm::vec2(Unorm(t), Unorm(t + 2));
+
+            posErr = std::max(posErr, glm::length(pos - mesh.positions[i]) / radius);
+            float cosAngle = glm::dot(normal, glm::normalize(mesh.normals[i]));
+            normalErr = std::max(normalErr, std::acos(std::min(cosAngle, 1.0f)));
+            uvErr = std::max(uvErr, glm::length(uv - mesh.uvs[i]));
+        }
+
+        // Vertex fetch traffic of a single draw; every post transform
+        // cache miss fetches a whole vertex (all attributes are read)
+        VertexCacheStats cacheStats = AnalyzeVertexCache(mesh.indices, qLayout.vertexCount);
+        double misses = double(cacheStats.acmr) * double(mesh.indices.size() / 3);
+        uint32_t fBytesPerVertex = (fLayout.attribStrides[0] + fLayout.attribStrides[1] +
+                                    fLayout.attribStrides[2]);
+        uint32_t qBytesPerVertex = qLayout.attribStrides[0];
+        double index32Size = double(mesh.indices.size() * sizeof(uint32_t)) / 1024.0;
+        std::printf("%-24s %8u %10.1f %10.1f %9.1fK %9.1fK %9.2e %8.4f\u00b0 %9.2e %9.1f %9.1f\n",
+                    std::filesystem::path(path).filename().string().c_str(),
+                    qLayout.vertexCount,
+                    double(fLayout.vertexBufferSize) / 1024.0,
+                    double(qLayout.vertexBufferSize) / 1024.0,
+                    misses * fBytesPerVertex / 1024.0,
+                    misses * qBytesPerVertex / 1024.0,
+                    double(posErr), double(glm::degrees(normalErr)), double(uvErr),
+                    index32Size, double(qLayout.indexBufferSize) / 1024.0);
+    }
+    std::printf("\n");
+}
+
+void BenchGenerate(const std::vector<std::string>& meshPaths)
+{
+    std::printf("== Procedural spheres vs OBJ load (to packed QUANTIZED "
+                "buffers, best of N, ms) ==\n");
+    std::printf("%-24s %8s %9s %9s %9s %9s %9s\n", "mesh", "tris",
+                "obj", "meshbin", "uv", "ico", "cube");
+    auto tmpDir = std::filesystem::temp_directory_path();
+    for(const std::string& path : meshPaths)
+    {
+        MeshData objMesh;
+        ParseObj(objMesh, path);
+        // UV sphere with the same tessellation (2 * s * (s - 1) triangles),
+        // ico and cube spheres with the closest triangle count
+        size_t triCount = objMesh.indices.size() / 3;
+        uint32_t segments = uint32_t(std::lround((1.0 + std::sqrt(1.0 + 2.0 * double(triCount))) * 0.5));
+        if(size_t(2) * segments * (segments - 1) != triCount) continue;
+        uint32_t frequency = uint32_t(std::lround(std::sqrt(double(triCount) / 20.0)));
+        uint32_t divisions = uint32_t(std::lround(std::sqrt(double(triCount) / 12.0)));
+
+        MeshLayout layout = {};
+        std::vector<std::byte> vertexData, indexData;
+        auto Pack = [&](const MeshData& mesh)
+        {
+            layout = ComputeMeshLayout(mesh, MeshLayout::QUANTIZED);
+            vertexData = PackVertexBuffer(mesh, layout);
+            indexData = PackIndexBuffer(mesh, layout);
+        };
+
+        std::string name = std::filesystem::path(path).filename().string();
+        std::string cachePath = (tmpDir / (name + ".meshbin")).string();
+        Pack(objMesh);
+        WriteMeshCache(cachePath, path, layout, 0, MeshOptStats{},
+                       vertexData.data(), indexData.data(), {});
+
+        constexpr uint32_t ITERATIONS = 20;
+        double tObj = BestOfSeconds(ITERATIONS, [&]()
+        {
+            MeshData mesh;
+            ParseObj(mesh, path);
+            Pack(mesh);
+        });
+        volatile uint64_t sink = 0;
+        double tCache = BestOfSeconds(ITERATIONS, [&]()
+        {
+            MeshCache c;
+            LoadMeshCache(c, cachePath, path);
+            sink = sink + HashBytes(c.file.data, c.file.size);
+        });
+        std::filesystem::remove(cachePath);
+        double tUV = BestOfSeconds(ITERATIONS, [&]()
+        {
+            Pack(GenerateUVSphere(segments, segments));
+        });
+        double tIco = BestOfSeconds(ITERATIONS, [&]()
+        {
+            Pack(GenerateIcoSphere(frequency));
+        });
+        double tCube = BestOfSeconds(ITERATIONS, [&]()
+        {
+            Pack(GenerateCubeSphere(divisions));
+        });
+        std::printf("%-24s %8zu %9.3f %9.3f %9.3f %9.3f %9.3f\n", name.c_str(),
+                    triCount, tObj * 1000.0, tCache * 1000.0, tUV * 1000.0,
+                    tIco * 1000.0, tCube * 1000.0);
+        std::printf("%-24s %8s %9s %9s %9u %9zu %9zu\n", "", "", "", "",
+                    uint32_t(2 * segments * (segments - 1)),
+                    size_t(20) * frequency * frequency,
+                    size_t(12) * divisions * divisions);
+    }
+    std::printf("\n");
+}
+
+// Face corners of an obj (triangles only, "p/t/n" form),
+// parsed plainly since this is not the measured part
+std::vector<ObjKeyType> ReadTriangleCorners(const std::string& path)
+{
+    std::vector<ObjKeyType> corners;
+    std::ifstream file(path);
+    std::string line;
+    while(std::getline(file, line))
+    {
+        if(line.size() < 2 || line[0] != 'f' || line[1] != ' ') continue;
+        uint32_t v[9];
+        if(std::sscanf(line.c_str(), "f %u/%u/%u %u/%u/%u %u/%u/%u",
+                       v + 0, v + 1, v + 2, v + 3, v + 4,
+                       v + 5, v + 6, v + 7, v + 8) != 9)
+            continue;
+        for(uint32_t i = 0; i < 9; i += 3)
+            corners.push_back(ObjKeyType{v[i] - 1, v[i + 1] - 1, v[i + 2] - 1});
+    }
+    return corners;
+}
+
+void BenchDedup(const std::vector<std::string>& meshPaths)
+{
+    std::printf("== Corner dedup throughput (best of N, Mcorners/s) ==\n");
+    std::printf("%-24s %10s %10s %12s %12s %8s\n", "mesh", "corners",
+                "unique", "unordered", "flat", "speedup");
+
+    std::vector<std::pair<std::string, std::vector<ObjKeyType>>> inputs;
+    for(const std::string& path : meshPaths)
+        inputs.emplace_back(std::filesystem::path(path).filename().string(),
+                            ReadTriangleCorners(path));
+    // High resolution stand-in, same corner pattern as "GenerateSphereObj"
+    {
+        static constexpr uint32_t RINGS = 512;
+        static constexpr uint32_t SEGMENTS = 1024;
+        std::vector<ObjKeyType> corners;
+        corners.reserve(size_t(RINGS) * SEGMENTS * 6);
+        for(uint32_t r = 0; r < RINGS; r++)
+        for(uint32_t s = 0; s < SEGMENTS; s++)
+        {
+            uint32_t i0 = r * (SEGMENTS + 1) + s;
+            uint32_t i1 = i0 + 1;
+            uint32_t i2 = i0 + SEGMENTS + 1;
+            uint32_t i3 = i2 + 1;
+            for(uint32_t i : {i0, i2, i1, i1, i2, i3})
+                corners.push_back(ObjKeyType{i, i, i});
+        }
+        inputs.emplace_back("synthetic_1M", std::move(corners));
+    }
+
+    for(const auto& [name, corners] : inputs)
+    {
+        std::vector<uint32_t> indicesA(corners.size()), indicesB(corners.size());
+        size_t uniqueA = 0, uniqueB = 0;
+        // Current estimate is the largest attribute count (+25%),
+        // for these meshes it is the highest position index
+        size_t maxIndex = 0;
+        for(const ObjKeyType& k : corners)
+            maxIndex = std::max({maxIndex, size_t(k.posIndex), size_t(k.uvIndex),
+                                 size_t(k.normalIndex)});
+        size_t estimate = std::min(corners.size(), (maxIndex + 1) * 5 / 4);
+
+        constexpr uint32_t ITERATIONS = 10;
+        double tMap = BestOfSeconds(ITERATIONS, [&]()
+        {
+            Legacy::ObjKeyHash hasher;
+            std::unordered_map<ObjKeyType, uint32_t, decltype(
+                [](const ObjKeyType& k)
+                {
+                    Legacy::ObjKeyHash h;
+                    return h(Legacy::ObjKeyType{k.posIndex, k.uvIndex, k.normalIndex});
+                })> map;
+            (void)hasher;
+            map.reserve(1024 * 1024);
+            uint32_t counter = 0;
+            for(size_t i = 0; i < corners.size(); i++)
+            {
+                auto r = map.emplace(corners[i], counter);
+                if(r.second) counter++;
+                indicesA[i] = r.first->second;
+            }
+            uniqueA = counter;
+        });
+        double tFlat = BestOfSeconds(ITERATIONS, [&]()
+        {
+            ObjKeyTable table(estimate);
+            uint32_t counter = 0;
+            for(size_t i = 0; i < corners.size(); i++)
+            {
+                auto r = table.Insert(corners[i], counter);
+                if(r.second) counter++;
+                indicesB[i] = r.first;
+            }
+            uniqueB = counter;
+        });
+        if(indicesA != indicesB || uniqueA != uniqueB)
+        {
+            std::fprintf(stderr, "Dedup mismatch on \"%s\"\n", name.c_str());
+            std::exit(EXIT_FAILURE);
+        }
+        double n = double(corners.size()) * 1e-6;
+        std::printf("%-24s %10zu %10zu %12.1f %12.1f %7.2fx\n", name.c_str(),
+                    corners.size(), uniqueB, n / tMap, n / tFlat, tMap / tFlat);
+    }
+    std::printf("\n");
+}
+
+// Writes a UV sphere obj with (2 * rings * segments) triangles,
+// used as a stand-in for the high resolution body meshes
+std::string GenerateSphereObj(uint32_t rings, uint32_t segments)
+{
+    std::string obj;
+    obj.reserve(size_t(rings) * segments * 160);
+    char line[160];
+    for(uint32_t r = 0; r <= rings; r++)
+    for(uint32_t s = 0; s <= segments; s++)
+    {
+        float theta = float(r) / float(rings) * 3.14159265f;
+        float phi = float(s) / float(segments) * 6.28318531f;
+        glm::vec3 p(std::sin(theta) * std::cos(phi), std::cos(theta),
+                    std::sin(theta) * std::sin(phi));
+        int n = std::snprintf(line, sizeof(line),
+                              "v %f %f %f\nvt %f %f\nvn %f %f %f\n",
+                              double(p.x), double(p.y), double(p.z),
+                              double(float(s) / float(segments)),
+                              double(float(r) / float(rings)),
+                              double(p.x), double(p.y), double(p.z));
+        obj.append(line, size_t(n));
+    }
+    for(uint32_t r = 0; r < rings; r++)
+    for(uint32_t s = 0; s < segments; s++)
+    {
+        uint32_t i0 = r * (segments + 1) + s + 1;
+        uint32_t i1 = i0 + 1;
+        uint32_t i2 = i0 + segments + 1;
+        uint32_t i3 = i2 + 1;
+        int n = std::snprintf(line, sizeof(line),
+                              "f %u/%u/%u %u/%u/%u %u/%u/%u\n"
+                              "f %u/%u/%u %u/%u/%u %u/%u/%u\n",
+                              i0, i0, i0, i2, i2, i2, i1, i1, i1,
+                              i1, i1, i1, i2, i2, i2, i3, i3, i3);
+        obj.append(line, size_t(n));
+    }
+    return obj;
+}
+
+void BenchParallel()
+{
+    static constexpr uint32_t RINGS = 512;
+    static constexpr uint32_t SEGMENTS = 1024;
+    std::string obj = GenerateSphereObj(RINGS, SEGMENTS);
+    std::printf("== Parallel OBJ parse, synthetic sphere "
+                "(%u triangles, %.1f MiB, best of N, ms) ==\n",
+                2 * RINGS * SEGMENTS, double(obj.size()) / (1024.0 * 1024.0));
+    std::printf("(hardware threads: %u)\n", std::thread::hardware_concurrency());
+
+    MeshData serialMesh;
+    constexpr uint32_t ITERATIONS = 5;
+    double tSerial = BestOfSeconds(ITERATIONS, [&]()
+    {
+        ParseObj(serialMesh, obj.data(), obj.size(), "synthetic");
+    });
+    std::printf("%-10s %10.3f\n", "serial", tSerial * 1000.0);
+
+    for(uint32_t threadCount : {1u, 2u, 4u, 8u})
+    {
+        ThreadPool pool(threadCount);
+        MeshData mesh;
+        double t = BestOfSeconds(ITERATIONS, [&]()
+        {
+            ParseObjParallel(mesh, obj.data(), obj.size(), "synthetic", pool);
+        });
+        if(!SameMesh(serialMesh, mesh) ||
+           serialMesh.missingNormals != mesh.missingNormals ||
+           serialMesh.missingUVs != mesh.missingUVs)
+        {
+            std::fprintf(stderr, "Parallel output (%u threads) differs "
+                         "from serial!\n", threadCount);
+            std::exit(EXIT_FAILURE);
+        }
+        std::printf("%u thread%-3s %10.3f %7.2fx\n", threadCount,
+                    (threadCount == 1) ? "" : "s", t * 1000.0, tSerial / t);
+    }
+    std::printf("\n");
+}
+
+void BenchMeshlets(const std::vector<std::string>& meshPaths)
+{
+    std::printf("== Meshlet culling (perspective camera looking at the mesh "
+                "from 64 directions, %% of triangles submitted) ==\n");
+    std::printf("%-24s %8s %9s %7s %8s %8s %8s %9s %9s %9s %9s\n", "mesh", "tris",
+                "meshlets", "avg", "ACMR", "ACMR'", "ACMR''", "near", "near(ex)",
+                "far", "far(ex)");
+
+    std::vector<std::pair<std::string, MeshData>> meshes;
+    for(const std::string& path : meshPaths)
+    {
+        MeshData mesh;
+        ParseObj(mesh, path);
+        meshes.emplace_back(std::filesystem::path(path).filename().string(),
+                            std::move(mesh));
+    }
+    for(uint32_t segments : {100u, 50u, 32u, 16u, 8u})
+    {
+        meshes.emplace_back("uv_" + std::to_string(segments),
+                            GenerateUVSphere(segments, segments));
+    }
+
+    for(auto& [name, mesh] : meshes)
+    {
+        OptimizeMesh(mesh);
+        uint32_t vertexCount = uint32_t(mesh.positions.size());
+        float acmr = AnalyzeVertexCache(mesh.indices, vertexCount).acmr;
+        MeshData original = mesh;
+        std::vector<Meshlet> meshlets = BuildMeshlets(mesh);
+        if(TriangleSet(original) != TriangleSet(mesh))
+        {
+            std::fprintf(stderr, "Meshlets changed the triangles "
+                         "of \"%s\"\n", name.c_str());
+            std::exit(EXIT_FAILURE);
+        }
+        float acmrMeshlet = AnalyzeVertexCache(mesh.indices, vertexCount).acmr;
+        OptimizeMeshletVertexCache(mesh, meshlets);
+        float acmrReordered = AnalyzeVertexCache(mesh.indices, vertexCount).acmr;
+        if(TriangleSet(original) != TriangleSet(mesh))
+        {
+            std::fprintf(stderr, "Meshlet reorder changed the triangles "
+                         "of \"%s\"\n", name.c_str());
+            std::exit(EXIT_FAILURE);
+        }
+
+        // Bounding radius of the mesh
+        float radius = 0.0f;
+        for(const glm::vec3& p : mesh.positions)
+            radius = std::max(radius, glm::length(p));
+
+        uint32_t triCount = uint32_t(mesh.indices.size() / 3);
+        auto Measure = [&](float distance, double& culled, double& exact)
+        {
+            constexpr uint32_t VIEW_COUNT = 64;
+            glm::mat4 proj = glm::perspective(glm::radians(45.0f), 1.0f,
+                                              0.1f, 100.0f * distance);
+            std::vector<IndexRange> ranges;
+            uint64_t culledSum = 0, exactSum = 0;
+            for(uint32_t i = 0; i < VIEW_COUNT; i++)
+            {
+                // Fibonacci sphere directions
+                float y = 1.0f - 2.0f * (float(i) + 0.5f) / float(VIEW_COUNT);
+                float r = std::sqrt(1.0f - y * y);
+                float phi = float(i) * 2.39996323f;
+                glm::vec3 eye = glm::vec3(r * std::cos(phi), y, r * std::sin(phi)) * distance;
+                glm::vec3 up = (std::abs(y) > 0.99f) ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+                glm::mat4 view = glm::lookAt(eye, glm::vec3(0.0f), up);
+                culledSum += CullMeshlets(ranges, meshlets, proj, view, true);
+                for(uint32_t t = 0; t < triCount; t++)
+                {
+                    const glm::vec3& p0 = mesh.positions[mesh.indices[t * 3 + 0]];
+                    const glm::vec3& p1 = mesh.positions[mesh.indices[t * 3 + 1]];
+                    const glm::vec3& p2 = mesh.positions[mesh.indices[t * 3 + 2]];
+                    glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+                    if(glm::dot(n, eye - p0) > 0.0f) exactSum++;
+                }
+            }
+            double total = double(triCount) * VIEW_COUNT;
+            culled = 100.0 * double(culledSum) / total;
+            exact = 100.0 * double(exactSum) / total;
+        };
+        double nearCulled, nearExact, farCulled, farExact;
+        Measure(3.0f * radius, nearCulled, nearExact);
+        Measure(20.0f * radius, farCulled, farExact);
+
+        std::printf("%-24s %8u %9zu %7.1f %8.3f %8.3f %8.3f %8.1f%% %8.1f%% %8.1f%% %8.1f%%\n",
+                    name.c_str(), triCount, meshlets.size(),
+                    double(triCount) / double(meshlets.size()),
+                    double(acmr), double(acmrMeshlet), double(acmrReordered),
+                    nearCulled, nearExact, farCulled, farExact);
+    }
+    std::printf("ACMR': after building the meshlets, ACMR'': triangles reordered "
+                "within the meshlets\n(ex): exact per-triangle back face count\n\n");
+}
+
+int main(int argc, const char* argv[])
+{
+    std::string meshDir = (argc > 1) ? argv[1] : "meshes";
+    std::vector<std::string> meshPaths;
+    for(const auto& entry : std::filesystem::directory_iterator(meshDir))
+    {
+        if(entry.path().extension() == ".obj")
+            meshPaths.push_back(entry.path().string());
+    }
+    std::sort(meshPaths.begin(), meshPaths.end());
+    if(meshPaths.empty())
+    {
+        std::fprintf(stderr, "No obj files found in \"%s\"\n", meshDir.c_str());
+        return EXIT_FAILURE;
+    }
+
+    BenchParse(meshPaths);
+    BenchCache(meshPaths);
+    BenchDedup(meshPaths);
+    BenchOptimize(meshPaths);
+    BenchVertexFormat(meshPaths);
+    BenchGenerate(meshPaths);
+    BenchMeshlets(meshPaths);
+    BenchParallel();
+    return 0;
+}
@@ -0,0 +1,205 @@
+/*
+    Image decode and texture mip generation micro benchmarks.
+    Run from the "working_dir", every image in "textures/" is measured.
+*/
+#include "benchutil.h"
+#include "imagedecode.h"
+#include "texcache.h"
+#include "mipgen.h"
+#include "threadpool.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <bit>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+// ============================================================================
+// REFERENCE
+// Previous scalar 2x2 box chain of "BuildTextureCache" (8-bit only),
+// kept verbatim so that new paths can be compared against it.
+// ============================================================================
+void DownsampleBox(uint8_t* dst, const uint8_t* src, uint32_t srcWidth, uint32_t srcHeight,
+                   uint32_t channelCount)
+{
+    uint32_t dstWidth = std::max(1u, srcWidth / 2);
+    uint32_t dstHeight = std::max(1u, srcHeight / 2);
+    for(uint32_t y = 0; y < dstHeight; y++)
+    {
+        uint32_t y0 = std::min(y * 2, srcHeight - 1);
+        uint32_t y1 = std::min(y * 2 + 1, srcHeight - 1);
+        for(uint32_t x = 0; x < dstWidth; x++)
+        {
+            uint32_t x0 = std::min(x * 2, srcWidth - 1);
+            uint32_t x1 = std::min(x * 2 + 1, srcWidth - 1);
+            for(uint32_t c = 0; c < channelCount; c++)
+            {
+                uint32_t sum = (uint32_t(src[(size_t(y0) * srcWidth + x0) * channelCount + c]) +
+                                uint32_t(src[(size_t(y0) * srcWidth + x1) * channelCount + c]) +
+                                uint32_t(src[(size_t(y1) * srcWidth + x0) * channelCount + c]) +
+                                uint32_t(src[(size_t(y1) * srcWidth + x1) * channelCount + c]));
+                dst[(size_t(y) * dstWidth + x) * channelCount + c] = uint8_t((sum + 2) / 4);
+            }
+        }
+    }
+}
+
+void LegacyMips(std::byte* levels, const TextureLayout& layout)
+{
+    uint32_t channelCount = ChannelCount(layout.format);
+    for(uint32_t i = 1; i < layout.mipCount; i++)
+    {
+        DownsampleBox(reinterpret_cast<uint8_t*>(levels + layout.levelOffsets[i]),
+                      reinterpret_cast<const uint8_t*>(levels + layout.levelOffsets[i - 1]),
+                      std::max(1u, layout.width >> (i - 1)),
+                      std::max(1u, layout.height >> (i - 1)), channelCount);
+    }
+}
+
+// Tightly packed chain with level 0 filled from the image
+bool LoadChain(TextureLayout& layout, std::vector<std::byte>& levels,
+               const std::string& path)
+{
+    DecodedImage image;
+    if(!DecodeImage(image, path) || image.is16Bit) return false;
+    layout = {};
+    layout.format = TextureLayout::PixelFormat(image.channelCount - 1);
+    layout.width = uint32_t(image.width);
+    layout.height = uint32_t(image.height);
+    layout.mipCount = std::min(uint32_t(std::bit_width(std::max(layout.width, layout.height))),
+                               TextureLayout::MAX_MIP_COUNT);
+    uint64_t offset = 0;
+    for(uint32_t i = 0; i < layout.mipCount; i++)
+    {
+        layout.levelOffsets[i] = offset;
+        layout.levelSizes[i] = uint64_t(std::max(1u, layout.width >> i)) *
+                               std::max(1u, layout.height >> i) * uint32_t(image.channelCount);
+        offset += layout.levelSizes[i];
+    }
+    levels.assign(size_t(offset), std::byte(0));
+    std::memcpy(levels.data(), image.pixels.get(), size_t(layout.levelSizes[0]));
+    return true;
+}
+
+void BenchDecode(const std::vector<std::string>& texPaths)
+{
+    std::printf("== Image decode (megapixels / s, best of N) ==\n");
+    std::printf("%-32s %11s %14s %9s %9s %8s %8s\n", "image", "size", "decoder",
+                "stb", "decoder", "speedup", "max err");
+    for(const std::string& path : texPaths)
+    {
+        ImageInfo info, stbInfo;
+        if(!ReadImageInfo(info, path) ||
+           !ReadImageInfo(stbInfo, path, ImageDecoder::STB))
+            continue;
+        // Same buffer for every run, as a decode into a mapped buffer would be
+        std::vector<uint8_t> pixels(ImageByteSize(info));
+        std::vector<uint8_t> stbPixels(ImageByteSize(stbInfo));
+        double megapixels = double(info.width) * double(info.height) / 1e6;
+
+        uint32_t iterations = (megapixels > 8.0) ? 2 : 5;
+        bool ok = true;
+        double tStb = BestOfSeconds(iterations, [&]()
+        {
+            ok &= DecodeImageInto(stbPixels.data(), stbInfo, path, ImageDecoder::STB);
+        });
+        double tAuto = BestOfSeconds(iterations, [&]()
+        {
+            ok &= DecodeImageInto(pixels.data(), info, path);
+        });
+        // Decoders round the IDCT / upsampling differently
+        int maxError = -1;
+        if(ok && pixels.size() == stbPixels.size() && !info.is16Bit)
+        {
+            maxError = 0;
+            for(size_t i = 0; i < pixels.size(); i++)
+                maxError = std::max(maxError, std::abs(int(pixels[i]) - int(stbPixels[i])));
+        }
+
+        std::string name = std::filesystem::path(path).filename().string();
+        std::string size = std::to_string(info.width) + "x" + std::to_string(info.height);
+        std::printf("%-32s %11s %14s %9.1f %9.1f %7.2fx %8d\n", name.c_str(), size.c_str(),
+                    ImageDecoderName(path), megapixels / tStb, megapixels / tAuto,
+                    tStb / tAuto, maxError);
+    }
+    std::printf("\n");
+}
+
+void BenchMips(const std::vector<std::string>& texPaths)
+{
+    std::printf("== Mip chain generation (level 0 megapixels / s, best of N) ==\n");
+    #if defined(__AVX__)
+        const char* simd = "AVX";
+    #elif defined(__SSE2__) || defined(_M_X64)
+        const char* simd = "SSE2";
+    #else
+        const char* simd = "none";
+    #endif
+    std::printf("(hardware threads: %u, SIMD: %s)\n", std::thread::hardware_concurrency(), simd);
+    std::printf("%-32s %6s %9s %9s %9s %9s %9s\n", "image", "format", "legacy",
+                "box", "box sRGB", "kaiser", "k. sRGB");
+
+    ThreadPool pool;
+    for(const std::string& path : texPaths)
+    {
+        TextureLayout layout;
+        std::vector<std::byte> levels;
+        if(!LoadChain(layout, levels, path)) continue;
+        double megapixels = double(layout.width) * double(layout.height) / 1e6;
+
+        uint32_t iterations = (megapixels > 8.0) ? 2 : 5;
+        double tLegacy = BestOfSeconds(iterations, [&]() { LegacyMips(levels.data(), layout); });
+        auto Run = [&](MipSettings::Filter filter, bool linearLight)
+        {
+            MipSettings settings;
+            settings.filter = filter;
+            settings.linearLight = linearLight;
+            return BestOfSeconds(iterations, [&]()
+            {
+                GenerateMips(levels.data(), layout, settings, &pool);
+            });
+        };
+        double tBox = Run(MipSettings::BOX, false);
+        double tBoxSRGB = Run(MipSettings::BOX, true);
+        double tKaiser = Run(MipSettings::KAISER, false);
+        double tKaiserSRGB = Run(MipSettings::KAISER, true);
+
+        std::string name = std::filesystem::path(path).filename().string();
+        std::printf("%-32s %6s %9.1f %9.1f %9.1f %9.1f %9.1f\n", name.c_str(),
+                    PixelFormatName(layout.format), megapixels / tLegacy,
+                    megapixels / tBox, megapixels / tBoxSRGB,
+                    megapixels / tKaiser, megapixels / tKaiserSRGB);
+    }
+    std::printf("\n");
+}
+
+}
+
+int main(int argc, const char* argv[])
+{
+    std::string texDir = (argc > 1) ? argv[1] : "textures";
+    std::vector<std::string> texPaths;
+    for(const auto& entry : std::filesystem::directory_iterator(texDir))
+    {
+        std::string ext = entry.path().extension().string();
+        if(ext == ".jpg" || ext == ".jpeg" || ext == ".png")
+            texPaths.push_back(entry.path().string());
+    }
+    std::sort(texPaths.begin(), texPaths.end());
+    if(texPaths.empty())
+    {
+        std::fprintf(stderr, "No images found in \"%s\"\n", texDir.c_str());
+        return EXIT_FAILURE;
+    }
+
+    BenchDecode(texPaths);
+    BenchMips(texPaths);
+    return 0;
+}
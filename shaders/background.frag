@@ -1,15 +1,13 @@
 #version 430
 /*
     Background Fragment Shader
-    Simply samples the stars texture
+    Samples the octahedral stars map along the view ray
 */
 
-#define IN_UV       layout(location = 0)
-#define OUT_COLOR   layout(location = 0)
-#define T_ALBEDO    layout(binding = 0)
+#include "include/locations.glsl"
 
 // Input
-in IN_UV vec2 fUV;
+in IN_RAY vec3 fRay;
 
 // Output
 out OUT_COLOR vec4 fragColor;
@@ -17,7 +15,22 @@ out OUT_COLOR vec4 fragColor;
 // Textures
 uniform T_ALBEDO sampler2D tAlbedo;
 
+// Octahedral map around +z (see "EquirectToOctahedral")
+vec2 OctEncode(vec3 d)
+{
+    d /= abs(d.x) + abs(d.y) + abs(d.z);
+    if(d.z < 0.0)
+        d.xy = (1.0 - abs(d.yx)) * vec2(d.x >= 0.0 ? 1.0 : -1.0, d.y >= 0.0 ? 1.0 : -1.0);
+    return d.xy * 0.5 + 0.5;
+}
+
 void main(void)
 {
-    fragColor = texture(tAlbedo, fUV);
+    vec3 dir = normalize(fRay);
+    // uv derivatives jump on the folds of the map, the footprint
+    // is taken from the ray instead; a texel spans about
+    // sqrt(4 pi) / size radians
+    float angle = max(length(dFdx(dir)), length(dFdy(dir)));
+    float lod = log2(angle * float(textureSize(tAlbedo, 0).x) / 3.545);
+    fragColor = textureLod(tAlbedo, OctEncode(dir), lod);
 }
@@ -0,0 +1,50 @@
+#version 430
+/*
+    Background Feedback Shader
+    Writes the virtual texture page each fragment needs,
+    "VirtualTexture" reads it back to stream the pages in
+*/
+
+#include "include/locations.glsl"
+
+#define PI 3.14159265358979
+
+// Input
+in IN_RAY vec3 fRay;
+
+// Output (page x, page y, level, written)
+out OUT_PAGE uvec4 fragPage;
+
+// Uniforms (see "background_vt.frag")
+U_VT_SIZE   uniform vec4 uVTSize;
+U_VT_ATLAS  uniform vec4 uVTAtlas;
+U_VT_LEVELS uniform vec4 uVTLevels[16];
+
+vec2 EquirectUV(vec3 d)
+{
+    return vec2(fract(atan(-d.z, d.x) / (2.0 * PI)),
+                acos(clamp(-d.y, -1.0, 1.0)) / PI);
+}
+
+// Bias accounts for the smaller target
+int PageLevel(vec3 dir)
+{
+    float angle = max(length(dFdx(dir)), length(dFdy(dir)));
+    float lod = log2(max(angle * uVTSize.x / (2.0 * PI), 1e-8)) + uVTAtlas.w;
+    return int(clamp(floor(lod), 0.0, uVTSize.w - 1.0));
+}
+
+ivec2 PageOf(vec2 uv, int level)
+{
+    vec4 l = uVTLevels[level];
+    ivec2 page = ivec2(floor(uv * l.xy / uVTSize.z));
+    ivec2 lastPage = ivec2(int(l.w), int(ceil(l.y / uVTSize.z))) - 1;
+    return clamp(page, ivec2(0), lastPage);
+}
+
+void main(void)
+{
+    vec3 dir = normalize(fRay);
+    int level = PageLevel(dir);
+    fragPage = uvec4(uvec2(PageOf(EquirectUV(dir), level)), uint(level), 1u);
+}
@@ -0,0 +1,85 @@
+#version 430
+/*
+    Background Fragment Shader (Virtual Texture)
+    Samples the stars from the page atlas of "VirtualTexture",
+    pages that are not streamed in yet fall back to the
+    finest resident parent or to the octahedral map
+*/
+
+#include "include/locations.glsl"
+
+#define PI 3.14159265358979
+
+// Input
+in IN_RAY vec3 fRay;
+
+// Output
+out OUT_COLOR vec4 fragColor;
+
+// Uniforms
+// xy: size, z: page size, w: level count
+U_VT_SIZE   uniform vec4 uVTSize;
+// x: atlas size, y: page stride, z: page border, w: level bias
+U_VT_ATLAS  uniform vec4 uVTAtlas;
+// xy: level size, z: indirection column, w: page count along x
+U_VT_LEVELS uniform vec4 uVTLevels[16];
+
+// Textures
+uniform T_ALBEDO            sampler2D   tAlbedo;
+uniform T_VT_PAGES          sampler2D   tVTPages;
+uniform T_VT_INDIRECTION    usampler2D  tVTIndirection;
+
+// Same mapping as "GenerateUVSphere"
+vec2 EquirectUV(vec3 d)
+{
+    return vec2(fract(atan(-d.z, d.x) / (2.0 * PI)),
+                acos(clamp(-d.y, -1.0, 1.0)) / PI);
+}
+
+// Octahedral map around +z (see "EquirectToOctahedral")
+vec2 OctEncode(vec3 d)
+{
+    d /= abs(d.x) + abs(d.y) + abs(d.z);
+    if(d.z < 0.0)
+        d.xy = (1.0 - abs(d.yx)) * vec2(d.x >= 0.0 ? 1.0 : -1.0, d.y >= 0.0 ? 1.0 : -1.0);
+    return d.xy * 0.5 + 0.5;
+}
+
+// Level from the angular footprint of the pixel, level 0 has
+// width / 2 pi texels per radian (u wraps and the poles
+// stretch, uv derivatives are not usable)
+int PageLevel(vec3 dir)
+{
+    float angle = max(length(dFdx(dir)), length(dFdy(dir)));
+    float lod = log2(max(angle * uVTSize.x / (2.0 * PI), 1e-8)) + uVTAtlas.w;
+    return int(clamp(floor(lod), 0.0, uVTSize.w - 1.0));
+}
+
+ivec2 PageOf(vec2 uv, int level)
+{
+    vec4 l = uVTLevels[level];
+    ivec2 page = ivec2(floor(uv * l.xy / uVTSize.z));
+    ivec2 lastPage = ivec2(int(l.w), int(ceil(l.y / uVTSize.z))) - 1;
+    return clamp(page, ivec2(0), lastPage);
+}
+
+void main(void)
+{
+    vec3 dir = normalize(fRay);
+    vec2 uv = EquirectUV(dir);
+    int level = PageLevel(dir);
+    ivec2 page = PageOf(uv, level);
+    // xy: atlas slot, z: level of the resident page, w: valid
+    uvec4 entry = texelFetch(tVTIndirection, ivec2(int(uVTLevels[level].z) + page.x, page.y), 0);
+    if(entry.w == 0u)
+    {
+        fragColor = textureLod(tAlbedo, OctEncode(dir), 0.0);
+        return;
+    }
+
+    int residentLevel = int(entry.z);
+    vec2 texel = uv * uVTLevels[residentLevel].xy;
+    vec2 inPage = texel - vec2(PageOf(uv, residentLevel)) * uVTSize.z;
+    vec2 atlasPos = vec2(entry.xy) * uVTAtlas.y + uVTAtlas.z + inPage;
+    fragColor = textureLod(tVTPages, atlasPos / uVTAtlas.x, 0.0);
+}
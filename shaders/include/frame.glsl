@@ -0,0 +1,36 @@
+/*
+    Frame & Draw Uniforms
+    std140 blocks, these must match "FrameBlock" / "DrawBlock"
+    of "frameuniforms.h". Frame block is bound once per frame,
+    draw block once per draw call (see "FrameUniforms").
+*/
+
+#include "locations.glsl"
+
+B_FRAME uniform FrameData
+{
+    mat4    uView;
+    mat4    uProjection;
+    // Background elements (stars, sun)
+    mat4    uOrthoProjection;
+    mat4    uLightVP;
+    // xyz, w is unused
+    vec4    uCameraPos;
+    vec4    uLightDir;
+    vec4    uLightColor;
+    // x: scene time
+    vec4    uTime;
+};
+
+B_DRAW uniform DrawData
+{
+    mat4    uModel;
+    mat3    uNormalMatrix;
+    // Vertex decode (see "MeshGL::DecodeVectors")
+    // [0]: xyz position scale, w > 0 if normals are octahedral
+    // [1]: xyz position offset
+    // [2]: xy uv scale, zw uv offset
+    vec4    uMeshDecode[3];
+    // Layer of the shared albedo array
+    int     uAlbedoLayer;
+};
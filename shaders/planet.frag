@@ -2,22 +2,27 @@
 /*
     Planet Fragment Shader
     Basic Blinn-Phong lighting with diffuse, specular, ambient, and shadow mapping
+    Permutations (see "ShaderBatch"):
+    ALBEDO_ARRAY: Albedo is a layer of one array texture shared by the bodies
+    SPECULAR_MAP: Shininess and strength of the highlight come from a specular map
+    NIGHT_LIGHTS: Night map is shown on the dark side with a smooth transition
+    SHADOW_PCF  : Filtered shadow edges (see "shadow.glsl")
 */
 
-// Definitions
-#define IN_UV           layout(location = 0)
-#define IN_NORMAL       layout(location = 1)
-#define IN_WORLD_POS    layout(location = 2)
-
-#define OUT_COLOR       layout(location = 0)
+#ifndef ALBEDO_ARRAY
+    #define ALBEDO_ARRAY 0
+#endif
+#ifndef SPECULAR_MAP
+    #define SPECULAR_MAP 0
+#endif
+#ifndef NIGHT_LIGHTS
+    #define NIGHT_LIGHTS 0
+#endif
 
-#define T_ALBEDO        layout(binding = 0)
-#define T_SHADOW        layout(binding = 1)
-
-#define U_LIGHT_DIR     layout(location = 4)
-#define U_CAMERA_POS    layout(location = 5)
-#define U_LIGHT_COLOR   layout(location = 6)
-#define U_LIGHT_VP      layout(location = 7)
+// Definitions
+#include "include/locations.glsl"
+#include "include/frame.glsl"
+#include "include/shadow.glsl"
 
 // Input
 IN_UV  in          vec2 fUV;
@@ -27,54 +32,32 @@ IN_WORLD_POS  in   vec3 fWorldPos;
 // Output
 OUT_COLOR out vec4 fragColor;
 
-// Uniforms
-U_LIGHT_DIR     uniform vec3 uLightDir;
-U_CAMERA_POS    uniform vec3 uCameraPos;
-U_LIGHT_COLOR   uniform vec3 uLightColor;
-U_LIGHT_VP      uniform mat4 uLightVP;
-
 // Textures
+#if ALBEDO_ARRAY
+T_ALBEDO uniform sampler2DArray tAlbedo;
+#else
 T_ALBEDO uniform sampler2D tAlbedo;
-T_SHADOW uniform sampler2D tShadowMap;
-
-float calculateShadow(vec3 worldPos)
-{
-    // Transform world position to light space
-    vec4 lightSpacePos = uLightVP * vec4(worldPos, 1.0);
-    
-    // Perspective divide
-    vec3 projCoords = lightSpacePos.xyz / lightSpacePos.w;
-    
-    // Transform to [0,1] range
-    projCoords = projCoords * 0.5 + 0.5;
-    
-    // Check if outside shadow map bounds
-    if(projCoords.z > 1.0 || projCoords.x < 0.0 || projCoords.x > 1.0 || 
-       projCoords.y < 0.0 || projCoords.y > 1.0)
-        return 0.0;
-    
-    // Get depth from shadow map
-    float closestDepth = texture(tShadowMap, projCoords.xy).r;
-    float currentDepth = projCoords.z;
-    
-    // Shadow bias to prevent shadow acne
-    float bias = 0.005;
-    
-    // Check if in shadow
-    float shadow = (currentDepth - bias) > closestDepth ? 1.0 : 0.0;
-    
-    return shadow;
-}
+#endif
+#if SPECULAR_MAP
+T_SPECULAR uniform sampler2D tSpecularMap;
+#endif
+#if NIGHT_LIGHTS
+T_NIGHT  uniform   sampler2D tNightMap;
+#endif
 
 void main(void)
 {
     // Sample albedo texture
+#if ALBEDO_ARRAY
+    vec3 albedo = texture(tAlbedo, vec3(fUV, float(uAlbedoLayer))).rgb;
+#else
     vec3 albedo = texture(tAlbedo, fUV).rgb;
+#endif
     
     // Normalize vectors
     vec3 normal = normalize(fNormal);
-    vec3 lightDir = normalize(-uLightDir);  // Light direction points TO the light
-    vec3 viewDir = normalize(uCameraPos - fWorldPos);
+    vec3 lightDir = normalize(-uLightDir.xyz);  // Light direction points TO the light
+    vec3 viewDir = normalize(uCameraPos.xyz - fWorldPos);
     
     // Ambient component
     vec3 ambient = 0.1 * albedo;
@@ -84,15 +67,31 @@ void main(void)
     
     // Diffuse component
     float diff = max(dot(normal, lightDir), 0.0);
-    vec3 diffuse = diff * albedo * uLightColor;
+    vec3 diffuse = diff * albedo * uLightColor.rgb;
     
     // Specular component (Blinn-Phong)
+#if SPECULAR_MAP
+    // Water (high specular mask) = high shininess, Land (low specular mask) = low shininess
+    float specularMask = texture(tSpecularMap, fUV).r;
+    float specularPower = mix(8.0, 64.0, specularMask);  // 8 for land, 64 for water
+    vec3 specularColor = uLightColor.rgb * specularMask * 0.8;
+#else
+    float specularPower = 32.0;
+    vec3 specularColor = uLightColor.rgb * 0.5;
+#endif
     vec3 halfDir = normalize(lightDir + viewDir);
-    float spec = pow(max(dot(normal, halfDir), 0.0), 32.0);
-    vec3 specular = spec * uLightColor * 0.5;
+    float spec = pow(max(dot(normal, halfDir), 0.0), specularPower);
+    vec3 specular = spec * specularColor;
     
     // Apply shadow (ambient is not affected)
     vec3 color = ambient + (1.0 - shadow) * (diffuse + specular);
     
+#if NIGHT_LIGHTS
+    // Night lights: visible on dark side of planet
+    // Use smooth transition based on diffuse factor
+    float nightFactor = 1.0 - smoothstep(0.05, 0.25, diff);
+    color += texture(tNightMap, fUV).rgb * nightFactor * 1.5;
+#endif
+    
     fragColor = vec4(color, 1.0);
 }
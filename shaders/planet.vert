@@ -5,20 +5,11 @@
 */
 
 // Definitions
-#define IN_POS          layout(location = 0)
-#define IN_NORMAL       layout(location = 1)
-#define IN_UV           layout(location = 2)
-
-#define OUT_UV          layout(location = 0)
-#define OUT_NORMAL      layout(location = 1)
-#define OUT_WORLD_POS   layout(location = 2)
-
-#define U_MODEL         layout(location = 0)
-#define U_VIEW          layout(location = 1)
-#define U_PROJ          layout(location = 2)
-#define U_NORMAL_MAT    layout(location = 3)
+#include "include/locations.glsl"
+#include "include/frame.glsl"
 
 // Input
+// Quantized meshes give normalized position and octahedral normal
 in IN_POS       vec3 vPos;
 in IN_NORMAL    vec3 vNormal;
 in IN_UV        vec2 vUV;
@@ -29,24 +20,28 @@ out OUT_UV          vec2 fUV;
 out OUT_NORMAL      vec3 fNormal;
 out OUT_WORLD_POS   vec3 fWorldPos;
 
-// Uniforms
-U_MODEL         uniform mat4 uModel;
-U_VIEW          uniform mat4 uView;
-U_PROJ          uniform mat4 uProjection;
-U_NORMAL_MAT    uniform mat3 uNormalMatrix;
+vec3 OctDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
 
 void main(void)
 {
     // Transform position to world space
-    vec4 worldPos = uModel * vec4(vPos, 1.0);
+    vec3 pos = vPos * uMeshDecode[0].xyz + uMeshDecode[1].xyz;
+    vec4 worldPos = uModel * vec4(pos, 1.0);
     fWorldPos = worldPos.xyz;
     
     // Transform to clip space
     gl_Position = uProjection * uView * worldPos;
     
     // Transform normal to world space
-    fNormal = normalize(uNormalMatrix * vNormal);
+    vec3 normal = (uMeshDecode[0].w > 0.0) ? OctDecode(vNormal.xy) : vNormal;
+    fNormal = normalize(uNormalMatrix * normal);
     
     // Pass UV coordinates
-    fUV = vUV;
+    fUV = vUV * uMeshDecode[2].xy + uMeshDecode[2].zw;
 }
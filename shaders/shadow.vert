@@ -4,11 +4,8 @@
     Transforms vertices to light space for shadow mapping
 */
 
-#define IN_POS          layout(location = 0)
-
-#define U_MODEL         layout(location = 0)
-#define U_VIEW          layout(location = 1)
-#define U_PROJ          layout(location = 2)
+#include "include/locations.glsl"
+#include "include/frame.glsl"
 
 // Input
 IN_POS in vec3 vPos;
@@ -16,12 +13,7 @@ IN_POS in vec3 vPos;
 // Output
 out gl_PerVertex {vec4 gl_Position;};
 
-// Uniforms
-U_MODEL uniform mat4 uModel;
-U_VIEW  uniform mat4 uView;
-U_PROJ  uniform mat4 uProjection;
-
 void main(void)
 {
-    gl_Position = uProjection * uView * uModel * vec4(vPos, 1.0);
+    gl_Position = uLightVP * uModel * vec4(vPos * uMeshDecode[0].xyz + uMeshDecode[1].xyz, 1.0);
 }
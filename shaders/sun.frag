@@ -4,7 +4,7 @@
     Renders the sun with a bright color
 */
 
-#define OUT_COLOR layout(location = 0)
+#include "include/locations.glsl"
 
 // Output
 out OUT_COLOR vec4 fragColor;
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+// Bodies drawn with the planet shader share one array texture (see
+// "TextureLoader::LoadArray"). Layers of a different size are resampled
+// to the size of the array and cached as "<image>.<W>x<H>.texbin",
+// TexturePrebuild builds these from the same table.
+struct BodyArray
+{
+    static constexpr uint32_t WIDTH  = 2048;
+    static constexpr uint32_t HEIGHT = 1024;
+    // Relative to the texture directory, in layer order
+    static constexpr std::array<const char*, 2> LAYERS =
+    {
+        "2k_moon.jpg",
+        "2k_jupiter.jpg"
+    };
+    static constexpr int32_t LAYER_MOON    = 0;
+    static constexpr int32_t LAYER_JUPITER = 1;
+};
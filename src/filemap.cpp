@@ -0,0 +1,208 @@
+#include "filemap.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+// Zero sized files can not be mapped, we return this instead
+static const char EmptyFileData[1] = {'\0'};
+
+MappedFile::MappedFile(const std::string& path)
+{
+    #ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                                  nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                                  nullptr);
+        if(file == INVALID_HANDLE_VALUE) return;
+
+        LARGE_INTEGER fileSize;
+        if(!GetFileSizeEx(file, &fileSize))
+        {
+            CloseHandle(file);
+            return;
+        }
+        if(fileSize.QuadPart == 0)
+        {
+            CloseHandle(file);
+            data = EmptyFileData;
+            return;
+        }
+
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY,
+                                            0, 0, nullptr);
+        if(!mapping)
+        {
+            CloseHandle(file);
+            return;
+        }
+        void* ptr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if(!ptr)
+        {
+            CloseHandle(mapping);
+            CloseHandle(file);
+            return;
+        }
+        fileHandle = file;
+        mapHandle = mapping;
+        data = static_cast<const char*>(ptr);
+        size = size_t(fileSize.QuadPart);
+    #else
+        int fd = open(path.c_str(), O_RDONLY);
+        if(fd < 0) return;
+
+        struct stat fileStat;
+        if(fstat(fd, &fileStat) != 0)
+        {
+            close(fd);
+            return;
+        }
+        if(fileStat.st_size == 0)
+        {
+            close(fd);
+            data = EmptyFileData;
+            return;
+        }
+
+        size_t fileSize = size_t(fileStat.st_size);
+        void* ptr = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        // Mapping holds its own reference to the file
+        close(fd);
+        if(ptr == MAP_FAILED) return;
+
+        // We always scan these front to back
+        madvise(ptr, fileSize, MADV_SEQUENTIAL);
+        data = static_cast<const char*>(ptr);
+        size = fileSize;
+    #endif
+}
+
+void MappedFile::Release()
+{
+    if(data && data != EmptyFileData)
+    {
+        #ifdef _WIN32
+            UnmapViewOfFile(data);
+            CloseHandle(mapHandle);
+            CloseHandle(fileHandle);
+            mapHandle = nullptr;
+            fileHandle = nullptr;
+        #else
+            munmap(const_cast<char*>(data), size);
+        #endif
+    }
+    data = nullptr;
+    size = 0;
+}
+
+bool GetFileStamp(FileStamp& out, const std::string& path)
+{
+    std::error_code err;
+    auto fileSize = std::filesystem::file_size(path, err);
+    if(err) return false;
+    auto writeTime = std::filesystem::last_write_time(path, err);
+    if(err) return false;
+
+    out.size = uint64_t(fileSize);
+    out.modifiedTime = int64_t(writeTime.time_since_epoch().count());
+    return true;
+}
+
+uint64_t HashBytes(const void* data, size_t size, uint64_t seed)
+{
+    static constexpr uint64_t K0 = 0x9E3779B97F4A7C15ull;
+    static constexpr uint64_t K1 = 0xBF58476D1CE4E5B9ull;
+    static constexpr uint64_t K2 = 0x94D049BB133111EBull;
+    // Final avalanche of splitmix64
+    auto Mix = [](uint64_t x)
+    {
+        x = (x ^ (x >> 30)) * K1;
+        x = (x ^ (x >> 27)) * K2;
+        return x ^ (x >> 31);
+    };
+
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t h = Mix(seed ^ (uint64_t(size) * K0));
+    while(size >= 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, bytes, sizeof(uint64_t));
+        h = std::rotl(h ^ Mix(word + K0), 27) * K1;
+        bytes += 8;
+        size -= 8;
+    }
+    if(size != 0)
+    {
+        uint64_t word = 0;
+        std::memcpy(&word, bytes, size);
+        h = std::rotl(h ^ Mix(word + K0), 27) * K1;
+    }
+    return Mix(h);
+}
+
+bool HashFile(uint64_t& out, const std::string& path)
+{
+    MappedFile file(path);
+    if(!file) return false;
+    out = HashBytes(file.data, file.size);
+    return true;
+}
+
+bool WriteFileAtomic(const std::string& path,
+                     std::initializer_list<FileChunk> chunks)
+{
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if(!file) return false;
+
+        static const char Zeros[256] = {};
+        for(const FileChunk& chunk : chunks)
+        {
+            if(chunk.data)
+            {
+                file.write(static_cast<const char*>(chunk.data),
+                           std::streamsize(chunk.size));
+                continue;
+            }
+            for(size_t left = chunk.size; left != 0;)
+            {
+                size_t count = std::min(left, sizeof(Zeros));
+                file.write(Zeros, std::streamsize(count));
+                left -= count;
+            }
+        }
+        if(!file)
+        {
+            file.close();
+            std::remove(tmpPath.c_str());
+            return false;
+        }
+    }
+    std::error_code err;
+    std::filesystem::rename(tmpPath, path, err);
+    if(err)
+    {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+#include <initializer_list>
+
+// Identity of a file on disk, used to detect stale caches
+struct FileStamp
+{
+    uint64_t size         = 0;
+    int64_t  modifiedTime = 0;
+
+    bool operator==(const FileStamp&) const = default;
+};
+
+// Returns false if the file does not exist
+bool        GetFileStamp(FileStamp& out, const std::string& path);
+// Fast non-cryptographic 64-bit hash (word at a time), used for
+// content based cache validation.
+uint64_t    HashBytes(const void* data, size_t size, uint64_t seed = 0);
+// "HashBytes" of the whole file, returns false if it can not be mapped
+bool        HashFile(uint64_t& out, const std::string& path);
+
+// Piece of a file that is being written, null "data" writes zeros
+// (used for alignment padding)
+struct FileChunk
+{
+    const void* data;
+    size_t      size;
+};
+// Writes the chunks back to back into a temporary file and renames it
+// over "path", readers never observe a partially written file.
+bool        WriteFileAtomic(const std::string& path,
+                            std::initializer_list<FileChunk> chunks);
+
+// Read-only memory mapping of a whole file.
+// On failure "data" is null, empty files map to a valid
+// (non-null) zero-sized range so callers only need to check "data".
+struct MappedFile
+{
+    const char* data = nullptr;
+    size_t      size = 0;
+    #ifdef _WIN32
+        void*   fileHandle = nullptr;
+        void*   mapHandle  = nullptr;
+    #endif
+
+    // Constructors, Movement & Destructor
+                MappedFile() = default;
+                MappedFile(const std::string& path);
+                MappedFile(const MappedFile&) = delete;
+                MappedFile(MappedFile&&);
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile& operator=(MappedFile&&);
+                ~MappedFile();
+
+    explicit    operator bool() const { return data != nullptr; }
+
+    private:
+    void        Release();
+};
+
+inline MappedFile::MappedFile(MappedFile&& other)
+    : data(other.data)
+    , size(other.size)
+    #ifdef _WIN32
+    , fileHandle(other.fileHandle)
+    , mapHandle(other.mapHandle)
+    #endif
+{
+    other.data = nullptr;
+    other.size = 0;
+    #ifdef _WIN32
+        other.fileHandle = nullptr;
+        other.mapHandle = nullptr;
+    #endif
+}
+
+inline MappedFile& MappedFile::operator=(MappedFile&& other)
+{
+    assert(this != &other);
+    Release();
+    data = other.data;
+    size = other.size;
+    other.data = nullptr;
+    other.size = 0;
+    #ifdef _WIN32
+        fileHandle = other.fileHandle;
+        mapHandle = other.mapHandle;
+        other.fileHandle = nullptr;
+        other.mapHandle = nullptr;
+    #endif
+    return *this;
+}
+
+inline MappedFile::~MappedFile()
+{
+    Release();
+}
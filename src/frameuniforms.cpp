@@ -0,0 +1,51 @@
+#include "frameuniforms.h"
+
+#include <cassert>
+#include <cstring>
+
+FrameUniforms::FrameUniforms(uint32_t drawsPerFrame, uint32_t framesInFlight)
+    : ring(uint64_t(framesInFlight) * (drawsPerFrame + 1u) * UploadRing::ALIGNMENT)
+{
+    // Regions are aligned to 256 which is the largest
+    // offset alignment that GL allows for uniform buffers
+    [[maybe_unused]] GLint alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    assert(alignment > 0 && UploadRing::ALIGNMENT % uint64_t(alignment) == 0);
+}
+
+void FrameUniforms::Write(const void* data, size_t size, GLuint binding)
+{
+    UploadRing::Region region;
+    if(!ring.Allocate(region, size))
+    {
+        // GPU is more frames behind than the ring holds (or a frame has
+        // more draws), wait for it instead of writing over live blocks
+        ring.Fence();
+        glFinish();
+        ring.Reclaim();
+        [[maybe_unused]] bool allocated = ring.Allocate(region, size);
+        assert(allocated);
+    }
+    std::memcpy(ring.Pointer(region), data, size);
+    glBindBufferRange(GL_UNIFORM_BUFFER, binding, ring.BufferId(),
+                      GLintptr(region.offset), GLsizeiptr(size));
+    ring.Retire(region);
+}
+
+void FrameUniforms::BeginFrame(const FrameBlock& frame)
+{
+    ring.Reclaim();
+    drawCount = 0;
+    Write(&frame, sizeof(FrameBlock), FrameBlock::BINDING);
+}
+
+void FrameUniforms::Draw(const DrawBlock& draw)
+{
+    Write(&draw, sizeof(DrawBlock), DrawBlock::BINDING);
+    drawCount++;
+}
+
+void FrameUniforms::EndFrame()
+{
+    ring.Fence();
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "uploadring.h"
+
+// ======================= //
+//    UNIFORM BLOCKS       //
+// ======================= //
+// std140 mirrors of the blocks of "shaders/include/frame.glsl". Every
+// member is a vec4 / mat4 (or padded to one) so the C++ layout is the
+// std140 layout; the order and sizes must match the shader.
+struct FrameBlock
+{
+    static constexpr GLuint BINDING = 0;
+
+    glm::mat4   view;
+    glm::mat4   projection;
+    // Background elements (stars, sun)
+    glm::mat4   orthoProjection;
+    glm::mat4   lightVP;
+    // xyz, w is unused
+    glm::vec4   cameraPos;
+    glm::vec4   lightDir;
+    glm::vec4   lightColor;
+    // x: scene time (seconds, scaled by the time speed)
+    glm::vec4   time;
+};
+
+struct DrawBlock
+{
+    static constexpr GLuint BINDING = 1;
+
+    glm::mat4   model;
+    // std140 mat3, columns are padded to vec4
+    glm::mat3x4 normalMatrix;
+    // Vertex decode (see "MeshGL::DecodeVectors")
+    glm::vec4   meshDecode[3];
+    // Layer of the shared albedo array (ALBEDO_ARRAY permutation)
+    int32_t     albedoLayer;
+    int32_t     pad[3];
+};
+static_assert(sizeof(FrameBlock) == 320, "FrameBlock must match the std140 layout");
+static_assert(sizeof(DrawBlock) == 176, "DrawBlock must match the std140 layout");
+
+// Per frame and per draw uniform blocks of the render loop. Blocks are
+// written into a persistently mapped ring and bound as a range of it,
+// a block is never overwritten before the GPU consumes the frame that
+// reads it (see "UploadRing"). Context thread only.
+class FrameUniforms
+{
+    private:
+    UploadRing  ring;
+    uint32_t    drawCount = 0;
+
+    void        Write(const void* data, size_t size, GLuint binding);
+
+    public:
+    // Ring holds "framesInFlight" frames of "drawsPerFrame" draws
+    explicit        FrameUniforms(uint32_t drawsPerFrame = 64,
+                                  uint32_t framesInFlight = 3);
+                    FrameUniforms(const FrameUniforms&) = delete;
+                    FrameUniforms(FrameUniforms&&) = delete;
+    FrameUniforms&  operator=(const FrameUniforms&) = delete;
+    FrameUniforms&  operator=(FrameUniforms&&) = delete;
+                    ~FrameUniforms() = default;
+
+    // Writes and binds the frame block, it stays bound
+    // for every draw of the frame
+    void            BeginFrame(const FrameBlock&);
+    // Writes and binds the block of the next draw call
+    void            Draw(const DrawBlock&);
+    // Fences the blocks of this frame, after the last draw
+    void            EndFrame();
+
+    // Draw blocks written since "BeginFrame"
+    uint32_t        DrawCount() const;
+};
+
+inline uint32_t FrameUniforms::DrawCount() const
+{
+    return drawCount;
+}
@@ -0,0 +1,322 @@
+#include "imagedecode.h"
+#include "filemap.h"
+
+#include <stb_image.h>
+
+#include <bit>
+#include <csetjmp>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+#ifdef CENG_HAS_LIBJPEG
+    #include <jpeglib.h>
+#endif
+#ifdef CENG_HAS_LIBPNG
+    #include <png.h>
+#endif
+
+namespace
+{
+
+// Decoders work on the whole file in memory. "Decode" checks that the
+// file matches "info" before it writes a single pixel.
+struct DecoderBackend
+{
+    const char* name;
+    bool        (*Recognizes)(const uint8_t* data, size_t size);
+    bool        (*ReadInfo)(ImageInfo& out, const uint8_t* data, size_t size);
+    bool        (*Decode)(void* pixels, const ImageInfo& info,
+                          const uint8_t* data, size_t size);
+};
+
+bool SameInfo(const ImageInfo& a, const ImageInfo& b)
+{
+    return (a.width == b.width && a.height == b.height &&
+            a.channelCount == b.channelCount && a.is16Bit == b.is16Bit);
+}
+
+// ============================================================================
+// STB_IMAGE
+// ============================================================================
+bool StbRecognizes(const uint8_t*, size_t)
+{
+    return true;
+}
+
+bool StbReadInfo(ImageInfo& out, const uint8_t* data, size_t size)
+{
+    int w, h, c;
+    if(!stbi_info_from_memory(data, int(size), &w, &h, &c)) return false;
+    out = ImageInfo{uint32_t(w), uint32_t(h), uint32_t(c),
+                    stbi_is_16_bit_from_memory(data, int(size)) != 0};
+    return true;
+}
+
+bool StbDecode(void* pixels, const ImageInfo& info, const uint8_t* data, size_t size)
+{
+    // Flip flag is per thread, decoders run on worker threads
+    stbi_set_flip_vertically_on_load_thread(1);
+    int w, h, c;
+    void* decoded = nullptr;
+    if(info.is16Bit) decoded = stbi_load_16_from_memory(data, int(size), &w, &h, &c, 0);
+    else             decoded = stbi_load_from_memory(data, int(size), &w, &h, &c, 0);
+    if(!decoded) return false;
+
+    // stb can not decode into caller memory, this path copies once
+    ImageInfo decodedInfo = {uint32_t(w), uint32_t(h), uint32_t(c), info.is16Bit};
+    bool matches = SameInfo(decodedInfo, info);
+    if(matches) std::memcpy(pixels, decoded, ImageByteSize(info));
+    stbi_image_free(decoded);
+    return matches;
+}
+
+// ============================================================================
+// LIBJPEG(-TURBO)
+// ============================================================================
+#ifdef CENG_HAS_LIBJPEG
+struct JpegError
+{
+    jpeg_error_mgr  mgr;
+    std::jmp_buf    jump;
+};
+
+void JpegErrorExit(j_common_ptr cinfo)
+{
+    std::longjmp(reinterpret_cast<JpegError*>(cinfo->err)->jump, 1);
+}
+
+void JpegSilence(j_common_ptr)
+{}
+
+bool JpegRecognizes(const uint8_t* data, size_t size)
+{
+    return size >= 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF;
+}
+
+// Header only when "pixels" is null. Nothing with a destructor may live
+// in here, errors "longjmp" back to the "setjmp".
+bool JpegRun(ImageInfo& info, void* pixels, const uint8_t* data, size_t size)
+{
+    jpeg_decompress_struct cinfo;
+    JpegError error;
+    cinfo.err = jpeg_std_error(&error.mgr);
+    error.mgr.error_exit = JpegErrorExit;
+    error.mgr.output_message = JpegSilence;
+    if(setjmp(error.jump))
+    {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, data, static_cast<unsigned long>(size));
+    jpeg_read_header(&cinfo, TRUE);
+
+    // CMYK / YCCK are left to the fallback
+    ImageInfo header = {cinfo.image_width, cinfo.image_height,
+                        uint32_t(cinfo.num_components), false};
+    if((header.channelCount != 1 && header.channelCount != 3) ||
+       (pixels && !SameInfo(header, info)))
+    {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+    info = header;
+    if(!pixels)
+    {
+        jpeg_destroy_decompress(&cinfo);
+        return true;
+    }
+
+    // Integer IDCT and color conversion are the SIMD paths of libjpeg-turbo,
+    // scanlines are written straight to their flipped rows
+    cinfo.out_color_space = (header.channelCount == 1) ? JCS_GRAYSCALE : JCS_RGB;
+    cinfo.dct_method = JDCT_ISLOW;
+    jpeg_start_decompress(&cinfo);
+    size_t rowBytes = size_t(header.width) * header.channelCount;
+    while(cinfo.output_scanline < cinfo.output_height)
+    {
+        JSAMPROW row = static_cast<JSAMPROW>(pixels) +
+                       size_t(cinfo.output_height - 1 - cinfo.output_scanline) * rowBytes;
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return true;
+}
+
+bool JpegReadInfo(ImageInfo& out, const uint8_t* data, size_t size)
+{
+    return JpegRun(out, nullptr, data, size);
+}
+
+bool JpegDecode(void* pixels, const ImageInfo& info, const uint8_t* data, size_t size)
+{
+    ImageInfo expected = info;
+    return JpegRun(expected, pixels, data, size);
+}
+#endif
+
+// ============================================================================
+// LIBPNG
+// ============================================================================
+#ifdef CENG_HAS_LIBPNG
+struct PngSource
+{
+    const uint8_t*  data;
+    size_t          size;
+    size_t          offset;
+};
+
+void PngRead(png_structp png, png_bytep out, size_t count)
+{
+    PngSource* source = static_cast<PngSource*>(png_get_io_ptr(png));
+    if(count > source->size - source->offset) png_error(png, "truncated");
+    std::memcpy(out, source->data + source->offset, count);
+    source->offset += count;
+}
+
+void PngError(png_structp png, png_const_charp)
+{
+    png_longjmp(png, 1);
+}
+
+void PngWarning(png_structp, png_const_charp)
+{}
+
+bool PngRecognizes(const uint8_t* data, size_t size)
+{
+    return size >= 8 && png_sig_cmp(data, 0, 8) == 0;
+}
+
+// Header only when "pixels" is null, see "JpegRun". Row pointers
+// are allocated before the "setjmp" so that nothing is skipped.
+bool PngRun(ImageInfo& info, void* pixels, const uint8_t* data, size_t size)
+{
+    std::vector<png_bytep> rows;
+    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr,
+                                             PngError, PngWarning);
+    if(!png) return false;
+    png_infop pngInfo = png_create_info_struct(png);
+    if(!pngInfo || setjmp(png_jmpbuf(png)))
+    {
+        png_destroy_read_struct(&png, &pngInfo, nullptr);
+        return false;
+    }
+    PngSource source = {data, size, 0};
+    png_set_read_fn(png, &source, PngRead);
+    // Sources are local assets, zlib's checksum is skipped
+    #ifdef PNG_IGNORE_ADLER32
+        png_set_option(png, PNG_IGNORE_ADLER32, PNG_OPTION_ON);
+    #endif
+    png_read_info(png, pngInfo);
+
+    // Expanded as stb_image does
+    int colorType = png_get_color_type(png, pngInfo);
+    int bitDepth = png_get_bit_depth(png, pngInfo);
+    if(colorType == PNG_COLOR_TYPE_PALETTE) png_set_palette_to_rgb(png);
+    if(colorType == PNG_COLOR_TYPE_GRAY && bitDepth < 8) png_set_expand_gray_1_2_4_to_8(png);
+    if(png_get_valid(png, pngInfo, PNG_INFO_tRNS)) png_set_tRNS_to_alpha(png);
+    if(bitDepth == 16 && std::endian::native == std::endian::little) png_set_swap(png);
+    png_set_interlace_handling(png);
+    png_read_update_info(png, pngInfo);
+
+    ImageInfo header = {png_get_image_width(png, pngInfo), png_get_image_height(png, pngInfo),
+                        png_get_channels(png, pngInfo), png_get_bit_depth(png, pngInfo) == 16};
+    if(header.channelCount < 1 || header.channelCount > 4 ||
+       (pixels && !SameInfo(header, info)))
+    {
+        png_destroy_read_struct(&png, &pngInfo, nullptr);
+        return false;
+    }
+    info = header;
+    if(!pixels)
+    {
+        png_destroy_read_struct(&png, &pngInfo, nullptr);
+        return true;
+    }
+
+    // Rows are given bottom to top, so they are written flipped
+    size_t rowBytes = png_get_rowbytes(png, pngInfo);
+    rows.resize(header.height);
+    for(uint32_t y = 0; y < header.height; y++)
+        rows[y] = static_cast<png_bytep>(pixels) + size_t(header.height - 1 - y) * rowBytes;
+    png_read_image(png, rows.data());
+    png_read_end(png, nullptr);
+    png_destroy_read_struct(&png, &pngInfo, nullptr);
+    return true;
+}
+
+bool PngReadInfo(ImageInfo& out, const uint8_t* data, size_t size)
+{
+    return PngRun(out, nullptr, data, size);
+}
+
+bool PngDecode(void* pixels, const ImageInfo& info, const uint8_t* data, size_t size)
+{
+    ImageInfo expected = info;
+    return PngRun(expected, pixels, data, size);
+}
+#endif
+
+// First one that recognizes the file is used, stb is the last
+constexpr DecoderBackend Backends[] =
+{
+    #ifdef CENG_HAS_LIBJPEG
+        #ifdef LIBJPEG_TURBO_VERSION
+            {"libjpeg-turbo", JpegRecognizes, JpegReadInfo, JpegDecode},
+        #else
+            {"libjpeg", JpegRecognizes, JpegReadInfo, JpegDecode},
+        #endif
+    #endif
+    #ifdef CENG_HAS_LIBPNG
+        {"libpng", PngRecognizes, PngReadInfo, PngDecode},
+    #endif
+    {"stb_image", StbRecognizes, StbReadInfo, StbDecode}
+};
+constexpr const DecoderBackend& Fallback = Backends[std::size(Backends) - 1];
+
+const DecoderBackend& SelectBackend(const MappedFile& file, ImageDecoder decoder)
+{
+    if(decoder == ImageDecoder::STB) return Fallback;
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(file.data);
+    for(const DecoderBackend& b : Backends)
+        if(b.Recognizes(data, file.size)) return b;
+    return Fallback;
+}
+
+}
+
+bool ReadImageInfo(ImageInfo& out, const std::string& imgPath, ImageDecoder decoder)
+{
+    MappedFile file(imgPath);
+    if(!file) return false;
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(file.data);
+    const DecoderBackend& backend = SelectBackend(file, decoder);
+    if(backend.ReadInfo(out, data, file.size)) return true;
+    return (&backend != &Fallback) && Fallback.ReadInfo(out, data, file.size);
+}
+
+bool DecodeImageInto(void* pixels, const ImageInfo& info, const std::string& imgPath,
+                     ImageDecoder decoder)
+{
+    MappedFile file(imgPath);
+    if(!file) return false;
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(file.data);
+    const DecoderBackend& backend = SelectBackend(file, decoder);
+    if(backend.Decode(pixels, info, data, file.size)) return true;
+    return (&backend != &Fallback) && Fallback.Decode(pixels, info, data, file.size);
+}
+
+size_t ImageByteSize(const ImageInfo& info)
+{
+    return size_t(info.width) * info.height * info.channelCount * (info.is16Bit ? 2u : 1u);
+}
+
+const char* ImageDecoderName(const std::string& imgPath, ImageDecoder decoder)
+{
+    MappedFile file(imgPath);
+    if(!file) return Fallback.name;
+    return SelectBackend(file, decoder).name;
+}
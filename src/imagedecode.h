@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// ================ //
+//  IMAGE DECODERS  //
+// ================ //
+// Images are decoded by the first backend that recognizes the file:
+// libjpeg-turbo (SIMD IDCT / color conversion) for JPEG and libpng
+// (zlib inflate, SIMD unfilter) for PNG when the build finds them
+// ("CENG_HAS_LIBJPEG", "CENG_HAS_LIBPNG"), stb_image otherwise. A file
+// that the fast backend fails on is retried with stb_image.
+// Pixels are in the native channel count of the file (palettes and
+// transparency keys are expanded as stb_image does), rows are bottom to
+// top (GL order) and 16-bit channels are in host byte order.
+struct ImageInfo
+{
+    uint32_t    width        = 0;
+    uint32_t    height       = 0;
+    uint32_t    channelCount = 0;
+    bool        is16Bit      = false;
+};
+
+enum class ImageDecoder
+{
+    AUTO,
+    // Fallback only, for comparisons
+    STB
+};
+
+// Thread safe, returns false when the file can not be opened or is not
+// an image that the decoders support
+bool        ReadImageInfo(ImageInfo& out, const std::string& imgPath,
+                          ImageDecoder = ImageDecoder::AUTO);
+// Decodes into caller memory (i.e. a mapped pixel unpack buffer) of
+// "ImageByteSize" bytes, "info" must be read with the same decoder
+bool        DecodeImageInto(void* pixels, const ImageInfo& info,
+                            const std::string& imgPath,
+                            ImageDecoder = ImageDecoder::AUTO);
+size_t      ImageByteSize(const ImageInfo&);
+// Backend that decodes the file, "stb_image" when the file can not be read
+const char* ImageDecoderName(const std::string& imgPath,
+                             ImageDecoder = ImageDecoder::AUTO);
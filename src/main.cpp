@@ -1,8 +1,23 @@
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <array>
 #include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
 
 #include "utility.h"
+#include "objparser.h"
+#include "spheregen.h"
+#include "meshlod.h"
+#include "meshlet.h"
+#include "textureloader.h"
+#include "texresidency.h"
+#include "virtualtexture.h"
+#include "shaderreload.h"
+#include "frameuniforms.h"
+#include "bodyarray.h"
 
 #include <GLFW/glfw3.h>
 #include <glm/ext.hpp>
@@ -199,11 +214,27 @@ void UpdateOrbitCamera(GLState& state)
 // MAIN FUNCTION
 // ============================================================================
 
-int main(int, const char*[])
+int main(int argc, const char* argv[])
 {
+    // Texture memory budget (MiB), "--texture-budget <MiB>"
+    uint64_t textureBudgetMiB = 256;
+    for(int i = 1; i + 1 < argc; i++)
+    {
+        if(std::strcmp(argv[i], "--texture-budget") == 0)
+            textureBudgetMiB = std::strtoull(argv[++i], nullptr, 10);
+    }
+
+    // Startup timings are reported relative to this
+    auto startTime = std::chrono::steady_clock::now();
+    auto MillisecondsSince = [](std::chrono::steady_clock::time_point t)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t).count();
+    };
+
     // Initialize state
     CallbackPointersGLFW callbacks;
-    GLState state("Planet Renderer - Phase 1", 1280, 720, callbacks);
+    const char* windowTitle = "Planet Renderer - Phase 1";
+    GLState state(windowTitle, 1280, 720, callbacks);
 
     printf("=== Controls ===\n");
     printf("P/O: Switch camera mode (Orbit Earth/Moon/Moon's Moon/FPS)\n");
@@ -213,28 +244,166 @@ int main(int, const char*[])
     printf("L/K: Speed up / Slow down time\n");
     printf("================\n\n");
 
-    // Load shaders
-    ShaderGL planetVS = ShaderGL(ShaderGL::VERTEX, "shaders/planet.vert");
-    ShaderGL planetFS = ShaderGL(ShaderGL::FRAGMENT, "shaders/planet.frag");
-    ShaderGL earthFS = ShaderGL(ShaderGL::FRAGMENT, "shaders/earth.frag");
-    ShaderGL cloudFS = ShaderGL(ShaderGL::FRAGMENT, "shaders/cloud.frag");
-    ShaderGL bgVS = ShaderGL(ShaderGL::VERTEX, "shaders/background.vert");
-    ShaderGL bgFS = ShaderGL(ShaderGL::FRAGMENT, "shaders/background.frag");
-    ShaderGL sunFS = ShaderGL(ShaderGL::FRAGMENT, "shaders/sun.frag");
-    ShaderGL shadowVS = ShaderGL(ShaderGL::VERTEX, "shaders/shadow.vert");
-    ShaderGL shadowFS = ShaderGL(ShaderGL::FRAGMENT, "shaders/shadow.frag");
-
-    // Load meshes
-    MeshGL sphereMesh = MeshGL("meshes/sphere_5k.obj");
-
-    // Load textures
-    TextureGL earthTex = TextureGL("textures/2k_earth_daymap.jpg", TextureGL::LINEAR, TextureGL::REPEAT);
-    TextureGL earthSpecular = TextureGL("textures/2k_earth_specular_map.png", TextureGL::LINEAR, TextureGL::REPEAT);
-    TextureGL earthNight = TextureGL("textures/2k_earth_nightmap_alpha.png", TextureGL::LINEAR, TextureGL::REPEAT);
-    TextureGL earthClouds = TextureGL("textures/2k_earth_clouds_alpha.png", TextureGL::LINEAR, TextureGL::REPEAT);
-    TextureGL moonTex = TextureGL("textures/2k_moon.jpg", TextureGL::LINEAR, TextureGL::REPEAT);
-    TextureGL jupiterTex = TextureGL("textures/2k_jupiter.jpg", TextureGL::LINEAR, TextureGL::REPEAT);
-    TextureGL starsTex = TextureGL("textures/2k_stars_milky_way.jpg", TextureGL::LINEAR, TextureGL::REPEAT);
+    // Start decoding the textures first, these load in the background
+    // while the shaders and meshes are prepared. Placeholders are chosen
+    // to be unobtrusive (no specular, no night lights, no clouds).
+    // Loaded textures are kept within the budget by dropping the mips
+    // that distant bodies can not show (see TextureResidency)
+    TextureResidency textureResidency(textureBudgetMiB * 1024 * 1024);
+    TextureLoader textureLoader(&textureResidency);
+    const glm::u8vec4 GREY = glm::u8vec4(128, 128, 128, 255);
+    const glm::u8vec4 BLACK = glm::u8vec4(0, 0, 0, 255);
+    const glm::u8vec4 CLEAR = glm::u8vec4(255, 255, 255, 0);
+    const TextureGL& earthTex = textureLoader.Load("textures/2k_earth_daymap.jpg", TextureGL::LINEAR, TextureGL::REPEAT, GREY);
+    const TextureGL& earthSpecular = textureLoader.Load("textures/2k_earth_specular_map.png", TextureGL::LINEAR, TextureGL::REPEAT, BLACK);
+    const TextureGL& earthNight = textureLoader.Load("textures/2k_earth_nightmap_alpha.png", TextureGL::LINEAR, TextureGL::REPEAT, BLACK);
+    const TextureGL& earthClouds = textureLoader.Load("textures/2k_earth_clouds_alpha.png", TextureGL::LINEAR, TextureGL::REPEAT, CLEAR);
+    // Bodies drawn with the planet shader share one array texture, the
+    // ones of a different size are resampled to the size of the array
+    std::vector<std::string> bodyLayers;
+    for(const char* layer : BodyArray::LAYERS)
+        bodyLayers.push_back(std::string("textures/") + layer);
+    const TextureArrayGL& bodyTex = textureLoader.LoadArray(bodyLayers,
+                                                            BodyArray::WIDTH, BodyArray::HEIGHT,
+                                                            TextureGL::LINEAR,
+                                                            TextureGL::REPEAT, GREY);
+    // Sky is drawn from an octahedral map (even texel density,
+    // no pole singularity) converted once from the equirect image
+    const TextureGL& starsTex = textureLoader.Load("textures/2k_stars_milky_way.jpg", TextureGL::LINEAR, TextureGL::CLAMP, BLACK, true);
+    // Full resolution sky is streamed page by page, the octahedral
+    // one is shown until (and where) its pages are not resident
+    VirtualTexture skyVT("textures/8k_stars_milky_way.jpg",
+                         VirtualTexture::CapacityForScreen(state.width, state.height));
+
+    // Load shaders, these are compiled by the driver while
+    // the meshes are generated (see ShaderBatch)
+    ShaderBatch shaderBatch;
+    ShaderGL planetVS = shaderBatch.Add(ShaderGL::VERTEX, "shaders/planet.vert");
+    // Bodies get their own permutation of the planet shader
+    ShaderGL planetFS = shaderBatch.Add(ShaderGL::FRAGMENT, "shaders/planet.frag",
+                                        {"ALBEDO_ARRAY=1", "SHADOW_PCF=1"});
+    ShaderGL earthFS = shaderBatch.Add(ShaderGL::FRAGMENT, "shaders/planet.frag",
+                                       {"SPECULAR_MAP=1", "NIGHT_LIGHTS=1", "SHADOW_PCF=1"});
+    ShaderGL cloudFS = shaderBatch.Add(ShaderGL::FRAGMENT, "shaders/cloud.frag");
+    ShaderGL bgVS = shaderBatch.Add(ShaderGL::VERTEX, "shaders/background.vert");
+    ShaderGL skyVS = shaderBatch.Add(ShaderGL::VERTEX, "shaders/sky.vert");
+    ShaderGL bgFS = shaderBatch.Add(ShaderGL::FRAGMENT, "shaders/background.frag");
+    ShaderGL bgVTFS = shaderBatch.Add(ShaderGL::FRAGMENT, "shaders/background_vt.frag");
+    ShaderGL bgFeedbackFS = shaderBatch.Add(ShaderGL::FRAGMENT, "shaders/background_feedback.frag");
+    ShaderGL sunFS = shaderBatch.Add(ShaderGL::FRAGMENT, "shaders/sun.frag");
+    ShaderGL shadowVS = shaderBatch.Add(ShaderGL::VERTEX, "shaders/shadow.vert");
+    ShaderGL shadowFS = shaderBatch.Add(ShaderGL::FRAGMENT, "shaders/shadow.frag");
+
+    // Generate meshes, UV sphere LODs finest first.
+    // 50x50 is the same tessellation as "meshes/sphere_5k.obj"
+    constexpr std::array<uint32_t, 5> LOD_SEGMENTS = {100, 50, 32, 16, 8};
+    constexpr float LOD_MAX_ERROR_PIXELS = 0.5f;
+    std::vector<MeshGL> sphereMeshes;
+    sphereMeshes.reserve(LOD_SEGMENTS.size());
+    for(uint32_t s : LOD_SEGMENTS)
+        sphereMeshes.emplace_back(GenerateUVSphere(s, s),
+                                  "UV Sphere " + std::to_string(s) + "x" + std::to_string(s));
+
+    // A level is needed once the next coarser one's
+    // silhouette error exceeds the limit
+    LODChain sphereLOD;
+    for(size_t i = 0; i < sphereMeshes.size(); i++)
+    {
+        sphereLOD.meshes.push_back(&sphereMeshes[i]);
+        sphereLOD.minRadius.push_back((i + 1 < LOD_SEGMENTS.size())
+                                        ? UVSphereMaxRadius(LOD_SEGMENTS[i + 1], LOD_MAX_ERROR_PIXELS)
+                                        : 0.0f);
+    }
+    // Per body and view (LODs hold the hysteresis state)
+    LODChain earthLOD = sphereLOD, cloudLOD = sphereLOD;
+    LODChain moonLOD = sphereLOD, moonMoonLOD = sphereLOD, sunLOD = sphereLOD;
+    LODChain earthShadowLOD = sphereLOD, moonShadowLOD = sphereLOD;
+    LODChain moonMoonShadowLOD = sphereLOD;
+    // Sky is a single full screen triangle, its vertices are
+    // generated in the shader; core profile still needs a VAO
+    GLuint skyVAO = 0;
+    glGenVertexArrays(1, &skyVAO);
+    // Fragments of the sky that pass the depth test, the sphere
+    // it replaces shaded every pixel of the screen
+    GLuint skyQuery = 0;
+    glGenQueries(1, &skyQuery);
+    bool skyQueryPending = false;
+    GLuint64 skyFragments = 0;
+
+    // Triangles per frame, and what they would be if every
+    // body was drawn with "sphere_5k" without meshlet culling
+    const uint32_t fullDetailTriangles = sphereMeshes[1].indexCount / 3;
+    uint32_t frameTriangles = 0;
+    uint32_t frameFullDetailTriangles = 0;
+    float lastTitleTime = 0.0f;
+    // Visible meshlets of the selected LOD, see "DrawVisible"
+    std::vector<IndexRange> drawRanges;
+    std::vector<GLsizei> drawCounts;
+    std::vector<const void*> drawOffsets;
+    // Back face culling of the meshlets must be disabled
+    // when GL_CULL_FACE is disabled for the draw
+    auto SelectLOD = [&](LODChain& lod, const glm::mat4& model,
+                         const glm::mat4& viewMatrix, const glm::mat4& projMatrix,
+                         float viewportHeight, bool backFaceCull = true) -> const MeshGL&
+    {
+        glm::mat4 modelView = viewMatrix * model;
+        float radius = ProjectedSphereRadius(projMatrix, modelView, viewportHeight);
+        const MeshGL& mesh = lod.Select(radius);
+        if(mesh.meshlets.size() < MIN_CULLED_MESHLETS)
+        {
+            drawRanges.assign(1, IndexRange{0, mesh.indexCount});
+            frameTriangles += mesh.indexCount / 3;
+        }
+        else
+        {
+            frameTriangles += CullMeshlets(drawRanges, mesh.meshlets, projMatrix,
+                                           modelView, backFaceCull);
+        }
+        frameFullDetailTriangles += fullDetailTriangles;
+        return mesh;
+    };
+    // Draws the meshlets that survived the culling in "SelectLOD",
+    // adjacent ones are already merged into a single range
+    auto DrawVisible = [&](const MeshGL& mesh)
+    {
+        if(drawRanges.empty()) return;
+
+        GLsizei indexSize = (mesh.indexType == GL_UNSIGNED_SHORT) ? 2 : 4;
+        if(drawRanges.size() == 1)
+        {
+            const IndexRange& r = drawRanges.front();
+            glDrawElements(GL_TRIANGLES, GLsizei(r.indexCount), mesh.indexType,
+                           reinterpret_cast<const void*>(uintptr_t(r.firstIndex) * uintptr_t(indexSize)));
+            return;
+        }
+        drawCounts.clear();
+        drawOffsets.clear();
+        for(const IndexRange& r : drawRanges)
+        {
+            drawCounts.push_back(GLsizei(r.indexCount));
+            drawOffsets.push_back(reinterpret_cast<const void*>(uintptr_t(r.firstIndex) * uintptr_t(indexSize)));
+        }
+        glMultiDrawElements(GL_TRIANGLES, drawCounts.data(), mesh.indexType,
+                            drawOffsets.data(), GLsizei(drawCounts.size()));
+    };
+    // Camera, light and time are written once per frame, the
+    // model and mesh of each draw go to their own block
+    // (see "shaders/include/frame.glsl")
+    FrameUniforms frameUniforms;
+    auto DrawMesh = [&](const MeshGL& mesh, const glm::mat4& model,
+                        int32_t albedoLayer = 0)
+    {
+        if(drawRanges.empty()) return;
+
+        DrawBlock draw = {};
+        draw.model = model;
+        draw.normalMatrix = glm::mat3x4(glm::inverseTranspose(glm::mat3(model)));
+        mesh.DecodeVectors(draw.meshDecode);
+        draw.albedoLayer = albedoLayer;
+        frameUniforms.Draw(draw);
+        glBindVertexArray(mesh.vaoId);
+        DrawVisible(mesh);
+    };
 
     // Create shadow framebuffer
     ShadowFBO shadowFBO(2048, 2048);
@@ -244,21 +413,23 @@ int main(int, const char*[])
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE);
 
-    // Uniform locations
-    constexpr GLuint U_MODEL = 0;
-    constexpr GLuint U_VIEW = 1;
-    constexpr GLuint U_PROJ = 2;
-    constexpr GLuint U_NORMAL = 3;
-    constexpr GLuint U_LIGHT_DIR = 4;
-    constexpr GLuint U_CAMERA_POS = 5;
-    constexpr GLuint U_LIGHT_COLOR = 6;
-    constexpr GLuint U_LIGHT_VP = 7;
+    // Texture units
     constexpr GLuint T_ALBEDO = 0;
     constexpr GLuint T_SHADOW = 1;
     constexpr GLuint T_SPECULAR = 2;
     constexpr GLuint T_NIGHT = 3;
+    constexpr GLuint T_VT_PAGES = 4;
+    constexpr GLuint T_VT_INDIRECTION = 5;
+
+    // Programs are first used by the render loop
+    shaderBatch.Finish();
+    // Edited shaders are rebuilt while running
+    ShaderReloader shaderReloader({&planetVS, &planetFS, &earthFS, &cloudFS,
+                                   &bgVS, &skyVS, &bgFS, &bgVTFS, &bgFeedbackFS,
+                                   &sunFS, &shadowVS, &shadowFS});
 
     float lastFrameTime = static_cast<float>(glfwGetTime());
+    bool firstFrame = true;
 
     // ========================================================================
     // RENDER LOOP
@@ -276,6 +447,20 @@ int main(int, const char*[])
         // Poll events
         glfwPollEvents();
 
+        // Swap in the shaders that are rebuilt since the last frame
+        shaderReloader.Update();
+
+        // Upload the textures that are decoded since the last frame
+        if(textureLoader.PendingCount() != 0 &&
+           textureLoader.Update() != 0 &&
+           textureLoader.PendingCount() == 0)
+        {
+            std::printf("All textures are at full quality after %.1f ms\n",
+                        MillisecondsSince(startTime));
+        }
+        // Sky pages that the last feedback asked for
+        skyVT.Update();
+
         // Update camera based on mode
         if (state.mode == 3) {
             // FPS mode
@@ -320,6 +505,18 @@ int main(int, const char*[])
         float shadowOrthoSize = 15.0f;
         glm::mat4 lightProj = glm::ortho(-shadowOrthoSize, shadowOrthoSize, -shadowOrthoSize, shadowOrthoSize, 1.0f, 50.0f);
         glm::mat4 lightVP = lightProj * lightView;
+
+        // Shared by every pass of this frame
+        FrameBlock frame = {};
+        frame.view = view;
+        frame.projection = proj;
+        frame.orthoProjection = orthoProj;
+        frame.lightVP = lightVP;
+        frame.cameraPos = glm::vec4(state.pos, 1.0f);
+        frame.lightDir = glm::vec4(lightDir, 0.0f);
+        frame.lightColor = glm::vec4(lightColor, 1.0f);
+        frame.time = glm::vec4(state.currentTime, 0.0f, 0.0f, 0.0f);
+        frameUniforms.BeginFrame(frame);
         
         // Bind shadow framebuffer
         glBindFramebuffer(GL_FRAMEBUFFER, shadowFBO.fboId);
@@ -334,20 +531,17 @@ int main(int, const char*[])
         glUseProgramStages(state.renderPipeline, GL_FRAGMENT_SHADER_BIT, shadowFS.shaderId);
         
         // Render all planets to shadow map
-        auto renderShadow = [&](const glm::mat4& model) {
-            glActiveShaderProgram(state.renderPipeline, shadowVS.shaderId);
-            glUniformMatrix4fv(U_MODEL, 1, false, glm::value_ptr(model));
-            glUniformMatrix4fv(U_VIEW, 1, false, glm::value_ptr(lightView));
-            glUniformMatrix4fv(U_PROJ, 1, false, glm::value_ptr(lightProj));
-            glBindVertexArray(sphereMesh.vaoId);
-            glDrawElements(GL_TRIANGLES, sphereMesh.indexCount, GL_UNSIGNED_INT, nullptr);
+        auto renderShadow = [&](const glm::mat4& model, LODChain& lod) {
+            const MeshGL& mesh = SelectLOD(lod, model, lightView, lightProj,
+                                           float(shadowFBO.height));
+            DrawMesh(mesh, model);
         };
         
         // Earth
         float earthRotation = state.currentTime * 0.2f;
         glm::mat4 earthModel = glm::rotate(glm::mat4(1.0f), earthRotation, glm::vec3(0, 1, 0));
         earthModel = glm::scale(earthModel, glm::vec3(1.0f));
-        renderShadow(earthModel);
+        renderShadow(earthModel, earthShadowLOD);
         
         // Moon
         float moonOrbitAngle = state.currentTime * 0.5f;
@@ -357,7 +551,7 @@ int main(int, const char*[])
         glm::mat4 moonRotate = glm::rotate(glm::mat4(1.0f), moonRotation, glm::vec3(0, 1, 0));
         glm::mat4 moonScale = glm::scale(glm::mat4(1.0f), glm::vec3(0.27f));
         glm::mat4 moonModel = earthModel * moonOrbit * moonTranslate * moonRotate * moonScale;
-        renderShadow(moonModel);
+        renderShadow(moonModel, moonShadowLOD);
         
         // Moon's moon
         float moonMoonOrbitAngle = state.currentTime * 1.0f;
@@ -367,7 +561,7 @@ int main(int, const char*[])
         glm::mat4 moonMoonRotate = glm::rotate(glm::mat4(1.0f), moonMoonRotation, glm::vec3(0, 1, 0));
         glm::mat4 moonMoonScale = glm::scale(glm::mat4(1.0f), glm::vec3(0.5f));
         glm::mat4 moonMoonModel = moonModel * moonMoonOrbit * moonMoonTranslate * moonMoonRotate * moonMoonScale;
-        renderShadow(moonMoonModel);
+        renderShadow(moonMoonModel, moonMoonShadowLOD);
         
         // Unbind shadow framebuffer
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -381,39 +575,8 @@ int main(int, const char*[])
         glViewport(0, 0, state.width, state.height);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // ====================================================================
-        // RENDER BACKGROUND (Stars)
-        // ====================================================================
-        glDepthMask(GL_FALSE); // Don't write to depth buffer
-        glDisable(GL_CULL_FACE);
-
-        glUseProgramStages(state.renderPipeline, GL_VERTEX_SHADER_BIT, bgVS.shaderId);
-        glUseProgramStages(state.renderPipeline, GL_FRAGMENT_SHADER_BIT, bgFS.shaderId);
-
-        glActiveShaderProgram(state.renderPipeline, bgVS.shaderId);
-        {
-            // Very large sphere centered on camera
-            glm::mat4 bgModel = glm::translate(glm::mat4(1.0f), state.pos);
-            bgModel = glm::scale(bgModel, glm::vec3(1000.0f));
-            glm::mat3 normalMat = glm::mat3(1.0f);
-
-            glUniformMatrix4fv(U_MODEL, 1, false, glm::value_ptr(bgModel));
-            glUniformMatrix4fv(U_VIEW, 1, false, glm::value_ptr(view));
-            glUniformMatrix4fv(U_PROJ, 1, false, glm::value_ptr(proj)); // Use perspective
-            glUniformMatrix3fv(U_NORMAL, 1, false, glm::value_ptr(normalMat));
-        }
-
-        glActiveShaderProgram(state.renderPipeline, bgFS.shaderId);
-        {
-            glActiveTexture(GL_TEXTURE0 + T_ALBEDO);
-            glBindTexture(GL_TEXTURE_2D, starsTex.textureId);
-        }
-
-        glBindVertexArray(sphereMesh.vaoId);
-        glDrawElements(GL_TRIANGLES, sphereMesh.indexCount, GL_UNSIGNED_INT, nullptr);
-
-        glDepthMask(GL_TRUE);
-        glEnable(GL_CULL_FACE);
+        // LOD of the body that is being drawn
+        const MeshGL* mesh = nullptr;
 
         // ====================================================================
         // RENDER SUN
@@ -421,41 +584,26 @@ int main(int, const char*[])
         glUseProgramStages(state.renderPipeline, GL_VERTEX_SHADER_BIT, bgVS.shaderId);
         glUseProgramStages(state.renderPipeline, GL_FRAGMENT_SHADER_BIT, sunFS.shaderId);
 
-        glActiveShaderProgram(state.renderPipeline, bgVS.shaderId);
         {
-            // Small sphere far away in direction of light
+            // Small sphere far away in direction of light,
+            // uses the orthographic projection
             glm::vec3 sunPos = state.pos - lightDir * 100.0f;
             glm::mat4 sunModel = glm::translate(glm::mat4(1.0f), sunPos);
             sunModel = glm::scale(sunModel, glm::vec3(5.0f));
-            glm::mat3 normalMat = glm::mat3(1.0f);
 
-            glUniformMatrix4fv(U_MODEL, 1, false, glm::value_ptr(sunModel));
-            glUniformMatrix4fv(U_VIEW, 1, false, glm::value_ptr(view));
-            glUniformMatrix4fv(U_PROJ, 1, false, glm::value_ptr(orthoProj)); // Use orthographic
-            glUniformMatrix3fv(U_NORMAL, 1, false, glm::value_ptr(normalMat));
+            mesh = &SelectLOD(sunLOD, sunModel, view, orthoProj, float(state.height));
+            DrawMesh(*mesh, sunModel);
         }
 
-        glBindVertexArray(sphereMesh.vaoId);
-        glDrawElements(GL_TRIANGLES, sphereMesh.indexCount, GL_UNSIGNED_INT, nullptr);
-
         // ====================================================================
         // RENDER PLANETS
         // ====================================================================
         glUseProgramStages(state.renderPipeline, GL_VERTEX_SHADER_BIT, planetVS.shaderId);
         glUseProgramStages(state.renderPipeline, GL_FRAGMENT_SHADER_BIT, planetFS.shaderId);
 
-        // Set common uniforms for all planets
-        glActiveShaderProgram(state.renderPipeline, planetFS.shaderId);
-        {
-            glUniform3fv(U_LIGHT_DIR, 1, glm::value_ptr(lightDir));
-            glUniform3fv(U_CAMERA_POS, 1, glm::value_ptr(state.pos));
-            glUniform3fv(U_LIGHT_COLOR, 1, glm::value_ptr(lightColor));
-            glUniformMatrix4fv(U_LIGHT_VP, 1, false, glm::value_ptr(lightVP));
-            
-            // Bind shadow map
-            glActiveTexture(GL_TEXTURE0 + T_SHADOW);
-            glBindTexture(GL_TEXTURE_2D, shadowFBO.colorTextureId);
-        }
+        // Bind shadow map, light and camera are in the frame block
+        glActiveTexture(GL_TEXTURE0 + T_SHADOW);
+        glBindTexture(GL_TEXTURE_2D, shadowFBO.colorTextureId);
 
         // --------------------------------------------------------------------
         // EARTH (Planet 0)
@@ -463,20 +611,6 @@ int main(int, const char*[])
         // Use Earth-specific shader
         glUseProgramStages(state.renderPipeline, GL_FRAGMENT_SHADER_BIT, earthFS.shaderId);
         
-        glActiveShaderProgram(state.renderPipeline, planetVS.shaderId);
-        {
-            float earthRotation = state.currentTime * 0.2f;
-            glm::mat4 earthModel = glm::rotate(glm::mat4(1.0f), earthRotation, glm::vec3(0, 1, 0));
-            earthModel = glm::scale(earthModel, glm::vec3(1.0f));
-            glm::mat3 normalMatrix = glm::inverseTranspose(glm::mat3(earthModel));
-
-            glUniformMatrix4fv(U_MODEL, 1, false, glm::value_ptr(earthModel));
-            glUniformMatrix4fv(U_VIEW, 1, false, glm::value_ptr(view));
-            glUniformMatrix4fv(U_PROJ, 1, false, glm::value_ptr(proj));
-            glUniformMatrix3fv(U_NORMAL, 1, false, glm::value_ptr(normalMatrix));
-        }
-
-        glActiveShaderProgram(state.renderPipeline, earthFS.shaderId);
         {
             glActiveTexture(GL_TEXTURE0 + T_ALBEDO);
             glBindTexture(GL_TEXTURE_2D, earthTex.textureId);
@@ -484,64 +618,28 @@ int main(int, const char*[])
             glBindTexture(GL_TEXTURE_2D, earthSpecular.textureId);
             glActiveTexture(GL_TEXTURE0 + T_NIGHT);
             glBindTexture(GL_TEXTURE_2D, earthNight.textureId);
-            
-            glUniform3fv(U_LIGHT_DIR, 1, glm::value_ptr(lightDir));
-            glUniform3fv(U_CAMERA_POS, 1, glm::value_ptr(state.pos));
-            glUniform3fv(U_LIGHT_COLOR, 1, glm::value_ptr(lightColor));
-            glUniformMatrix4fv(U_LIGHT_VP, 1, false, glm::value_ptr(lightVP));
-            
-            glActiveTexture(GL_TEXTURE0 + T_SHADOW);
-            glBindTexture(GL_TEXTURE_2D, shadowFBO.colorTextureId);
-        }
 
-        glBindVertexArray(sphereMesh.vaoId);
-        glDrawElements(GL_TRIANGLES, sphereMesh.indexCount, GL_UNSIGNED_INT, nullptr);
-        
-        // --------------------------------------------------------------------
-        // EARTH CLOUDS
-        // --------------------------------------------------------------------
-        // Enable alpha blending for clouds
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        glDepthMask(GL_FALSE); // Don't write to depth buffer
-        
-        glUseProgramStages(state.renderPipeline, GL_FRAGMENT_SHADER_BIT, cloudFS.shaderId);
-        
-        glActiveShaderProgram(state.renderPipeline, planetVS.shaderId);
-        {
-            // Clouds stay still (no rotation) while Earth rotates
-            glm::mat4 cloudModel = glm::mat4(1.0f); // Identity matrix - no rotation
-            cloudModel = glm::scale(cloudModel, glm::vec3(1.015f)); // Slightly larger than Earth
-            glm::mat3 normalMatrix = glm::inverseTranspose(glm::mat3(cloudModel));
+            float earthRotation = state.currentTime * 0.2f;
+            glm::mat4 earthModel = glm::rotate(glm::mat4(1.0f), earthRotation, glm::vec3(0, 1, 0));
+            earthModel = glm::scale(earthModel, glm::vec3(1.0f));
 
-            glUniformMatrix4fv(U_MODEL, 1, false, glm::value_ptr(cloudModel));
-            glUniformMatrix4fv(U_VIEW, 1, false, glm::value_ptr(view));
-            glUniformMatrix4fv(U_PROJ, 1, false, glm::value_ptr(proj));
-            glUniformMatrix3fv(U_NORMAL, 1, false, glm::value_ptr(normalMatrix));
+            mesh = &SelectLOD(earthLOD, earthModel, view, proj, float(state.height));
+            float earthRadius = ProjectedSphereRadius(proj, view * earthModel, float(state.height));
+            textureResidency.Request(earthTex, earthRadius);
+            textureResidency.Request(earthSpecular, earthRadius);
+            textureResidency.Request(earthNight, earthRadius);
+            DrawMesh(*mesh, earthModel);
         }
 
-        glActiveShaderProgram(state.renderPipeline, cloudFS.shaderId);
-        {
-            glActiveTexture(GL_TEXTURE0 + T_ALBEDO);
-            glBindTexture(GL_TEXTURE_2D, earthClouds.textureId);
-            glUniform3fv(U_LIGHT_DIR, 1, glm::value_ptr(lightDir));
-            glUniform3fv(U_LIGHT_COLOR, 1, glm::value_ptr(lightColor));
-        }
-
-        glBindVertexArray(sphereMesh.vaoId);
-        glDrawElements(GL_TRIANGLES, sphereMesh.indexCount, GL_UNSIGNED_INT, nullptr);
-        
-        // Restore render state
-        glDepthMask(GL_TRUE);
-        glDisable(GL_BLEND);
-        
-        // Switch back to regular planet shader for other planets
+        // Switch back to regular planet shader for other planets,
+        // their albedo maps are bound once
         glUseProgramStages(state.renderPipeline, GL_FRAGMENT_SHADER_BIT, planetFS.shaderId);
+        glActiveTexture(GL_TEXTURE0 + T_ALBEDO);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, bodyTex.textureId);
 
         // --------------------------------------------------------------------
         // MOON (Planet 1) - Orbits Earth
         // --------------------------------------------------------------------
-        glActiveShaderProgram(state.renderPipeline, planetVS.shaderId);
         {
             float moonOrbitAngle = state.currentTime * 0.5f;
             float moonRotation = state.currentTime * 0.3f;
@@ -557,27 +655,16 @@ int main(int, const char*[])
             glm::mat4 moonScale = glm::scale(glm::mat4(1.0f), glm::vec3(0.27f)); // Moon is ~1/4 size
 
             glm::mat4 moonModel = earthModel * moonOrbit * moonTranslate * moonRotate * moonScale;
-            glm::mat3 normalMatrix = glm::inverseTranspose(glm::mat3(moonModel));
 
-            glUniformMatrix4fv(U_MODEL, 1, false, glm::value_ptr(moonModel));
-            glUniformMatrix4fv(U_VIEW, 1, false, glm::value_ptr(view));
-            glUniformMatrix4fv(U_PROJ, 1, false, glm::value_ptr(proj));
-            glUniformMatrix3fv(U_NORMAL, 1, false, glm::value_ptr(normalMatrix));
+            mesh = &SelectLOD(moonLOD, moonModel, view, proj, float(state.height));
+            textureResidency.Request(bodyTex, ProjectedSphereRadius(proj, view * moonModel,
+                                                                    float(state.height)));
+            DrawMesh(*mesh, moonModel, BodyArray::LAYER_MOON);
         }
 
-        glActiveShaderProgram(state.renderPipeline, planetFS.shaderId);
-        {
-            glActiveTexture(GL_TEXTURE0 + T_ALBEDO);
-            glBindTexture(GL_TEXTURE_2D, moonTex.textureId);
-        }
-
-        glBindVertexArray(sphereMesh.vaoId);
-        glDrawElements(GL_TRIANGLES, sphereMesh.indexCount, GL_UNSIGNED_INT, nullptr);
-
         // --------------------------------------------------------------------
         // MOON'S MOON (Planet 2) - Orbits Moon
         // --------------------------------------------------------------------
-        glActiveShaderProgram(state.renderPipeline, planetVS.shaderId);
         {
             float moonOrbitAngle = state.currentTime * 0.5f;
             float moonRotation = state.currentTime * 0.3f;
@@ -602,26 +689,140 @@ int main(int, const char*[])
             glm::mat4 moonMoonScale = glm::scale(glm::mat4(1.0f), glm::vec3(0.5f)); // Smaller than moon
 
             glm::mat4 moonMoonModel = moonModel * moonMoonOrbit * moonMoonTranslate * moonMoonRotate * moonMoonScale;
-            glm::mat3 normalMatrix = glm::inverseTranspose(glm::mat3(moonMoonModel));
 
-            glUniformMatrix4fv(U_MODEL, 1, false, glm::value_ptr(moonMoonModel));
-            glUniformMatrix4fv(U_VIEW, 1, false, glm::value_ptr(view));
-            glUniformMatrix4fv(U_PROJ, 1, false, glm::value_ptr(proj));
-            glUniformMatrix3fv(U_NORMAL, 1, false, glm::value_ptr(normalMatrix));
+            mesh = &SelectLOD(moonMoonLOD, moonMoonModel, view, proj, float(state.height));
+            textureResidency.Request(bodyTex, ProjectedSphereRadius(proj, view * moonMoonModel,
+                                                                    float(state.height)));
+            DrawMesh(*mesh, moonMoonModel, BodyArray::LAYER_JUPITER);
+        }
+
+        // ====================================================================
+        // RENDER BACKGROUND (Stars)
+        // ====================================================================
+        // After the opaque bodies, early depth test skips the covered pixels
+        glDepthMask(GL_FALSE);
+        glDepthFunc(GL_LEQUAL);
+        glDisable(GL_CULL_FACE);
+
+        glUseProgramStages(state.renderPipeline, GL_VERTEX_SHADER_BIT, skyVS.shaderId);
+        glUseProgramStages(state.renderPipeline, GL_FRAGMENT_SHADER_BIT, bgFS.shaderId);
+        glBindVertexArray(skyVAO);
+
+        if(skyVT.Ready())
+        {
+            // Pages the sky needs, read back a few frames later. Skipped
+            // while the previous read back is still in flight.
+            if(skyVT.BeginFeedback(state.width, state.height))
+            {
+                glUseProgramStages(state.renderPipeline, GL_FRAGMENT_SHADER_BIT, bgFeedbackFS.shaderId);
+                skyVT.SetUniforms(bgFeedbackFS.shaderId, true);
+                glDrawArrays(GL_TRIANGLES, 0, 3);
+                skyVT.EndFeedback();
+                glViewport(0, 0, state.width, state.height);
+            }
+            glUseProgramStages(state.renderPipeline, GL_FRAGMENT_SHADER_BIT, bgVTFS.shaderId);
+            skyVT.SetUniforms(bgVTFS.shaderId, false);
+            skyVT.BindTextures(T_VT_PAGES, T_VT_INDIRECTION);
+        }
+
+        glActiveTexture(GL_TEXTURE0 + T_ALBEDO);
+        glBindTexture(GL_TEXTURE_2D, starsTex.textureId);
+        if(skyQueryPending)
+        {
+            GLuint available = GL_FALSE;
+            glGetQueryObjectuiv(skyQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+            if(available)
+            {
+                glGetQueryObjectui64v(skyQuery, GL_QUERY_RESULT, &skyFragments);
+                skyQueryPending = false;
+            }
         }
+        if(!skyQueryPending) glBeginQuery(GL_SAMPLES_PASSED, skyQuery);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        if(!skyQueryPending) glEndQuery(GL_SAMPLES_PASSED);
+        skyQueryPending = true;
+        frameTriangles += 1;
+        frameFullDetailTriangles += fullDetailTriangles;
+
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+        glEnable(GL_CULL_FACE);
 
-        glActiveShaderProgram(state.renderPipeline, planetFS.shaderId);
+        // --------------------------------------------------------------------
+        // EARTH CLOUDS
+        // --------------------------------------------------------------------
+        // Drawn last, these blend over the planets and the sky
+        // Enable alpha blending for clouds
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glDepthMask(GL_FALSE); // Don't write to depth buffer
+        
+        glUseProgramStages(state.renderPipeline, GL_VERTEX_SHADER_BIT, planetVS.shaderId);
+        glUseProgramStages(state.renderPipeline, GL_FRAGMENT_SHADER_BIT, cloudFS.shaderId);
+        
         {
             glActiveTexture(GL_TEXTURE0 + T_ALBEDO);
-            glBindTexture(GL_TEXTURE_2D, jupiterTex.textureId);
+            glBindTexture(GL_TEXTURE_2D, earthClouds.textureId);
+
+            // Clouds stay still (no rotation) while Earth rotates
+            glm::mat4 cloudModel = glm::mat4(1.0f); // Identity matrix - no rotation
+            cloudModel = glm::scale(cloudModel, glm::vec3(1.015f)); // Slightly larger than Earth
+
+            mesh = &SelectLOD(cloudLOD, cloudModel, view, proj, float(state.height));
+            textureResidency.Request(earthClouds, ProjectedSphereRadius(proj, view * cloudModel,
+                                                                        float(state.height)));
+            DrawMesh(*mesh, cloudModel);
         }
+        
+        // Restore render state
+        glDepthMask(GL_TRUE);
+        glDisable(GL_BLEND);
+
+        // Sky fills the screen, it stays fully resident
+        textureResidency.Request(starsTex, TextureResidency::FULL_RESOLUTION);
+        textureResidency.Update();
 
-        glBindVertexArray(sphereMesh.vaoId);
-        glDrawElements(GL_TRIANGLES, sphereMesh.indexCount, GL_UNSIGNED_INT, nullptr);
+        // Report the triangle counts twice a second
+        if(currentFrame - lastTitleTime >= 0.5f)
+        {
+            std::string title = (std::string(windowTitle) +
+                                 " | Triangles: " + std::to_string(frameTriangles) +
+                                 " (without LOD and culling: " + std::to_string(frameFullDetailTriangles) + ")" +
+                                 " | Sky fragments: " + std::to_string(skyFragments) + "/" +
+                                 std::to_string(state.width * state.height));
+            if(skyVT.Ready())
+            {
+                VirtualTexture::Stats sky = skyVT.GetStats();
+                title += " | Sky pages: " + std::to_string(sky.residentPages) + "/" +
+                         std::to_string(sky.capacity) + " (" +
+                         std::to_string(sky.atlasBytes / (1024 * 1024)) + " MiB)";
+            }
+            TextureResidency::Stats tex = textureResidency.GetStats();
+            title += " | Textures: " + std::to_string(tex.residentBytes / (1024 * 1024)) + "/" +
+                     std::to_string(tex.budgetBytes / (1024 * 1024)) + " MiB (" +
+                     std::to_string(tex.reducedCount) + " reduced, " +
+                     std::to_string(tex.evictionCount) + " evictions)";
+            glfwSetWindowTitle(state.window, title.c_str());
+            lastTitleTime = currentFrame;
+        }
+        frameTriangles = 0;
+        frameFullDetailTriangles = 0;
+        frameUniforms.EndFrame();
 
         // Swap buffers
         glfwSwapBuffers(state.window);
+
+        if(firstFrame)
+        {
+            std::printf("First frame after %.1f ms (%u/%u textures ready)\n",
+                        MillisecondsSince(startTime),
+                        textureLoader.TextureCount() - textureLoader.PendingCount(),
+                        textureLoader.TextureCount());
+            firstFrame = false;
+        }
     }
 
+    glDeleteQueries(1, &skyQuery);
+    glDeleteVertexArrays(1, &skyVAO);
     return 0;
 }
\ No newline at end of file
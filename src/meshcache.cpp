@@ -0,0 +1,295 @@
+#include "meshcache.h"
+#include "objparser.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+static_assert(std::is_trivially_copyable_v<MeshCacheHeader>,
+              "Mesh cache header is written as raw bytes!");
+static_assert(std::is_trivially_copyable_v<Meshlet>,
+              "Meshlets are written as raw bytes!");
+
+namespace
+{
+
+// "QUANTIZED" vertex
+struct QuantizedVertex
+{
+    int16_t     pos[4];
+    int16_t     normal[2];
+    uint16_t    uv[2];
+};
+static_assert(sizeof(QuantizedVertex) == 16, "Quantized vertex should be 16 bytes");
+
+int16_t QuantizeSnorm16(float v)
+{
+    return int16_t(std::lround(std::clamp(v, -1.0f, 1.0f) * 32767.0f));
+}
+
+uint16_t QuantizeUnorm16(float v)
+{
+    return uint16_t(std::lround(std::clamp(v, 0.0f, 1.0f) * 65535.0f));
+}
+
+// No primitive restart is used, so all 2^16 values are valid indices
+constexpr uint32_t MAX_INDEX16_VERTEX_COUNT = 1u << 16;
+
+constexpr uint64_t AlignUp(uint64_t v, uint64_t alignment)
+{
+    return (v + alignment - 1) / alignment * alignment;
+}
+
+}
+
+MeshLayout ComputeMeshLayout(const MeshData& mesh,
+                             MeshLayout::VertexFormat format)
+{
+    static constexpr uint32_t FloatStrides[MeshLayout::ATTRIB_COUNT] =
+    {
+        sizeof(glm::vec3),
+        sizeof(glm::vec3),
+        sizeof(glm::vec2)
+    };
+    static constexpr uint32_t QuantizedStride = sizeof(QuantizedVertex);
+    static constexpr uint64_t QuantizedOffsets[MeshLayout::ATTRIB_COUNT] =
+    {
+        offsetof(QuantizedVertex, pos),
+        offsetof(QuantizedVertex, normal),
+        offsetof(QuantizedVertex, uv)
+    };
+
+    MeshLayout layout;
+    layout.format = format;
+    layout.vertexCount = uint32_t(mesh.positions.size());
+    layout.indexCount = uint32_t(mesh.indices.size());
+    layout.indexSize = (layout.vertexCount <= MAX_INDEX16_VERTEX_COUNT)
+                            ? uint32_t(sizeof(uint16_t))
+                            : uint32_t(sizeof(uint32_t));
+    layout.indexBufferSize = uint64_t(layout.indexCount) * layout.indexSize;
+    if(format == MeshLayout::FLOAT32)
+    {
+        uint64_t offset = 0;
+        for(uint32_t i = 0; i < MeshLayout::ATTRIB_COUNT; i++)
+        {
+            layout.attribStrides[i] = FloatStrides[i];
+            layout.attribOffsets[i] = offset;
+            offset += AlignUp(uint64_t(FloatStrides[i]) * layout.vertexCount, 256);
+        }
+        layout.vertexBufferSize = offset;
+        return layout;
+    }
+
+    for(uint32_t i = 0; i < MeshLayout::ATTRIB_COUNT; i++)
+    {
+        layout.attribStrides[i] = QuantizedStride;
+        layout.attribOffsets[i] = QuantizedOffsets[i];
+    }
+    layout.vertexBufferSize = uint64_t(QuantizedStride) * layout.vertexCount;
+
+    // Positions ([-1, 1]) and uvs ([0, 1]) are quantized
+    // relative to their bounding boxes
+    static constexpr float MIN_SCALE = std::numeric_limits<float>::min();
+    glm::vec3 pMin(std::numeric_limits<float>::max());
+    glm::vec3 pMax(-std::numeric_limits<float>::max());
+    for(const glm::vec3& p : mesh.positions)
+    {
+        pMin = glm::min(pMin, p);
+        pMax = glm::max(pMax, p);
+    }
+    glm::vec2 uvMin(std::numeric_limits<float>::max());
+    glm::vec2 uvMax(-std::numeric_limits<float>::max());
+    for(const glm::vec2& uv : mesh.uvs)
+    {
+        uvMin = glm::min(uvMin, uv);
+        uvMax = glm::max(uvMax, uv);
+    }
+    if(mesh.positions.empty())
+    {
+        pMin = pMax = glm::vec3(0.0f);
+        uvMin = uvMax = glm::vec2(0.0f);
+    }
+    // Flat axes would divide by zero
+    layout.posOffset = (pMax + pMin) * 0.5f;
+    layout.posScale = glm::max((pMax - pMin) * 0.5f, glm::vec3(MIN_SCALE));
+    layout.uvOffset = uvMin;
+    layout.uvScale = glm::max(uvMax - uvMin, glm::vec2(MIN_SCALE));
+    return layout;
+}
+
+std::vector<std::byte> PackVertexBuffer(const MeshData& mesh,
+                                        const MeshLayout& layout)
+{
+    std::vector<std::byte> buffer(layout.vertexBufferSize, std::byte(0));
+    if(layout.format == MeshLayout::FLOAT32)
+    {
+        std::memcpy(buffer.data() + layout.attribOffsets[0], mesh.positions.data(),
+                    mesh.positions.size() * sizeof(glm::vec3));
+        std::memcpy(buffer.data() + layout.attribOffsets[1], mesh.normals.data(),
+                    mesh.normals.size() * sizeof(glm::vec3));
+        std::memcpy(buffer.data() + layout.attribOffsets[2], mesh.uvs.data(),
+                    mesh.uvs.size() * sizeof(glm::vec2));
+        return buffer;
+    }
+
+    glm::vec3 invPosScale = 1.0f / layout.posScale;
+    glm::vec2 invUVScale = 1.0f / layout.uvScale;
+    for(size_t i = 0; i < layout.vertexCount; i++)
+    {
+        QuantizedVertex v = {};
+        glm::vec3 p = (mesh.positions[i] - layout.posOffset) * invPosScale;
+        glm::vec2 n = OctEncode(mesh.normals[i]);
+        glm::vec2 uv = (mesh.uvs[i] - layout.uvOffset) * invUVScale;
+        for(int c = 0; c < 3; c++) v.pos[c] = QuantizeSnorm16(p[c]);
+        for(int c = 0; c < 2; c++)
+        {
+            v.normal[c] = QuantizeSnorm16(n[c]);
+            v.uv[c] = QuantizeUnorm16(uv[c]);
+        }
+        std::memcpy(buffer.data() + i * sizeof(QuantizedVertex),
+                    &v, sizeof(QuantizedVertex));
+    }
+    return buffer;
+}
+
+std::vector<std::byte> PackIndexBuffer(const MeshData& mesh,
+                                       const MeshLayout& layout)
+{
+    std::vector<std::byte> buffer(layout.indexBufferSize);
+    if(layout.indexSize == sizeof(uint32_t))
+    {
+        std::memcpy(buffer.data(), mesh.indices.data(), buffer.size());
+        return buffer;
+    }
+
+    for(size_t i = 0; i < mesh.indices.size(); i++)
+    {
+        assert(mesh.indices[i] <= std::numeric_limits<uint16_t>::max());
+        uint16_t index = uint16_t(mesh.indices[i]);
+        std::memcpy(buffer.data() + i * sizeof(uint16_t), &index, sizeof(uint16_t));
+    }
+    return buffer;
+}
+
+glm::vec2 OctEncode(const glm::vec3& n)
+{
+    float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    // Missing normals (zero) map to +Z
+    if(l1 == 0.0f) return glm::vec2(0.0f);
+
+    glm::vec2 e = glm::vec2(n.x, n.y) / l1;
+    // Lower hemisphere is folded over the diagonals
+    if(n.z < 0.0f)
+    {
+        glm::vec2 signs(e.x >= 0.0f ? 1.0f : -1.0f,
+                        e.y >= 0.0f ? 1.0f : -1.0f);
+        e = (1.0f - glm::abs(glm::vec2(e.y, e.x))) * signs;
+    }
+    return e;
+}
+
+glm::vec3 OctDecode(const glm::vec2& e)
+{
+    // Same as the shaders
+    glm::vec3 n(e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y));
+    float t = std::max(-n.z, 0.0f);
+    n.x += (n.x >= 0.0f) ? -t : t;
+    n.y += (n.y >= 0.0f) ? -t : t;
+    return glm::normalize(n);
+}
+
+bool LoadMeshCache(MeshCache& out, const std::string& cachePath,
+                   const std::string& sourcePath)
+{
+    FileStamp sourceStamp;
+    if(!GetFileStamp(sourceStamp, sourcePath)) return false;
+
+    MappedFile file(cachePath);
+    if(!file || file.size < sizeof(MeshCacheHeader)) return false;
+
+    MeshCacheHeader header;
+    std::memcpy(&header, file.data, sizeof(MeshCacheHeader));
+    if(std::memcmp(header.magic, MeshCacheHeader::MAGIC, sizeof(header.magic)) != 0 ||
+       header.version != MeshCacheHeader::VERSION)
+        return false;
+
+    // Bounds check, file may be truncated
+    const MeshLayout& layout = header.layout;
+    if(header.vertexDataOffset + layout.vertexBufferSize > file.size ||
+       header.indexDataOffset + layout.indexBufferSize > file.size ||
+       header.meshletDataOffset + uint64_t(header.meshletCount) * sizeof(Meshlet) > file.size ||
+       (layout.indexSize != sizeof(uint16_t) && layout.indexSize != sizeof(uint32_t)) ||
+       layout.indexBufferSize != uint64_t(layout.indexCount) * layout.indexSize ||
+       (layout.format != MeshLayout::FLOAT32 && layout.format != MeshLayout::QUANTIZED))
+        return false;
+
+    // Staleness check
+    if(header.sourceStamp.size != sourceStamp.size) return false;
+    if(header.sourceStamp.modifiedTime != sourceStamp.modifiedTime)
+    {
+        uint64_t sourceHash;
+        if(!HashFile(sourceHash, sourcePath) ||
+           sourceHash != header.sourceHash)
+            return false;
+
+        // Content is the same, refresh the stamp so that
+        // the next load does not need to hash again.
+        header.sourceStamp = sourceStamp;
+        WriteFileAtomic(cachePath,
+        {
+            FileChunk{&header, sizeof(MeshCacheHeader)},
+            FileChunk{file.data + sizeof(MeshCacheHeader),
+                      file.size - sizeof(MeshCacheHeader)}
+        });
+    }
+
+    out.header = header;
+    out.vertexData = file.data + header.vertexDataOffset;
+    out.indexData = file.data + header.indexDataOffset;
+    out.meshlets = reinterpret_cast<const Meshlet*>(file.data + header.meshletDataOffset);
+    out.file = std::move(file);
+    return true;
+}
+
+bool WriteMeshCache(const std::string& cachePath,
+                    const std::string& sourcePath,
+                    const MeshLayout& layout, uint32_t flags,
+                    const MeshOptStats& optStats,
+                    const void* vertexData, const void* indexData,
+                    const std::vector<Meshlet>& meshlets)
+{
+    MeshCacheHeader header = {};
+    std::memcpy(header.magic, MeshCacheHeader::MAGIC, sizeof(header.magic));
+    header.version = MeshCacheHeader::VERSION;
+    header.flags = flags;
+    header.layout = layout;
+    header.optStats = optStats;
+    if(!GetFileStamp(header.sourceStamp, sourcePath) ||
+       !HashFile(header.sourceHash, sourcePath))
+        return false;
+
+    header.vertexDataOffset = AlignUp(sizeof(MeshCacheHeader), 256);
+    header.indexDataOffset = AlignUp(header.vertexDataOffset +
+                                     layout.vertexBufferSize, 256);
+    header.meshletDataOffset = AlignUp(header.indexDataOffset +
+                                       layout.indexBufferSize, 256);
+    header.meshletCount = uint32_t(meshlets.size());
+    uint64_t headerPad = header.vertexDataOffset - sizeof(MeshCacheHeader);
+    uint64_t vertexPad = (header.indexDataOffset - header.vertexDataOffset -
+                          layout.vertexBufferSize);
+    uint64_t indexPad = (header.meshletDataOffset - header.indexDataOffset -
+                         layout.indexBufferSize);
+    return WriteFileAtomic(cachePath,
+    {
+        FileChunk{&header, sizeof(MeshCacheHeader)},
+        FileChunk{nullptr, size_t(headerPad)},
+        FileChunk{vertexData, size_t(layout.vertexBufferSize)},
+        FileChunk{nullptr, size_t(vertexPad)},
+        FileChunk{indexData, size_t(layout.indexBufferSize)},
+        FileChunk{nullptr, size_t(indexPad)},
+        FileChunk{meshlets.data(), meshlets.size() * sizeof(Meshlet)}
+    });
+}
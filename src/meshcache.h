@@ -0,0 +1,116 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+#include "filemap.h"
+#include "meshopt.h"
+#include "meshlet.h"
+
+struct MeshData;
+
+// Memory layout of the "MeshGL" buffers.
+// FLOAT32  : Attribute streams (pos, normal, uv) are placed back to back
+//            on a single vertex buffer at 256 byte aligned offsets.
+// QUANTIZED: Single interleaved stream of 16 byte vertices;
+//            position is snorm16x4 (w is unused) relative to the mesh
+//            bounds, normal is octahedral snorm16x2 and uv is unorm16x2
+//            relative to the uv bounds.
+//            "attribOffsets" are relative to the vertex start.
+// Indices are 16-bit when every vertex is addressable by it.
+struct MeshLayout
+{
+    enum VertexFormat : uint32_t
+    {
+        FLOAT32     = 0,
+        QUANTIZED   = 1
+    };
+    static constexpr uint32_t ATTRIB_COUNT = 3;
+
+    VertexFormat format           = FLOAT32;
+    uint32_t     vertexCount      = 0;
+    uint32_t     indexCount       = 0;
+    uint32_t     indexSize        = sizeof(uint32_t);
+    uint32_t     attribStrides[ATTRIB_COUNT] = {};
+    uint64_t     vertexBufferSize = 0;
+    uint64_t     indexBufferSize  = 0;
+    uint64_t     attribOffsets[ATTRIB_COUNT] = {};
+    // Attribute = decoded attribute * scale + offset
+    glm::vec3    posScale         = glm::vec3(1.0f);
+    glm::vec3    posOffset        = glm::vec3(0.0f);
+    glm::vec2    uvScale          = glm::vec2(1.0f);
+    glm::vec2    uvOffset         = glm::vec2(0.0f);
+};
+
+MeshLayout              ComputeMeshLayout(const MeshData& mesh,
+                                          MeshLayout::VertexFormat format);
+// Packs (and quantizes) the attributes of the mesh into a single
+// buffer that matches the layout
+std::vector<std::byte>  PackVertexBuffer(const MeshData& mesh,
+                                         const MeshLayout& layout);
+
+// Converts the indices to "indexSize" wide integers
+std::vector<std::byte>  PackIndexBuffer(const MeshData& mesh,
+                                        const MeshLayout& layout);
+
+// Octahedral normal encoding, result is in [-1, 1]^2
+glm::vec2               OctEncode(const glm::vec3& n);
+glm::vec3               OctDecode(const glm::vec2& e);
+
+// ======================= //
+//    BINARY MESH CACHE    //
+// ======================= //
+// ".meshbin" file is a header followed by the GPU-ready vertex and
+// index buffers, these can be given to "glBufferStorage" directly
+// from the mapping. Meshlets of the index buffer come last. Header
+// holds the size, modification time and the content hash of the source
+// file. When size and time match the cache is used without touching the
+// source; when only the time differs (i.e. fresh checkout) the content
+// hash decides.
+struct MeshCacheHeader
+{
+    static constexpr char     MAGIC[8] = {'M', 'E', 'S', 'H', 'B', 'I', 'N', '\0'};
+    static constexpr uint32_t VERSION  = 7;
+    // Flags
+    static constexpr uint32_t MISSING_NORMALS = 0x1;
+    static constexpr uint32_t MISSING_UVS     = 0x2;
+    // Buffers went through "OptimizeMesh"
+    static constexpr uint32_t OPTIMIZED       = 0x4;
+
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    flags;
+    FileStamp   sourceStamp;
+    uint64_t    sourceHash;
+    MeshLayout  layout;
+    // Only valid when "OPTIMIZED" is set
+    MeshOptStats optStats;
+    uint64_t    vertexDataOffset;
+    uint64_t    indexDataOffset;
+    uint64_t    meshletDataOffset;
+    uint32_t    meshletCount;
+};
+
+// Mapped cache file, data pointers point into the mapping
+struct MeshCache
+{
+    MappedFile      file;
+    MeshCacheHeader header     = {};
+    const void*     vertexData = nullptr;
+    const void*     indexData  = nullptr;
+    const Meshlet*  meshlets   = nullptr;
+};
+
+// Returns false when the cache does not exist, is corrupted or stale
+bool    LoadMeshCache(MeshCache& out, const std::string& cachePath,
+                      const std::string& sourcePath);
+bool    WriteMeshCache(const std::string& cachePath,
+                       const std::string& sourcePath,
+                       const MeshLayout& layout, uint32_t flags,
+                       const MeshOptStats& optStats,
+                       const void* vertexData, const void* indexData,
+                       const std::vector<Meshlet>& meshlets);
@@ -0,0 +1,267 @@
+#include "meshlet.h"
+#include "objparser.h"
+#include "meshopt.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+
+constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+void ComputeBounds(Meshlet& m, const MeshData& mesh)
+{
+    const uint32_t* indices = mesh.indices.data() + m.firstIndex;
+    uint32_t indexCount = m.triangleCount * 3;
+
+    glm::vec3 bMin(std::numeric_limits<float>::max());
+    glm::vec3 bMax(-std::numeric_limits<float>::max());
+    for(uint32_t i = 0; i < indexCount; i++)
+    {
+        bMin = glm::min(bMin, mesh.positions[indices[i]]);
+        bMax = glm::max(bMax, mesh.positions[indices[i]]);
+    }
+    m.center = (bMin + bMax) * 0.5f;
+    m.radius = 0.0f;
+    for(uint32_t i = 0; i < indexCount; i++)
+        m.radius = std::max(m.radius, glm::length(mesh.positions[indices[i]] - m.center));
+
+    // Cone axis is the average normal, half angle is
+    // the furthest triangle normal from it
+    std::vector<glm::vec3> normals(m.triangleCount);
+    glm::vec3 axis(0.0f);
+    for(uint32_t t = 0; t < m.triangleCount; t++)
+    {
+        const glm::vec3& p0 = mesh.positions[indices[t * 3 + 0]];
+        const glm::vec3& p1 = mesh.positions[indices[t * 3 + 1]];
+        const glm::vec3& p2 = mesh.positions[indices[t * 3 + 2]];
+        glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+        float length = glm::length(n);
+        normals[t] = (length > 0.0f) ? n / length : glm::vec3(0.0f);
+        axis += normals[t];
+    }
+    float axisLength = glm::length(axis);
+    m.coneAxis = (axisLength > 0.0f) ? axis / axisLength : glm::vec3(0.0f, 0.0f, 1.0f);
+    m.coneCutoff = 1.0f;
+    if(axisLength == 0.0f) return;
+
+    float minDot = 1.0f;
+    for(const glm::vec3& n : normals)
+    {
+        // Degenerate triangles are not rasterized
+        if(n == glm::vec3(0.0f)) continue;
+        minDot = std::min(minDot, glm::dot(n, m.coneAxis));
+    }
+    // Cone is wider than a hemisphere
+    if(minDot <= 0.0f) return;
+    m.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+}
+
+}
+
+std::vector<Meshlet> BuildMeshlets(MeshData& mesh, uint32_t maxVertices,
+                                   uint32_t maxTriangles)
+{
+    assert(maxVertices >= 3 && maxTriangles >= 1);
+    uint32_t vertexCount = uint32_t(mesh.positions.size());
+    uint32_t triCount = uint32_t(mesh.indices.size() / 3);
+    std::vector<Meshlet> meshlets;
+    if(triCount == 0) return meshlets;
+
+    // Vertex -> triangle adjacency (CSR)
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for(uint32_t i : mesh.indices) offsets[i + 1]++;
+    for(uint32_t v = 0; v < vertexCount; v++) offsets[v + 1] += offsets[v];
+    std::vector<uint32_t> adjacency(mesh.indices.size());
+    {
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for(size_t i = 0; i < mesh.indices.size(); i++)
+            adjacency[fill[mesh.indices[i]]++] = uint32_t(i / 3);
+    }
+
+    std::vector<glm::vec3> centroids(triCount);
+    for(uint32_t t = 0; t < triCount; t++)
+        centroids[t] = (mesh.positions[mesh.indices[t * 3 + 0]] +
+                        mesh.positions[mesh.indices[t * 3 + 1]] +
+                        mesh.positions[mesh.indices[t * 3 + 2]]) / 3.0f;
+
+    // Meshlet id that the vertex is last added to
+    std::vector<uint32_t> vertexOwner(vertexCount, NONE);
+    std::vector<char> assigned(triCount, 0);
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> result;
+    result.reserve(mesh.indices.size());
+
+    uint32_t seedCursor = 0;
+    uint32_t assignedCount = 0;
+    while(assignedCount < triCount)
+    {
+        // Continue from the frontier of the previous meshlet so that the
+        // leftovers do not end up as small scattered clusters
+        uint32_t seed = NONE;
+        for(uint32_t t : candidates)
+            if(!assigned[t]) { seed = t; break; }
+        if(seed == NONE)
+        {
+            while(assigned[seedCursor]) seedCursor++;
+            seed = seedCursor;
+        }
+        candidates.clear();
+
+        uint32_t id = uint32_t(meshlets.size());
+        Meshlet meshlet = {};
+        meshlet.firstIndex = uint32_t(result.size());
+        uint32_t meshletVertexCount = 0;
+        glm::vec3 centroidSum(0.0f);
+
+        uint32_t next = seed;
+        while(next != NONE)
+        {
+            const uint32_t* tri = mesh.indices.data() + size_t(next) * 3;
+            result.insert(result.end(), tri, tri + 3);
+            assigned[next] = 1;
+            assignedCount++;
+            meshlet.triangleCount++;
+            centroidSum += centroids[next];
+            for(uint32_t i = 0; i < 3; i++)
+            {
+                if(vertexOwner[tri[i]] == id) continue;
+                vertexOwner[tri[i]] = id;
+                meshletVertexCount++;
+                for(uint32_t j = offsets[tri[i]]; j < offsets[tri[i] + 1]; j++)
+                    if(!assigned[adjacency[j]]) candidates.push_back(adjacency[j]);
+            }
+            if(meshlet.triangleCount == maxTriangles) break;
+
+            // Fewest new vertices first, then the closest one
+            glm::vec3 center = centroidSum / float(meshlet.triangleCount);
+            next = NONE;
+            uint32_t bestNewVertices = NONE;
+            float bestDistance = std::numeric_limits<float>::max();
+            size_t kept = 0;
+            for(uint32_t t : candidates)
+            {
+                if(assigned[t]) continue;
+                candidates[kept++] = t;
+
+                const uint32_t* c = mesh.indices.data() + size_t(t) * 3;
+                uint32_t newVertices = ((vertexOwner[c[0]] != id ? 1u : 0u) +
+                                        (vertexOwner[c[1]] != id ? 1u : 0u) +
+                                        (vertexOwner[c[2]] != id ? 1u : 0u));
+                if(meshletVertexCount + newVertices > maxVertices) continue;
+
+                glm::vec3 d = centroids[t] - center;
+                float distance = glm::dot(d, d);
+                if(newVertices < bestNewVertices ||
+                   (newVertices == bestNewVertices && distance < bestDistance))
+                {
+                    next = t;
+                    bestNewVertices = newVertices;
+                    bestDistance = distance;
+                }
+            }
+            candidates.resize(kept);
+        }
+        meshlets.push_back(meshlet);
+    }
+
+    mesh.indices = std::move(result);
+    for(Meshlet& m : meshlets) ComputeBounds(m, mesh);
+    return meshlets;
+}
+
+void OptimizeMeshletVertexCache(MeshData& mesh, const std::vector<Meshlet>& meshlets)
+{
+    // Meshlets are small, vertices are renumbered locally so the
+    // optimizer only sizes its tables for the vertices of one meshlet
+    std::vector<uint32_t> localIds(mesh.positions.size(), NONE);
+    std::vector<uint32_t> globalIds;
+    std::vector<uint32_t> indices;
+    for(const Meshlet& m : meshlets)
+    {
+        auto first = mesh.indices.begin() + ptrdiff_t(m.firstIndex);
+        auto last = first + ptrdiff_t(m.triangleCount * 3);
+        globalIds.clear();
+        indices.clear();
+        for(auto it = first; it != last; it++)
+        {
+            uint32_t& local = localIds[*it];
+            if(local == NONE)
+            {
+                local = uint32_t(globalIds.size());
+                globalIds.push_back(*it);
+            }
+            indices.push_back(local);
+        }
+
+        OptimizeVertexCache(indices, uint32_t(globalIds.size()));
+        for(size_t i = 0; i < indices.size(); i++)
+            *(first + ptrdiff_t(i)) = globalIds[indices[i]];
+        for(uint32_t v : globalIds) localIds[v] = NONE;
+    }
+}
+
+uint32_t CullMeshlets(std::vector<IndexRange>& out,
+                      const std::vector<Meshlet>& meshlets,
+                      const glm::mat4& proj, const glm::mat4& modelView,
+                      bool backFaceCull)
+{
+    out.clear();
+
+    // Frustum planes in mesh space (Gribb & Hartmann)
+    glm::mat4 mvp = proj * modelView;
+    glm::vec4 rows[4];
+    for(int i = 0; i < 4; i++)
+        rows[i] = glm::vec4(mvp[0][i], mvp[1][i], mvp[2][i], mvp[3][i]);
+    glm::vec4 planes[6] =
+    {
+        rows[3] + rows[0], rows[3] - rows[0],
+        rows[3] + rows[1], rows[3] - rows[1],
+        rows[3] + rows[2], rows[3] - rows[2]
+    };
+    for(glm::vec4& p : planes)
+        p /= glm::length(glm::vec3(p));
+
+    // Camera in mesh space; the position for perspective,
+    // the view direction for orthographic projections
+    glm::mat4 invModelView = glm::inverse(modelView);
+    bool isPerspective = (proj[2][3] != 0.0f);
+    glm::vec3 eye = invModelView[3];
+    glm::vec3 viewDir = glm::normalize(glm::vec3(invModelView * glm::vec4(0.0f, 0.0f, -1.0f, 0.0f)));
+
+    uint32_t visibleTriangles = 0;
+    for(const Meshlet& m : meshlets)
+    {
+        bool outside = false;
+        for(const glm::vec4& p : planes)
+            outside |= (glm::dot(glm::vec3(p), m.center) + p.w < -m.radius);
+        if(outside) continue;
+
+        // Every triangle faces away from every point of the bounding
+        // sphere, when the direction to the center is within the
+        // complement of the cone angle (widened by the radius)
+        if(backFaceCull && m.coneCutoff < 1.0f)
+        {
+            bool backFacing;
+            if(isPerspective)
+            {
+                glm::vec3 v = m.center - eye;
+                backFacing = (glm::dot(v, m.coneAxis) >=
+                              m.coneCutoff * glm::length(v) + m.radius * (1.0f + m.coneCutoff));
+            }
+            else backFacing = (glm::dot(viewDir, m.coneAxis) >= m.coneCutoff);
+            if(backFacing) continue;
+        }
+
+        visibleTriangles += m.triangleCount;
+        uint32_t indexCount = m.triangleCount * 3;
+        if(!out.empty() && out.back().firstIndex + out.back().indexCount == m.firstIndex)
+            out.back().indexCount += indexCount;
+        else
+            out.push_back(IndexRange{m.firstIndex, indexCount});
+    }
+    return visibleTriangles;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+struct MeshData;
+
+// Cluster of spatially close triangles, these are contiguous
+// on the index buffer. Bounds are in the mesh space.
+struct Meshlet
+{
+    uint32_t    firstIndex;
+    uint32_t    triangleCount;
+    // Bounding sphere
+    glm::vec3   center;
+    float       radius;
+    // Normal cone, every triangle normal is within the cone.
+    // "coneCutoff" is the sine of the cone half angle,
+    // it is 1 when the cluster can not be back face culled.
+    glm::vec3   coneAxis;
+    float       coneCutoff;
+};
+
+// Range of the index buffer
+struct IndexRange
+{
+    uint32_t    firstIndex;
+    uint32_t    indexCount;
+};
+
+// Meshes with fewer meshlets are drawn whole with a single draw call,
+// their meshlets are too coarse for the culling to pay off (UV sphere
+// 32x32 and coarser still submit 76-99% of the triangles, see MeshBench)
+constexpr uint32_t MIN_CULLED_MESHLETS = 32;
+
+// Splits the mesh into meshlets of at most "maxVertices" unique vertices
+// and "maxTriangles" triangles. Clusters are grown greedily over the
+// triangle adjacency, preferring triangles that add the fewest vertices
+// and are closest to the cluster. Indices are reordered so that
+// each meshlet is contiguous (triangle order within a meshlet is kept).
+std::vector<Meshlet>    BuildMeshlets(MeshData& mesh, uint32_t maxVertices = 64,
+                                      uint32_t maxTriangles = 124);
+
+// Reorders the triangles within each meshlet for the post transform
+// cache (see "OptimizeVertexCache"), building the meshlets keeps the
+// triangle order of the input which breaks its cache locality.
+// Meshlet ranges, bounds and cones stay valid.
+void                    OptimizeMeshletVertexCache(MeshData& mesh,
+                                                   const std::vector<Meshlet>& meshlets);
+
+// Culls the meshlets against the view frustum and (optionally) by their
+// normal cones. Visible meshlets are written as index ranges, adjacent ones
+// are merged. Mesh transform must not have non-uniform scale.
+// Returns the visible triangle count.
+uint32_t                CullMeshlets(std::vector<IndexRange>& out,
+                                     const std::vector<Meshlet>& meshlets,
+                                     const glm::mat4& proj, const glm::mat4& modelView,
+                                     bool backFaceCull);
@@ -0,0 +1,41 @@
+#include "meshlod.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <numbers>
+
+float ProjectedSphereRadius(const glm::mat4& proj, const glm::mat4& modelView,
+                            float viewportHeight)
+{
+    glm::vec3 center = modelView[3];
+    float radius = std::max({glm::length(glm::vec3(modelView[0])),
+                             glm::length(glm::vec3(modelView[1])),
+                             glm::length(glm::vec3(modelView[2]))});
+    // Clip space "w" of the center, orthographic projections have 1
+    float w = proj[2][3] * center.z + proj[3][3];
+    bool isPerspective = (proj[2][3] != 0.0f);
+    if(isPerspective) w = std::max(w, radius);
+    return radius * proj[1][1] / w * viewportHeight * 0.5f;
+}
+
+float UVSphereMaxRadius(uint32_t segments, float maxErrorPixels)
+{
+    // Edge midpoints of the equator are the furthest from the sphere
+    float halfAngle = std::numbers::pi_v<float> / float(segments);
+    return maxErrorPixels / (1.0f - std::cos(halfAngle));
+}
+
+const MeshGL& LODChain::Select(float screenRadius)
+{
+    assert(!meshes.empty() && meshes.size() == minRadius.size());
+    uint32_t levelCount = uint32_t(meshes.size());
+    current = std::min(current, levelCount - 1);
+    while(current > 0 &&
+          screenRadius >= minRadius[current - 1] * (1.0f + hysteresis))
+        current--;
+    while(current + 1 < levelCount &&
+          screenRadius < minRadius[current] * (1.0f - hysteresis))
+        current++;
+    return *meshes[current];
+}
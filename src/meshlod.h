@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+struct MeshGL;
+
+// Screen space radius (in pixels) of a mesh that fits in the unit sphere.
+// Works for both perspective and orthographic projections; when the
+// camera is inside the sphere it covers the entire viewport height.
+float   ProjectedSphereRadius(const glm::mat4& proj, const glm::mat4& modelView,
+                              float viewportHeight);
+// Largest screen radius (in pixels) a UV sphere of "segments" can be drawn
+// with while its silhouette stays within "maxErrorPixels" of the sphere
+float   UVSphereMaxRadius(uint32_t segments, float maxErrorPixels);
+
+// Level of detail chain of a body. Meshes are ordered finest first and
+// level "i" is used while the projected radius is at least "minRadius[i]"
+// pixels (last one should be zero). Level only changes when the radius
+// crosses the threshold by "hysteresis" (relative), so that bodies
+// around a threshold do not pop back and forth every frame.
+// Chain holds the selection state, each view of a body (i.e. the camera
+// and the shadow pass) needs its own copy.
+struct LODChain
+{
+    std::vector<const MeshGL*>  meshes;
+    std::vector<float>          minRadius;
+    float                       hysteresis = 0.1f;
+    uint32_t                    current    = 0;
+
+    const MeshGL&               Select(float screenRadius);
+};
@@ -0,0 +1,373 @@
+#include "meshopt.h"
+#include "objparser.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace
+{
+
+// Forsyth's tuning values, see
+// "Linear-Speed Vertex Cache Optimisation" (Tom Forsyth, 2006)
+constexpr uint32_t  FORSYTH_CACHE_SIZE  = 32;
+constexpr float     CACHE_DECAY_POWER   = 1.5f;
+constexpr float     LAST_TRI_SCORE      = 0.75f;
+constexpr float     VALENCE_BOOST_SCALE = 2.0f;
+constexpr float     VALENCE_BOOST_POWER = 0.5f;
+constexpr uint32_t  VALENCE_TABLE_SIZE  = 64;
+
+struct ForsythTables
+{
+    std::array<float, FORSYTH_CACHE_SIZE> cache;
+    std::array<float, VALENCE_TABLE_SIZE> valence;
+
+    ForsythTables()
+    {
+        for(uint32_t i = 0; i < FORSYTH_CACHE_SIZE; i++)
+        {
+            // Last triangle's vertices get a fixed score so that the
+            // order inside the triangle does not matter
+            if(i < 3) cache[i] = LAST_TRI_SCORE;
+            else
+            {
+                float s = 1.0f - float(i - 3) / float(FORSYTH_CACHE_SIZE - 3);
+                cache[i] = std::pow(s, CACHE_DECAY_POWER);
+            }
+        }
+        valence[0] = 0.0f;
+        for(uint32_t i = 1; i < VALENCE_TABLE_SIZE; i++)
+            valence[i] = VALENCE_BOOST_SCALE * std::pow(float(i), -VALENCE_BOOST_POWER);
+    }
+
+    float VertexScore(int32_t cachePos, uint32_t remaining) const
+    {
+        // No triangle needs this vertex anymore
+        if(remaining == 0) return -1.0f;
+
+        float score = (cachePos >= 0) ? cache[uint32_t(cachePos)] : 0.0f;
+        score += (remaining < VALENCE_TABLE_SIZE)
+                    ? valence[remaining]
+                    : VALENCE_BOOST_SCALE * std::pow(float(remaining), -VALENCE_BOOST_POWER);
+        return score;
+    }
+};
+
+// Returns the triangle count (0-3) that missed the cache
+// for a FIFO cache simulation via timestamps
+inline uint32_t UpdateFIFO(std::vector<uint32_t>& timestamps, uint32_t& time,
+                           uint32_t cacheSize, const uint32_t* tri)
+{
+    uint32_t misses = 0;
+    for(uint32_t i = 0; i < 3; i++)
+    {
+        if(time - timestamps[tri[i]] > cacheSize)
+        {
+            timestamps[tri[i]] = time++;
+            misses++;
+        }
+    }
+    return misses;
+}
+
+}
+
+VertexCacheStats AnalyzeVertexCache(const std::vector<uint32_t>& indices,
+                                    uint32_t vertexCount, uint32_t cacheSize)
+{
+    VertexCacheStats stats;
+    if(indices.empty()) return stats;
+
+    std::vector<uint32_t> timestamps(vertexCount, 0);
+    std::vector<char> referenced(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+    size_t misses = 0;
+    for(size_t i = 0; i < indices.size(); i += 3)
+    {
+        misses += UpdateFIFO(timestamps, time, cacheSize, indices.data() + i);
+        for(size_t j = 0; j < 3; j++) referenced[indices[i + j]] = 1;
+    }
+    size_t usedVertices = size_t(std::count(referenced.begin(), referenced.end(), 1));
+
+    stats.acmr = float(misses) / float(indices.size() / 3);
+    stats.atvr = float(misses) / float(usedVertices);
+    return stats;
+}
+
+void OptimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount)
+{
+    static const ForsythTables Tables;
+    assert(indices.size() % 3 == 0);
+    size_t triCount = indices.size() / 3;
+    if(triCount == 0) return;
+
+    // Vertex -> triangle adjacency (CSR). Active triangles of vertex "v"
+    // are at [offsets[v], offsets[v] + remaining[v]), emitted ones are
+    // swapped out of that range.
+    std::vector<uint32_t> remaining(vertexCount, 0);
+    for(uint32_t i : indices) remaining[i]++;
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for(uint32_t v = 0; v < vertexCount; v++)
+        offsets[v + 1] = offsets[v] + remaining[v];
+    std::vector<uint32_t> adjacency(indices.size());
+    {
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for(size_t i = 0; i < indices.size(); i++)
+            adjacency[fill[indices[i]]++] = uint32_t(i / 3);
+    }
+
+    std::vector<int32_t> cachePos(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount);
+    for(uint32_t v = 0; v < vertexCount; v++)
+        vertexScore[v] = Tables.VertexScore(-1, remaining[v]);
+
+    std::vector<float> triScore(triCount);
+    for(size_t t = 0; t < triCount; t++)
+        triScore[t] = (vertexScore[indices[t * 3 + 0]] +
+                       vertexScore[indices[t * 3 + 1]] +
+                       vertexScore[indices[t * 3 + 2]]);
+    std::vector<char> emitted(triCount, 0);
+
+    // Cache can temporarily hold 3 more entries before eviction
+    std::array<uint32_t, FORSYTH_CACHE_SIZE + 3> cache;
+    std::array<uint32_t, FORSYTH_CACHE_SIZE + 3> newCache;
+    uint32_t cacheCount = 0;
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+
+    size_t bestTri = size_t(std::max_element(triScore.begin(), triScore.end()) -
+                            triScore.begin());
+    size_t deadEndCursor = 0;
+    for(size_t emitCount = 0; emitCount < triCount; emitCount++)
+    {
+        // Nothing in the cache has pending triangles, continue from
+        // the next unemitted triangle in the original order
+        if(bestTri == std::numeric_limits<size_t>::max())
+        {
+            while(emitted[deadEndCursor]) deadEndCursor++;
+            bestTri = deadEndCursor;
+        }
+
+        const uint32_t* tri = indices.data() + bestTri * 3;
+        result.insert(result.end(), tri, tri + 3);
+        emitted[bestTri] = 1;
+
+        // Remove the triangle from the adjacency of its vertices
+        for(uint32_t i = 0; i < 3; i++)
+        {
+            uint32_t v = tri[i];
+            uint32_t* begin = adjacency.data() + offsets[v];
+            uint32_t* end = begin + remaining[v];
+            uint32_t* it = std::find(begin, end, uint32_t(bestTri));
+            assert(it != end);
+            std::swap(*it, *(end - 1));
+            remaining[v]--;
+        }
+
+        // Move triangle's vertices to the front of the cache
+        uint32_t newCount = 0;
+        for(uint32_t i = 0; i < 3; i++) newCache[newCount++] = tri[i];
+        for(uint32_t i = 0; i < cacheCount; i++)
+        {
+            uint32_t v = cache[i];
+            if(v != tri[0] && v != tri[1] && v != tri[2])
+                newCache[newCount++] = v;
+        }
+        // Evicted ones lose their cache score
+        for(uint32_t i = FORSYTH_CACHE_SIZE; i < newCount; i++)
+            cachePos[newCache[i]] = -1;
+
+        // Update the scores, both of the cached and the evicted vertices
+        for(uint32_t i = 0; i < newCount; i++)
+        {
+            uint32_t v = newCache[i];
+            if(i < FORSYTH_CACHE_SIZE) cachePos[v] = int32_t(i);
+            float newScore = Tables.VertexScore(cachePos[v], remaining[v]);
+            float delta = newScore - vertexScore[v];
+            vertexScore[v] = newScore;
+            for(uint32_t j = 0; j < remaining[v]; j++)
+                triScore[adjacency[offsets[v] + j]] += delta;
+        }
+
+        cacheCount = std::min(newCount, FORSYTH_CACHE_SIZE);
+        std::copy(newCache.begin(), newCache.begin() + cacheCount, cache.begin());
+
+        // Next triangle is the best one that touches the cache
+        bestTri = std::numeric_limits<size_t>::max();
+        float bestScore = -std::numeric_limits<float>::max();
+        for(uint32_t i = 0; i < cacheCount; i++)
+        {
+            uint32_t v = cache[i];
+            for(uint32_t j = 0; j < remaining[v]; j++)
+            {
+                uint32_t t = adjacency[offsets[v] + j];
+                if(triScore[t] > bestScore)
+                {
+                    bestScore = triScore[t];
+                    bestTri = t;
+                }
+            }
+        }
+    }
+    indices = std::move(result);
+}
+
+uint32_t OptimizeOverdraw(std::vector<uint32_t>& indices,
+                          const MeshData& mesh, float threshold)
+{
+    static constexpr uint32_t CACHE_SIZE = 16;
+    size_t triCount = indices.size() / 3;
+    if(triCount == 0) return 0;
+
+    uint32_t vertexCount = uint32_t(mesh.positions.size());
+    float targetACMR = AnalyzeVertexCache(indices, vertexCount, CACHE_SIZE).acmr * threshold;
+
+    // ========================== //
+    //     FIND THE CLUSTERS      //
+    // ========================== //
+    // Hard boundaries are the cache flushes (all three vertices missed).
+    // Hard clusters are further split where the part so far, simulated
+    // with a cold cache, is already as efficient as the target ACMR.
+    // Then any cluster order costs at most "threshold" in cache efficiency.
+    std::vector<size_t> hardStarts;
+    std::vector<uint32_t> timestamps(vertexCount, 0);
+    uint32_t time = CACHE_SIZE + 1;
+    for(size_t t = 0; t < triCount; t++)
+    {
+        uint32_t misses = UpdateFIFO(timestamps, time, CACHE_SIZE,
+                                     indices.data() + t * 3);
+        if(t == 0 || misses == 3) hardStarts.push_back(t);
+    }
+    hardStarts.push_back(triCount);
+
+    std::vector<size_t> clusterStarts;
+    for(size_t h = 0; h + 1 < hardStarts.size(); h++)
+    {
+        size_t clusterMisses = 0;
+        size_t clusterTris = 0;
+        for(size_t t = hardStarts[h]; t < hardStarts[h + 1]; t++)
+        {
+            if(clusterTris == 0)
+            {
+                clusterStarts.push_back(t);
+                // Invalidate the whole cache
+                time += CACHE_SIZE + 1;
+            }
+            clusterMisses += UpdateFIFO(timestamps, time, CACHE_SIZE,
+                                        indices.data() + t * 3);
+            clusterTris++;
+            if(float(clusterMisses) <= targetACMR * float(clusterTris))
+                clusterTris = clusterMisses = 0;
+        }
+    }
+    uint32_t clusterCount = uint32_t(clusterStarts.size());
+    clusterStarts.push_back(triCount);
+
+    // ========================== //
+    //   SORT OUTSIDE TO INSIDE   //
+    // ========================== //
+    auto TriGeometry = [&](size_t t, glm::vec3& centroid, glm::vec3& areaNormal)
+    {
+        const glm::vec3& p0 = mesh.positions[indices[t * 3 + 0]];
+        const glm::vec3& p1 = mesh.positions[indices[t * 3 + 1]];
+        const glm::vec3& p2 = mesh.positions[indices[t * 3 + 2]];
+        centroid = (p0 + p1 + p2) / 3.0f;
+        areaNormal = glm::cross(p1 - p0, p2 - p0);
+    };
+
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for(size_t t = 0; t < triCount; t++)
+    {
+        glm::vec3 c, n;
+        TriGeometry(t, c, n);
+        float area = glm::length(n);
+        meshCentroid += c * area;
+        meshArea += area;
+    }
+    if(meshArea > 0.0f) meshCentroid /= meshArea;
+
+    std::vector<float> sortKeys(clusterCount);
+    for(uint32_t i = 0; i < clusterCount; i++)
+    {
+        glm::vec3 centroid(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for(size_t t = clusterStarts[i]; t < clusterStarts[i + 1]; t++)
+        {
+            glm::vec3 c, n;
+            TriGeometry(t, c, n);
+            float a = glm::length(n);
+            centroid += c * a;
+            normal += n;
+            area += a;
+        }
+        if(area > 0.0f) centroid /= area;
+        float normalLength = glm::length(normal);
+        if(normalLength > 0.0f) normal /= normalLength;
+        // Outward facing clusters that are far away from the center
+        // are the likely occluders, these go first
+        sortKeys[i] = glm::dot(centroid - meshCentroid, normal);
+    }
+
+    std::vector<uint32_t> order(clusterCount);
+    std::iota(order.begin(), order.end(), 0u);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+    {
+        return sortKeys[a] > sortKeys[b];
+    });
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    for(uint32_t c : order)
+        result.insert(result.end(),
+                      indices.begin() + std::ptrdiff_t(clusterStarts[c] * 3),
+                      indices.begin() + std::ptrdiff_t(clusterStarts[c + 1] * 3));
+    indices = std::move(result);
+    return clusterCount;
+}
+
+void OptimizeVertexFetch(MeshData& mesh)
+{
+    static constexpr uint32_t UNUSED = std::numeric_limits<uint32_t>::max();
+    size_t vertexCount = mesh.positions.size();
+    std::vector<uint32_t> remap(vertexCount, UNUSED);
+    uint32_t next = 0;
+    for(uint32_t& i : mesh.indices)
+    {
+        if(remap[i] == UNUSED) remap[i] = next++;
+        i = remap[i];
+    }
+
+    // Unreferenced vertices are dropped
+    std::vector<glm::vec3> positions(next), normals(next);
+    std::vector<glm::vec2> uvs(next);
+    for(size_t v = 0; v < vertexCount; v++)
+    {
+        if(remap[v] == UNUSED) continue;
+        positions[remap[v]] = mesh.positions[v];
+        normals[remap[v]] = mesh.normals[v];
+        uvs[remap[v]] = mesh.uvs[v];
+    }
+    mesh.positions = std::move(positions);
+    mesh.normals = std::move(normals);
+    mesh.uvs = std::move(uvs);
+}
+
+MeshOptStats OptimizeMesh(MeshData& mesh)
+{
+    MeshOptStats stats;
+    uint32_t vertexCount = uint32_t(mesh.positions.size());
+    stats.before = AnalyzeVertexCache(mesh.indices, vertexCount);
+
+    OptimizeVertexCache(mesh.indices, vertexCount);
+    stats.clusterCount = OptimizeOverdraw(mesh.indices, mesh);
+    OptimizeVertexFetch(mesh);
+
+    stats.after = AnalyzeVertexCache(mesh.indices,
+                                     uint32_t(mesh.positions.size()));
+    return stats;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+struct MeshData;
+
+// Post transform cache statistics of an index buffer.
+// ACMR: average cache miss ratio (vertex shader runs per triangle),
+//       1/2 is the practical optimum for regular meshes, 3 the worst.
+// ATVR: average transform to vertex ratio, 1 is the optimum.
+struct VertexCacheStats
+{
+    float acmr = 0.0f;
+    float atvr = 0.0f;
+};
+
+struct MeshOptStats
+{
+    VertexCacheStats before;
+    VertexCacheStats after;
+    uint32_t         clusterCount = 0;
+};
+
+// Simulates a FIFO post transform cache of the given size
+VertexCacheStats    AnalyzeVertexCache(const std::vector<uint32_t>& indices,
+                                       uint32_t vertexCount,
+                                       uint32_t cacheSize = 16);
+
+// Forsyth's linear-speed triangle reordering for a LRU cache.
+void                OptimizeVertexCache(std::vector<uint32_t>& indices,
+                                        uint32_t vertexCount);
+// Splits the (cache optimized) index buffer into clusters on cache
+// flushes and reorders the clusters front to back from the outside in
+// (Sander et al. "Fast triangle reordering for vertex locality and
+// reduced overdraw"). Clusters may only be split where the local ACMR
+// is within "threshold" of the whole mesh. Returns the cluster count.
+uint32_t            OptimizeOverdraw(std::vector<uint32_t>& indices,
+                                     const MeshData& mesh,
+                                     float threshold = 1.05f);
+// Renumbers the vertices in the order they are first referenced
+// by the index buffer, so vertex fetches become mostly sequential.
+void                OptimizeVertexFetch(MeshData& mesh);
+
+// Runs all of the above in order
+MeshOptStats        OptimizeMesh(MeshData& mesh);
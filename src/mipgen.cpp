@@ -0,0 +1,443 @@
+#include "mipgen.h"
+#include "texcache.h"
+#include "texcompress.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <functional>
+#include <numbers>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define CENG_MIP_SSE2
+    #include <emmintrin.h>
+#endif
+#if defined(__AVX__)
+    #define CENG_MIP_AVX
+    #include <immintrin.h>
+#endif
+
+namespace
+{
+
+// ======================= //
+//          sRGB           //
+// ======================= //
+float SRGBToLinear(float c)
+{
+    return (c <= 0.04045f) ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+float LinearToSRGB(float c)
+{
+    return (c <= 0.0031308f) ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+struct ConversionTables
+{
+    // Linear values are quantized to this many steps
+    // before they are encoded back to 8-bit sRGB
+    static constexpr uint32_t ENCODE_SIZE = 16384;
+
+    std::array<float, 256>          unorm;
+    std::array<float, 256>          toLinear;
+    std::array<uint8_t, ENCODE_SIZE> toSRGB;
+
+    ConversionTables()
+    {
+        for(uint32_t i = 0; i < 256; i++)
+        {
+            unorm[i] = float(i) / 255.0f;
+            toLinear[i] = SRGBToLinear(unorm[i]);
+        }
+        for(uint32_t i = 0; i < ENCODE_SIZE; i++)
+        {
+            float c = LinearToSRGB(float(i) / float(ENCODE_SIZE - 1));
+            toSRGB[i] = uint8_t(std::lround(c * 255.0f));
+        }
+    }
+};
+
+const ConversionTables& Tables()
+{
+    static const ConversionTables tables;
+    return tables;
+}
+
+// ======================= //
+//         Filters         //
+// ======================= //
+struct Kernel
+{
+    static constexpr uint32_t MAX_RADIUS = 4;
+
+    // Taps on each side of the destination texel center
+    uint32_t    radius;
+    float       weights[2 * MAX_RADIUS];
+};
+
+Kernel MakeKernel(MipSettings::Filter filter)
+{
+    Kernel k = {};
+    if(filter == MipSettings::BOX)
+    {
+        k.radius = 1;
+        k.weights[0] = k.weights[1] = 0.5f;
+        return k;
+    }
+
+    // Sinc windowed over 2 destination texels on each side
+    static constexpr double ALPHA = 4.0;
+    static constexpr double WIDTH = 2.0;
+    auto BesselI0 = [](double x)
+    {
+        double sum = 1.0, term = 1.0;
+        for(uint32_t i = 1; i < 16; i++)
+        {
+            double t = x / (2.0 * double(i));
+            term *= t * t;
+            sum += term;
+        }
+        return sum;
+    };
+    k.radius = Kernel::MAX_RADIUS;
+    double total = 0.0;
+    double weights[2 * Kernel::MAX_RADIUS];
+    for(uint32_t j = 0; j < 2 * k.radius; j++)
+    {
+        // Source texel distance in destination texels
+        double d = (double(j) - double(k.radius) + 0.5) * 0.5;
+        double x = std::numbers::pi * d;
+        double sinc = (d == 0.0) ? 1.0 : std::sin(x) / x;
+        double r = d / WIDTH;
+        double window = BesselI0(ALPHA * std::sqrt(std::max(0.0, 1.0 - r * r))) / BesselI0(ALPHA);
+        weights[j] = sinc * window;
+        total += weights[j];
+    }
+    for(uint32_t j = 0; j < 2 * k.radius; j++)
+        k.weights[j] = float(weights[j] / total);
+    return k;
+}
+
+// acc[i] += w * src[i]
+void MulAdd(float* acc, const float* src, float w, uint32_t n)
+{
+    uint32_t i = 0;
+    #if defined(CENG_MIP_AVX)
+        __m256 w8 = _mm256_set1_ps(w);
+        for(; i + 8 <= n; i += 8)
+        {
+            __m256 a = _mm256_loadu_ps(acc + i);
+            a = _mm256_add_ps(a, _mm256_mul_ps(w8, _mm256_loadu_ps(src + i)));
+            _mm256_storeu_ps(acc + i, a);
+        }
+    #elif defined(CENG_MIP_SSE2)
+        __m128 w4 = _mm_set1_ps(w);
+        for(; i + 4 <= n; i += 4)
+        {
+            __m128 a = _mm_loadu_ps(acc + i);
+            a = _mm_add_ps(a, _mm_mul_ps(w4, _mm_loadu_ps(src + i)));
+            _mm_storeu_ps(acc + i, a);
+        }
+    #endif
+    for(; i < n; i++) acc[i] += w * src[i];
+}
+
+// even[i] = src[2i], odd[i] = src[2i + 1] for i in [0, n)
+void Deinterleave(float* even, float* odd, const float* src, uint32_t n)
+{
+    uint32_t i = 0;
+    #if defined(CENG_MIP_SSE2)
+        for(; i + 4 <= n; i += 4)
+        {
+            __m128 a = _mm_loadu_ps(src + 2 * i);
+            __m128 b = _mm_loadu_ps(src + 2 * i + 4);
+            _mm_storeu_ps(even + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps(odd + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        }
+    #endif
+    for(; i < n; i++)
+    {
+        even[i] = src[2 * i];
+        odd[i] = src[2 * i + 1];
+    }
+}
+
+// ======================= //
+//         Levels          //
+// ======================= //
+struct ChainFormat
+{
+    uint32_t    channelCount;
+    bool        is16Bit;
+    // Leading channels that are sRGB encoded
+    uint32_t    colorCount;
+    // Index of the alpha channel, "channelCount" when there is none
+    uint32_t    alpha;
+};
+
+// Float texels of a level, one plane per channel
+struct FloatLevel
+{
+    uint32_t            width  = 0;
+    uint32_t            height = 0;
+    std::vector<float>  texels;
+
+    void Resize(uint32_t w, uint32_t h, uint32_t channelCount)
+    {
+        width = w;
+        height = h;
+        texels.resize(size_t(w) * h * channelCount);
+    }
+    float* Row(uint32_t c, uint32_t y)
+    {
+        return texels.data() + (size_t(c) * height + y) * width;
+    }
+    const float* Plane(uint32_t c) const
+    {
+        return texels.data() + size_t(c) * height * width;
+    }
+};
+
+// Row "y" of an integer level to one float row per channel
+void LoadRow(float* const rows[4], const std::byte* level, uint32_t width,
+             uint32_t y, const ChainFormat& f)
+{
+    const ConversionTables& tables = Tables();
+    size_t start = size_t(y) * width * f.channelCount;
+    for(uint32_t c = 0; c < f.channelCount; c++)
+    {
+        bool isColor = (c < f.colorCount);
+        if(f.is16Bit)
+        {
+            const uint16_t* src = reinterpret_cast<const uint16_t*>(level) + start + c;
+            for(uint32_t x = 0; x < width; x++)
+            {
+                float v = float(src[size_t(x) * f.channelCount]) / 65535.0f;
+                rows[c][x] = isColor ? SRGBToLinear(v) : v;
+            }
+        }
+        else
+        {
+            const uint8_t* src = reinterpret_cast<const uint8_t*>(level) + start + c;
+            const float* lut = isColor ? tables.toLinear.data() : tables.unorm.data();
+            for(uint32_t x = 0; x < width; x++)
+                rows[c][x] = lut[src[size_t(x) * f.channelCount]];
+        }
+    }
+}
+
+void StoreRow(std::byte* level, uint32_t width, uint32_t y,
+              const float* const rows[4], const ChainFormat& f, float alphaScale)
+{
+    const ConversionTables& tables = Tables();
+    size_t start = size_t(y) * width * f.channelCount;
+    for(uint32_t c = 0; c < f.channelCount; c++)
+    {
+        bool isColor = (c < f.colorCount);
+        float scale = (c == f.alpha) ? alphaScale : 1.0f;
+        const float* src = rows[c];
+        if(f.is16Bit)
+        {
+            uint16_t* dst = reinterpret_cast<uint16_t*>(level) + start + c;
+            for(uint32_t x = 0; x < width; x++)
+            {
+                // Negative lobes of the filter may overshoot
+                float v = std::clamp(src[x] * scale, 0.0f, 1.0f);
+                if(isColor) v = LinearToSRGB(v);
+                dst[size_t(x) * f.channelCount] = uint16_t(v * 65535.0f + 0.5f);
+            }
+            continue;
+        }
+
+        // Linear values are quantized to the encode table steps
+        uint8_t* dst = reinterpret_cast<uint8_t*>(level) + start + c;
+        float steps = isColor ? float(ConversionTables::ENCODE_SIZE - 1) : 255.0f;
+        uint32_t x = 0;
+        #if defined(CENG_MIP_SSE2)
+            __m128 mul = _mm_set1_ps(scale * steps);
+            __m128 hi = _mm_set1_ps(steps);
+            for(; x + 4 <= width; x += 4)
+            {
+                __m128 v = _mm_mul_ps(_mm_loadu_ps(src + x), mul);
+                v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), hi);
+                alignas(16) int32_t q[4];
+                _mm_store_si128(reinterpret_cast<__m128i*>(q),
+                                _mm_cvttps_epi32(_mm_add_ps(v, _mm_set1_ps(0.5f))));
+                for(uint32_t k = 0; k < 4; k++)
+                {
+                    size_t i = size_t(x + k) * f.channelCount;
+                    dst[i] = isColor ? tables.toSRGB[uint32_t(q[k])] : uint8_t(q[k]);
+                }
+            }
+        #endif
+        for(; x < width; x++)
+        {
+            float v = std::clamp(src[x] * scale, 0.0f, 1.0f);
+            uint32_t q = uint32_t(v * steps + 0.5f);
+            dst[size_t(x) * f.channelCount] = isColor ? tables.toSRGB[q] : uint8_t(q);
+        }
+    }
+}
+
+// Calls "f(first, last)" for bands of rows, bands run on the pool
+void ForRowBands(uint32_t rowCount, ThreadPool* pool,
+                 const std::function<void(uint32_t, uint32_t)>& f)
+{
+    static constexpr uint32_t BAND_SIZE = 16;
+    uint32_t bandCount = (rowCount + BAND_SIZE - 1) / BAND_SIZE;
+    auto Band = [&](uint32_t b)
+    {
+        f(b * BAND_SIZE, std::min(rowCount, (b + 1) * BAND_SIZE));
+    };
+    if(pool && bandCount > 1) pool->ParallelFor(bandCount, Band);
+    else for(uint32_t b = 0; b < bandCount; b++) Band(b);
+}
+
+// Fraction of the texels whose alpha is above "ref" after "scale"
+float Coverage(const float* alpha, size_t count, float scale, float ref)
+{
+    size_t covered = 0;
+    for(size_t i = 0; i < count; i++)
+        covered += (alpha[i] * scale > ref) ? 1u : 0u;
+    return float(covered) / float(count);
+}
+
+// Alpha scale that brings the coverage of the level to "target"
+float CoverageScale(const float* alpha, size_t count, float ref, float target)
+{
+    float lo = 0.0f, hi = 4.0f;
+    for(uint32_t i = 0; i < 16; i++)
+    {
+        float mid = 0.5f * (lo + hi);
+        if(Coverage(alpha, count, mid, ref) < target) lo = mid;
+        else hi = mid;
+    }
+    return 0.5f * (lo + hi);
+}
+
+}
+
+void GenerateMips(std::byte* levels, const TextureLayout& layout,
+                  const MipSettings& settings, ThreadPool* pool)
+{
+    assert(!IsBlockCompressed(layout.format));
+    ChainFormat f = {};
+    f.channelCount = ChannelCount(layout.format);
+    f.is16Bit = (layout.format >= TextureLayout::R16);
+    f.alpha = (f.channelCount == 2 || f.channelCount == 4) ? f.channelCount - 1 : f.channelCount;
+    f.colorCount = settings.linearLight ? std::min(f.alpha, 3u) : 0u;
+
+    // Coverage of level 0 is the target of the rest
+    bool keepCoverage = (f.alpha < f.channelCount && settings.alphaCoverage > 0.0f);
+    float targetCoverage = 0.0f;
+    if(keepCoverage)
+    {
+        std::vector<float> row[4];
+        float* rows[4] = {};
+        for(uint32_t c = 0; c < f.channelCount; c++)
+        {
+            row[c].resize(layout.width);
+            rows[c] = row[c].data();
+        }
+        for(uint32_t y = 0; y < layout.height; y++)
+        {
+            LoadRow(rows, levels + layout.levelOffsets[0], layout.width, y, f);
+            targetCoverage += Coverage(rows[f.alpha], layout.width, 1.0f, settings.alphaCoverage);
+        }
+        targetCoverage /= float(layout.height);
+    }
+
+    const Kernel kernel = MakeKernel(settings.filter);
+    const uint32_t r = kernel.radius;
+    FloatLevel src, dst;
+    for(uint32_t i = 1; i < layout.mipCount; i++)
+    {
+        uint32_t srcWidth = std::max(1u, layout.width >> (i - 1));
+        uint32_t srcHeight = std::max(1u, layout.height >> (i - 1));
+        uint32_t dstWidth = std::max(1u, layout.width >> i);
+        uint32_t dstHeight = std::max(1u, layout.height >> i);
+        dst.Resize(dstWidth, dstHeight, f.channelCount);
+
+        ForRowBands(dstHeight, pool, [&](uint32_t first, uint32_t last)
+        {
+            // Source rows of the band; level 0 rows are converted
+            // once, others are read from the previous float level
+            int64_t rowFirst = std::max(int64_t(2 * first + 1) - int64_t(r), int64_t(0));
+            int64_t rowLast = std::min(int64_t(2 * last) + int64_t(r), int64_t(srcHeight));
+            uint32_t bandRows = uint32_t(rowLast - rowFirst);
+            std::vector<float> loaded;
+            if(i == 1)
+            {
+                loaded.resize(size_t(f.channelCount) * bandRows * srcWidth);
+                for(uint32_t row = 0; row < bandRows; row++)
+                {
+                    float* rows[4] = {};
+                    for(uint32_t c = 0; c < f.channelCount; c++)
+                        rows[c] = loaded.data() + (size_t(c) * bandRows + row) * srcWidth;
+                    LoadRow(rows, levels + layout.levelOffsets[0], srcWidth,
+                            uint32_t(rowFirst) + row, f);
+                }
+            }
+            auto SourceRow = [&](uint32_t c, uint32_t row) -> const float*
+            {
+                if(i != 1) return src.Row(c, row);
+                return loaded.data() + (size_t(c) * bandRows + (row - uint32_t(rowFirst))) * srcWidth;
+            };
+
+            // Vertical pass result is padded by the radius on both
+            // sides; horizontal taps read it as even / odd halves
+            uint32_t padded = srcWidth + 2 * r + 2;
+            uint32_t halfCount = dstWidth + r;
+            std::vector<float> scratch(size_t(padded) + 2 * size_t(halfCount));
+            float* vertical = scratch.data();
+            float* even = vertical + padded;
+            float* odd = even + halfCount;
+
+            for(uint32_t y = first; y < last; y++)
+            for(uint32_t c = 0; c < f.channelCount; c++)
+            {
+                std::fill_n(vertical, padded, 0.0f);
+                for(uint32_t j = 0; j < 2 * r; j++)
+                {
+                    int64_t sy = int64_t(2 * y + 1 + j) - int64_t(r);
+                    uint32_t row = uint32_t(std::clamp(sy, int64_t(0), int64_t(srcHeight - 1)));
+                    MulAdd(vertical + r, SourceRow(c, row), kernel.weights[j], srcWidth);
+                }
+
+                std::fill_n(vertical, r, vertical[r]);
+                std::fill(vertical + r + srcWidth, vertical + 2 * halfCount,
+                          vertical[r + srcWidth - 1]);
+                Deinterleave(even, odd, vertical, halfCount);
+
+                float* out = dst.Row(c, y);
+                std::fill_n(out, dstWidth, 0.0f);
+                for(uint32_t j = 0; j < 2 * r; j++)
+                {
+                    const float* taps = (j % 2 == 0) ? (odd + j / 2) : (even + j / 2 + 1);
+                    MulAdd(out, taps, kernel.weights[j], dstWidth);
+                }
+            }
+        });
+
+        float alphaScale = 1.0f;
+        if(keepCoverage)
+            alphaScale = CoverageScale(dst.Plane(f.alpha), size_t(dstWidth) * dstHeight,
+                                       settings.alphaCoverage, targetCoverage);
+
+        std::byte* level = levels + layout.levelOffsets[i];
+        ForRowBands(dstHeight, pool, [&](uint32_t first, uint32_t last)
+        {
+            for(uint32_t y = first; y < last; y++)
+            {
+                const float* rows[4] = {};
+                for(uint32_t c = 0; c < f.channelCount; c++) rows[c] = dst.Row(c, y);
+                StoreRow(level, dstWidth, y, rows, f, alphaScale);
+            }
+        });
+        std::swap(src, dst);
+    }
+}
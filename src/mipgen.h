@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+class ThreadPool;
+struct TextureLayout;
+
+// How the mip chain of a texture is filtered
+struct MipSettings
+{
+    enum Filter : uint32_t
+    {
+        BOX,        // 2x2 average
+        KAISER      // Kaiser windowed sinc, 8x8 taps
+    };
+
+    Filter  filter          = KAISER;
+    // Color channels are sRGB encoded, they are
+    // averaged in linear light
+    bool    linearLight     = false;
+    // Alpha test reference, the fraction of the texels above
+    // it is kept through the chain (0 disables it)
+    float   alphaCoverage   = 0.0f;
+
+    bool    operator==(const MipSettings&) const = default;
+};
+
+// Fills levels [1, mipCount) of an uncompressed chain from level 0.
+// Level i starts at "levels + layout.levelOffsets[i]". Texels are filtered
+// as float (SSE2 / AVX when the target has them), each level is made from
+// the float result of the previous one. Rows are distributed over the pool
+// when it is given, the pool must not be the one that runs the caller.
+void    GenerateMips(std::byte* levels, const TextureLayout& layout,
+                     const MipSettings& settings, ThreadPool* pool = nullptr);
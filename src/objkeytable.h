@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <utility>
+#include <vector>
+#include <bit>
+
+// For mesh multiple index hashing
+struct ObjKeyType
+{
+    uint32_t posIndex;
+    uint32_t uvIndex;
+    uint32_t normalIndex;
+
+    bool operator==(const ObjKeyType& other) const
+    {
+        return (posIndex == other.posIndex &&
+                uvIndex == other.uvIndex &&
+                normalIndex == other.normalIndex);
+    }
+};
+
+// Mixes all 96 bits of the key into a 64-bit hash. Obj indices are small
+// and highly correlated (pos/uv/normal indices usually move together),
+// a linear combination of them collides a lot.
+inline uint64_t HashObjKey(const ObjKeyType& k)
+{
+    uint64_t lo = uint64_t(k.posIndex) | (uint64_t(k.uvIndex) << 32);
+    uint64_t hi = uint64_t(k.normalIndex);
+    uint64_t h = (lo * 0x9E3779B97F4A7C15ull) ^ ((hi + 0x632BE59BD9B4E019ull) *
+                                                 0xC2B2AE3D27D4EB4Full);
+    // murmur3 finalizer
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+// Flat open addressing (linear probing) map of ObjKeyType -> uint32_t.
+// Keys and values are stored inline in a single power of two array,
+// there is no per element allocation. Table grows when it is more than
+// 3/4 full, but it is meant to be sized up front from the record counts.
+class ObjKeyTable
+{
+    private:
+    // Positions are mandatory, so this can not be a valid key
+    static constexpr uint32_t EMPTY = std::numeric_limits<uint32_t>::max();
+
+    struct Slot
+    {
+        ObjKeyType  key;
+        uint32_t    value;
+    };
+    static_assert(sizeof(Slot) == 16, "Slot should be 16 bytes");
+
+    std::vector<Slot>   slots;
+    uint32_t            shift = 64;
+    size_t              count = 0;
+
+    void        Allocate(size_t expectedCount);
+    void        Grow();
+
+    public:
+    explicit    ObjKeyTable(size_t expectedCount);
+
+    // Inserts the key with "value" if it does not exist.
+    // Returns the stored value and whether the insertion happened
+    std::pair<uint32_t, bool>   Insert(const ObjKeyType& key, uint32_t value);
+    size_t                      Size() const { return count; }
+};
+
+inline ObjKeyTable::ObjKeyTable(size_t expectedCount)
+{
+    Allocate(expectedCount);
+}
+
+inline void ObjKeyTable::Allocate(size_t expectedCount)
+{
+    // At most 3/4 full
+    size_t capacity = std::bit_ceil(std::max(size_t(16), expectedCount * 4 / 3 + 1));
+    slots.assign(capacity, Slot{ObjKeyType{EMPTY, EMPTY, EMPTY}, 0});
+    shift = uint32_t(64 - std::countr_zero(capacity));
+    count = 0;
+}
+
+inline void ObjKeyTable::Grow()
+{
+    std::vector<Slot> oldSlots = std::move(slots);
+    Allocate(oldSlots.size());
+    for(const Slot& s : oldSlots)
+        if(s.key.posIndex != EMPTY) Insert(s.key, s.value);
+}
+
+inline std::pair<uint32_t, bool> ObjKeyTable::Insert(const ObjKeyType& key,
+                                                     uint32_t value)
+{
+    if((count + 1) * 4 > slots.size() * 3) Grow();
+
+    // High bits of the hash select the slot
+    size_t mask = slots.size() - 1;
+    size_t i = size_t(HashObjKey(key) >> shift);
+    while(true)
+    {
+        Slot& s = slots[i];
+        if(s.key.posIndex == EMPTY)
+        {
+            s.key = key;
+            s.value = value;
+            count++;
+            return {value, true};
+        }
+        if(s.key == key) return {s.value, false};
+        i = (i + 1) & mask;
+    }
+}
@@ -0,0 +1,547 @@
+#include "objparser.h"
+#include "filemap.h"
+#include "threadpool.h"
+#include "objkeytable.h"
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <charconv>
+#include <limits>
+
+namespace
+{
+
+constexpr uint32_t OBJ_NO_INDEX = std::numeric_limits<uint32_t>::max();
+
+inline bool IsBlank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+inline const char* SkipBlanks(const char* p, const char* end)
+{
+    while(p != end && IsBlank(*p)) p++;
+    return p;
+}
+
+// Returns null if the token is not a valid float
+inline const char* ParseFloat(float& out, const char* p, const char* end)
+{
+    p = SkipBlanks(p, end);
+    // "from_chars" does not accept the explicit plus sign
+    if(p != end && *p == '+') p++;
+    auto result = std::from_chars(p, end, out);
+    return (result.ec == std::errc()) ? result.ptr : nullptr;
+}
+
+// Obj indices are one-based, negative ones are relative
+// to the current end of the respective array.
+// Returns null if the token is not an integer or out of range.
+inline const char* ParseIndex(uint32_t& out, const char* p, const char* end,
+                              size_t elementCount)
+{
+    int64_t objIndex = 0;
+    auto result = std::from_chars(p, end, objIndex);
+    if(result.ec != std::errc()) return nullptr;
+
+    int64_t i = (objIndex < 0) ? int64_t(elementCount) + objIndex
+                               : objIndex - 1;
+    if(i < 0 || i >= int64_t(elementCount)) return nullptr;
+    out = uint32_t(i);
+    return result.ptr;
+}
+
+// Parses "p", "p/t", "p//n" or "p/t/n"
+inline const char* ParseCorner(ObjKeyType& key, const char* p, const char* end,
+                               size_t posCount, size_t uvCount,
+                               size_t normalCount)
+{
+    key = ObjKeyType{OBJ_NO_INDEX, OBJ_NO_INDEX, OBJ_NO_INDEX};
+    p = ParseIndex(key.posIndex, p, end, posCount);
+    if(!p || p == end || *p != '/') return p;
+    // UV (optional)
+    p++;
+    if(p != end && *p != '/')
+    {
+        p = ParseIndex(key.uvIndex, p, end, uvCount);
+        if(!p) return nullptr;
+    }
+    // Normal (optional)
+    if(p != end && *p == '/')
+    {
+        p = ParseIndex(key.normalIndex, p + 1, end, normalCount);
+    }
+    return p;
+}
+
+// Record counts of a range of the obj text
+struct ObjCounts
+{
+    size_t   positions = 0;
+    size_t   uvs       = 0;
+    size_t   normals   = 0;
+    // Face corners after triangulation
+    size_t   corners   = 0;
+    uint32_t lines     = 0;
+
+    ObjCounts& operator+=(const ObjCounts& other)
+    {
+        positions += other.positions;
+        uvs += other.uvs;
+        normals += other.normals;
+        corners += other.corners;
+        lines += other.lines;
+        return *this;
+    }
+};
+
+// Raw (multi indexed) records of the obj file. These are sized by
+// the counting pass up front, so each chunk writes to its own slice.
+struct ObjRecords
+{
+    std::vector<glm::vec3>  positions;
+    std::vector<glm::vec3>  normals;
+    std::vector<glm::vec2>  uvs;
+    std::vector<ObjKeyType> corners;
+
+    ObjRecords(const ObjCounts& c)
+        : positions(c.positions)
+        , normals(c.normals)
+        , uvs(c.uvs)
+        , corners(c.corners)
+    {}
+};
+
+struct ObjError
+{
+    uint32_t    line   = 0;
+    const char* reason = nullptr;
+};
+
+enum class ObjRecordType
+{
+    POSITION,
+    UV,
+    NORMAL,
+    FACE,
+    OTHER
+};
+
+// Calls "f(type, dataStart, lineEnd)" for each line in [p, end).
+// "end" must be the end of the file or just after a new line.
+template<class Func>
+inline bool ForEachRecord(const char* p, const char* end, Func&& f)
+{
+    while(p != end)
+    {
+        const void* nl = std::memchr(p, '\n', size_t(end - p));
+        const char* lineEnd = nl ? static_cast<const char*>(nl) : end;
+        const char* nextLine = nl ? lineEnd + 1 : end;
+        if(lineEnd != p && lineEnd[-1] == '\r') lineEnd--;
+
+        p = SkipBlanks(p, lineEnd);
+        size_t length = size_t(lineEnd - p);
+        ObjRecordType type = ObjRecordType::OTHER;
+        const char* data = p;
+        if(length >= 2 && p[0] == 'v' && IsBlank(p[1]))
+        {
+            type = ObjRecordType::POSITION;
+            data = p + 2;
+        }
+        else if(length >= 3 && p[0] == 'v' && p[1] == 't' && IsBlank(p[2]))
+        {
+            type = ObjRecordType::UV;
+            data = p + 3;
+        }
+        else if(length >= 3 && p[0] == 'v' && p[1] == 'n' && IsBlank(p[2]))
+        {
+            type = ObjRecordType::NORMAL;
+            data = p + 3;
+        }
+        else if(length >= 2 && p[0] == 'f' && IsBlank(p[1]))
+        {
+            type = ObjRecordType::FACE;
+            data = p + 2;
+        }
+        if(!f(type, data, lineEnd)) return false;
+        p = nextLine;
+    }
+    return true;
+}
+
+ObjCounts CountRecords(const char* begin, const char* end)
+{
+    ObjCounts counts;
+    ForEachRecord(begin, end, [&counts](ObjRecordType type, const char* p,
+                                        const char* lineEnd)
+    {
+        counts.lines++;
+        switch(type)
+        {
+            case ObjRecordType::POSITION:   counts.positions++; break;
+            case ObjRecordType::UV:         counts.uvs++;       break;
+            case ObjRecordType::NORMAL:     counts.normals++;   break;
+            case ObjRecordType::FACE:
+            {
+                size_t tokens = 0;
+                while((p = SkipBlanks(p, lineEnd)) != lineEnd)
+                {
+                    tokens++;
+                    while(p != lineEnd && !IsBlank(*p)) p++;
+                }
+                if(tokens >= 3) counts.corners += (tokens - 2) * 3;
+                break;
+            }
+            case ObjRecordType::OTHER:      break;
+        }
+        return true;
+    });
+    return counts;
+}
+
+// Parses the records in [begin, end) into "out". "base" holds the
+// counts of the preceding text, it is the write offset of this range
+// and the reference point of the relative indices.
+bool ParseRecords(ObjRecords& out, ObjError& err,
+                  const char* begin, const char* end, const ObjCounts& base)
+{
+    ObjCounts c = base;
+    return ForEachRecord(begin, end, [&](ObjRecordType type, const char* p,
+                                         const char* lineEnd)
+    {
+        c.lines++;
+        switch(type)
+        {
+            case ObjRecordType::POSITION:
+            {
+                glm::vec3& pos = out.positions[c.positions++];
+                if(!(p = ParseFloat(pos[0], p, lineEnd)) ||
+                   !(p = ParseFloat(pos[1], p, lineEnd)) ||
+                   !(p = ParseFloat(pos[2], p, lineEnd)))
+                {
+                    err = ObjError{c.lines, "malformed position"};
+                    return false;
+                }
+                break;
+            }
+            case ObjRecordType::UV:
+            {
+                glm::vec2& uv = out.uvs[c.uvs++];
+                if(!(p = ParseFloat(uv[0], p, lineEnd)) ||
+                   !(p = ParseFloat(uv[1], p, lineEnd)))
+                {
+                    err = ObjError{c.lines, "malformed uv"};
+                    return false;
+                }
+                break;
+            }
+            case ObjRecordType::NORMAL:
+            {
+                glm::vec3& normal = out.normals[c.normals++];
+                if(!(p = ParseFloat(normal[0], p, lineEnd)) ||
+                   !(p = ParseFloat(normal[1], p, lineEnd)) ||
+                   !(p = ParseFloat(normal[2], p, lineEnd)))
+                {
+                    err = ObjError{c.lines, "malformed normal"};
+                    return false;
+                }
+                break;
+            }
+            case ObjRecordType::FACE:
+            {
+                // Polygons are fan triangulated
+                ObjKeyType first = {}, prev = {};
+                uint32_t cornerCount = 0;
+                while((p = SkipBlanks(p, lineEnd)) != lineEnd)
+                {
+                    ObjKeyType key;
+                    p = ParseCorner(key, p, lineEnd, c.positions,
+                                    c.uvs, c.normals);
+                    if(!p || (p != lineEnd && !IsBlank(*p)))
+                    {
+                        err = ObjError{c.lines, "malformed or out of range face index"};
+                        return false;
+                    }
+
+                    if(cornerCount >= 2)
+                    {
+                        out.corners[c.corners++] = first;
+                        out.corners[c.corners++] = prev;
+                        out.corners[c.corners++] = key;
+                    }
+                    if(cornerCount == 0) first = key;
+                    prev = key;
+                    cornerCount++;
+                }
+                if(cornerCount < 3)
+                {
+                    err = ObjError{c.lines, "face has less than three corners"};
+                    return false;
+                }
+                break;
+            }
+            case ObjRecordType::OTHER: break;
+        }
+        return true;
+    });
+}
+
+// Writes the attributes of the unique vertices in [start, end)
+void Linearize(MeshData& out, bool& missingUVs, bool& missingNormals,
+               const ObjRecords& records,
+               const std::vector<ObjKeyType>& uniqueKeys,
+               size_t start, size_t end)
+{
+    for(size_t i = start; i < end; i++)
+    {
+        const ObjKeyType& key = uniqueKeys[i];
+        out.positions[i] = records.positions[key.posIndex];
+        if(key.uvIndex != OBJ_NO_INDEX)
+            out.uvs[i] = records.uvs[key.uvIndex];
+        else
+        {
+            missingUVs = true;
+            out.uvs[i] = glm::vec2(0);
+        }
+        //
+        if(key.normalIndex != OBJ_NO_INDEX)
+            out.normals[i] = records.normals[key.normalIndex];
+        else
+        {
+            missingNormals = true;
+            out.normals[i] = glm::vec3(0);
+        }
+    }
+}
+
+// Unique vertex count estimate for sizing the dedup tables.
+// Every attribute record is usually referenced at least once, so the
+// largest attribute count is close to the vertex count (seams add a few).
+// Corner count is the hard upper bound.
+size_t EstimateVertexCount(const ObjCounts& c)
+{
+    size_t attribMax = std::max({c.positions, c.uvs, c.normals});
+    return std::min(c.corners, attribMax + attribMax / 4);
+}
+
+bool ReportError(const char* name, const ObjError& err)
+{
+    std::fprintf(stderr, "Unable to parse obj file \"%s\" (line %u): %s\n",
+                 name, err.line, err.reason);
+    return false;
+}
+
+}
+
+bool ParseObj(MeshData& out, const std::string& objPath)
+{
+    MappedFile file(objPath);
+    if(!file)
+    {
+        std::fprintf(stderr, "Unable to open obj file \"%s\"\n",
+                     objPath.c_str());
+        return false;
+    }
+    return ParseObj(out, file.data, file.size, objPath.c_str());
+}
+
+bool ParseObj(MeshData& out, const char* data, size_t size,
+              const char* name)
+{
+    const char* const end = data + size;
+    out = MeshData();
+
+    ObjCounts counts = CountRecords(data, end);
+    ObjRecords records(counts);
+    ObjError err;
+    if(!ParseRecords(records, err, data, end, ObjCounts{}))
+        return ReportError(name, err);
+
+    // Deduplicate the corners, vertices are numbered
+    // in the order of their first occurrence
+    size_t vertexEstimate = EstimateVertexCount(counts);
+    std::vector<ObjKeyType> uniqueKeys; uniqueKeys.reserve(vertexEstimate);
+    ObjKeyTable indexHashes(vertexEstimate);
+    out.indices.resize(records.corners.size());
+    for(size_t i = 0; i < records.corners.size(); i++)
+    {
+        const ObjKeyType& key = records.corners[i];
+        auto insertR = indexHashes.Insert(key, uint32_t(uniqueKeys.size()));
+        if(insertR.second) uniqueKeys.push_back(key);
+        out.indices[i] = insertR.first;
+    }
+
+    // Convert the data to single indexed mode
+    out.positions.resize(uniqueKeys.size());
+    out.normals.resize(uniqueKeys.size());
+    out.uvs.resize(uniqueKeys.size());
+    Linearize(out, out.missingUVs, out.missingNormals, records,
+              uniqueKeys, 0, uniqueKeys.size());
+    return true;
+}
+
+bool ParseObjParallel(MeshData& out, const std::string& objPath,
+                      ThreadPool& pool)
+{
+    MappedFile file(objPath);
+    if(!file)
+    {
+        std::fprintf(stderr, "Unable to open obj file \"%s\"\n",
+                     objPath.c_str());
+        return false;
+    }
+    return ParseObjParallel(out, file.data, file.size, objPath.c_str(), pool);
+}
+
+bool ParseObjParallel(MeshData& out, const char* data, size_t size,
+                      const char* name, ThreadPool& pool)
+{
+    // Few chunks per thread for load balancing,
+    // small files are not worth splitting much
+    static constexpr size_t MIN_CHUNK_SIZE = 64 * 1024;
+    const char* const end = data + size;
+    out = MeshData();
+
+    // ===================== //
+    //  NEWLINE ALIGNED SPLIT //
+    // ===================== //
+    size_t chunkCount = std::max(size_t(1), std::min(size_t(pool.ThreadCount()) * 4,
+                                                     size / MIN_CHUNK_SIZE));
+    std::vector<const char*> bounds;
+    bounds.reserve(chunkCount + 1);
+    bounds.push_back(data);
+    for(size_t i = 1; i < chunkCount; i++)
+    {
+        const char* p = std::max(data + size * i / chunkCount, bounds.back());
+        const void* nl = std::memchr(p, '\n', size_t(end - p));
+        bounds.push_back(nl ? static_cast<const char*>(nl) + 1 : end);
+    }
+    bounds.push_back(end);
+
+    // ===================== //
+    //    COUNT & PREFIX     //
+    // ===================== //
+    std::vector<ObjCounts> bases(chunkCount + 1);
+    pool.ParallelFor(uint32_t(chunkCount), [&](uint32_t i)
+    {
+        bases[i + 1] = CountRecords(bounds[i], bounds[i + 1]);
+    });
+    for(size_t i = 1; i <= chunkCount; i++)
+        bases[i] += bases[i - 1];
+
+    // ===================== //
+    //     PARSE RECORDS     //
+    // ===================== //
+    ObjRecords records(bases.back());
+    std::vector<ObjError> errors(chunkCount);
+    std::vector<char> chunkFailed(chunkCount, 0);
+    pool.ParallelFor(uint32_t(chunkCount), [&](uint32_t i)
+    {
+        chunkFailed[i] = !ParseRecords(records, errors[i], bounds[i],
+                                       bounds[i + 1], bases[i]);
+    });
+    // Report the first error in the file, same as the serial parser
+    for(size_t i = 0; i < chunkCount; i++)
+        if(chunkFailed[i]) return ReportError(name, errors[i]);
+
+    // ===================== //
+    //  SHARDED DEDUPLICATE  //
+    // ===================== //
+    // Corners are bucketed into shards by their hash, every shard
+    // is deduplicated by a single thread in corner order. This gives the
+    // first occurrence of each key. Vertices are then numbered in the
+    // order of their first occurrence, exactly like the serial version.
+    const std::vector<ObjKeyType>& corners = records.corners;
+    size_t cornerCount = corners.size();
+    uint32_t shardCount = pool.ThreadCount();
+    uint32_t rangeCount = uint32_t(std::max(size_t(1), std::min(size_t(pool.ThreadCount()) * 4,
+                                                                cornerCount / 4096)));
+    auto RangeStart = [&](uint32_t r)
+    {
+        return cornerCount * r / rangeCount;
+    };
+    // Tables use the high bits of the hash, shards use the low bits
+    auto ShardOf = [shardCount](const ObjKeyType& key)
+    {
+        return uint32_t(uint32_t(HashObjKey(key)) % shardCount);
+    };
+    size_t shardEstimate = EstimateVertexCount(bases.back()) / shardCount;
+
+    std::vector<std::vector<uint32_t>> buckets(size_t(rangeCount) * shardCount);
+    pool.ParallelFor(rangeCount, [&](uint32_t r)
+    {
+        for(size_t c = RangeStart(r); c < RangeStart(r + 1); c++)
+            buckets[size_t(r) * shardCount + ShardOf(corners[c])].push_back(uint32_t(c));
+    });
+
+    std::vector<uint32_t> firstCorner(cornerCount);
+    pool.ParallelFor(shardCount, [&](uint32_t s)
+    {
+        size_t shardSize = 0;
+        for(uint32_t r = 0; r < rangeCount; r++)
+            shardSize += buckets[size_t(r) * shardCount + s].size();
+
+        ObjKeyTable shardHashes(std::min(shardSize, shardEstimate + shardEstimate / 8));
+        for(uint32_t r = 0; r < rangeCount; r++)
+        for(uint32_t c : buckets[size_t(r) * shardCount + s])
+        {
+            auto insertR = shardHashes.Insert(corners[c], c);
+            firstCorner[c] = insertR.first;
+        }
+    });
+    buckets = std::vector<std::vector<uint32_t>>();
+
+    std::vector<size_t> vertexBases(rangeCount + 1, 0);
+    pool.ParallelFor(rangeCount, [&](uint32_t r)
+    {
+        size_t newCount = 0;
+        for(size_t c = RangeStart(r); c < RangeStart(r + 1); c++)
+            newCount += (firstCorner[c] == c) ? 1u : 0u;
+        vertexBases[r + 1] = newCount;
+    });
+    for(uint32_t r = 1; r <= rangeCount; r++)
+        vertexBases[r] += vertexBases[r - 1];
+
+    std::vector<ObjKeyType> uniqueKeys(vertexBases.back());
+    out.indices.resize(cornerCount);
+    pool.ParallelFor(rangeCount, [&](uint32_t r)
+    {
+        uint32_t vertexId = uint32_t(vertexBases[r]);
+        for(size_t c = RangeStart(r); c < RangeStart(r + 1); c++)
+        {
+            if(firstCorner[c] != c) continue;
+            uniqueKeys[vertexId] = corners[c];
+            out.indices[c] = vertexId++;
+        }
+    });
+    pool.ParallelFor(rangeCount, [&](uint32_t r)
+    {
+        for(size_t c = RangeStart(r); c < RangeStart(r + 1); c++)
+            if(firstCorner[c] != c) out.indices[c] = out.indices[firstCorner[c]];
+    });
+
+    // ===================== //
+    //      LINEARIZE        //
+    // ===================== //
+    size_t vertexCount = uniqueKeys.size();
+    out.positions.resize(vertexCount);
+    out.normals.resize(vertexCount);
+    out.uvs.resize(vertexCount);
+    std::vector<char> missingUVs(rangeCount, 0), missingNormals(rangeCount, 0);
+    pool.ParallelFor(rangeCount, [&](uint32_t r)
+    {
+        bool mUV = false, mNormal = false;
+        Linearize(out, mUV, mNormal, records, uniqueKeys,
+                  vertexCount * r / rangeCount,
+                  vertexCount * (r + 1) / rangeCount);
+        missingUVs[r] = mUV;
+        missingNormals[r] = mNormal;
+    });
+    for(uint32_t r = 0; r < rangeCount; r++)
+    {
+        out.missingUVs |= bool(missingUVs[r]);
+        out.missingNormals |= bool(missingNormals[r]);
+    }
+    return true;
+}
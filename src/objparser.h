@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+class ThreadPool;
+
+// CPU side single indexed mesh, this is what "MeshGL" uploads.
+// Positions, normals and uvs are parallel arrays (one entry per vertex).
+struct MeshData
+{
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> uvs;
+    std::vector<uint32_t>  indices;
+    // Some face corners did not reference these,
+    // such attributes are written as zero.
+    bool missingNormals = false;
+    bool missingUVs     = false;
+};
+
+// Wavefront obj parser. File is memory mapped and scanned in place,
+// there is no per-line or per-corner allocation.
+// Only "v", "vt", "vn" and "f" records are considered; polygons are
+// fan triangulated and negative (relative) indices are supported.
+// Returns false and prints the reason on failure.
+bool ParseObj(MeshData& out, const std::string& objPath);
+// Same as above but works on an in-memory obj text,
+// "name" is only used for error reporting.
+bool ParseObj(MeshData& out, const char* data, size_t size,
+              const char* name);
+
+// Parallel variant of the above. Text is split into newline aligned
+// chunks that are parsed on the pool; corners are then deduplicated on
+// a sharded hash table. Output is byte-identical to "ParseObj".
+bool ParseObjParallel(MeshData& out, const std::string& objPath,
+                      ThreadPool& pool);
+bool ParseObjParallel(MeshData& out, const char* data, size_t size,
+                      const char* name, ThreadPool& pool);
@@ -0,0 +1,92 @@
+#include "programcache.h"
+#include "filemap.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+bool ProgramBinarySupported()
+{
+    GLint formatCount = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    return formatCount > 0;
+}
+
+std::string ProgramCachePath(const std::string& shaderPath,
+                             const std::string& permutationKey)
+{
+    if(permutationKey.empty()) return shaderPath + ".progbin";
+
+    char hash[17];
+    std::snprintf(hash, sizeof(hash), "%016llx",
+                  static_cast<unsigned long long>(HashBytes(permutationKey.data(),
+                                                            permutationKey.size())));
+    return shaderPath + "." + hash + ".progbin";
+}
+
+uint64_t DriverHash()
+{
+    static constexpr GLenum NAMES[] = {GL_VENDOR, GL_RENDERER, GL_VERSION};
+    uint64_t hash = 0;
+    for(GLenum name : NAMES)
+    {
+        const char* str = reinterpret_cast<const char*>(glGetString(name));
+        if(str) hash = HashBytes(str, std::strlen(str), hash);
+    }
+    return hash;
+}
+
+bool LoadProgramCache(GLuint program, const std::string& cachePath,
+                      GLenum stage, uint64_t sourceHash)
+{
+    if(!ProgramBinarySupported()) return false;
+
+    MappedFile file(cachePath);
+    if(!file || file.size < sizeof(ProgramCacheHeader)) return false;
+
+    ProgramCacheHeader header;
+    std::memcpy(&header, file.data, sizeof(ProgramCacheHeader));
+    if(std::memcmp(header.magic, ProgramCacheHeader::MAGIC, sizeof(header.magic)) != 0 ||
+       header.version != ProgramCacheHeader::VERSION ||
+       header.stage != stage ||
+       header.sourceHash != sourceHash ||
+       header.driverHash != DriverHash() ||
+       sizeof(ProgramCacheHeader) + uint64_t(header.binarySize) > file.size)
+        return false;
+
+    glProgramBinary(program, GLenum(header.binaryFormat),
+                    file.data + sizeof(ProgramCacheHeader),
+                    GLsizei(header.binarySize));
+    GLint isLinked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &isLinked);
+    return isLinked == GL_TRUE;
+}
+
+bool WriteProgramCache(const std::string& cachePath, GLuint program,
+                       GLenum stage, uint64_t sourceHash)
+{
+    if(!ProgramBinarySupported()) return false;
+
+    GLint binarySize = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binarySize);
+    if(binarySize <= 0) return false;
+
+    std::vector<std::byte> binary(static_cast<size_t>(binarySize));
+    GLenum binaryFormat = 0;
+    glGetProgramBinary(program, binarySize, &binarySize, &binaryFormat, binary.data());
+
+    ProgramCacheHeader header = {};
+    std::memcpy(header.magic, ProgramCacheHeader::MAGIC, sizeof(header.magic));
+    header.version = ProgramCacheHeader::VERSION;
+    header.stage = stage;
+    header.sourceHash = sourceHash;
+    header.driverHash = DriverHash();
+    header.binaryFormat = binaryFormat;
+    header.binarySize = uint32_t(binarySize);
+    return WriteFileAtomic(cachePath,
+    {
+        FileChunk{&header, sizeof(ProgramCacheHeader)},
+        FileChunk{binary.data(), size_t(binarySize)}
+    });
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+#include <glad/glad.h>
+
+// ======================= //
+//   PROGRAM BINARY CACHE  //
+// ======================= //
+// ".progbin" file is a header followed by the "glGetProgramBinary" output
+// of a single stage separable program. Binaries are only valid on the
+// driver that produced them, so the header holds the hash of the exact
+// source text that was compiled (includes and defines expanded) and the
+// hash of the GL vendor, renderer and version strings. A driver may
+// still reject a binary with matching strings (i.e. after an update),
+// then the program is compiled from source and the cache is written again.
+struct ProgramCacheHeader
+{
+    static constexpr char     MAGIC[8] = {'P', 'R', 'O', 'G', 'B', 'I', 'N', '\0'};
+    static constexpr uint32_t VERSION  = 1;
+
+    char        magic[8];
+    uint32_t    version;
+    // Shader stage (GL_VERTEX_SHADER, ...)
+    uint32_t    stage;
+    uint64_t    sourceHash;
+    uint64_t    driverHash;
+    uint32_t    binaryFormat;
+    uint32_t    binarySize;
+};
+
+// False when the driver has no binary formats (i.e. Mesa with its
+// own shader cache disabled), the cache is not used then
+bool        ProgramBinarySupported();
+// "shaders/planet.frag" -> "shaders/planet.frag.progbin", permutations
+// (see "PermutationKey") are "shaders/planet.frag.<key hash>.progbin"
+std::string ProgramCachePath(const std::string& shaderPath,
+                             const std::string& permutationKey = "");
+// Hash of the strings that identify the driver of the current context
+uint64_t    DriverHash();
+
+// Loads the binary into "program" (which must be separable and not yet
+// linked), returns false when the cache does not exist, is stale or when
+// the driver rejects it. A rejected program object must not be reused.
+bool        LoadProgramCache(GLuint program, const std::string& cachePath,
+                             GLenum stage, uint64_t sourceHash);
+// "program" must be linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+bool        WriteProgramCache(const std::string& cachePath, GLuint program,
+                              GLenum stage, uint64_t sourceHash);
@@ -0,0 +1,185 @@
+#include "shaderreload.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+#ifdef __linux__
+    #include <sys/inotify.h>
+    #include <unistd.h>
+#endif
+
+bool ShaderReloader::ReadStamps(std::vector<FileStamp>& out,
+                                const std::vector<std::string>& files)
+{
+    out.resize(files.size());
+    for(size_t i = 0; i < files.size(); i++)
+        if(!GetFileStamp(out[i], files[i])) return false;
+    return true;
+}
+
+void ShaderReloader::RestampFiles(std::vector<FileStamp>& stamps,
+                                  const std::vector<std::string>& previousFiles,
+                                  const std::vector<std::string>& files)
+{
+    std::vector<FileStamp> out(files.size());
+    for(size_t i = 0; i < files.size(); i++)
+    {
+        auto it = std::find(previousFiles.begin(), previousFiles.end(), files[i]);
+        size_t previous = size_t(it - previousFiles.begin());
+        if(it != previousFiles.end() && previous < stamps.size())
+            out[i] = stamps[previous];
+        else
+            GetFileStamp(out[i], files[i]);
+    }
+    stamps = std::move(out);
+}
+
+void ShaderReloader::WatchDirectories()
+{
+    #ifdef __linux__
+    if(notifyFd < 0) return;
+
+    for(const Watched& w : watched)
+    for(const std::string& file : w.shader->files)
+    {
+        std::string dir = std::filesystem::path(file).parent_path().generic_string();
+        auto it = std::find_if(directories.begin(), directories.end(),
+                               [&](const WatchedDirectory& d) { return d.path == dir; });
+        if(it != directories.end()) continue;
+
+        // Editors often save to a temporary file and rename it
+        // over the source, the directory sees both kinds of writes
+        int watchId = inotify_add_watch(notifyFd, dir.empty() ? "." : dir.c_str(),
+                                        IN_CLOSE_WRITE | IN_MOVED_TO);
+        if(watchId < 0)
+        {
+            std::printf("[WARNING]: Unable to watch \"%s\", shaders are polled.\n",
+                        dir.c_str());
+            close(notifyFd);
+            notifyFd = -1;
+            directories.clear();
+            return;
+        }
+        directories.push_back(WatchedDirectory{watchId, dir});
+    }
+    #endif
+}
+
+bool ShaderReloader::ReadEvents()
+{
+    #ifdef __linux__
+    if(notifyFd < 0) return false;
+
+    alignas(inotify_event) char buffer[4096];
+    ssize_t readSize;
+    while((readSize = read(notifyFd, buffer, sizeof(buffer))) > 0)
+    {
+        for(size_t offset = 0; offset < size_t(readSize);)
+        {
+            inotify_event event;
+            std::memcpy(&event, buffer + offset, sizeof(inotify_event));
+            const char* name = buffer + offset + sizeof(inotify_event);
+            offset += sizeof(inotify_event) + event.len;
+
+            // Events are dropped, any file may have changed
+            if(event.mask & IN_Q_OVERFLOW)
+            {
+                for(Watched& w : watched) w.dirty = true;
+                continue;
+            }
+            auto dir = std::find_if(directories.begin(), directories.end(),
+                                    [&](const WatchedDirectory& d) { return d.watchId == event.wd; });
+            if(dir == directories.end() || event.len == 0) continue;
+
+            std::string file = dir->path.empty() ? std::string(name) : dir->path + "/" + name;
+            for(Watched& w : watched)
+                if(std::find(w.shader->files.begin(), w.shader->files.end(), file) != w.shader->files.end())
+                    w.dirty = true;
+        }
+    }
+    return true;
+    #else
+    return false;
+    #endif
+}
+
+ShaderReloader::ShaderReloader(std::initializer_list<ShaderGL*> shaders)
+    : lastPoll(std::chrono::steady_clock::now())
+{
+    watched.reserve(shaders.size());
+    for(ShaderGL* shader : shaders)
+    {
+        Watched w = {shader, {}, nullptr, ShaderGL()};
+        ReadStamps(w.stamps, shader->files);
+        watched.push_back(std::move(w));
+    }
+
+    #ifdef __linux__
+    notifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(notifyFd < 0) std::printf("[WARNING]: inotify is not available, shaders are polled.\n");
+    WatchDirectories();
+    #endif
+}
+
+ShaderReloader::~ShaderReloader()
+{
+    for(Watched& w : watched)
+        if(w.batch) w.batch->Finish(false);
+    #ifdef __linux__
+    if(notifyFd >= 0) close(notifyFd);
+    #endif
+}
+
+void ShaderReloader::Update()
+{
+    for(Watched& w : watched)
+    {
+        if(!w.batch || !w.batch->IsReady()) continue;
+
+        if(w.batch->Finish(false))
+        {
+            // Includes may be added or removed by the edit, the others
+            // keep the stamps of the rebuild start so that an edit saved
+            // during the rebuild starts another one
+            std::vector<std::string> previousFiles = std::move(w.shader->files);
+            *w.shader = std::move(w.candidate);
+            RestampFiles(w.stamps, previousFiles, w.shader->files);
+            WatchDirectories();
+            std::printf("Shader \"%s\" is reloaded.\n", w.shader->path.c_str());
+        }
+        else
+        {
+            std::printf("[WARNING]: Shader \"%s\" is not reloaded, "
+                        "previous program is kept.\n", w.shader->path.c_str());
+            w.candidate = ShaderGL();
+        }
+        w.batch.reset();
+    }
+
+    if(!ReadEvents())
+    {
+        auto now = std::chrono::steady_clock::now();
+        if(now - lastPoll < POLL_INTERVAL) return;
+        lastPoll = now;
+        for(Watched& w : watched) w.dirty = true;
+    }
+
+    // Editors may replace the file while saving, a file that is
+    // missing for a moment is picked up by its next event (or poll).
+    // Changes during a rebuild start another one after it is swapped.
+    std::vector<FileStamp> stamps;
+    for(Watched& w : watched)
+    {
+        if(!w.dirty || w.batch) continue;
+
+        w.dirty = false;
+        if(!ReadStamps(stamps, w.shader->files) || stamps == w.stamps)
+            continue;
+
+        w.stamps = stamps;
+        w.batch = std::make_unique<ShaderBatch>();
+        w.candidate = w.batch->Add(w.shader->type, w.shader->path, w.shader->defines);
+    }
+}
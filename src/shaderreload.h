@@ -0,0 +1,78 @@
+#pragma once
+
+#include <chrono>
+#include <initializer_list>
+#include <memory>
+#include <vector>
+
+#include "utility.h"
+#include "filemap.h"
+
+// Rebuilds the shaders whose source changes while the program runs. On
+// Linux the directories of the sources (and their includes) are watched
+// with inotify, elsewhere the files are polled every "POLL_INTERVAL". A
+// file is changed when its size / modification time differs, the shader
+// is rebuilt in the background (see "ShaderBatch") and swapped into its
+// "ShaderGL" by a later "Update" once the driver is done, so the next
+// "glUseProgramStages" of the frame picks it up. When the new source fails
+// to compile or link, the error is printed and the old program stays.
+class ShaderReloader
+{
+    public:
+    // Without inotify
+    static constexpr std::chrono::milliseconds POLL_INTERVAL{250};
+
+    private:
+    struct Watched
+    {
+        ShaderGL*                       shader;
+        // One per "ShaderGL::files"
+        std::vector<FileStamp>          stamps;
+        // In flight rebuild, null when there is none
+        std::unique_ptr<ShaderBatch>    batch;
+        ShaderGL                        candidate;
+        // A file may have changed, stamps are compared once
+        // there is no rebuild in flight
+        bool                            dirty = false;
+    };
+    struct WatchedDirectory
+    {
+        int                             watchId;
+        std::string                     path;
+    };
+
+    std::vector<Watched>                    watched;
+    std::chrono::steady_clock::time_point   lastPoll;
+    // inotify instance, -1 when the files are polled
+    int                                     notifyFd = -1;
+    std::vector<WatchedDirectory>           directories;
+
+    // Adds the directories of the watched files that are not watched
+    // yet (i.e. a new include), no-op without inotify
+    void                WatchDirectories();
+    // Marks the shaders of the changed files dirty, false
+    // when the files must be polled instead
+    bool                ReadEvents();
+
+    // False when a file is missing
+    static bool         ReadStamps(std::vector<FileStamp>& out,
+                                   const std::vector<std::string>& files);
+    // Stamps of "files" after a swap; files that are also in
+    // "previousFiles" keep their stamp, new ones are read
+    static void         RestampFiles(std::vector<FileStamp>& stamps,
+                                     const std::vector<std::string>& previousFiles,
+                                     const std::vector<std::string>& files);
+
+    public:
+    // Constructors, Movement & Destructor
+    // Shaders must outlive the reloader
+    explicit            ShaderReloader(std::initializer_list<ShaderGL*> shaders);
+                        ShaderReloader(const ShaderReloader&) = delete;
+                        ShaderReloader(ShaderReloader&&) = delete;
+    ShaderReloader&     operator=(const ShaderReloader&) = delete;
+    ShaderReloader&     operator=(ShaderReloader&&) = delete;
+                        ~ShaderReloader();
+
+    // Once per frame before the draws, must be called on the context thread
+    void                Update();
+};
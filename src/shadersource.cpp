@@ -0,0 +1,139 @@
+#include "shadersource.h"
+
+#include <cstdio>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string_view>
+
+namespace
+{
+
+bool ReadText(std::string& out, const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if(!file) return false;
+    std::ostringstream text;
+    text << file.rdbuf();
+    out = std::move(text).str();
+    return true;
+}
+
+std::string_view Directive(std::string_view line, std::string_view name)
+{
+    size_t i = line.find_first_not_of(" \t");
+    if(i == std::string_view::npos || line.substr(i, name.size()) != name)
+        return {};
+    return line.substr(i + name.size());
+}
+
+// "#include "name"" -> "name", empty for the other lines
+std::string_view IncludeName(std::string_view line)
+{
+    std::string_view rest = Directive(line, "#include");
+    size_t open = rest.find('"');
+    if(open == std::string_view::npos) return {};
+    size_t close = rest.find('"', open + 1);
+    if(close == std::string_view::npos) return {};
+    return rest.substr(open + 1, close - open - 1);
+}
+
+std::string LineDirective(size_t line, size_t fileIndex)
+{
+    return "#line " + std::to_string(line) + " " + std::to_string(fileIndex) + "\n";
+}
+
+std::string DefineLines(const ShaderDefines& defines)
+{
+    std::string lines;
+    for(const std::string& d : defines)
+    {
+        size_t eq = d.find('=');
+        if(eq == std::string::npos) lines += "#define " + d + " 1\n";
+        else lines += "#define " + d.substr(0, eq) + " " + d.substr(eq + 1) + "\n";
+    }
+    return lines;
+}
+
+// Defines are given for the main file only, these are cleared once written
+bool Expand(ShaderSource& out, const std::string& path, const std::string& text,
+            size_t fileIndex, const ShaderDefines*& defines)
+{
+    size_t lineNumber = 0;
+    size_t pos = 0;
+    while(pos < text.size())
+    {
+        size_t end = std::min(text.find('\n', pos), text.size());
+        std::string_view line(text.data() + pos, end - pos);
+        pos = end + 1;
+        lineNumber++;
+
+        std::string_view include = IncludeName(line);
+        if(include.empty())
+        {
+            out.text.append(line);
+            out.text += '\n';
+            if(defines && !Directive(line, "#version").empty())
+            {
+                out.text += DefineLines(*defines);
+                out.text += LineDirective(lineNumber + 1, fileIndex);
+                defines = nullptr;
+            }
+            continue;
+        }
+
+        namespace fs = std::filesystem;
+        std::string includePath = (fs::path(path).parent_path() / include).lexically_normal().generic_string();
+        if(std::find(out.files.begin(), out.files.end(), includePath) == out.files.end())
+        {
+            std::string includeText;
+            if(!ReadText(includeText, includePath))
+            {
+                std::fprintf(stderr, "Unable to open shader include \"%s\" of \"%s\".\n",
+                             includePath.c_str(), path.c_str());
+                return false;
+            }
+            size_t includeIndex = out.files.size();
+            out.files.push_back(includePath);
+            out.text += LineDirective(1, includeIndex);
+            if(!Expand(out, includePath, includeText, includeIndex, defines))
+                return false;
+        }
+        out.text += LineDirective(lineNumber + 1, fileIndex);
+    }
+    return true;
+}
+
+}
+
+bool ExpandShaderSource(ShaderSource& out, const std::string& path,
+                        const ShaderDefines& defines)
+{
+    std::string text;
+    if(!ReadText(text, path))
+    {
+        std::fprintf(stderr, "Unable to open shader file at \"%s\".\n", path.c_str());
+        return false;
+    }
+
+    out.text.clear();
+    out.files = {std::filesystem::path(path).lexically_normal().generic_string()};
+    const ShaderDefines* pendingDefines = defines.empty() ? nullptr : &defines;
+    if(!Expand(out, path, text, 0, pendingDefines)) return false;
+    // No "#version" line, these go on top
+    if(pendingDefines)
+        out.text = DefineLines(defines) + LineDirective(1, 0) + out.text;
+    return true;
+}
+
+std::string PermutationKey(const ShaderDefines& defines)
+{
+    std::string key;
+    for(const std::string& d : defines)
+    {
+        if(!key.empty()) key += ' ';
+        key += d;
+    }
+    return key;
+}
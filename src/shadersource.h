@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// ======================= //
+//   GLSL PREPROCESSING    //
+// ======================= //
+// "#include "file"" lines are replaced with the file, paths are relative
+// to the including file and a file is included once per shader (later
+// includes of it are dropped). Defines are inserted right after the
+// "#version" line; "NAME=VALUE" becomes "#define NAME VALUE" and "NAME"
+// becomes "#define NAME 1". "#line" directives keep the line numbers of
+// the compiler log, the source string number of a file is its index in
+// "files".
+using ShaderDefines = std::vector<std::string>;
+
+struct ShaderSource
+{
+    std::string                 text;
+    // Main file first, then the includes in the order they are found
+    std::vector<std::string>    files;
+};
+
+// Prints the error and returns false when a file can not be read
+bool        ExpandShaderSource(ShaderSource& out, const std::string& path,
+                               const ShaderDefines& defines);
+// Name of a permutation, "SPECULAR_MAP=1 NIGHT_LIGHTS=1" (empty
+// without defines). Order matters, a permutation must always be
+// given with its defines in the same order.
+std::string PermutationKey(const ShaderDefines& defines);
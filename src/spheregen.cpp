@@ -0,0 +1,299 @@
+#include "spheregen.h"
+#include "objparser.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <numbers>
+
+namespace
+{
+
+constexpr float PI = std::numbers::pi_v<float>;
+
+// Equirectangular mapping of a point on the unit sphere, u is in [0, 1)
+glm::vec2 SphericalUV(const glm::vec3& p)
+{
+    float u = std::atan2(-p.z, p.x) / (2.0f * PI);
+    if(u < 0.0f) u += 1.0f;
+    float v = std::acos(std::clamp(-p.y, -1.0f, 1.0f)) / PI;
+    return glm::vec2(u, v);
+}
+
+uint32_t PushVertex(MeshData& mesh, const glm::vec3& p, const glm::vec2& uv)
+{
+    mesh.positions.push_back(p);
+    mesh.normals.push_back(p);
+    mesh.uvs.push_back(uv);
+    return uint32_t(mesh.positions.size() - 1);
+}
+
+// Ico and cube spheres do not have edges on the u = 0 meridian, and their
+// pole vertices are shared between triangles of different longitudes.
+// Triangles that cross the meridian get copies of their u < 0.5 vertices
+// shifted by +1 (texture repeats, quantization uses the uv bounds) and
+// every triangle gets its own pole vertex with the mean u of the others.
+void SplitUVSeam(MeshData& mesh)
+{
+    static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+    auto IsPole = [&](uint32_t v)
+    {
+        const glm::vec3& p = mesh.positions[v];
+        return (p.x * p.x + p.z * p.z) < 1e-12f;
+    };
+
+    std::vector<uint32_t> wrapped(mesh.positions.size(), NONE);
+    for(size_t t = 0; t < mesh.indices.size(); t += 3)
+    {
+        uint32_t* tri = mesh.indices.data() + t;
+        float uMin = 1.0f, uMax = 0.0f;
+        for(uint32_t i = 0; i < 3; i++)
+        {
+            if(IsPole(tri[i])) continue;
+            uMin = std::min(uMin, mesh.uvs[tri[i]].x);
+            uMax = std::max(uMax, mesh.uvs[tri[i]].x);
+        }
+
+        float uSum = 0.0f;
+        uint32_t uCount = 0;
+        for(uint32_t i = 0; i < 3; i++)
+        {
+            uint32_t v = tri[i];
+            if(IsPole(v)) continue;
+            if(uMax - uMin > 0.5f && mesh.uvs[v].x < 0.5f)
+            {
+                if(wrapped[v] == NONE)
+                {
+                    glm::vec2 uv = mesh.uvs[v] + glm::vec2(1.0f, 0.0f);
+                    wrapped[v] = PushVertex(mesh, mesh.positions[v], uv);
+                }
+                tri[i] = wrapped[v];
+            }
+            uSum += mesh.uvs[tri[i]].x;
+            uCount++;
+        }
+
+        for(uint32_t i = 0; i < 3; i++)
+        {
+            uint32_t v = tri[i];
+            if(!IsPole(v)) continue;
+            glm::vec2 uv(uSum / float(uCount), mesh.uvs[v].y);
+            tri[i] = PushVertex(mesh, mesh.positions[v], uv);
+        }
+    }
+}
+
+}
+
+MeshData GenerateUVSphere(uint32_t segments, uint32_t rings)
+{
+    assert(segments >= 3 && rings >= 2);
+    MeshData mesh;
+    size_t vertexCount = 2 * segments + size_t(rings - 1) * (segments + 1);
+    mesh.positions.reserve(vertexCount);
+    mesh.normals.reserve(vertexCount);
+    mesh.uvs.reserve(vertexCount);
+    mesh.indices.reserve(size_t(segments) * (rings - 1) * 6);
+
+    std::vector<float> sinPhi(segments + 1), cosPhi(segments + 1);
+    for(uint32_t s = 0; s <= segments; s++)
+    {
+        float phi = 2.0f * PI * float(s) / float(segments);
+        sinPhi[s] = std::sin(phi);
+        cosPhi[s] = std::cos(phi);
+    }
+    // Last column is the seam duplicate of the first one
+    sinPhi[segments] = sinPhi[0];
+    cosPhi[segments] = cosPhi[0];
+
+    // Poles have a vertex per segment so that every
+    // cap triangle gets its own u
+    auto PushPole = [&](float y, float v)
+    {
+        uint32_t first = uint32_t(mesh.positions.size());
+        for(uint32_t s = 0; s < segments; s++)
+            PushVertex(mesh, glm::vec3(0.0f, y, 0.0f),
+                       glm::vec2((float(s) + 0.5f) / float(segments), v));
+        return first;
+    };
+
+    uint32_t southPole = PushPole(-1.0f, 0.0f);
+    uint32_t firstRing = uint32_t(mesh.positions.size());
+    for(uint32_t r = 1; r < rings; r++)
+    {
+        float v = float(r) / float(rings);
+        float theta = PI * v;
+        float y = -std::cos(theta);
+        float radius = std::sin(theta);
+        for(uint32_t s = 0; s <= segments; s++)
+        {
+            glm::vec3 p(radius * cosPhi[s], y, -radius * sinPhi[s]);
+            PushVertex(mesh, p, glm::vec2(float(s) / float(segments), v));
+        }
+    }
+    uint32_t northPole = PushPole(1.0f, 1.0f);
+
+    auto Ring = [&](uint32_t r, uint32_t s)
+    {
+        return firstRing + (r - 1) * (segments + 1) + s;
+    };
+    auto PushTri = [&](uint32_t a, uint32_t b, uint32_t c)
+    {
+        mesh.indices.insert(mesh.indices.end(), {a, b, c});
+    };
+    for(uint32_t s = 0; s < segments; s++)
+        PushTri(southPole + s, Ring(1, s + 1), Ring(1, s));
+    for(uint32_t r = 1; r + 1 < rings; r++)
+    for(uint32_t s = 0; s < segments; s++)
+    {
+        PushTri(Ring(r, s), Ring(r, s + 1), Ring(r + 1, s));
+        PushTri(Ring(r + 1, s), Ring(r, s + 1), Ring(r + 1, s + 1));
+    }
+    for(uint32_t s = 0; s < segments; s++)
+        PushTri(Ring(rings - 1, s), Ring(rings - 1, s + 1), northPole + s);
+    return mesh;
+}
+
+MeshData GenerateIcoSphere(uint32_t frequency)
+{
+    assert(frequency >= 1);
+    // Poles are on the icosahedron vertices, two rings of five in between
+    std::array<glm::vec3, 12> corners;
+    corners[0] = glm::vec3(0.0f, 1.0f, 0.0f);
+    corners[11] = glm::vec3(0.0f, -1.0f, 0.0f);
+    float ringY = 1.0f / std::sqrt(5.0f);
+    float ringRadius = 2.0f / std::sqrt(5.0f);
+    for(uint32_t k = 0; k < 5; k++)
+    {
+        float upper = 2.0f * PI * float(k) / 5.0f;
+        float lower = upper + PI / 5.0f;
+        corners[1 + k] = glm::vec3(ringRadius * std::cos(upper), ringY,
+                                   -ringRadius * std::sin(upper));
+        corners[6 + k] = glm::vec3(ringRadius * std::cos(lower), -ringY,
+                                   -ringRadius * std::sin(lower));
+    }
+    std::array<std::array<uint32_t, 3>, 20> faces;
+    for(uint32_t k = 0; k < 5; k++)
+    {
+        uint32_t k1 = (k + 1) % 5;
+        faces[k * 4 + 0] = {0, 1 + k, 1 + k1};
+        faces[k * 4 + 1] = {1 + k, 6 + k, 1 + k1};
+        faces[k * 4 + 2] = {1 + k1, 6 + k, 6 + k1};
+        faces[k * 4 + 3] = {11, 6 + k1, 6 + k};
+    }
+
+    MeshData mesh;
+    size_t faceVertexCount = size_t(frequency + 1) * (frequency + 2) / 2;
+    mesh.positions.reserve(20 * faceVertexCount);
+    mesh.normals.reserve(20 * faceVertexCount);
+    mesh.uvs.reserve(20 * faceVertexCount);
+    mesh.indices.reserve(20 * size_t(frequency) * frequency * 3);
+    for(std::array<uint32_t, 3> f : faces)
+    {
+        // Counter clockwise when seen from outside
+        const glm::vec3& a = corners[f[0]];
+        if(glm::dot(glm::cross(corners[f[1]] - a, corners[f[2]] - a), a) < 0.0f)
+            std::swap(f[1], f[2]);
+
+        // Triangular grid; row "i" goes from corner 0 towards the
+        // 1-2 edge, column "j" from the 0-1 edge towards 0-2.
+        // Edge vertices are not shared between the faces, instead they
+        // are summed in the global corner order so the duplicates
+        // have the exact same position (no cracks).
+        uint32_t first = uint32_t(mesh.positions.size());
+        std::array<uint32_t, 3> order = {0, 1, 2};
+        std::sort(order.begin(), order.end(), [&](uint32_t x, uint32_t y)
+        {
+            return f[x] < f[y];
+        });
+        for(uint32_t i = 0; i <= frequency; i++)
+        for(uint32_t j = 0; j <= i; j++)
+        {
+            std::array<uint32_t, 3> weights = {frequency - i, i - j, j};
+            glm::vec3 p(0.0f);
+            for(uint32_t c : order)
+                p += float(weights[c]) * corners[f[c]];
+            p = glm::normalize(p);
+            PushVertex(mesh, p, SphericalUV(p));
+        }
+
+        auto Grid = [&](uint32_t i, uint32_t j)
+        {
+            return first + i * (i + 1) / 2 + j;
+        };
+        for(uint32_t i = 0; i < frequency; i++)
+        for(uint32_t j = 0; j <= i; j++)
+        {
+            mesh.indices.insert(mesh.indices.end(),
+                                {Grid(i, j), Grid(i + 1, j), Grid(i + 1, j + 1)});
+            if(j < i)
+                mesh.indices.insert(mesh.indices.end(),
+                                    {Grid(i, j), Grid(i + 1, j + 1), Grid(i, j + 1)});
+        }
+    }
+    SplitUVSeam(mesh);
+    return mesh;
+}
+
+MeshData GenerateCubeSphere(uint32_t divisions)
+{
+    assert(divisions >= 1);
+    // Face normal, then the grid axes (cross(u, v) == normal)
+    using IVec3 = std::array<int32_t, 3>;
+    static constexpr std::array<std::array<IVec3, 3>, 6> Faces =
+    {{
+        {{{ 1, 0, 0}, {0, 0, -1}, {0, 1,  0}}},
+        {{{-1, 0, 0}, {0, 0,  1}, {0, 1,  0}}},
+        {{{ 0, 1, 0}, {1, 0,  0}, {0, 0, -1}}},
+        {{{ 0,-1, 0}, {1, 0,  0}, {0, 0,  1}}},
+        {{{ 0, 0, 1}, {1, 0,  0}, {0, 1,  0}}},
+        {{{ 0, 0,-1}, {-1, 0, 0}, {0, 1,  0}}}
+    }};
+
+    MeshData mesh;
+    size_t faceVertexCount = size_t(divisions + 1) * (divisions + 1);
+    mesh.positions.reserve(6 * faceVertexCount);
+    mesh.normals.reserve(6 * faceVertexCount);
+    mesh.uvs.reserve(6 * faceVertexCount);
+    mesh.indices.reserve(6 * size_t(divisions) * divisions * 6);
+
+    int32_t n = int32_t(divisions);
+    for(const std::array<IVec3, 3>& face : Faces)
+    {
+        // Grid is computed in integer cube coordinates ([-n, n]), so that
+        // the duplicated edge vertices of the neighbouring faces match
+        uint32_t first = uint32_t(mesh.positions.size());
+        for(int32_t b = 0; b <= n; b++)
+        for(int32_t a = 0; a <= n; a++)
+        {
+            glm::vec3 c;
+            for(size_t k = 0; k < 3; k++)
+                c[glm::length_t(k)] = float(face[0][k] * n + face[1][k] * (2 * a - n) +
+                             face[2][k] * (2 * b - n)) / float(n);
+            // Area preserving cube to sphere mapping
+            glm::vec3 c2 = c * c;
+            glm::vec3 p(c.x * std::sqrt(1.0f - c2.y * 0.5f - c2.z * 0.5f + c2.y * c2.z / 3.0f),
+                        c.y * std::sqrt(1.0f - c2.z * 0.5f - c2.x * 0.5f + c2.z * c2.x / 3.0f),
+                        c.z * std::sqrt(1.0f - c2.x * 0.5f - c2.y * 0.5f + c2.x * c2.y / 3.0f));
+            p = glm::normalize(p);
+            PushVertex(mesh, p, SphericalUV(p));
+        }
+
+        auto Grid = [&](int32_t a, int32_t b)
+        {
+            return first + uint32_t(b * (n + 1) + a);
+        };
+        for(int32_t b = 0; b < n; b++)
+        for(int32_t a = 0; a < n; a++)
+        {
+            mesh.indices.insert(mesh.indices.end(),
+                                {Grid(a, b), Grid(a + 1, b), Grid(a + 1, b + 1)});
+            mesh.indices.insert(mesh.indices.end(),
+                                {Grid(a, b), Grid(a + 1, b + 1), Grid(a, b + 1)});
+        }
+    }
+    SplitUVSeam(mesh);
+    return mesh;
+}
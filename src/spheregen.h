@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+
+struct MeshData;
+
+// Procedural unit spheres (radius 1, centered at origin, +Y is up).
+// Normals are analytic and uvs are the equirectangular mapping of the
+// planet textures (u = 0 at +X going towards -Z, v = 0 at the south pole),
+// same as the shipped obj spheres. Output is ready for "MeshGL",
+// there is no file access or vertex deduplication involved.
+
+// Latitude / longitude sphere, "rings" latitude bands and
+// "segments" longitude slices (sphere_5k.obj is 50 x 50).
+// Triangle count is 2 * segments * (rings - 1).
+MeshData    GenerateUVSphere(uint32_t segments, uint32_t rings);
+// Icosahedron with each face subdivided into "frequency"^2 triangles
+// and projected to the sphere. Triangle count is 20 * frequency^2.
+MeshData    GenerateIcoSphere(uint32_t frequency);
+// Cube with each face divided into a "divisions"^2 grid, spherified
+// with an area preserving mapping. Triangle count is 12 * divisions^2.
+MeshData    GenerateCubeSphere(uint32_t divisions);
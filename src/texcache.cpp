@@ -0,0 +1,512 @@
+#include "texcache.h"
+#include "texcompress.h"
+#include "mipgen.h"
+#include "threadpool.h"
+#include "imagedecode.h"
+
+#include <algorithm>
+#include <cassert>
+#include <bit>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <numbers>
+#include <type_traits>
+
+static_assert(std::is_trivially_copyable_v<TextureCacheHeader>,
+              "Texture cache header is written as raw bytes!");
+
+namespace
+{
+
+constexpr uint64_t AlignUp(uint64_t v, uint64_t alignment)
+{
+    return (v + alignment - 1) / alignment * alignment;
+}
+
+// Octahedral map of "size" texels per side from an equirectangular
+// image, each texel is the average of 2x2 bilinear taps
+template<class T>
+void ResampleOctahedral(T* out, const T* in, uint32_t inWidth, uint32_t inHeight,
+                        uint32_t channelCount, uint32_t size, uint32_t row)
+{
+    constexpr float PI = std::numbers::pi_v<float>;
+    for(uint32_t x = 0; x < size; x++)
+    {
+        float sum[4] = {};
+        for(uint32_t s = 0; s < 4; s++)
+        {
+            // [-1, 1] over the map
+            float ex = (float(x) + 0.25f + 0.5f * float(s % 2)) / float(size) * 2.0f - 1.0f;
+            float ey = (float(row) + 0.25f + 0.5f * float(s / 2)) / float(size) * 2.0f - 1.0f;
+            float dx = ex, dy = ey;
+            float dz = 1.0f - std::abs(ex) - std::abs(ey);
+            if(dz < 0.0f)
+            {
+                dx = (1.0f - std::abs(ey)) * std::copysign(1.0f, ex);
+                dy = (1.0f - std::abs(ex)) * std::copysign(1.0f, ey);
+            }
+            float len = std::sqrt(dx * dx + dy * dy + dz * dz);
+            dx /= len; dy /= len; dz /= len;
+
+            // Same as "SphericalUV" of spheregen.cpp
+            float u = std::atan2(-dz, dx) / (2.0f * PI);
+            float v = std::acos(std::clamp(-dy, -1.0f, 1.0f)) / PI;
+            float fx = u * float(inWidth) - 0.5f;
+            float fy = v * float(inHeight) - 0.5f;
+            float x0f = std::floor(fx), y0f = std::floor(fy);
+            float wx = fx - x0f, wy = fy - y0f;
+            // x wraps, y clamps
+            int64_t w = inWidth;
+            int64_t x0 = ((int64_t(x0f) % w) + w) % w;
+            int64_t x1 = (x0 + 1) % w;
+            int64_t y0 = std::clamp(int64_t(y0f), int64_t(0), int64_t(inHeight) - 1);
+            int64_t y1 = std::clamp(int64_t(y0f) + 1, int64_t(0), int64_t(inHeight) - 1);
+            const T* r0 = in + size_t(y0) * inWidth * channelCount;
+            const T* r1 = in + size_t(y1) * inWidth * channelCount;
+            for(uint32_t c = 0; c < channelCount; c++)
+            {
+                float top = float(r0[size_t(x0) * channelCount + c]) * (1.0f - wx) +
+                            float(r0[size_t(x1) * channelCount + c]) * wx;
+                float bottom = float(r1[size_t(x0) * channelCount + c]) * (1.0f - wx) +
+                               float(r1[size_t(x1) * channelCount + c]) * wx;
+                sum[c] += top * (1.0f - wy) + bottom * wy;
+            }
+        }
+        for(uint32_t c = 0; c < channelCount; c++)
+            out[(size_t(row) * size + x) * channelCount + c] = T(std::lround(sum[c] * 0.25f));
+    }
+}
+
+// Tent filter taps of a resampled axis, edges clamp
+struct ResampleTaps
+{
+    std::vector<uint32_t>   first;
+    std::vector<uint32_t>   count;
+    std::vector<float>      weights;
+    uint32_t                maxCount = 0;
+
+    ResampleTaps(uint32_t srcSize, uint32_t dstSize)
+    {
+        float scale = float(srcSize) / float(dstSize);
+        float support = std::max(1.0f, scale);
+        maxCount = uint32_t(std::ceil(support)) * 2 + 1;
+        first.resize(dstSize);
+        count.resize(dstSize);
+        weights.assign(size_t(dstSize) * maxCount, 0.0f);
+        for(uint32_t i = 0; i < dstSize; i++)
+        {
+            float center = (float(i) + 0.5f) * scale - 0.5f;
+            int64_t lo = int64_t(std::floor(center - support)) + 1;
+            int64_t hi = int64_t(std::ceil(center + support)) - 1;
+            lo = std::clamp(lo, int64_t(0), int64_t(srcSize) - 1);
+            hi = std::clamp(hi, lo, int64_t(srcSize) - 1);
+            hi = std::min(hi, lo + int64_t(maxCount) - 1);
+            first[i] = uint32_t(lo);
+            count[i] = uint32_t(hi - lo + 1);
+
+            float* w = weights.data() + size_t(i) * maxCount;
+            float sum = 0.0f;
+            for(uint32_t j = 0; j < count[i]; j++)
+            {
+                float d = std::abs(float(lo + j) - center) / support;
+                w[j] = std::max(0.0f, 1.0f - d);
+                sum += w[j];
+            }
+            for(uint32_t j = 0; j < count[i]; j++) w[j] = (sum > 0.0f) ? w[j] / sum : 1.0f / float(count[i]);
+        }
+    }
+};
+
+// Rows of the horizontally resampled image are made on demand,
+// each output row filters the rows it needs
+template<class T>
+void ResizeRows(T* out, const T* in, uint32_t srcWidth, uint32_t dstWidth,
+                uint32_t channelCount, const ResampleTaps& tapsX,
+                const ResampleTaps& tapsY, uint32_t firstRow, uint32_t lastRow)
+{
+    std::vector<float> horizontal(size_t(dstWidth) * channelCount);
+    std::vector<float> accum(size_t(dstWidth) * channelCount);
+    constexpr float MAX_VALUE = float(std::numeric_limits<T>::max());
+    for(uint32_t y = firstRow; y < lastRow; y++)
+    {
+        std::fill(accum.begin(), accum.end(), 0.0f);
+        const float* wy = tapsY.weights.data() + size_t(y) * tapsY.maxCount;
+        for(uint32_t j = 0; j < tapsY.count[y]; j++)
+        {
+            const T* src = in + size_t(tapsY.first[y] + j) * srcWidth * channelCount;
+            for(uint32_t x = 0; x < dstWidth; x++)
+            {
+                const float* wx = tapsX.weights.data() + size_t(x) * tapsX.maxCount;
+                const T* s = src + size_t(tapsX.first[x]) * channelCount;
+                for(uint32_t c = 0; c < channelCount; c++)
+                {
+                    float v = 0.0f;
+                    for(uint32_t i = 0; i < tapsX.count[x]; i++)
+                        v += float(s[i * channelCount + c]) * wx[i];
+                    horizontal[x * channelCount + c] = v;
+                }
+            }
+            for(size_t i = 0; i < accum.size(); i++) accum[i] += horizontal[i] * wy[j];
+        }
+        T* dst = out + size_t(y) * dstWidth * channelCount;
+        for(size_t i = 0; i < accum.size(); i++)
+            dst[i] = T(std::lround(std::clamp(accum[i], 0.0f, MAX_VALUE)));
+    }
+}
+
+}
+
+void DecodedImage::PixelDeleter::operator()(void* p) const
+{
+    std::free(p);
+}
+
+bool DecodeImage(DecodedImage& out, const std::string& imgPath)
+{
+    ImageInfo info;
+    if(!ReadImageInfo(info, imgPath)) return false;
+    out.pixels.reset(std::malloc(ImageByteSize(info)));
+    if(!out.pixels || !DecodeImageInto(out.pixels.get(), info, imgPath))
+    {
+        out.pixels.reset();
+        return false;
+    }
+    out.width = int(info.width);
+    out.height = int(info.height);
+    out.channelCount = int(info.channelCount);
+    out.is16Bit = info.is16Bit;
+    return true;
+}
+
+uint32_t BytesPerPixel(TextureLayout::PixelFormat format)
+{
+    assert(!IsBlockCompressed(format));
+    bool is16Bit = (format >= TextureLayout::R16);
+    return ChannelCount(format) * (is16Bit ? 2u : 1u);
+}
+
+uint32_t ChannelCount(TextureLayout::PixelFormat format)
+{
+    switch(format)
+    {
+        case TextureLayout::BC1: return 3;
+        case TextureLayout::BC3: return 4;
+        case TextureLayout::BC4: return 1;
+        case TextureLayout::BC5: return 2;
+        case TextureLayout::BC7: return 4;
+        default: return (uint32_t(format) % 4) + 1;
+    }
+}
+
+const char* PixelFormatName(TextureLayout::PixelFormat format)
+{
+    static constexpr const char* Names[] =
+    {
+        "R8", "RG8", "RGB8", "RGBA8",
+        "R16", "RG16", "RGB16", "RGBA16",
+        "BC1", "BC3", "BC4", "BC5", "BC7"
+    };
+    return Names[format];
+}
+
+uint64_t TextureDataSize(const TextureLayout& layout)
+{
+    uint64_t size = 0;
+    for(uint32_t i = 0; i < layout.mipCount; i++) size += layout.levelSizes[i];
+    return size;
+}
+
+MipSettings ImageMipSettings(const std::string& sourcePath)
+{
+    std::string name = std::filesystem::path(sourcePath).filename().string();
+    MipSettings settings;
+    settings.filter = MipSettings::KAISER;
+    settings.linearLight = (name.find("specular") == std::string::npos);
+    settings.alphaCoverage = (name.find("_alpha") != std::string::npos) ? 0.5f : 0.0f;
+    return settings;
+}
+
+std::string TextureCachePath(const std::string& sourcePath,
+                             const TextureBuildSettings& build)
+{
+    std::string path = sourcePath;
+    if(build.octahedral) path += ".oct";
+    if(build.width != 0)
+        path += "." + std::to_string(build.width) + "x" + std::to_string(build.height);
+    return path + ".texbin";
+}
+
+void EquirectToOctahedral(DecodedImage& image, uint32_t size, ThreadPool* pool)
+{
+    uint32_t channelCount = uint32_t(image.channelCount);
+    size_t bytes = size_t(size) * size * channelCount * (image.is16Bit ? 2u : 1u);
+    // Freed by "PixelDeleter", which is "free"
+    DecodedImage result;
+    result.pixels.reset(std::malloc(bytes));
+    result.width = int(size);
+    result.height = int(size);
+    result.channelCount = image.channelCount;
+    result.is16Bit = image.is16Bit;
+
+    auto Row = [&](uint32_t y)
+    {
+        if(image.is16Bit)
+            ResampleOctahedral(static_cast<uint16_t*>(result.pixels.get()),
+                               static_cast<const uint16_t*>(image.pixels.get()),
+                               uint32_t(image.width), uint32_t(image.height),
+                               channelCount, size, y);
+        else
+            ResampleOctahedral(static_cast<uint8_t*>(result.pixels.get()),
+                               static_cast<const uint8_t*>(image.pixels.get()),
+                               uint32_t(image.width), uint32_t(image.height),
+                               channelCount, size, y);
+    };
+    if(pool) pool->ParallelFor(size, Row);
+    else for(uint32_t y = 0; y < size; y++) Row(y);
+    image = std::move(result);
+}
+
+void ResizeImage(DecodedImage& image, uint32_t width, uint32_t height, ThreadPool* pool)
+{
+    uint32_t channelCount = uint32_t(image.channelCount);
+    size_t bytes = size_t(width) * height * channelCount * (image.is16Bit ? 2u : 1u);
+    // Freed by "PixelDeleter", which is "free"
+    DecodedImage result;
+    result.pixels.reset(std::malloc(bytes));
+    result.width = int(width);
+    result.height = int(height);
+    result.channelCount = image.channelCount;
+    result.is16Bit = image.is16Bit;
+
+    ResampleTaps tapsX(uint32_t(image.width), width);
+    ResampleTaps tapsY(uint32_t(image.height), height);
+    constexpr uint32_t BAND_ROWS = 16;
+    uint32_t bandCount = (height + BAND_ROWS - 1) / BAND_ROWS;
+    auto Band = [&](uint32_t band)
+    {
+        uint32_t first = band * BAND_ROWS;
+        uint32_t last = std::min(height, first + BAND_ROWS);
+        if(image.is16Bit)
+            ResizeRows(static_cast<uint16_t*>(result.pixels.get()),
+                       static_cast<const uint16_t*>(image.pixels.get()),
+                       uint32_t(image.width), width, channelCount,
+                       tapsX, tapsY, first, last);
+        else
+            ResizeRows(static_cast<uint8_t*>(result.pixels.get()),
+                       static_cast<const uint8_t*>(image.pixels.get()),
+                       uint32_t(image.width), width, channelCount,
+                       tapsX, tapsY, first, last);
+    };
+    if(pool) pool->ParallelFor(bandCount, Band);
+    else for(uint32_t b = 0; b < bandCount; b++) Band(b);
+    image = std::move(result);
+}
+
+bool LoadTextureCache(TextureCache& out, const std::string& cachePath,
+                      const std::string& sourcePath,
+                      const TextureBuildSettings& build, const MipSettings& mips)
+{
+    FileStamp sourceStamp;
+    if(!GetFileStamp(sourceStamp, sourcePath)) return false;
+
+    MappedFile file(cachePath);
+    if(!file || file.size < sizeof(TextureCacheHeader)) return false;
+
+    TextureCacheHeader header;
+    std::memcpy(&header, file.data, sizeof(TextureCacheHeader));
+    if(std::memcmp(header.magic, TextureCacheHeader::MAGIC, sizeof(header.magic)) != 0 ||
+       header.version != TextureCacheHeader::VERSION ||
+       bool(header.flags & TextureCacheHeader::COMPRESS) != build.compress ||
+       bool(header.flags & TextureCacheHeader::OCTAHEDRAL) != build.octahedral ||
+       bool(header.flags & TextureCacheHeader::LINEAR_LIGHT) != mips.linearLight ||
+       header.mipFilter != mips.filter || header.mipAlphaCoverage != mips.alphaCoverage)
+        return false;
+
+    // Bounds check, file may be truncated
+    const TextureLayout& layout = header.layout;
+    if(layout.format > TextureLayout::BC7 ||
+       layout.mipCount == 0 || layout.mipCount > TextureLayout::MAX_MIP_COUNT)
+        return false;
+    if(build.width != 0 && (layout.width != build.width || layout.height != build.height))
+        return false;
+    for(uint32_t i = 0; i < layout.mipCount; i++)
+    {
+        if(layout.levelOffsets[i] + layout.levelSizes[i] > file.size)
+            return false;
+    }
+
+    // Staleness check
+    if(header.sourceStamp.size != sourceStamp.size) return false;
+    if(header.sourceStamp.modifiedTime != sourceStamp.modifiedTime)
+    {
+        uint64_t sourceHash;
+        if(!HashFile(sourceHash, sourcePath) ||
+           sourceHash != header.sourceHash)
+            return false;
+
+        // Content is the same, refresh the stamp so that
+        // the next load does not need to hash again.
+        header.sourceStamp = sourceStamp;
+        WriteFileAtomic(cachePath,
+        {
+            FileChunk{&header, sizeof(TextureCacheHeader)},
+            FileChunk{file.data + sizeof(TextureCacheHeader),
+                      file.size - sizeof(TextureCacheHeader)}
+        });
+    }
+
+    out.header = header;
+    out.data = reinterpret_cast<const std::byte*>(file.data);
+    out.file = std::move(file);
+    out.memory.clear();
+    return true;
+}
+
+void BuildMipChain(TextureLayout& layout, std::vector<std::byte>& levels,
+                   DecodedImage& image, const MipSettings& mips, ThreadPool* pool)
+{
+    uint32_t channelCount = uint32_t(image.channelCount);
+    uint32_t formatIndex = (channelCount - 1) + (image.is16Bit ? 4u : 0u);
+    layout = {};
+    layout.format = TextureLayout::PixelFormat(formatIndex);
+    layout.width = uint32_t(image.width);
+    layout.height = uint32_t(image.height);
+    // Full chain down to 1x1
+    layout.mipCount = uint32_t(std::bit_width(std::max(layout.width, layout.height)));
+    layout.mipCount = std::min(layout.mipCount, TextureLayout::MAX_MIP_COUNT);
+
+    uint32_t bpp = BytesPerPixel(layout.format);
+    uint64_t offset = 0;
+    for(uint32_t i = 0; i < layout.mipCount; i++)
+    {
+        uint64_t w = std::max(1u, layout.width >> i);
+        uint64_t h = std::max(1u, layout.height >> i);
+        layout.levelOffsets[i] = offset;
+        layout.levelSizes[i] = w * h * bpp;
+        offset += layout.levelSizes[i];
+    }
+    levels.assign(static_cast<size_t>(offset), std::byte(0));
+    std::memcpy(levels.data(), image.pixels.get(), size_t(layout.levelSizes[0]));
+    image.pixels.reset();
+    GenerateMips(levels.data(), layout, mips, pool);
+}
+
+bool BuildTextureCache(TextureCache& out, const std::string& sourcePath,
+                       const TextureBuildSettings& build, const MipSettings& mips,
+                       ThreadPool* pool)
+{
+    DecodedImage image;
+    if(!DecodeImage(image, sourcePath)) return false;
+    if(image.channelCount < 1 || image.channelCount > 4) return false;
+    // Half the width keeps the texel density of the equator
+    // with half of the texels
+    if(build.octahedral)
+    {
+        uint32_t size = (build.width != 0) ? build.width
+                                           : std::bit_floor(uint32_t(image.width) / 2);
+        EquirectToOctahedral(image, size, pool);
+    }
+    else if(build.width != 0 &&
+            (uint32_t(image.width) != build.width || uint32_t(image.height) != build.height))
+        ResizeImage(image, build.width, build.height, pool);
+
+    TextureCacheHeader header = {};
+    std::memcpy(header.magic, TextureCacheHeader::MAGIC, sizeof(header.magic));
+    header.version = TextureCacheHeader::VERSION;
+    header.flags = build.compress ? TextureCacheHeader::COMPRESS : 0u;
+    header.flags |= mips.linearLight ? TextureCacheHeader::LINEAR_LIGHT : 0u;
+    header.flags |= build.octahedral ? TextureCacheHeader::OCTAHEDRAL : 0u;
+    header.mipFilter = mips.filter;
+    header.mipAlphaCoverage = mips.alphaCoverage;
+    if(!GetFileStamp(header.sourceStamp, sourcePath) ||
+       !HashFile(header.sourceHash, sourcePath))
+        return false;
+
+    // Mip chain is generated uncompressed
+    TextureLayout levels;
+    std::vector<std::byte> levelData;
+    BuildMipChain(levels, levelData, image, mips, pool);
+    uint32_t channelCount = ChannelCount(levels.format);
+
+    // File layout
+    static constexpr TextureLayout::PixelFormat CompressedFormats[4] =
+    {
+        TextureLayout::BC4, TextureLayout::BC5,
+        TextureLayout::BC1, TextureLayout::BC7
+    };
+    TextureLayout& layout = header.layout;
+    layout = levels;
+    if(build.compress && !image.is16Bit) layout.format = CompressedFormats[channelCount - 1];
+    uint64_t offset = AlignUp(sizeof(TextureCacheHeader), 256);
+    for(uint32_t i = 0; i < layout.mipCount; i++)
+    {
+        uint32_t w = std::max(1u, layout.width >> i);
+        uint32_t h = std::max(1u, layout.height >> i);
+        layout.levelOffsets[i] = offset;
+        if(IsBlockCompressed(layout.format))
+            layout.levelSizes[i] = CompressedSize(layout.format, w, h);
+        offset = AlignUp(offset + layout.levelSizes[i], 256);
+    }
+
+    out.file = MappedFile();
+    out.memory.assign(size_t(offset), std::byte(0));
+    out.header = header;
+    out.data = out.memory.data();
+    std::memcpy(out.memory.data(), &header, sizeof(TextureCacheHeader));
+    for(uint32_t i = 0; i < layout.mipCount; i++)
+    {
+        std::byte* dst = out.memory.data() + layout.levelOffsets[i];
+        const std::byte* src = levelData.data() + levels.levelOffsets[i];
+        if(IsBlockCompressed(layout.format))
+        {
+            uint32_t w = std::max(1u, layout.width >> i);
+            uint32_t h = std::max(1u, layout.height >> i);
+            CompressBC(dst, reinterpret_cast<const uint8_t*>(src), w, h,
+                       channelCount, layout.format, pool);
+        }
+        else std::memcpy(dst, src, size_t(layout.levelSizes[i]));
+    }
+    return true;
+}
+
+bool WriteTextureCache(const TextureCache& cache, const std::string& cachePath)
+{
+    const TextureLayout& layout = cache.header.layout;
+    uint64_t size = layout.levelOffsets[layout.mipCount - 1] + layout.levelSizes[layout.mipCount - 1];
+    return WriteFileAtomic(cachePath,
+    {
+        FileChunk{cache.data, size_t(size)}
+    });
+}
+
+bool LoadOrBuildTextureCache(TextureCache& out, const std::string& sourcePath,
+                             const TextureBuildSettings& build, bool& rebuilt)
+{
+    rebuilt = false;
+    MipSettings mips = ImageMipSettings(sourcePath);
+    // Source sized cache serves the resize requests that it already matches
+    if(build.width != 0 && !build.octahedral)
+    {
+        TextureBuildSettings sourceSize = build;
+        sourceSize.width = sourceSize.height = 0;
+        if(LoadTextureCache(out, TextureCachePath(sourcePath, sourceSize),
+                            sourcePath, sourceSize, mips) &&
+           out.header.layout.width == build.width &&
+           out.header.layout.height == build.height)
+            return true;
+    }
+    std::string cachePath = TextureCachePath(sourcePath, build);
+    if(LoadTextureCache(out, cachePath, sourcePath, build, mips)) return true;
+
+    if(!BuildTextureCache(out, sourcePath, build, mips)) return false;
+    rebuilt = true;
+    // Not fatal, next launch decodes again
+    if(!WriteTextureCache(out, cachePath))
+        std::printf("[WARNING]: Unable to write texture cache \"%s\"\n",
+                    cachePath.c_str());
+    return true;
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+#include "filemap.h"
+#include "mipgen.h"
+
+class ThreadPool;
+
+// CPU side image, rows are bottom to top (GL order)
+struct DecodedImage
+{
+    struct PixelDeleter { void operator()(void*) const; };
+
+    std::unique_ptr<void, PixelDeleter> pixels;
+    int     width        = 0;
+    int     height       = 0;
+    int     channelCount = 0;
+    bool    is16Bit      = false;
+};
+
+// Thread safe, returns false when the file can not be opened or decoded
+// (see imagedecode.h for the decoders)
+bool    DecodeImage(DecodedImage& out, const std::string& imgPath);
+
+// Texel format and the full mip chain of a texture.
+// Level offsets are relative to the start of the cache file,
+// levels are tightly packed (1 byte row alignment) or are
+// 4x4 blocks for compressed formats.
+struct TextureLayout
+{
+    enum PixelFormat : uint32_t
+    {
+        R8, RG8, RGB8, RGBA8,
+        R16, RG16, RGB16, RGBA16,
+        // Block compressed (see texcompress.h)
+        BC1, BC3, BC4, BC5, BC7
+    };
+    static constexpr uint32_t MAX_MIP_COUNT = 16;
+
+    PixelFormat format      = RGBA8;
+    uint32_t    width       = 0;
+    uint32_t    height      = 0;
+    uint32_t    mipCount    = 0;
+    uint64_t    levelOffsets[MAX_MIP_COUNT] = {};
+    uint64_t    levelSizes[MAX_MIP_COUNT]   = {};
+};
+
+// Uncompressed formats only
+uint32_t    BytesPerPixel(TextureLayout::PixelFormat);
+uint32_t    ChannelCount(TextureLayout::PixelFormat);
+const char* PixelFormatName(TextureLayout::PixelFormat);
+// Total size of the mip levels
+uint64_t    TextureDataSize(const TextureLayout&);
+
+// Resamples an equirectangular image (mapped as "GenerateUVSphere" does)
+// to a "size" x "size" octahedral map around +z, the mapping is
+// "OctEncode" of "shaders/background.frag". Rows run on the pool when
+// it is given.
+void        EquirectToOctahedral(DecodedImage& image, uint32_t size,
+                                 ThreadPool* pool = nullptr);
+
+// Resamples the image to "width" x "height" with a tent filter that
+// is widened when minifying. Rows run on the pool when it is given.
+void        ResizeImage(DecodedImage& image, uint32_t width, uint32_t height,
+                        ThreadPool* pool = nullptr);
+
+// Tightly packed uncompressed mip chain of the image (level offsets are
+// relative to "levels"), releases the decoded pixels. Mips are generated
+// on the pool when it is given.
+void        BuildMipChain(TextureLayout& layout, std::vector<std::byte>& levels,
+                          DecodedImage& image, const MipSettings& mips,
+                          ThreadPool* pool = nullptr);
+
+// ======================= //
+//   BINARY TEXTURE CACHE  //
+// ======================= //
+// ".texbin" file is a header followed by the mip levels of the
+// decoded image, these can be given to "glTexSubImage2D" directly from
+// the mapping. Staleness is checked as in ".meshbin" (see meshcache.h).
+// 8-bit images are block compressed when it is requested:
+// R -> BC4, RG -> BC5, RGB -> BC1, RGBA -> BC7.
+struct TextureCacheHeader
+{
+    static constexpr char     MAGIC[8] = {'T', 'E', 'X', 'B', 'I', 'N', '\0', '\0'};
+    static constexpr uint32_t VERSION  = 3;
+    // Flags
+    // Built with compression requested (16-bit
+    // images stay uncompressed regardless)
+    static constexpr uint32_t COMPRESS      = 0x1;
+    // "MipSettings::linearLight"
+    static constexpr uint32_t LINEAR_LIGHT  = 0x2;
+    // Equirectangular source is stored as an
+    // octahedral map (see "EquirectToOctahedral")
+    static constexpr uint32_t OCTAHEDRAL    = 0x4;
+
+    char            magic[8];
+    uint32_t        version;
+    uint32_t        flags;
+    FileStamp       sourceStamp;
+    uint64_t        sourceHash;
+    // Rest of the "MipSettings" of the chain
+    uint32_t        mipFilter;
+    float           mipAlphaCoverage;
+    TextureLayout   layout;
+};
+
+// How a cache is derived from its source; a cache built with
+// different settings is stale
+struct TextureBuildSettings
+{
+    // Block compressed (16-bit images stay uncompressed regardless)
+    bool        compress    = true;
+    // Equirectangular source is stored as an
+    // octahedral map (see "EquirectToOctahedral")
+    bool        octahedral  = false;
+    // Level 0 is resampled to this size, zero keeps the source
+    // size (octahedral maps are half of the source width)
+    uint32_t    width       = 0;
+    uint32_t    height      = 0;
+
+    bool        operator==(const TextureBuildSettings&) const = default;
+};
+
+// Texture cache file image; either a mapping of the cache file
+// or the in-memory result of "BuildTextureCache"
+struct TextureCache
+{
+    MappedFile              file;
+    std::vector<std::byte>  memory;
+    TextureCacheHeader      header = {};
+    const std::byte*        data   = nullptr;
+
+    const void* Level(uint32_t mip) const;
+};
+
+// Cache file of an image, "textures/a.jpg" -> "textures/a.jpg.texbin"
+// (the extension is kept so that "a.jpg" and "a.png" do not collide),
+// octahedral / resized ones are "textures/a.jpg[.oct][.WxH].texbin"
+std::string TextureCachePath(const std::string& sourcePath,
+                             const TextureBuildSettings& build = {});
+
+// Mip settings by the naming of "textures/": "*specular*" maps hold
+// data, others are sRGB colors. Alpha coverage of "*_alpha*" images
+// is kept so that the clouds do not thin out in the distance.
+MipSettings ImageMipSettings(const std::string& sourcePath);
+
+// Returns false when the cache does not exist, is corrupted, stale
+// or is built with different build / mip settings
+bool    LoadTextureCache(TextureCache& out, const std::string& cachePath,
+                         const std::string& sourcePath,
+                         const TextureBuildSettings& build, const MipSettings& mips);
+// Decodes the source and generates its mip chain (see "GenerateMips").
+// Resampling, mips and compression run on the pool when given.
+bool    BuildTextureCache(TextureCache& out, const std::string& sourcePath,
+                          const TextureBuildSettings& build, const MipSettings& mips,
+                          ThreadPool* pool = nullptr);
+bool    WriteTextureCache(const TextureCache&, const std::string& cachePath);
+// Loads the cache of the source, (re)builds and writes it when it is
+// missing or stale (with "ImageMipSettings"). Resize requests use the
+// source sized cache when it matches. "rebuilt" is set when the source
+// is decoded.
+bool    LoadOrBuildTextureCache(TextureCache& out, const std::string& sourcePath,
+                                const TextureBuildSettings& build, bool& rebuilt);
+
+// Inline Definitions
+inline const void* TextureCache::Level(uint32_t mip) const
+{
+    return data + header.layout.levelOffsets[mip];
+}
@@ -0,0 +1,771 @@
+#include "texcompress.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define CENG_BC_SSE2
+    #include <emmintrin.h>
+#endif
+
+namespace
+{
+
+// 4x4 texels as float, channels are stored separately (SoA)
+struct Block
+{
+    alignas(16) float c[4][16];
+};
+
+void LoadBlock(Block& b, const uint8_t* pixels, uint32_t width, uint32_t height,
+               uint32_t channelCount, uint32_t bx, uint32_t by)
+{
+    for(uint32_t y = 0; y < 4; y++)
+    for(uint32_t x = 0; x < 4; x++)
+    {
+        uint32_t px = std::min(bx * 4 + x, width - 1);
+        uint32_t py = std::min(by * 4 + y, height - 1);
+        const uint8_t* p = pixels + (size_t(py) * width + px) * channelCount;
+        for(uint32_t ch = 0; ch < 4; ch++)
+        {
+            float missing = (ch == 3) ? 255.0f : 0.0f;
+            b.c[ch][y * 4 + x] = (ch < channelCount) ? float(p[ch]) : missing;
+        }
+    }
+}
+
+// t[i] = saturate(dot(p[i] - origin, axis) * scale) over the
+// channels [first, first + count)
+void Project(float t[16], const Block& b, uint32_t first, uint32_t count,
+             const float origin[4], const float axis[4], float scale)
+{
+    #ifdef CENG_BC_SSE2
+        for(uint32_t i = 0; i < 16; i += 4)
+        {
+            __m128 d = _mm_setzero_ps();
+            for(uint32_t ch = first; ch < first + count; ch++)
+            {
+                __m128 v = _mm_sub_ps(_mm_load_ps(&b.c[ch][i]), _mm_set1_ps(origin[ch]));
+                d = _mm_add_ps(d, _mm_mul_ps(v, _mm_set1_ps(axis[ch])));
+            }
+            d = _mm_mul_ps(d, _mm_set1_ps(scale));
+            d = _mm_min_ps(_mm_max_ps(d, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+            _mm_storeu_ps(t + i, d);
+        }
+    #else
+        for(uint32_t i = 0; i < 16; i++)
+        {
+            float d = 0.0f;
+            for(uint32_t ch = first; ch < first + count; ch++)
+                d += (b.c[ch][i] - origin[ch]) * axis[ch];
+            t[i] = std::clamp(d * scale, 0.0f, 1.0f);
+        }
+    #endif
+}
+
+// Squared error of the block against the selected palette entries
+float PaletteError(const Block& b, uint32_t first, uint32_t count,
+                   const float (*palette)[4], const uint8_t idx[16])
+{
+    float error = 0.0f;
+    for(uint32_t i = 0; i < 16; i++)
+    for(uint32_t ch = first; ch < first + count; ch++)
+    {
+        float d = b.c[ch][i] - palette[idx[i]][ch];
+        error += d * d;
+    }
+    return error;
+}
+
+// Mean and the principal axis (power iteration on the covariance),
+// returns false for a constant block
+bool PrincipalAxis(float mean[4], float axis[4], const Block& b,
+                   uint32_t first, uint32_t count)
+{
+    float lo[4] = {}, hi[4] = {};
+    for(uint32_t ch = first; ch < first + count; ch++)
+    {
+        mean[ch] = 0.0f;
+        lo[ch] = std::numeric_limits<float>::max();
+        hi[ch] = -std::numeric_limits<float>::max();
+        for(uint32_t i = 0; i < 16; i++)
+        {
+            mean[ch] += b.c[ch][i];
+            lo[ch] = std::min(lo[ch], b.c[ch][i]);
+            hi[ch] = std::max(hi[ch], b.c[ch][i]);
+        }
+        mean[ch] /= 16.0f;
+    }
+    float cov[4][4] = {};
+    for(uint32_t i = 0; i < 16; i++)
+    for(uint32_t r = first; r < first + count; r++)
+    for(uint32_t c = first; c < first + count; c++)
+        cov[r][c] += (b.c[r][i] - mean[r]) * (b.c[c][i] - mean[c]);
+
+    // Bounding box diagonal is a good starting guess
+    float length2 = 0.0f;
+    for(uint32_t ch = first; ch < first + count; ch++)
+    {
+        axis[ch] = hi[ch] - lo[ch];
+        length2 += axis[ch] * axis[ch];
+    }
+    if(length2 == 0.0f) return false;
+
+    for(uint32_t iter = 0; iter < 8; iter++)
+    {
+        float v[4] = {};
+        float vLength2 = 0.0f;
+        for(uint32_t r = first; r < first + count; r++)
+        {
+            for(uint32_t c = first; c < first + count; c++)
+                v[r] += cov[r][c] * axis[c];
+            vLength2 += v[r] * v[r];
+        }
+        if(vLength2 < 1e-12f) break;
+        float inv = 1.0f / std::sqrt(vLength2);
+        for(uint32_t ch = first; ch < first + count; ch++)
+            axis[ch] = v[ch] * inv;
+    }
+    float inv = 0.0f;
+    for(uint32_t ch = first; ch < first + count; ch++) inv += axis[ch] * axis[ch];
+    inv = 1.0f / std::sqrt(inv);
+    for(uint32_t ch = first; ch < first + count; ch++) axis[ch] *= inv;
+    return true;
+}
+
+// Endpoints along the principal axis, pulled in by
+// "inset" of the range to reduce the error of the extremes
+void AxisEndpoints(float e0[4], float e1[4], const Block& b, uint32_t first,
+                   uint32_t count, float inset)
+{
+    float mean[4], axis[4];
+    if(!PrincipalAxis(mean, axis, b, first, count))
+    {
+        for(uint32_t ch = first; ch < first + count; ch++)
+            e0[ch] = e1[ch] = b.c[ch][0];
+        return;
+    }
+    float tMin = std::numeric_limits<float>::max();
+    float tMax = -std::numeric_limits<float>::max();
+    for(uint32_t i = 0; i < 16; i++)
+    {
+        float t = 0.0f;
+        for(uint32_t ch = first; ch < first + count; ch++)
+            t += (b.c[ch][i] - mean[ch]) * axis[ch];
+        tMin = std::min(tMin, t);
+        tMax = std::max(tMax, t);
+    }
+    float pull = (tMax - tMin) * inset;
+    tMin += pull;
+    tMax -= pull;
+    for(uint32_t ch = first; ch < first + count; ch++)
+    {
+        e0[ch] = std::clamp(mean[ch] + axis[ch] * tMax, 0.0f, 255.0f);
+        e1[ch] = std::clamp(mean[ch] + axis[ch] * tMin, 0.0f, 255.0f);
+    }
+}
+
+// Least squares endpoints for the given interpolation weights
+// (weight of e0 per texel), returns false when it is singular
+bool LeastSquaresEndpoints(float e0[4], float e1[4], const Block& b,
+                           uint32_t first, uint32_t count, const float w[16])
+{
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ax[4] = {}, bx[4] = {};
+    for(uint32_t i = 0; i < 16; i++)
+    {
+        float a = w[i];
+        float c = 1.0f - a;
+        aa += a * a;
+        ab += a * c;
+        bb += c * c;
+        for(uint32_t ch = first; ch < first + count; ch++)
+        {
+            ax[ch] += a * b.c[ch][i];
+            bx[ch] += c * b.c[ch][i];
+        }
+    }
+    float det = aa * bb - ab * ab;
+    if(std::abs(det) < 1e-6f) return false;
+    float invDet = 1.0f / det;
+    for(uint32_t ch = first; ch < first + count; ch++)
+    {
+        e0[ch] = std::clamp((bb * ax[ch] - ab * bx[ch]) * invDet, 0.0f, 255.0f);
+        e1[ch] = std::clamp((aa * bx[ch] - ab * ax[ch]) * invDet, 0.0f, 255.0f);
+    }
+    return true;
+}
+
+// ======================= //
+//           BC1           //
+// ======================= //
+uint16_t To565(const float c[4])
+{
+    uint32_t r = uint32_t(std::lround(c[0] * 31.0f / 255.0f));
+    uint32_t g = uint32_t(std::lround(c[1] * 63.0f / 255.0f));
+    uint32_t b = uint32_t(std::lround(c[2] * 31.0f / 255.0f));
+    return uint16_t((r << 11) | (g << 5) | b);
+}
+
+void From565(float out[4], uint16_t v)
+{
+    uint32_t r = (v >> 11) & 31u;
+    uint32_t g = (v >> 5) & 63u;
+    uint32_t b = v & 31u;
+    out[0] = float((r << 3) | (r >> 2));
+    out[1] = float((g << 2) | (g >> 4));
+    out[2] = float((b << 3) | (b >> 2));
+    out[3] = 255.0f;
+}
+
+struct BC1Fit
+{
+    uint16_t    c0;
+    uint16_t    c1;
+    uint8_t     idx[16];
+    float       error;
+};
+
+void FitBC1Indices(BC1Fit& f, const Block& b)
+{
+    // Four color mode requires c0 > c1
+    if(f.c0 < f.c1) std::swap(f.c0, f.c1);
+
+    float palette[4][4];
+    From565(palette[0], f.c0);
+    From565(palette[1], f.c1);
+    for(uint32_t ch = 0; ch < 3; ch++)
+    {
+        palette[2][ch] = (2.0f * palette[0][ch] + palette[1][ch]) / 3.0f;
+        palette[3][ch] = (palette[0][ch] + 2.0f * palette[1][ch]) / 3.0f;
+    }
+
+    if(f.c0 == f.c1)
+        std::fill(f.idx, f.idx + 16, uint8_t(0));
+    else
+    {
+        float axis[4];
+        float length2 = 0.0f;
+        for(uint32_t ch = 0; ch < 3; ch++)
+        {
+            axis[ch] = palette[1][ch] - palette[0][ch];
+            length2 += axis[ch] * axis[ch];
+        }
+        alignas(16) float t[16];
+        Project(t, b, 0, 3, palette[0], axis, 1.0f / length2);
+        static constexpr uint8_t Order[4] = {0, 2, 3, 1};
+        for(uint32_t i = 0; i < 16; i++)
+            f.idx[i] = Order[std::lround(t[i] * 3.0f)];
+    }
+    f.error = PaletteError(b, 0, 3, palette, f.idx);
+}
+
+void EncodeBC1Block(uint8_t* out, const Block& b)
+{
+    float e0[4], e1[4];
+    AxisEndpoints(e0, e1, b, 0, 3, 1.0f / 16.0f);
+    BC1Fit best = {To565(e0), To565(e1), {}, 0.0f};
+    FitBC1Indices(best, b);
+
+    if(best.c0 != best.c1)
+    {
+        static constexpr float Weights[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+        float w[16];
+        for(uint32_t i = 0; i < 16; i++) w[i] = Weights[best.idx[i]];
+        if(LeastSquaresEndpoints(e0, e1, b, 0, 3, w))
+        {
+            BC1Fit refined = {To565(e0), To565(e1), {}, 0.0f};
+            FitBC1Indices(refined, b);
+            if(refined.error < best.error) best = refined;
+        }
+    }
+
+    uint32_t indices = 0;
+    for(uint32_t i = 0; i < 16; i++) indices |= uint32_t(best.idx[i]) << (i * 2);
+    out[0] = uint8_t(best.c0 & 0xFF);
+    out[1] = uint8_t(best.c0 >> 8);
+    out[2] = uint8_t(best.c1 & 0xFF);
+    out[3] = uint8_t(best.c1 >> 8);
+    for(uint32_t i = 0; i < 4; i++) out[4 + i] = uint8_t(indices >> (i * 8));
+}
+
+void DecodeBC1Block(uint8_t rgba[16][4], const uint8_t* in, bool forceFourColor)
+{
+    uint16_t c0 = uint16_t(in[0] | (in[1] << 8));
+    uint16_t c1 = uint16_t(in[2] | (in[3] << 8));
+    float p[4][4];
+    From565(p[0], c0);
+    From565(p[1], c1);
+    uint8_t palette[4][4];
+    for(uint32_t ch = 0; ch < 4; ch++)
+    {
+        uint32_t a = uint32_t(p[0][ch]);
+        uint32_t b = uint32_t(p[1][ch]);
+        palette[0][ch] = uint8_t(a);
+        palette[1][ch] = uint8_t(b);
+        if(c0 > c1 || forceFourColor)
+        {
+            palette[2][ch] = uint8_t((2 * a + b) / 3);
+            palette[3][ch] = uint8_t((a + 2 * b) / 3);
+        }
+        else
+        {
+            // Three color mode, last entry is transparent black
+            palette[2][ch] = uint8_t((a + b) / 2);
+            palette[3][ch] = 0;
+        }
+    }
+
+    uint32_t indices = uint32_t(in[4] | (in[5] << 8) | (in[6] << 16)) | (uint32_t(in[7]) << 24);
+    for(uint32_t i = 0; i < 16; i++)
+        std::memcpy(rgba[i], palette[(indices >> (i * 2)) & 3u], 4);
+}
+
+// ======================= //
+//           BC4           //
+// ======================= //
+void EncodeBC4Block(uint8_t* out, const Block& b, uint32_t ch)
+{
+    float lo = 255.0f, hi = 0.0f;
+    for(uint32_t i = 0; i < 16; i++)
+    {
+        lo = std::min(lo, b.c[ch][i]);
+        hi = std::max(hi, b.c[ch][i]);
+    }
+    // Eight value mode (a0 > a1), palette is a0, a1 and
+    // the six interpolants from a0 towards a1
+    uint8_t a0 = uint8_t(hi);
+    uint8_t a1 = uint8_t(lo);
+    out[0] = a0;
+    out[1] = a1;
+
+    uint8_t idx[16] = {};
+    if(a0 != a1)
+    {
+        float origin[4] = {}, axis[4] = {};
+        origin[ch] = float(a0);
+        axis[ch] = -1.0f;
+        alignas(16) float t[16];
+        Project(t, b, ch, 1, origin, axis, 1.0f / float(a0 - a1));
+        for(uint32_t i = 0; i < 16; i++)
+        {
+            long s = std::lround(t[i] * 7.0f);
+            idx[i] = uint8_t((s == 0) ? 0 : (s == 7) ? 1 : s + 1);
+        }
+    }
+    uint64_t bits = 0;
+    for(uint32_t i = 0; i < 16; i++) bits |= uint64_t(idx[i]) << (i * 3);
+    for(uint32_t i = 0; i < 6; i++) out[2 + i] = uint8_t(bits >> (i * 8));
+}
+
+void DecodeBC4Block(uint8_t rgba[16][4], const uint8_t* in, uint32_t ch)
+{
+    uint32_t a0 = in[0];
+    uint32_t a1 = in[1];
+    uint8_t palette[8];
+    palette[0] = uint8_t(a0);
+    palette[1] = uint8_t(a1);
+    if(a0 > a1)
+    {
+        for(uint32_t i = 1; i < 7; i++)
+            palette[i + 1] = uint8_t((a0 * (7 - i) + a1 * i) / 7);
+    }
+    else
+    {
+        for(uint32_t i = 1; i < 5; i++)
+            palette[i + 1] = uint8_t((a0 * (5 - i) + a1 * i) / 5);
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+    uint64_t bits = 0;
+    for(uint32_t i = 0; i < 6; i++) bits |= uint64_t(in[2 + i]) << (i * 8);
+    for(uint32_t i = 0; i < 16; i++)
+        rgba[i][ch] = palette[(bits >> (i * 3)) & 7u];
+}
+
+// ======================= //
+//     BC7 (mode 5, 6)     //
+// ======================= //
+constexpr uint8_t BC7Weights2[4] = {0, 21, 43, 64};
+constexpr uint8_t BC7Weights4[16] = {0, 4, 9, 13, 17, 21, 26, 30,
+                                     34, 38, 43, 47, 51, 55, 60, 64};
+
+// One endpoint pair and its index set over
+// the channels [first, first + count)
+struct BC7Fit
+{
+    uint8_t     q[2][4];    // As stored (without the p-bit)
+    uint8_t     e[2][4];    // Expanded to 8 bits
+    uint8_t     idx[16];
+    float       error;
+};
+
+struct BC7Params
+{
+    uint32_t        first;
+    uint32_t        count;
+    uint32_t        bits;       // Per endpoint channel, without the p-bit
+    bool            pBits;      // Unique p-bit per endpoint
+    const uint8_t*  weights;
+    uint32_t        weightCount;
+};
+
+constexpr BC7Params BC7Mode5Color = {0, 3, 7, false, BC7Weights2, 4};
+constexpr BC7Params BC7Mode5Alpha = {3, 1, 8, false, BC7Weights2, 4};
+constexpr BC7Params BC7Mode6      = {0, 4, 7, true, BC7Weights4, 16};
+
+uint8_t ExpandBC7(uint32_t q, uint32_t bits)
+{
+    return uint8_t((q << (8 - bits)) | (q >> (2 * bits - 8)));
+}
+
+void QuantizeBC7(BC7Fit& f, const BC7Params& m, const float e0[4], const float e1[4],
+                 uint32_t p0, uint32_t p1)
+{
+    const float* e[2] = {e0, e1};
+    const uint32_t p[2] = {p0, p1};
+    long maxQ = (1l << m.bits) - 1;
+    for(uint32_t j = 0; j < 2; j++)
+    for(uint32_t ch = m.first; ch < m.first + m.count; ch++)
+    {
+        if(m.pBits)
+        {
+            long q = std::clamp(std::lround((e[j][ch] - float(p[j])) * 0.5f), 0l, maxQ);
+            f.q[j][ch] = uint8_t(q);
+            f.e[j][ch] = uint8_t((q << 1) | long(p[j]));
+        }
+        else
+        {
+            long q = std::clamp(std::lround(e[j][ch] * float(maxQ) / 255.0f), 0l, maxQ);
+            f.q[j][ch] = uint8_t(q);
+            f.e[j][ch] = ExpandBC7(uint32_t(q), m.bits);
+        }
+    }
+}
+
+void FitBC7Indices(BC7Fit& f, const BC7Params& m, const Block& b)
+{
+    float palette[16][4] = {};
+    for(uint32_t i = 0; i < m.weightCount; i++)
+    for(uint32_t ch = m.first; ch < m.first + m.count; ch++)
+    {
+        uint32_t w = m.weights[i];
+        palette[i][ch] = float(((64 - w) * f.e[0][ch] + w * f.e[1][ch] + 32) >> 6);
+    }
+
+    float axis[4] = {}, origin[4] = {};
+    float length2 = 0.0f;
+    for(uint32_t ch = m.first; ch < m.first + m.count; ch++)
+    {
+        origin[ch] = float(f.e[0][ch]);
+        axis[ch] = float(f.e[1][ch]) - origin[ch];
+        length2 += axis[ch] * axis[ch];
+    }
+    if(length2 == 0.0f)
+        std::fill(f.idx, f.idx + 16, uint8_t(0));
+    else
+    {
+        alignas(16) float t[16];
+        Project(t, b, m.first, m.count, origin, axis, 1.0f / length2);
+        // "Project" saturates to 1, weights are in [0, 64]
+        for(uint32_t i = 0; i < 16; i++)
+        {
+            float w = t[i] * 64.0f;
+            uint8_t k = 0;
+            while(k + 1u < m.weightCount &&
+                  w > 0.5f * float(m.weights[k] + m.weights[k + 1])) k++;
+            f.idx[i] = k;
+        }
+    }
+    f.error = PaletteError(b, m.first, m.count, palette, f.idx);
+}
+
+void TryBC7Endpoints(BC7Fit& best, const BC7Params& m, const float e0[4],
+                     const float e1[4], const Block& b)
+{
+    for(uint32_t p = 0; p < (m.pBits ? 4u : 1u); p++)
+    {
+        BC7Fit fit = {};
+        QuantizeBC7(fit, m, e0, e1, p & 1u, p >> 1);
+        FitBC7Indices(fit, m, b);
+        if(fit.error < best.error) best = fit;
+    }
+}
+
+void FitBC7(BC7Fit& best, const BC7Params& m, const Block& b)
+{
+    float e0[4], e1[4];
+    AxisEndpoints(e0, e1, b, m.first, m.count, 1.0f / 32.0f);
+    best = {};
+    best.error = std::numeric_limits<float>::max();
+    TryBC7Endpoints(best, m, e0, e1, b);
+
+    float w[16];
+    for(uint32_t i = 0; i < 16; i++) w[i] = 1.0f - float(m.weights[best.idx[i]]) / 64.0f;
+    if(LeastSquaresEndpoints(e0, e1, b, m.first, m.count, w))
+        TryBC7Endpoints(best, m, e0, e1, b);
+
+    // Anchor (first) index has an implicit zero MSB
+    if(best.idx[0] >= m.weightCount / 2)
+    {
+        std::swap(best.q[0], best.q[1]);
+        std::swap(best.e[0], best.e[1]);
+        for(uint8_t& i : best.idx) i = uint8_t(m.weightCount - 1 - i);
+    }
+}
+
+struct BitWriter
+{
+    uint8_t*    out;
+    uint32_t    pos = 0;
+
+    void Write(uint32_t v, uint32_t bitCount)
+    {
+        for(uint32_t i = 0; i < bitCount; i++, pos++)
+            out[pos / 8] = uint8_t(out[pos / 8] | (((v >> i) & 1u) << (pos % 8)));
+    }
+};
+
+struct BitReader
+{
+    const uint8_t*  in;
+    uint32_t        pos = 0;
+
+    uint32_t Read(uint32_t bitCount)
+    {
+        uint32_t v = 0;
+        for(uint32_t i = 0; i < bitCount; i++, pos++)
+            v |= uint32_t((in[pos / 8] >> (pos % 8)) & 1u) << i;
+        return v;
+    }
+};
+
+void WriteBC7Endpoints(BitWriter& writer, const BC7Fit& f, const BC7Params& m)
+{
+    for(uint32_t ch = m.first; ch < m.first + m.count; ch++)
+    {
+        writer.Write(f.q[0][ch], m.bits);
+        writer.Write(f.q[1][ch], m.bits);
+    }
+}
+
+void WriteBC7Indices(BitWriter& writer, const BC7Fit& f, const BC7Params& m)
+{
+    uint32_t indexBits = uint32_t(std::bit_width(m.weightCount - 1));
+    writer.Write(f.idx[0], indexBits - 1);
+    for(uint32_t i = 1; i < 16; i++) writer.Write(f.idx[i], indexBits);
+}
+
+// Mode 6 shares the indices between color and alpha, mode 5
+// has separate ones for alpha that does not follow the color
+void EncodeBC7Block(uint8_t* out, const Block& b)
+{
+    BC7Fit mode6, color, alpha;
+    FitBC7(mode6, BC7Mode6, b);
+    FitBC7(color, BC7Mode5Color, b);
+    FitBC7(alpha, BC7Mode5Alpha, b);
+
+    std::memset(out, 0, 16);
+    BitWriter writer = {out};
+    if(mode6.error <= color.error + alpha.error)
+    {
+        writer.Write(1u << 6, 7);
+        WriteBC7Endpoints(writer, mode6, BC7Mode6);
+        writer.Write(mode6.e[0][0] & 1u, 1);
+        writer.Write(mode6.e[1][0] & 1u, 1);
+        WriteBC7Indices(writer, mode6, BC7Mode6);
+    }
+    else
+    {
+        // No channel rotation
+        writer.Write(1u << 5, 6);
+        writer.Write(0, 2);
+        WriteBC7Endpoints(writer, color, BC7Mode5Color);
+        WriteBC7Endpoints(writer, alpha, BC7Mode5Alpha);
+        WriteBC7Indices(writer, color, BC7Mode5Color);
+        WriteBC7Indices(writer, alpha, BC7Mode5Alpha);
+    }
+    assert(writer.pos == 128);
+}
+
+void DecodeBC7Block(uint8_t rgba[16][4], const uint8_t* in)
+{
+    // Only the modes that the encoder emits,
+    // others decode to zero
+    BitReader reader = {in};
+    uint32_t mode = 0;
+    while(mode < 8 && reader.Read(1) == 0) mode++;
+    if(mode != 5 && mode != 6)
+    {
+        std::memset(rgba, 0, 16 * 4);
+        return;
+    }
+
+    uint32_t e[2][4];
+    if(mode == 6)
+    {
+        for(uint32_t ch = 0; ch < 4; ch++)
+        {
+            e[0][ch] = reader.Read(7) << 1;
+            e[1][ch] = reader.Read(7) << 1;
+        }
+        uint32_t p0 = reader.Read(1);
+        uint32_t p1 = reader.Read(1);
+        for(uint32_t ch = 0; ch < 4; ch++)
+        {
+            e[0][ch] |= p0;
+            e[1][ch] |= p1;
+        }
+        for(uint32_t i = 0; i < 16; i++)
+        {
+            uint32_t w = BC7Weights4[reader.Read((i == 0) ? 3 : 4)];
+            for(uint32_t ch = 0; ch < 4; ch++)
+                rgba[i][ch] = uint8_t(((64 - w) * e[0][ch] + w * e[1][ch] + 32) >> 6);
+        }
+        return;
+    }
+
+    uint32_t rotation = reader.Read(2);
+    for(uint32_t ch = 0; ch < 4; ch++)
+    {
+        uint32_t bits = (ch == 3) ? 8 : 7;
+        e[0][ch] = ExpandBC7(reader.Read(bits), bits);
+        e[1][ch] = ExpandBC7(reader.Read(bits), bits);
+    }
+    for(uint32_t i = 0; i < 16; i++)
+    {
+        uint32_t w = BC7Weights2[reader.Read((i == 0) ? 1 : 2)];
+        for(uint32_t ch = 0; ch < 3; ch++)
+            rgba[i][ch] = uint8_t(((64 - w) * e[0][ch] + w * e[1][ch] + 32) >> 6);
+    }
+    for(uint32_t i = 0; i < 16; i++)
+    {
+        uint32_t w = BC7Weights2[reader.Read((i == 0) ? 1 : 2)];
+        rgba[i][3] = uint8_t(((64 - w) * e[0][3] + w * e[1][3] + 32) >> 6);
+    }
+    if(rotation != 0)
+        for(uint32_t i = 0; i < 16; i++) std::swap(rgba[i][rotation - 1], rgba[i][3]);
+}
+
+void EncodeBlock(uint8_t* out, const Block& b, TextureLayout::PixelFormat format)
+{
+    switch(format)
+    {
+        case TextureLayout::BC1: EncodeBC1Block(out, b); break;
+        case TextureLayout::BC3: EncodeBC4Block(out, b, 3);
+                                 EncodeBC1Block(out + 8, b); break;
+        case TextureLayout::BC4: EncodeBC4Block(out, b, 0); break;
+        case TextureLayout::BC5: EncodeBC4Block(out, b, 0);
+                                 EncodeBC4Block(out + 8, b, 1); break;
+        case TextureLayout::BC7: EncodeBC7Block(out, b); break;
+        default: assert(false); break;
+    }
+}
+
+void DecodeBlock(uint8_t rgba[16][4], const uint8_t* in, TextureLayout::PixelFormat format)
+{
+    for(uint32_t i = 0; i < 16; i++)
+    {
+        rgba[i][0] = rgba[i][1] = rgba[i][2] = 0;
+        rgba[i][3] = 255;
+    }
+    switch(format)
+    {
+        case TextureLayout::BC1: DecodeBC1Block(rgba, in, false); break;
+        case TextureLayout::BC3: DecodeBC1Block(rgba, in + 8, true);
+                                 DecodeBC4Block(rgba, in, 3); break;
+        case TextureLayout::BC4: DecodeBC4Block(rgba, in, 0); break;
+        case TextureLayout::BC5: DecodeBC4Block(rgba, in, 0);
+                                 DecodeBC4Block(rgba, in + 8, 1); break;
+        case TextureLayout::BC7: DecodeBC7Block(rgba, in); break;
+        default: assert(false); break;
+    }
+}
+
+}
+
+bool IsBlockCompressed(TextureLayout::PixelFormat format)
+{
+    return format >= TextureLayout::BC1;
+}
+
+uint32_t BlockByteSize(TextureLayout::PixelFormat format)
+{
+    assert(IsBlockCompressed(format));
+    return (format == TextureLayout::BC1 || format == TextureLayout::BC4) ? 8 : 16;
+}
+
+uint64_t CompressedSize(TextureLayout::PixelFormat format, uint32_t width, uint32_t height)
+{
+    uint64_t blocksX = (width + 3) / 4;
+    uint64_t blocksY = (height + 3) / 4;
+    return blocksX * blocksY * BlockByteSize(format);
+}
+
+void CompressBC(std::byte* out, const uint8_t* pixels,
+                uint32_t width, uint32_t height, uint32_t channelCount,
+                TextureLayout::PixelFormat format, ThreadPool* pool)
+{
+    uint32_t blocksX = (width + 3) / 4;
+    uint32_t blocksY = (height + 3) / 4;
+    uint32_t blockSize = BlockByteSize(format);
+    auto EncodeRow = [&](uint32_t by)
+    {
+        uint8_t* rowOut = reinterpret_cast<uint8_t*>(out) + size_t(by) * blocksX * blockSize;
+        for(uint32_t bx = 0; bx < blocksX; bx++)
+        {
+            Block b;
+            LoadBlock(b, pixels, width, height, channelCount, bx, by);
+            EncodeBlock(rowOut + size_t(bx) * blockSize, b, format);
+        }
+    };
+
+    if(pool && blocksY > 1) pool->ParallelFor(blocksY, EncodeRow);
+    else for(uint32_t by = 0; by < blocksY; by++) EncodeRow(by);
+}
+
+void DecompressBC(uint8_t* rgbaOut, const std::byte* blocks,
+                  uint32_t width, uint32_t height,
+                  TextureLayout::PixelFormat format)
+{
+    uint32_t blocksX = (width + 3) / 4;
+    uint32_t blocksY = (height + 3) / 4;
+    uint32_t blockSize = BlockByteSize(format);
+    const uint8_t* in = reinterpret_cast<const uint8_t*>(blocks);
+    for(uint32_t by = 0; by < blocksY; by++)
+    for(uint32_t bx = 0; bx < blocksX; bx++)
+    {
+        uint8_t rgba[16][4];
+        DecodeBlock(rgba, in + (size_t(by) * blocksX + bx) * blockSize, format);
+        for(uint32_t y = 0; y < 4; y++)
+        for(uint32_t x = 0; x < 4; x++)
+        {
+            uint32_t px = bx * 4 + x;
+            uint32_t py = by * 4 + y;
+            if(px >= width || py >= height) continue;
+            std::memcpy(rgbaOut + (size_t(py) * width + px) * 4, rgba[y * 4 + x], 4);
+        }
+    }
+}
+
+double ComputePSNR(const uint8_t* a, uint32_t channelCount,
+                   const uint8_t* rgba, uint32_t width, uint32_t height)
+{
+    double sum = 0.0;
+    size_t pixelCount = size_t(width) * height;
+    for(size_t i = 0; i < pixelCount; i++)
+    for(uint32_t ch = 0; ch < channelCount; ch++)
+    {
+        double d = double(a[i * channelCount + ch]) - double(rgba[i * 4 + ch]);
+        sum += d * d;
+    }
+    double mse = sum / double(pixelCount * channelCount);
+    if(mse == 0.0) return std::numeric_limits<double>::infinity();
+    return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
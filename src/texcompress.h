@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include "texcache.h"
+
+class ThreadPool;
+
+// Block compression (BCn) of 8-bit images. Blocks are 4x4 texels in
+// memory row order; edge blocks of images that are not a multiple of
+// 4 replicate the last row / column.
+// BC1: RGB      (8 bytes / block, 4 color mode only)
+// BC3: RGBA     (BC1 color + BC4 alpha, 16 bytes / block)
+// BC4: R        (8 bytes / block)
+// BC5: RG       (two BC4 blocks, 16 bytes / block)
+// BC7: RGBA     (16 bytes / block, single subset modes only; mode 6
+//                or mode 5 when alpha does not follow the color)
+// Endpoints are fit with PCA and refined once with least squares,
+// index selection is vectorized (SSE2) where it is available.
+
+bool        IsBlockCompressed(TextureLayout::PixelFormat);
+uint32_t    BlockByteSize(TextureLayout::PixelFormat);
+uint64_t    CompressedSize(TextureLayout::PixelFormat, uint32_t width, uint32_t height);
+
+// "pixels" has "channelCount" channels, missing channels are taken as
+// 0 (alpha as 255). Block rows are distributed over the pool when it
+// is given, the pool must not be the one that runs the caller.
+void        CompressBC(std::byte* out, const uint8_t* pixels,
+                       uint32_t width, uint32_t height, uint32_t channelCount,
+                       TextureLayout::PixelFormat format, ThreadPool* pool = nullptr);
+// Inverse of the above, output is RGBA8
+void        DecompressBC(uint8_t* rgbaOut, const std::byte* blocks,
+                         uint32_t width, uint32_t height,
+                         TextureLayout::PixelFormat format);
+
+// Peak signal to noise ratio of the first "channelCount" channels,
+// "a" has "channelCount" channels and "rgba" has 4
+double      ComputePSNR(const uint8_t* a, uint32_t channelCount,
+                        const uint8_t* rgba, uint32_t width, uint32_t height);
@@ -0,0 +1,205 @@
+#include "texresidency.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <numbers>
+
+TextureResidency::TextureResidency(uint64_t budget)
+    : budgetBytes(budget)
+{}
+
+bool TextureResidency::Complete(const Entry& e)
+{
+    return e.trackedLayers == e.layers.size();
+}
+
+uint64_t TextureResidency::ResidentBytes(const Entry& e, uint32_t baseLevel)
+{
+    const TextureLayout& layout = e.layers.front().header.layout;
+    uint64_t size = 0;
+    for(uint32_t i = baseLevel; i < layout.mipCount; i++) size += layout.levelSizes[i];
+    return size * e.layers.size();
+}
+
+TextureResidency::Entry& TextureResidency::FindOrAdd(const void* texture,
+                                                     const std::string& name)
+{
+    auto [it, added] = entryIndices.emplace(texture, uint32_t(entries.size()));
+    if(added)
+        entries.push_back(Entry{name, nullptr, nullptr, TextureGL::LINEAR, TextureGL::REPEAT,
+                                {}, 0, 0, 0, 0.0f, false});
+    return entries[it->second];
+}
+
+void TextureResidency::Track(TextureGL& texture, TextureCache&& cache,
+                             TextureGL::SampleMode sampleMode,
+                             TextureGL::EdgeResolve edgeResolve,
+                             const std::string& name)
+{
+    Entry& e = FindOrAdd(&texture, name);
+    e.texture = &texture;
+    e.sampleMode = sampleMode;
+    e.edgeResolve = edgeResolve;
+    e.layers.clear();
+    e.layers.push_back(std::move(cache));
+    e.trackedLayers = 1;
+}
+
+void TextureResidency::TrackLayer(TextureArrayGL& texture, int layer, TextureCache&& cache,
+                                  TextureGL::SampleMode sampleMode,
+                                  TextureGL::EdgeResolve edgeResolve,
+                                  const std::string& name)
+{
+    Entry& e = FindOrAdd(&texture, name);
+    e.array = &texture;
+    e.sampleMode = sampleMode;
+    e.edgeResolve = edgeResolve;
+    e.layers.resize(size_t(texture.layerCount));
+    e.layers[size_t(layer)] = std::move(cache);
+    e.trackedLayers++;
+}
+
+void TextureResidency::Request(const void* texture, float screenRadius)
+{
+    auto it = entryIndices.find(texture);
+    if(it == entryIndices.end()) return;
+    Entry& e = entries[it->second];
+    e.screenRadius = std::max(e.screenRadius, screenRadius);
+}
+
+void TextureResidency::Reallocate(Entry& e, uint32_t baseLevel)
+{
+    // Immutable storage can not shrink, the levels are
+    // uploaded again into a new texture
+    if(e.texture)
+    {
+        const TextureCache& cache = e.layers.front();
+        glDeleteTextures(1, &e.texture->textureId);
+        glGenTextures(1, &e.texture->textureId);
+        e.texture->Upload(cache.header.layout, reinterpret_cast<uintptr_t>(cache.data),
+                          e.sampleMode, e.edgeResolve, baseLevel);
+    }
+    else
+    {
+        for(size_t i = 0; i < e.layers.size(); i++)
+            e.array->UploadLayer(int(i), e.layers[i].header.layout,
+                                 reinterpret_cast<uintptr_t>(e.layers[i].data),
+                                 e.sampleMode, e.edgeResolve, baseLevel);
+    }
+    e.baseLevel = baseLevel;
+}
+
+void TextureResidency::Update()
+{
+    // Finest level that the body can show, the texture width maps 1:1 to
+    // the pixels at the center of the disc when it is "2 pi r". Changes
+    // only when it is off by a quarter level, so bodies at a boundary do
+    // not flip between two levels.
+    for(Entry& e : entries)
+    {
+        if(!Complete(e)) continue;
+        const TextureLayout& layout = e.layers.front().header.layout;
+        uint32_t coarsest = layout.mipCount - 1;
+        float level = std::log2(float(layout.width) /
+                                (2.0f * std::numbers::pi_v<float> * e.screenRadius));
+        level = std::clamp(level, 0.0f, float(coarsest));
+        if(level < float(e.wantedLevel) - 0.25f || level > float(e.wantedLevel) + 1.25f)
+            e.wantedLevel = uint32_t(level);
+        e.fullResolution = std::isinf(e.screenRadius);
+        e.screenRadius = 0.0f;
+    }
+
+    // Targets start fully resident, then levels are dropped from the
+    // texture that is the most levels finer than it can show (larger
+    // one on a tie) until the total fits, full resolution ones are kept
+    std::vector<uint32_t> targets(entries.size(), 0);
+    uint64_t targetBytes = 0;
+    uint64_t residentBytes = 0;
+    for(const Entry& e : entries)
+    {
+        if(!Complete(e)) continue;
+        targetBytes += ResidentBytes(e, 0);
+        residentBytes += ResidentBytes(e, e.baseLevel);
+    }
+    while(targetBytes > budgetBytes)
+    {
+        size_t best = entries.size();
+        int64_t bestSurplus = std::numeric_limits<int64_t>::min();
+        uint64_t bestBytes = 0;
+        for(size_t i = 0; i < entries.size(); i++)
+        {
+            const Entry& e = entries[i];
+            if(!Complete(e) || e.fullResolution ||
+               targets[i] + 1 >= e.layers.front().header.layout.mipCount)
+                continue;
+            int64_t surplus = int64_t(e.wantedLevel) - int64_t(targets[i]);
+            uint64_t bytes = ResidentBytes(e, targets[i]);
+            if(surplus > bestSurplus || (surplus == bestSurplus && bytes > bestBytes))
+            {
+                best = i;
+                bestSurplus = surplus;
+                bestBytes = bytes;
+            }
+        }
+        if(best == entries.size()) break;
+        targetBytes -= bestBytes - ResidentBytes(entries[best], targets[best] + 1);
+        targets[best]++;
+    }
+
+    // One reallocation per frame; while over the budget the one that frees
+    // the most, otherwise the restore that is the most levels off and fits
+    size_t chosen = entries.size();
+    uint64_t chosenKey = 0;
+    bool overBudget = (residentBytes > budgetBytes);
+    for(size_t i = 0; i < entries.size(); i++)
+    {
+        const Entry& e = entries[i];
+        if(!Complete(e) || targets[i] == e.baseLevel) continue;
+
+        uint64_t current = ResidentBytes(e, e.baseLevel);
+        uint64_t target = ResidentBytes(e, targets[i]);
+        uint64_t key = 0;
+        if(overBudget && targets[i] > e.baseLevel)
+            key = current - target;
+        else if(!overBudget && targets[i] < e.baseLevel &&
+                residentBytes - current + target <= budgetBytes)
+            key = e.baseLevel - targets[i];
+        if(key > chosenKey)
+        {
+            chosen = i;
+            chosenKey = key;
+        }
+    }
+    if(chosen == entries.size()) return;
+
+    Entry& e = entries[chosen];
+    bool evict = targets[chosen] > e.baseLevel;
+    residentBytes += ResidentBytes(e, targets[chosen]);
+    residentBytes -= ResidentBytes(e, e.baseLevel);
+    Reallocate(e, targets[chosen]);
+    if(evict) evictionCount++;
+    else restoreCount++;
+
+    const TextureLayout& layout = e.layers.front().header.layout;
+    std::printf("Texture \"%s\" is %s to %ux%u (%.2f/%.2f MiB resident).\n",
+                e.name.c_str(), evict ? "reduced" : "restored",
+                std::max(1u, layout.width >> e.baseLevel),
+                std::max(1u, layout.height >> e.baseLevel),
+                double(residentBytes) / (1024.0 * 1024.0),
+                double(budgetBytes) / (1024.0 * 1024.0));
+}
+
+TextureResidency::Stats TextureResidency::GetStats() const
+{
+    Stats stats = {0, 0, budgetBytes, 0, 0, evictionCount, restoreCount};
+    for(const Entry& e : entries)
+    {
+        if(!Complete(e)) continue;
+        stats.residentBytes += ResidentBytes(e, e.baseLevel);
+        stats.fullBytes += ResidentBytes(e, 0);
+        stats.textureCount++;
+        if(e.baseLevel != 0) stats.reducedCount++;
+    }
+    return stats;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "utility.h"
+
+// Keeps the textures within a memory budget by dropping their finest mip
+// levels. Every frame the bodies report the screen radius they are drawn
+// with, which gives the finest level each texture can show. While the
+// resident total is over the budget, levels are dropped from the
+// textures that are furthest above what they can show (unrequested ones
+// first); they are restored once they come close again and fit. A texture
+// is reallocated from its new base level and re-uploaded from its cache
+// mapping, at most one per frame. Textures requested at FULL_RESOLUTION
+// are never reduced.
+class TextureResidency
+{
+    public:
+    // Radius of a texture that must stay fully resident (i.e. the sky), it
+    // is exempt from the budget for the frames it is requested with
+    static constexpr float FULL_RESOLUTION = std::numeric_limits<float>::infinity();
+
+    struct Stats
+    {
+        uint64_t    residentBytes;
+        uint64_t    fullBytes;
+        uint64_t    budgetBytes;
+        uint32_t    textureCount;
+        // Textures that are missing their finest level(s)
+        uint32_t    reducedCount;
+        uint32_t    evictionCount;
+        uint32_t    restoreCount;
+    };
+
+    private:
+    struct Entry
+    {
+        std::string                 name;
+        // One of them is set
+        TextureGL*                  texture;
+        TextureArrayGL*             array;
+        TextureGL::SampleMode       sampleMode;
+        TextureGL::EdgeResolve      edgeResolve;
+        // One per layer, kept mapped for the re-uploads
+        std::vector<TextureCache>   layers;
+        uint32_t                    trackedLayers;
+        uint32_t                    baseLevel;
+        uint32_t                    wantedLevel;
+        float                       screenRadius;
+        // Requested at FULL_RESOLUTION last frame
+        bool                        fullResolution;
+    };
+
+    std::vector<Entry>                          entries;
+    std::unordered_map<const void*, uint32_t>   entryIndices;
+    uint64_t                                    budgetBytes;
+    uint32_t                                    evictionCount = 0;
+    uint32_t                                    restoreCount  = 0;
+
+    static bool     Complete(const Entry&);
+    static uint64_t ResidentBytes(const Entry&, uint32_t baseLevel);
+    Entry&          FindOrAdd(const void* texture, const std::string& name);
+    void            Request(const void* texture, float screenRadius);
+    void            Reallocate(Entry&, uint32_t baseLevel);
+
+    public:
+    explicit            TextureResidency(uint64_t budgetBytes);
+                        TextureResidency(const TextureResidency&) = delete;
+                        TextureResidency(TextureResidency&&) = delete;
+    TextureResidency&   operator=(const TextureResidency&) = delete;
+    TextureResidency&   operator=(TextureResidency&&) = delete;
+                        ~TextureResidency() = default;
+
+    // Textures are tracked right after their full upload (see TextureLoader),
+    // they must outlive the manager's use of them
+    void        Track(TextureGL&, TextureCache&&, TextureGL::SampleMode,
+                      TextureGL::EdgeResolve, const std::string& name);
+    void        TrackLayer(TextureArrayGL&, int layer, TextureCache&&,
+                           TextureGL::SampleMode, TextureGL::EdgeResolve,
+                           const std::string& name);
+
+    // Screen radius (in pixels, see "ProjectedSphereRadius") of a body
+    // that is drawn with the texture this frame, the largest one is kept.
+    // Untracked textures are ignored.
+    void        Request(const TextureGL&, float screenRadius);
+    void        Request(const TextureArrayGL&, float screenRadius);
+    // Once per frame after the requests, must be called on the context thread
+    void        Update();
+
+    void        SetBudget(uint64_t budgetBytes);
+    Stats       GetStats() const;
+};
+
+inline void TextureResidency::Request(const TextureGL& texture, float screenRadius)
+{
+    Request(static_cast<const void*>(&texture), screenRadius);
+}
+
+inline void TextureResidency::Request(const TextureArrayGL& texture, float screenRadius)
+{
+    Request(static_cast<const void*>(&texture), screenRadius);
+}
+
+inline void TextureResidency::SetBudget(uint64_t bytes)
+{
+    budgetBytes = bytes;
+}
@@ -0,0 +1,207 @@
+#include "textureloader.h"
+#include "texresidency.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+
+TextureLoader::TextureLoader(TextureResidency* residencyManager, uint32_t threadCount)
+    : ring(RING_SIZE)
+    , residency(residencyManager)
+    , pool(threadCount)
+{}
+
+// Residency manager keeps the caches, a fresh build is swapped for
+// the mapping of the file it is written to so that it holds no memory
+static void MapRebuiltCache(TextureCache& cache, const std::string& texPath,
+                            const TextureBuildSettings& build)
+{
+    TextureCache mapped;
+    if(LoadTextureCache(mapped, TextureCachePath(texPath, build), texPath, build,
+                        ImageMipSettings(texPath)))
+        cache = std::move(mapped);
+}
+
+const TextureGL& TextureLoader::Load(const std::string& texPath,
+                                     TextureGL::SampleMode sampleMode,
+                                     TextureGL::EdgeResolve edgeResolve,
+                                     const glm::u8vec4& placeholderColor,
+                                     bool octahedral)
+{
+    uint32_t requestIndex = uint32_t(requests.size());
+    requests.push_back(Request{TextureGL(placeholderColor), texPath,
+                               sampleMode, edgeResolve, octahedral});
+    pendingCount++;
+    imageCount++;
+
+    // Queried here, workers have no context
+    TextureBuildSettings build;
+    build.compress = TextureCompressionSupported();
+    build.octahedral = octahedral;
+    pool.Submit([this, requestIndex, texPath, build]()
+    {
+        Result result = {requestIndex, NO_LAYER, false, false, TextureCache{}};
+        result.loaded = LoadOrBuildTextureCache(result.cache, texPath, build,
+                                                result.rebuilt);
+        if(result.loaded && result.rebuilt && residency)
+            MapRebuiltCache(result.cache, texPath, build);
+
+        std::lock_guard<std::mutex> lock(resultMutex);
+        results.push_back(std::move(result));
+    });
+    return requests.back().texture;
+}
+
+const TextureArrayGL& TextureLoader::LoadArray(const std::vector<std::string>& texPaths,
+                                               uint32_t width, uint32_t height,
+                                               TextureGL::SampleMode sampleMode,
+                                               TextureGL::EdgeResolve edgeResolve,
+                                               const glm::u8vec4& placeholderColor)
+{
+    uint32_t layerCount = uint32_t(texPaths.size());
+    uint32_t requestIndex = uint32_t(arrayRequests.size());
+    arrayRequests.push_back(ArrayRequest{TextureArrayGL(placeholderColor, int(layerCount)),
+                                         texPaths, sampleMode, edgeResolve});
+    pendingCount += layerCount;
+    imageCount += layerCount;
+
+    TextureBuildSettings build;
+    build.compress = TextureCompressionSupported();
+    build.width = width;
+    build.height = height;
+    for(uint32_t layer = 0; layer < layerCount; layer++)
+    {
+        pool.Submit([this, requestIndex, layer, texPath = texPaths[layer], build]()
+        {
+            Result result = {requestIndex, layer, false, false, TextureCache{}};
+            result.loaded = LoadOrBuildTextureCache(result.cache, texPath, build,
+                                                    result.rebuilt);
+            if(result.loaded && result.rebuilt && residency)
+                MapRebuiltCache(result.cache, texPath, build);
+
+            std::lock_guard<std::mutex> lock(resultMutex);
+            results.push_back(std::move(result));
+        });
+    }
+    return arrayRequests.back().texture;
+}
+
+// Bytes from the first level to the end of the last one
+static uint64_t LevelSpan(const TextureLayout& layout)
+{
+    uint32_t last = layout.mipCount - 1;
+    return layout.levelOffsets[last] + layout.levelSizes[last] - layout.levelOffsets[0];
+}
+
+uint32_t TextureLoader::Update()
+{
+    ring.Reclaim();
+    {
+        std::lock_guard<std::mutex> lock(resultMutex);
+        for(Result& r : results) waitingResults.push_back(std::move(r));
+        results.clear();
+    }
+
+    // Copies are started in order, a load that does not fit waits
+    // until the ring drains (ones larger than the ring skip it)
+    while(!waitingResults.empty())
+    {
+        Result& r = waitingResults.front();
+        if(!r.loaded)
+        {
+            const std::string& path = (r.layer == NO_LAYER)
+                                        ? requests[r.requestIndex].path
+                                        : arrayRequests[r.requestIndex].paths[r.layer];
+            std::fprintf(stderr, "Unable to read image \"%s\"\n", path.c_str());
+            std::exit(EXIT_FAILURE);
+        }
+        UploadRing::Region region = {0, 0};
+        uint64_t span = LevelSpan(r.cache.header.layout);
+        if(span <= ring.Capacity() && !ring.Allocate(region, span)) break;
+
+        StagedResult& staged = stagedResults.emplace_back();
+        staged.result = std::move(r);
+        staged.region = region;
+        waitingResults.pop_front();
+        if(region.reserved == 0) continue;
+
+        std::byte* dst = ring.Pointer(region);
+        const TextureCache* cache = &staged.result.cache;
+        staged.copy = pool.Submit([dst, cache, span]()
+        {
+            std::memcpy(dst, cache->Level(0), span);
+        });
+    }
+
+    // Uploads are issued in allocation order, so that the
+    // ring regions retire in order as well
+    uint32_t uploadCount = 0;
+    uint64_t uploadBytes = 0;
+    while(!stagedResults.empty() && uploadBytes < UPLOAD_BYTES_PER_FRAME)
+    {
+        StagedResult& staged = stagedResults.front();
+        bool fromRing = (staged.region.reserved != 0);
+        if(fromRing && staged.copy.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            break;
+
+        Result& r = staged.result;
+        const TextureLayout& layout = r.cache.header.layout;
+        // Level offsets are relative to the cache, shift them to the region
+        uintptr_t levelBase = reinterpret_cast<uintptr_t>(r.cache.data);
+        if(fromRing)
+        {
+            levelBase = uintptr_t(staged.region.offset) - uintptr_t(layout.levelOffsets[0]);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring.BufferId());
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        const std::string* path;
+        if(r.layer == NO_LAYER)
+        {
+            Request& request = requests[r.requestIndex];
+            request.texture.Upload(layout, levelBase, request.sampleMode, request.edgeResolve);
+            path = &request.path;
+        }
+        else
+        {
+            ArrayRequest& request = arrayRequests[r.requestIndex];
+            request.texture.UploadLayer(int(r.layer), layout, levelBase,
+                                        request.sampleMode, request.edgeResolve);
+            path = &request.paths[r.layer];
+        }
+        double uploadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if(fromRing)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            ring.Retire(staged.region);
+        }
+
+        double vramMiB = double(TextureDataSize(layout)) / (1024.0 * 1024.0);
+        std::string layerStr = (r.layer == NO_LAYER) ? "" : ", layer " + std::to_string(r.layer);
+        std::printf("Texture \"%s\" is loaded %s (%s, %ux%u, %.2f MiB%s, upload %.2f ms%s).\n",
+                    path->c_str(), r.rebuilt ? "succesfully" : "from cache",
+                    PixelFormatName(layout.format), layout.width, layout.height,
+                    vramMiB, layerStr.c_str(), uploadMs, fromRing ? "" : ", unstaged");
+        uploadBytes += TextureDataSize(layout);
+        uploadCount++;
+        if(residency && r.layer == NO_LAYER)
+        {
+            Request& request = requests[r.requestIndex];
+            residency->Track(request.texture, std::move(r.cache), request.sampleMode,
+                             request.edgeResolve, request.path);
+        }
+        else if(residency)
+        {
+            ArrayRequest& request = arrayRequests[r.requestIndex];
+            residency->TrackLayer(request.texture, int(r.layer), std::move(r.cache),
+                                  request.sampleMode, request.edgeResolve,
+                                  request.paths.front() + " (array)");
+        }
+        stagedResults.pop_front();
+    }
+    ring.Fence();
+
+    pendingCount -= uploadCount;
+    return uploadCount;
+}
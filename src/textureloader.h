@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "utility.h"
+#include "threadpool.h"
+#include "uploadring.h"
+
+class TextureResidency;
+
+// Loads the texture caches (decodes the images when stale) on worker
+// threads and uploads them on the GL context thread. Textures are usable right after "Load",
+// these show a 1x1 placeholder color until "Update" uploads them.
+// Texture arrays show the placeholder until all of their layers are uploaded.
+//
+// Loaded mip chains are copied by the workers into a persistently mapped
+// upload ring (see uploadring.h), the context thread only issues the
+// uploads from it; at most "UPLOAD_BYTES_PER_FRAME" are issued per
+// "Update" so that a burst of finished loads is spread over frames.
+// Uploaded textures are handed over to the residency manager when given.
+class TextureLoader
+{
+    public:
+    static constexpr uint64_t RING_SIZE              = 32 * 1024 * 1024;
+    static constexpr uint64_t UPLOAD_BYTES_PER_FRAME = 8 * 1024 * 1024;
+
+    private:
+    struct Request
+    {
+        TextureGL               texture;
+        std::string             path;
+        TextureGL::SampleMode   sampleMode;
+        TextureGL::EdgeResolve  edgeResolve;
+        bool                    octahedral;
+    };
+    struct ArrayRequest
+    {
+        TextureArrayGL              texture;
+        std::vector<std::string>    paths;
+        TextureGL::SampleMode       sampleMode;
+        TextureGL::EdgeResolve      edgeResolve;
+    };
+    // Layer is "NO_LAYER" for the "requests"
+    static constexpr uint32_t NO_LAYER = UINT32_MAX;
+    struct Result
+    {
+        uint32_t        requestIndex;
+        uint32_t        layer;
+        bool            loaded;
+        bool            rebuilt;
+        TextureCache    cache;
+    };
+    // Result whose levels are being copied into the ring
+    struct StagedResult
+    {
+        Result              result;
+        UploadRing::Region  region;
+        std::future<void>   copy;
+    };
+
+    // Deque keeps the returned references stable
+    std::deque<Request>     requests;
+    std::deque<ArrayRequest> arrayRequests;
+    uint32_t                imageCount = 0;
+    std::mutex              resultMutex;
+    std::vector<Result>     results;
+    uint32_t                pendingCount = 0;
+    // Loaded, waiting for ring space / being copied, in upload order
+    std::deque<Result>      waitingResults;
+    std::deque<StagedResult> stagedResults;
+    UploadRing              ring;
+    TextureResidency*       residency;
+    // Destroyed first, joins the workers
+    ThreadPool              pool;
+
+    public:
+    // Zero means "one per hardware thread"
+    explicit            TextureLoader(TextureResidency* residency = nullptr,
+                                      uint32_t threadCount = 0);
+                        TextureLoader(const TextureLoader&) = delete;
+                        TextureLoader(TextureLoader&&) = delete;
+    TextureLoader&      operator=(const TextureLoader&) = delete;
+    TextureLoader&      operator=(TextureLoader&&) = delete;
+                        ~TextureLoader() = default;
+
+    // Returned texture lives as long as the loader. Equirectangular
+    // images can be loaded as octahedral maps (see texcache.h).
+    const TextureGL&    Load(const std::string& texPath,
+                             TextureGL::SampleMode, TextureGL::EdgeResolve,
+                             const glm::u8vec4& placeholderColor = glm::u8vec4(128, 128, 128, 255),
+                             bool octahedral = false);
+    // Image "i" is layer "i" of the returned array, images are resampled
+    // to "width" x "height" when their size differs (see "ResizeImage")
+    const TextureArrayGL& LoadArray(const std::vector<std::string>& texPaths,
+                                    uint32_t width, uint32_t height,
+                                    TextureGL::SampleMode, TextureGL::EdgeResolve,
+                                    const glm::u8vec4& placeholderColor = glm::u8vec4(128, 128, 128, 255));
+    // Stages and uploads the finished loads, must be called on the
+    // context thread. Returns the number of images uploaded.
+    uint32_t            Update();
+
+    // Counts are in images, a layer of an array is one image
+    uint32_t            PendingCount() const;
+    uint32_t            TextureCount() const;
+};
+
+inline uint32_t TextureLoader::PendingCount() const
+{
+    return pendingCount;
+}
+
+inline uint32_t TextureLoader::TextureCount() const
+{
+    return imageCount;
+}
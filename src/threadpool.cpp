@@ -0,0 +1,55 @@
+#include "threadpool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(uint32_t threadCount)
+{
+    if(threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    workers.reserve(threadCount);
+    for(uint32_t i = 0; i < threadCount; i++)
+        workers.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopRequested = true;
+    }
+    queueCondition.notify_all();
+    for(std::thread& t : workers) t.join();
+}
+
+void ThreadPool::WorkerLoop()
+{
+    while(true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCondition.wait(lock, [this]()
+            {
+                return stopRequested || !tasks.empty();
+            });
+            // Drain the queue before stopping
+            if(tasks.empty()) return;
+
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+        task();
+    }
+}
+
+void ThreadPool::ParallelFor(uint32_t count,
+                             const std::function<void(uint32_t)>& f)
+{
+    std::vector<std::future<void>> futures;
+    futures.reserve(count);
+    for(uint32_t i = 0; i < count; i++)
+        futures.push_back(Submit([&f, i]() { f(i); }));
+    // "get" rethrows the exceptions of the tasks if any
+    for(std::future<void>& future : futures) future.get();
+}
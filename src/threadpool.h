@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <thread>
+#include <vector>
+#include <type_traits>
+
+// Fixed size worker pool with a single FIFO task queue.
+// Tasks must not block on other tasks of the same pool.
+class ThreadPool
+{
+    private:
+    std::vector<std::thread>            workers;
+    std::queue<std::function<void()>>   tasks;
+    std::mutex                          queueMutex;
+    std::condition_variable             queueCondition;
+    bool                                stopRequested = false;
+
+    void        WorkerLoop();
+
+    public:
+    // Zero means "one per hardware thread"
+    explicit    ThreadPool(uint32_t threadCount = 0);
+                ThreadPool(const ThreadPool&) = delete;
+                ThreadPool(ThreadPool&&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ThreadPool& operator=(ThreadPool&&) = delete;
+                ~ThreadPool();
+
+    uint32_t    ThreadCount() const;
+
+    template<class Func>
+    auto        Submit(Func&& f) -> std::future<std::invoke_result_t<Func>>;
+
+    // Calls "f(i)" for every i in [0, count) on the pool,
+    // returns when all of them are finished.
+    void        ParallelFor(uint32_t count,
+                            const std::function<void(uint32_t)>& f);
+};
+
+inline uint32_t ThreadPool::ThreadCount() const
+{
+    return uint32_t(workers.size());
+}
+
+template<class Func>
+auto ThreadPool::Submit(Func&& f) -> std::future<std::invoke_result_t<Func>>
+{
+    using Result = std::invoke_result_t<Func>;
+    // std::function requires copyable callables, hence the shared_ptr
+    auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Func>(f));
+    std::future<Result> future = task->get_future();
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        tasks.emplace([task]() { (*task)(); });
+    }
+    queueCondition.notify_one();
+    return future;
+}
@@ -0,0 +1,81 @@
+#include "uploadring.h"
+
+#include <cassert>
+
+static constexpr uint64_t AlignUp(uint64_t v, uint64_t alignment)
+{
+    return (v + alignment - 1) / alignment * alignment;
+}
+
+UploadRing::UploadRing(uint64_t size)
+    : capacity(AlignUp(size, ALIGNMENT))
+{
+    // Coherent, writes are visible to the commands issued after them
+    // without an explicit flush
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &bufferId);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, bufferId);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, GLsizeiptr(capacity), nullptr, flags);
+    mapping = static_cast<std::byte*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0,
+                                                       GLsizeiptr(capacity), flags));
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+UploadRing::~UploadRing()
+{
+    for(const FencedBytes& f : fences) glDeleteSync(f.fence);
+    if(!bufferId) return;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, bufferId);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &bufferId);
+}
+
+bool UploadRing::Allocate(Region& out, uint64_t size)
+{
+    size = AlignUp(size, ALIGNMENT);
+    if(mapping == nullptr || size > capacity) return false;
+
+    // Held bytes are a single run that ends at "head", the
+    // new region extends it (skipping the tail on a wrap)
+    uint64_t offset = head;
+    uint64_t skipped = 0;
+    if(offset + size > capacity)
+    {
+        skipped = capacity - offset;
+        offset = 0;
+    }
+    if(usedBytes + skipped + size > capacity) return false;
+
+    out = Region{offset, skipped + size};
+    usedBytes += out.reserved;
+    head = (offset + size == capacity) ? 0 : offset + size;
+    return true;
+}
+
+void UploadRing::Retire(const Region& region)
+{
+    retiredBytes += region.reserved;
+    assert(retiredBytes <= usedBytes);
+}
+
+void UploadRing::Fence()
+{
+    if(retiredBytes == 0) return;
+    fences.push_back(FencedBytes{glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0),
+                                 retiredBytes});
+    retiredBytes = 0;
+}
+
+void UploadRing::Reclaim()
+{
+    while(!fences.empty())
+    {
+        GLenum status = glClientWaitSync(fences.front().fence, 0, 0);
+        if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+
+        glDeleteSync(fences.front().fence);
+        usedBytes -= fences.front().byteCount;
+        fences.pop_front();
+    }
+}
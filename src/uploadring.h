@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+
+#include <glad/glad.h>
+
+// Persistently mapped buffer that GPU bound data is staged in. It has two
+// users: texture uploads bind it as the GL_PIXEL_UNPACK_BUFFER and read
+// their regions from it (see "TextureLoader"), "FrameUniforms" binds its
+// regions as uniform blocks with glBindBufferRange. Regions are handed
+// out back to back and wrap around, aligned to "ALIGNMENT" which covers
+// the uniform buffer offset alignment; any thread may write into an
+// allocated region, the rest must be called on the context thread. A
+// region is retired once the commands that read it are issued, it is
+// recycled when the fence that follows them passes, so the CPU never
+// writes over data that the GPU has not consumed yet.
+class UploadRing
+{
+    public:
+    static constexpr uint64_t ALIGNMENT = 256;
+
+    struct Region
+    {
+        uint64_t    offset;
+        // Bytes held, including the skipped tail of the buffer on a wrap
+        uint64_t    reserved;
+    };
+
+    private:
+    struct FencedBytes
+    {
+        GLsync      fence;
+        uint64_t    byteCount;
+    };
+
+    GLuint                  bufferId = 0;
+    std::byte*              mapping  = nullptr;
+    uint64_t                capacity;
+    uint64_t                head           = 0;
+    uint64_t                usedBytes      = 0;
+    uint64_t                retiredBytes   = 0;
+    std::deque<FencedBytes> fences;
+
+    public:
+    // Capacity is rounded up to "ALIGNMENT"
+    explicit        UploadRing(uint64_t capacity);
+                    UploadRing(const UploadRing&) = delete;
+                    UploadRing(UploadRing&&) = delete;
+    UploadRing&     operator=(const UploadRing&) = delete;
+    UploadRing&     operator=(UploadRing&&) = delete;
+                    ~UploadRing();
+
+    // Returns false when the region does not fit until earlier
+    // regions are recycled (or when it is larger than the ring)
+    bool            Allocate(Region& out, uint64_t size);
+    // Regions must be retired in allocation order
+    void            Retire(const Region&);
+    // Fences the regions retired since the last call, once per frame
+    void            Fence();
+    // Recycles the regions whose fence passed, does not wait
+    void            Reclaim();
+
+    std::byte*      Pointer(const Region&) const;
+    GLuint          BufferId() const;
+    uint64_t        Capacity() const;
+    uint64_t        UsedBytes() const;
+};
+
+inline std::byte* UploadRing::Pointer(const Region& region) const
+{
+    return mapping + region.offset;
+}
+
+inline GLuint UploadRing::BufferId() const
+{
+    return bufferId;
+}
+
+inline uint64_t UploadRing::Capacity() const
+{
+    return capacity;
+}
+
+inline uint64_t UploadRing::UsedBytes() const
+{
+    return usedBytes;
+}
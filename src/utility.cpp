@@ -1,17 +1,27 @@
 #include "utility.h"
+#include "objparser.h"
+#include "meshcache.h"
+#include "threadpool.h"
+#include "meshopt.h"
+#include "meshlet.h"
+#include "texcompress.h"
+#include "programcache.h"
+#include "shadersource.h"
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
-#include <stb_image.h>
 #include <glm/glm.hpp>
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <algorithm>
 #include <bit>
-#include <unordered_map>
+#include <chrono>
 #include <fstream>
+#include <filesystem>
+#include <thread>
 #include <vector>
-#include <charconv>
 #include <array>
 
 void SetupGLFWErrorCallback();
@@ -128,77 +138,42 @@ GLState::~GLState()
     glfwTerminate();
 }
 
-ShaderGL::ShaderGL(Type t, const std::string& path)
-{
-    std::ifstream file(path, std::ios::binary);
-    if(!file)
-    {
-        std::printf("Unable to open shader file at \"%s\".\n",
-                    path.c_str());
-        std::exit(EXIT_FAILURE);
-    }
-    GLint sourceSize = GLint(file.seekg(0, std::ios::end).tellg());
-    std::vector<GLchar> source(size_t(sourceSize + 1), '\0');
-    file.seekg(0, std::ios::beg);
-    file.read(source.data(), sourceSize);
-
-    // Create temporary shader
-    GLuint shaderGL = glCreateShader(t);
-    GLchar* srcPtr = source.data();
-    glShaderSource(shaderGL, 1, &srcPtr, &sourceSize);
-    glCompileShader(shaderGL);
-    GLint isCompiled = GL_FALSE;
-    glGetShaderiv(shaderGL, GL_COMPILE_STATUS, &isCompiled);
-    if(isCompiled == GL_FALSE)
-    {
-        std::fprintf(stderr, "Unable to compile shader \"%s\"\n",
-                     path.c_str());
-
-        GLint errLen = 0;
-        glGetShaderiv(shaderGL, GL_INFO_LOG_LENGTH, &errLen);
-        std::vector<char> errLog(size_t(errLen + 1), '\0');
-        glGetShaderInfoLog(shaderGL, errLen, &errLen, errLog.data());
-
-        // Use our own print here
-        PrintOpenGLError(GL_DEBUG_SOURCE_SHADER_COMPILER,
-                         GL_DEBUG_TYPE_ERROR, 0,
-                         GL_DEBUG_SEVERITY_HIGH,
-                         errLen, errLog.data(), nullptr);
-
-        std::exit(EXIT_FAILURE);
-    }
+// KHR_parallel_shader_compile, glad is generated without the extension
+static constexpr GLenum COMPLETION_STATUS_KHR = 0x91B1;
+using MaxShaderCompilerThreadsFunc = void (APIENTRY*)(GLuint);
 
-    shaderId = glCreateProgram();
-    glProgramParameteri(shaderId, GL_PROGRAM_SEPARABLE, GL_TRUE);
-    glAttachShader(shaderId, shaderGL);
-    glLinkProgram(shaderId);
-    GLint isLinked = GL_FALSE;
-    glGetProgramiv(shaderId, GL_LINK_STATUS, &isLinked);
-    if(isLinked == GL_FALSE)
+static bool ParallelShaderCompileSupported()
+{
+    // Driver picks the thread count
+    static const bool hasParallel = []()
     {
-        std::fprintf(stderr, "Unable to link shader \"%s\"\n",
-                     path.c_str());
-
-        GLint errLen = 0;
-        glGetProgramiv(shaderId, GL_INFO_LOG_LENGTH, &errLen);
-        std::vector<char> errLog(size_t(errLen + 1), '\0');
-        glGetProgramInfoLog(shaderId, errLen, &errLen, errLog.data());
-        PrintOpenGLError(GL_DEBUG_SOURCE_SHADER_COMPILER,
-                         GL_DEBUG_TYPE_ERROR, 0,
-                         GL_DEBUG_SEVERITY_HIGH,
-                         errLen, errLog.data(), nullptr);
-        std::exit(EXIT_FAILURE);
-    }
-    glDetachShader(shaderId, shaderGL);
-    glDeleteShader(shaderGL);
+        GLint extCount = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extCount);
+        for(GLint i = 0; i < extCount; i++)
+        {
+            const char* ext = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, GLuint(i)));
+            const char* func = nullptr;
+            if(std::strcmp(ext, "GL_KHR_parallel_shader_compile") == 0)
+                func = "glMaxShaderCompilerThreadsKHR";
+            else if(std::strcmp(ext, "GL_ARB_parallel_shader_compile") == 0)
+                func = "glMaxShaderCompilerThreadsARB";
+            if(!func) continue;
+
+            auto SetThreads = reinterpret_cast<MaxShaderCompilerThreadsFunc>(glfwGetProcAddress(func));
+            if(SetThreads) SetThreads(0xFFFFFFFF);
+            return true;
+        }
+        return false;
+    }();
+    return hasParallel;
+}
 
-    static const char* const VertexStr      = "Vertex";
-    static const char* const FragmentStr    = "Fragment";
-    const char* shaderTypeStr = nullptr;
+static const char* ShaderTypeString(ShaderGL::Type t, const std::string& path)
+{
     switch(t)
     {
-        case ShaderGL::VERTEX:      shaderTypeStr = VertexStr; break;
-        case ShaderGL::FRAGMENT:    shaderTypeStr = FragmentStr; break;
+        case ShaderGL::VERTEX:      return "Vertex";
+        case ShaderGL::FRAGMENT:    return "Fragment";
         default:
         {
             std::fprintf(stderr, "Unkown Shader Type while compiling \"%s\"!",
@@ -206,342 +181,589 @@ ShaderGL::ShaderGL(Type t, const std::string& path)
             std::exit(EXIT_FAILURE);
         }
     }
-    std::printf("%s Shader \"%s\" is compiled succesfully.\n",
-                shaderTypeStr, path.c_str());
 }
 
-// For mesh multiple index hashing
-struct ObjKeyType
+ShaderGL::ShaderGL(Type t, const std::string& shaderPath,
+                   const ShaderDefines& shaderDefines)
 {
-    uint32_t posIndex;
-    uint32_t uvIndex;
-    uint32_t normalIndex;
+    ShaderBatch batch;
+    *this = batch.Add(t, shaderPath, shaderDefines);
+    batch.Finish();
+}
 
-    bool operator==(const ObjKeyType& other) const
-    {
-        return (posIndex == other.posIndex &&
-                uvIndex == other.uvIndex &&
-                normalIndex == other.normalIndex);
-    }
-};
+ShaderBatch::~ShaderBatch()
+{
+    Finish();
+}
 
-template<>
-struct std::hash<ObjKeyType>
+ShaderGL ShaderBatch::Add(ShaderGL::Type t, const std::string& path,
+                         const ShaderDefines& defines)
 {
-    std::uint64_t operator()(const ObjKeyType& k) const
+    // Enables the driver threads before the first compile
+    ParallelShaderCompileSupported();
+    ShaderTypeString(t, path);
+
+    auto startTime = std::chrono::steady_clock::now();
+    Pending p = {0, 0, t, path, PermutationKey(defines), {}, 0, true, 0.0};
+    p.programId = glCreateProgram();
+    glProgramParameteri(p.programId, GL_PROGRAM_SEPARABLE, GL_TRUE);
+
+    // Stage is defined so that the shared includes can tell
+    // the vertex inputs apart from the fragment ones
+    ShaderDefines stageDefines = defines;
+    stageDefines.push_back((t == ShaderGL::VERTEX) ? "VERTEX_SHADER" : "FRAGMENT_SHADER");
+    ShaderSource source;
+    p.readable = ExpandShaderSource(source, path, stageDefines);
+    p.files = std::move(source.files);
+    p.sourceHash = HashBytes(source.text.data(), source.text.size());
+
+    // Warm starts load the linked program from its binary, the source
+    // is compiled when there is none or when the driver rejects it.
+    // Unreadable ones fail in "Finish".
+    if(p.readable &&
+       !LoadProgramCache(p.programId, ProgramCachePath(path, p.key), GLenum(t), p.sourceHash))
     {
-        return (k.posIndex * 7741ull +
-                k.normalIndex * 5113ull +
-                k.uvIndex * 9157ull);
+        glDeleteProgram(p.programId);
+        p.programId = glCreateProgram();
+        glProgramParameteri(p.programId, GL_PROGRAM_SEPARABLE, GL_TRUE);
+        // Binary is kept retrievable for the program cache
+        glProgramParameteri(p.programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+        // Statuses are not queried here, that would wait for the compile
+        p.stageId = glCreateShader(t);
+        const GLchar* srcPtr = source.text.data();
+        GLint sourceSize = GLint(source.text.size());
+        glShaderSource(p.stageId, 1, &srcPtr, &sourceSize);
+        glCompileShader(p.stageId);
+        glAttachShader(p.programId, p.stageId);
+        glLinkProgram(p.programId);
     }
-};
+    p.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+                                                     startTime).count();
+
+    ShaderGL shader;
+    shader.shaderId = p.programId;
+    shader.type = t;
+    shader.path = path;
+    shader.defines = defines;
+    shader.files = p.files;
+    pending.push_back(std::move(p));
+    return shader;
+}
 
-MeshGL::MeshGL(const std::string& objPath)
+bool ShaderBatch::Resolve(Pending& p, bool exitOnError)
 {
-    // ===================== //
-    //  PARSE WAVEFRONT OBJ  //
-    // ===================== //
-    std::from_chars_result result;
-    std::ifstream file(objPath);
-    if(!file)
+    auto startTime = std::chrono::steady_clock::now();
+    const char* shaderTypeStr = ShaderTypeString(p.type, p.path);
+    std::string name = p.path;
+    if(!p.key.empty()) name += " [" + p.key + "]";
+    if(!p.readable)
     {
-        std::fprintf(stderr, "Unable to open obj file \"%s\"\n",
-                     objPath.c_str());
-        std::exit(EXIT_FAILURE);
+        if(exitOnError) std::exit(EXIT_FAILURE);
+        return false;
     }
-    //
-    std::vector<glm::vec3> positions; positions.reserve(512);
-    std::vector<glm::vec3> normals;   normals.reserve(512);
-    std::vector<glm::vec2> uvs;       uvs.reserve(512);
-    std::vector<uint32_t> indices;    indices.reserve(512);
-    //
-    std::unordered_map<ObjKeyType, uint32_t> indexHashes;
-    indexHashes.reserve(1024 * 1024);
 
-    uint32_t indexCounter = 0;
-    std::string line;
-    while(std::getline(file, line))
+    if(p.stageId)
     {
-        if(line.size() >= 2 && line[0] == 'v' && line[1] == ' ')
+        GLint isCompiled = GL_FALSE;
+        glGetShaderiv(p.stageId, GL_COMPILE_STATUS, &isCompiled);
+        if(isCompiled == GL_FALSE)
         {
-            glm::vec3 pos;
-            if(sscanf(line.c_str(), "v %f %f %f", &pos[0], &pos[1], &pos[2]) == 3)
-            {
-                positions.push_back(pos);
-            }
+            std::fprintf(stderr, "Unable to compile shader \"%s\"\n",
+                         name.c_str());
+            // Log refers to the files by their source string number
+            if(p.files.size() > 1)
+                for(size_t i = 0; i < p.files.size(); i++)
+                    std::fprintf(stderr, "    %zu: \"%s\"\n", i, p.files[i].c_str());
+
+            GLint errLen = 0;
+            glGetShaderiv(p.stageId, GL_INFO_LOG_LENGTH, &errLen);
+            std::vector<char> errLog(size_t(errLen + 1), '\0');
+            glGetShaderInfoLog(p.stageId, errLen, &errLen, errLog.data());
+
+            // Use our own print here
+            PrintOpenGLError(GL_DEBUG_SOURCE_SHADER_COMPILER,
+                             GL_DEBUG_TYPE_ERROR, 0,
+                             GL_DEBUG_SEVERITY_HIGH,
+                             errLen, errLog.data(), nullptr);
+
+            if(exitOnError) std::exit(EXIT_FAILURE);
+            glDeleteShader(p.stageId);
+            return false;
         }
-        else if(line.size() >= 2 && line[0] == 'f' && line[1] == ' ')
-        {
-            auto ParseTriplet = [&](const std::string& line, size_t start, size_t end) -> ObjKeyType
-            {
-                std::string localView = line.substr(start, end - start);
-                const char* ptr = localView.c_str();
-                size_t s0  = 0;
-                size_t s1 = localView.find_first_of('/', s0);
-                size_t s2 = (s1 != std::string::npos) ? localView.find_first_of('/', s1 + 1) : std::string::npos;
-                size_t s3 = end - start;
-                
-                uint32_t pId = std::numeric_limits<uint32_t>::max();
-                uint32_t uvId = std::numeric_limits<uint32_t>::max();
-                uint32_t nId = std::numeric_limits<uint32_t>::max();
-                
-                // Pos
-                if(s1 != std::string::npos)
-                {
-                    result = std::from_chars(ptr + s0, ptr + s1, pId);
-                    assert(result.ec == std::errc());
-                }
-                else
-                {
-                    result = std::from_chars(ptr + s0, ptr + s3, pId);
-                    assert(result.ec == std::errc());
-                }
-                
-                // UV (optional)
-                if(s1 != std::string::npos && s2 != std::string::npos && s2 > s1 + 1)
-                {
-                    result = std::from_chars(ptr + s1 + 1, ptr + s2, uvId);
-                    assert(result.ec == std::errc());
-                }
-                
-                // Normal (optional)
-                if(s2 != std::string::npos && s2 + 1 < s3)
-                {
-                    result = std::from_chars(ptr + s2 + 1, ptr + s3, nId);
-                    assert(result.ec == std::errc());
-                }
-                
-                return ObjKeyType
-                {
-                    pId - 1,
-                    uvId - 1,
-                    nId - 1
-                };
-            };
-
-            size_t s0 = line.find_first_of(' ') + 1;
-            size_t s1 = line.find_first_of(' ', s0);
-            size_t s2 = (s1 != std::string::npos) ? line.find_first_of(' ', s1 + 1) : std::string::npos;
-            size_t s3 = line.size();
-            
-            if(s1 == std::string::npos) continue;
-            
-            auto pack0 = ParseTriplet(line, s0, s1);
-            auto pack1 = ParseTriplet(line, s1 + 1, (s2 != std::string::npos) ? s2 : s3);
-            
-            ObjKeyType pack2;
-            if(s2 != std::string::npos)
-            {
-                pack2 = ParseTriplet(line, s2 + 1, s3);
-            }
-
-            auto insertR = indexHashes.emplace(pack0, indexCounter);
-            if(insertR.second) indexCounter++;
-            indices.push_back(insertR.first->second);
-
-            insertR = indexHashes.emplace(pack1, indexCounter);
-            if(insertR.second) indexCounter++;
-            indices.push_back(insertR.first->second);
-
-            if(s2 != std::string::npos)
-            {
-                insertR = indexHashes.emplace(pack2, indexCounter);
-                if(insertR.second) indexCounter++;
-                indices.push_back(insertR.first->second);
-            }
-        }
-        else if(line.size() >= 3 && line[0] == 'v' && line[1] == 't' && line[2] == ' ')
-        {
-            glm::vec2 uv;
-            if(sscanf(line.c_str(), "vt %f %f", &uv[0], &uv[1]) == 2)
-            {
-                uvs.push_back(uv);
-            }
-        }
-        else if(line.size() >= 3 && line[0] == 'v' && line[1] == 'n' && line[2] == ' ')
+
+        GLint isLinked = GL_FALSE;
+        glGetProgramiv(p.programId, GL_LINK_STATUS, &isLinked);
+        if(isLinked == GL_FALSE)
         {
-            glm::vec3 normal;
-            if(sscanf(line.c_str(), "vn %f %f %f", &normal[0], &normal[1], &normal[2]) == 3)
-            {
-                normals.push_back(normal);
-            }
+            std::fprintf(stderr, "Unable to link shader \"%s\"\n",
+                         name.c_str());
+
+            GLint errLen = 0;
+            glGetProgramiv(p.programId, GL_INFO_LOG_LENGTH, &errLen);
+            std::vector<char> errLog(size_t(errLen + 1), '\0');
+            glGetProgramInfoLog(p.programId, errLen, &errLen, errLog.data());
+            PrintOpenGLError(GL_DEBUG_SOURCE_SHADER_COMPILER,
+                             GL_DEBUG_TYPE_ERROR, 0,
+                             GL_DEBUG_SEVERITY_HIGH,
+                             errLen, errLog.data(), nullptr);
+            if(exitOnError) std::exit(EXIT_FAILURE);
+            glDeleteShader(p.stageId);
+            return false;
         }
+        glDetachShader(p.programId, p.stageId);
+        glDeleteShader(p.stageId);
+
+        std::string cachePath = ProgramCachePath(p.path, p.key);
+        if(ProgramBinarySupported() &&
+           !WriteProgramCache(cachePath, p.programId, GLenum(p.type), p.sourceHash))
+            std::printf("[WARNING]: Unable to write program cache \"%s\".\n",
+                        cachePath.c_str());
     }
-    // Convert the data to single indexed mode
-    bool warnNormalsZero = false;
-    bool warnUVsZero = false;
-    std::vector<glm::vec3> linPositions; linPositions.resize(indexHashes.size());
-    std::vector<glm::vec3> linNormals;   linNormals.resize(indexHashes.size());
-    std::vector<glm::vec2> linUVs;       linUVs.resize(indexHashes.size());
-    for(const auto& entry : indexHashes)
+
+    p.ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+                                                      startTime).count();
+    std::printf("%s Shader \"%s\" is %s (%.2f ms).\n",
+                shaderTypeStr, name.c_str(),
+                p.stageId ? "compiled succesfully" : "loaded from its program binary", p.ms);
+    return true;
+}
+
+static bool IsComplete(GLuint programId)
+{
+    GLint isComplete = GL_TRUE;
+    glGetProgramiv(programId, COMPLETION_STATUS_KHR, &isComplete);
+    return isComplete == GL_TRUE;
+}
+
+bool ShaderBatch::IsReady() const
+{
+    if(!ParallelShaderCompileSupported()) return true;
+    return std::all_of(pending.begin(), pending.end(),
+                       [](const Pending& p) { return IsComplete(p.programId); });
+}
+
+bool ShaderBatch::Finish(bool exitOnError)
+{
+    // Ones that the driver reports as complete are checked first,
+    // otherwise the oldest one is waited on
+    bool succeeded = true;
+    while(!pending.empty())
     {
-        uint32_t i = entry.second;
-        linPositions[i] = positions[entry.first.posIndex];
-        if(entry.first.uvIndex != std::numeric_limits<uint32_t>::max())
-            linUVs[i] = uvs[entry.first.uvIndex];
-        else
-        {
-            warnUVsZero = true;
-            linUVs[i] = glm::vec2(0);
-        }
-        //
-        if(entry.first.normalIndex != std::numeric_limits<uint32_t>::max())
-            linNormals[i] = normals[entry.first.normalIndex];
-        else
+        auto it = pending.begin();
+        if(ParallelShaderCompileSupported())
         {
-            warnNormalsZero = true;
-            linNormals[i] = glm::vec3(0);
+            auto ready = std::find_if(pending.begin(), pending.end(),
+                                      [](const Pending& p) { return IsComplete(p.programId); });
+            if(ready != pending.end()) it = ready;
         }
+        succeeded &= Resolve(*it, exitOnError);
+        pending.erase(it);
+    }
+    return succeeded;
+}
+
+void PrintMeshOptStats(const std::string& objPath, const MeshOptStats& stats)
+{
+    std::printf("Mesh \"%s\" is optimized: ACMR %.3f -> %.3f, "
+                "ATVR %.3f -> %.3f (%u clusters)\n",
+                objPath.c_str(),
+                double(stats.before.acmr), double(stats.after.acmr),
+                double(stats.before.atvr), double(stats.after.atvr),
+                stats.clusterCount);
+}
+
+void OptimizeAndBuildMeshlets(MeshOptStats& stats, std::vector<Meshlet>& meshlets,
+                            MeshData& mesh, bool optimize)
+{
+    if(optimize) stats = OptimizeMesh(mesh);
+    // Meshlets regroup the triangles, cache order within the
+    // meshlets, vertex fetch order and the final cache stats
+    // are refreshed after
+    meshlets = BuildMeshlets(mesh);
+    if(!optimize) return;
+    OptimizeMeshletVertexCache(mesh, meshlets);
+    OptimizeVertexFetch(mesh);
+    stats.after = AnalyzeVertexCache(mesh.indices, uint32_t(mesh.positions.size()));
+}
+
+void UploadMeshGL(MeshGL& mesh, const MeshLayout& layout,
+                  const void* vertexData, const void* indexData)
+{
+    // Vertices
+    glGenBuffers(1, &mesh.vBufferId);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vBufferId);
+    glBufferStorage(GL_ARRAY_BUFFER, GLsizeiptr(layout.vertexBufferSize),
+                    vertexData, GL_DYNAMIC_STORAGE_BIT);
+    // Indices
+    glGenBuffers(1, &mesh.iBufferId);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.iBufferId);
+    glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, GLsizeiptr(layout.indexBufferSize),
+                    indexData, GL_DYNAMIC_STORAGE_BIT);
+
+    // VAO
+    glGenVertexArrays(1, &mesh.vaoId);
+    glBindVertexArray(mesh.vaoId);
+    if(layout.format == MeshLayout::FLOAT32)
+    {
+        // Pos (tightly packed vec3)
+        glBindVertexBuffer(0, mesh.vBufferId, GLintptr(layout.attribOffsets[0]), GLsizei(layout.attribStrides[0]));
+        glEnableVertexAttribArray(0);
+        glVertexAttribFormat(0, 3, GL_FLOAT, false, 0);
+        // Normal (tightly packed vec3)
+        glBindVertexBuffer(1, mesh.vBufferId, GLintptr(layout.attribOffsets[1]), GLsizei(layout.attribStrides[1]));
+        glEnableVertexAttribArray(1);
+        glVertexAttribFormat(1, 3, GL_FLOAT, false, 0);
+        // UV (tightly packed vec2)
+        glBindVertexBuffer(2, mesh.vBufferId, GLintptr(layout.attribOffsets[2]), GLsizei(layout.attribStrides[2]));
+        glEnableVertexAttribArray(2);
+        glVertexAttribFormat(2, 2, GL_FLOAT, false, 0);
+
+        glVertexAttribBinding(0, MeshGL::IN_POS);
+        glVertexAttribBinding(1, MeshGL::IN_NORMAL);
+        glVertexAttribBinding(2, MeshGL::IN_UV);
+    }
+    else
+    {
+        // Single interleaved binding, shaders decode the
+        // position scale and the octahedral normal
+        glBindVertexBuffer(0, mesh.vBufferId, 0, GLsizei(layout.attribStrides[0]));
+        // Pos (snorm16x3)
+        glEnableVertexAttribArray(MeshGL::IN_POS);
+        glVertexAttribFormat(MeshGL::IN_POS, 3, GL_SHORT, true, GLuint(layout.attribOffsets[0]));
+        // Normal (octahedral snorm16x2)
+        glEnableVertexAttribArray(MeshGL::IN_NORMAL);
+        glVertexAttribFormat(MeshGL::IN_NORMAL, 2, GL_SHORT, true, GLuint(layout.attribOffsets[1]));
+        // UV (unorm16x2)
+        glEnableVertexAttribArray(MeshGL::IN_UV);
+        glVertexAttribFormat(MeshGL::IN_UV, 2, GL_UNSIGNED_SHORT, true, GLuint(layout.attribOffsets[2]));
+
+        glVertexAttribBinding(MeshGL::IN_POS, 0);
+        glVertexAttribBinding(MeshGL::IN_NORMAL, 0);
+        glVertexAttribBinding(MeshGL::IN_UV, 0);
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.iBufferId);
+
+    mesh.indexCount = layout.indexCount;
+    mesh.indexType = (layout.indexSize == sizeof(uint16_t)) ? GL_UNSIGNED_SHORT
+                                                            : GL_UNSIGNED_INT;
+    mesh.format = layout.format;
+    mesh.posScale = layout.posScale;
+    mesh.posOffset = layout.posOffset;
+    mesh.uvScale = layout.uvScale;
+    mesh.uvOffset = layout.uvOffset;
+    assert(mesh.indexCount % 3 == 0);
+}
+
+MeshGL::MeshGL(const std::string& objPath,
+               MeshLayout::VertexFormat vertexFormat, bool optimize)
+{
+    // ===================== //
+    //   TRY BINARY CACHE    //
+    // ===================== //
+    std::string cachePath = std::filesystem::path(objPath)
+                                .replace_extension(".meshbin").string();
+    MeshCache cache;
+    if(LoadMeshCache(cache, cachePath, objPath) &&
+       bool(cache.header.flags & MeshCacheHeader::OPTIMIZED) == optimize &&
+       cache.header.layout.format == vertexFormat)
+    {
+        UploadMeshGL(*this, cache.header.layout,
+                     cache.vertexData, cache.indexData);
+        meshlets.assign(cache.meshlets, cache.meshlets + cache.header.meshletCount);
+        std::printf("Obj file \"%s\" is loaded from cache \"%s\".\n",
+                    objPath.c_str(), cachePath.c_str());
+        if(optimize) PrintMeshOptStats(objPath, cache.header.optStats);
+        return;
+    }
+
+    // ===================== //
+    //  PARSE WAVEFRONT OBJ  //
+    // ===================== //
+    // Large (high resolution) meshes are parsed on all cores, with a
+    // single core the split only adds the merge pass (~10% slower)
+    static constexpr uint64_t PARALLEL_PARSE_THRESHOLD = 16ull * 1024 * 1024;
+    FileStamp objStamp;
+    bool isLarge = (std::thread::hardware_concurrency() > 1 &&
+                    GetFileStamp(objStamp, objPath) &&
+                    objStamp.size >= PARALLEL_PARSE_THRESHOLD);
+    MeshData mesh;
+    bool parsed = false;
+    if(isLarge)
+    {
+        ThreadPool pool;
+        parsed = ParseObjParallel(mesh, objPath, pool);
     }
-    // Delete tmp buffers
-    positions = std::vector<glm::vec3>();
-    normals = std::vector<glm::vec3>();
-    uvs = std::vector<glm::vec2>();
+    else parsed = ParseObj(mesh, objPath);
+    if(!parsed) std::exit(EXIT_FAILURE);
 
-    if(warnNormalsZero)
+    uint32_t cacheFlags = 0;
+    if(mesh.missingNormals)
+    {
+        cacheFlags |= MeshCacheHeader::MISSING_NORMALS;
         std::printf("[WARNING]: Obj file \"%s\" has some of its "
                     "normals are not present. These are written as zero!\n",
                     objPath.c_str());
-    if(warnUVsZero)
+    }
+    if(mesh.missingUVs)
+    {
+        cacheFlags |= MeshCacheHeader::MISSING_UVS;
         std::printf("[WARNING]: Obj file \"%s\" has some of its "
                     "uvs are not present. These are written as zero!\n",
                     objPath.c_str());
+    }
 
     // ===================== //
-    //   GEN BUFFER AND VAO  //
+    //       OPTIMIZE        //
     // ===================== //
-    // Gen buffer
-    std::array<size_t, 3> sizes = {};
-    sizes[0] = linPositions.size() * sizeof(glm::vec3);
-    sizes[1] = linNormals.size() * sizeof(glm::vec3);
-    sizes[2] = linUVs.size() * sizeof(glm::vec2);
-    //
-    std::array<size_t, 4> offsets = {};
-    offsets[0] = 0;
-    for(uint32_t i = 1; i < 4; i++)
-    {
-        size_t alignedSize = (sizes[i - 1] + 255) / 256 * 256;
-        offsets[i] = offsets[i - 1] + alignedSize;
-    }
-
-    // Vertices
-    glGenBuffers(1, &vBufferId);
-    glBindBuffer(GL_ARRAY_BUFFER, vBufferId);
-    glBufferStorage(GL_ARRAY_BUFFER, GLintptr(offsets.back()), nullptr, GL_DYNAMIC_STORAGE_BIT);
-    // Load the data
-    glBufferSubData(GL_ARRAY_BUFFER, GLintptr(offsets[0]), GLsizei(sizes[0]), linPositions.data());
-    glBufferSubData(GL_ARRAY_BUFFER, GLintptr(offsets[1]), GLsizei(sizes[1]), linNormals.data());
-    glBufferSubData(GL_ARRAY_BUFFER, GLintptr(offsets[2]), GLsizei(sizes[2]), linUVs.data());
-    // Indices
-    glGenBuffers(1, &iBufferId);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, iBufferId);
-    glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, GLsizei(indices.size() * sizeof(uint32_t)),
-                    indices.data(), GL_DYNAMIC_STORAGE_BIT);
+    MeshOptStats optStats;
+    if(optimize) cacheFlags |= MeshCacheHeader::OPTIMIZED;
+    OptimizeAndBuildMeshlets(optStats, meshlets, mesh, optimize);
+    if(optimize) PrintMeshOptStats(objPath, optStats);
 
-    // VAO
-    glGenVertexArrays(1, &vaoId);
-    glBindVertexArray(vaoId);
-    // Pos (tightly packed vec3)
-    glBindVertexBuffer(0, vBufferId, GLintptr(offsets[0]), GLsizei(sizeof(glm::vec3)));
-    glEnableVertexAttribArray(0);
-    glVertexAttribFormat(0, 3, GL_FLOAT, false, 0);
-    // Normal (tightly packed vec3)
-    glBindVertexBuffer(1, vBufferId, GLintptr(offsets[1]), GLsizei(sizeof(glm::vec3)));
-    glEnableVertexAttribArray(1);
-    glVertexAttribFormat(1, 3, GL_FLOAT, false, 0);
-
-    // UV (tightly packed vec2)
-    glBindVertexBuffer(2, vBufferId, GLintptr(offsets[2]), GLsizei(sizeof(glm::vec2)));
-    glEnableVertexAttribArray(2);
-    glVertexAttribFormat(2, 2, GL_FLOAT, false, 0);
-
-    glVertexAttribBinding(0, IN_POS);
-    glVertexAttribBinding(1, IN_NORMAL);
-    glVertexAttribBinding(2, IN_UV);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, iBufferId);
+    // ===================== //
+    //   GEN BUFFER AND VAO  //
+    // ===================== //
+    MeshLayout layout = ComputeMeshLayout(mesh, vertexFormat);
+    std::vector<std::byte> vertexData = PackVertexBuffer(mesh, layout);
+    std::vector<std::byte> indexData = PackIndexBuffer(mesh, layout);
+    UploadMeshGL(*this, layout, vertexData.data(), indexData.data());
 
     std::printf("Obj file \"%s\" is loaded succesfully.\n",
                 objPath.c_str());
 
-    indexCount = uint32_t(indices.size());
-    assert(indexCount % 3 == 0);
+    // Next launch will skip the parsing
+    if(!WriteMeshCache(cachePath, objPath, layout, cacheFlags, optStats,
+                       vertexData.data(), indexData.data(), meshlets))
+        std::printf("[WARNING]: Unable to write mesh cache \"%s\"\n",
+                    cachePath.c_str());
+}
+
+MeshGL::MeshGL(MeshData&& mesh, const std::string& name,
+               MeshLayout::VertexFormat vertexFormat, bool optimize)
+{
+    MeshOptStats optStats;
+    OptimizeAndBuildMeshlets(optStats, meshlets, mesh, optimize);
+    if(optimize) PrintMeshOptStats(name, optStats);
+
+    MeshLayout layout = ComputeMeshLayout(mesh, vertexFormat);
+    std::vector<std::byte> vertexData = PackVertexBuffer(mesh, layout);
+    std::vector<std::byte> indexData = PackIndexBuffer(mesh, layout);
+    UploadMeshGL(*this, layout, vertexData.data(), indexData.data());
+    std::printf("Mesh \"%s\" is generated succesfully.\n", name.c_str());
 }
 
 TextureGL::TextureGL(const std::string& texPath,
                      SampleMode sampleMode, EdgeResolve edgeResolveMode)
 {
-    stbi_set_flip_vertically_on_load(1);
-    std::FILE* f = fopen(texPath.c_str(), "rb");
-    if(!f)
+    if(!std::filesystem::exists(texPath))
     {
         std::fprintf(stderr, "Unable to open image \"%s\"\n", texPath.c_str());
         std::exit(EXIT_FAILURE);
     }
-    //
-    bool is16Bit = stbi_is_16_bit_from_file(f);
-    void* rawPixels = nullptr;
-    if(is16Bit) rawPixels = stbi_load_from_file_16(f, &width, &height, &channelCount, 0);
-    else        rawPixels = stbi_load_from_file(f, &width, &height, &channelCount, 0);
-    fclose(f);
-    //
-    if(!rawPixels)
+    TextureCache cache;
+    bool rebuilt;
+    TextureBuildSettings build;
+    build.compress = TextureCompressionSupported();
+    if(!LoadOrBuildTextureCache(cache, texPath, build, rebuilt))
     {
         std::fprintf(stderr, "Unable to read image \"%s\"\n", texPath.c_str());
         std::exit(EXIT_FAILURE);
     }
+    glGenTextures(1, &textureId);
+    Upload(cache, sampleMode, edgeResolveMode);
+}
 
-    // Mipmap count calculation
-    uint32_t mipCount = uint32_t(std::max(width, height));
-    uint32_t temp = mipCount;
-    uint32_t log2 = 0;
-    while(temp > 1)
-    {
-        temp >>= 1;
-        log2++;
-    }
-    mipCount = log2 + 1;
-    //
-    GLenum internalFormatSized = 0;
-    GLenum internalFormat = 0;
-    GLenum pixType = (is16Bit) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
-    switch(channelCount)
+TextureGL::TextureGL(const glm::u8vec4& placeholderColor)
+{
+    // Mutable storage, so that "glTexStorage2D" can be called on it later
+    glGenTextures(1, &textureId);
+    glBindTexture(GL_TEXTURE_2D, textureId);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, &placeholderColor.x);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+}
+
+// EXT_texture_compression_s3tc enums, glad is
+// generated without the extension
+static constexpr GLenum COMPRESSED_RGB_S3TC_DXT1  = 0x83F0;
+static constexpr GLenum COMPRESSED_RGBA_S3TC_DXT5 = 0x83F3;
+// Sized internal format, format and type of "TextureLayout::PixelFormat"
+// (format and type are unused for the compressed ones)
+static constexpr std::array<std::array<GLenum, 3>, 13> GLFormats =
+{{
+    {GL_R8,     GL_RED,  GL_UNSIGNED_BYTE},
+    {GL_RG8,    GL_RG,   GL_UNSIGNED_BYTE},
+    {GL_RGB8,   GL_RGB,  GL_UNSIGNED_BYTE},
+    {GL_RGBA8,  GL_RGBA, GL_UNSIGNED_BYTE},
+    {GL_R16,    GL_RED,  GL_UNSIGNED_SHORT},
+    {GL_RG16,   GL_RG,   GL_UNSIGNED_SHORT},
+    {GL_RGB16,  GL_RGB,  GL_UNSIGNED_SHORT},
+    {GL_RGBA16, GL_RGBA, GL_UNSIGNED_SHORT},
+    {COMPRESSED_RGB_S3TC_DXT1,      GL_NONE, GL_NONE},
+    {COMPRESSED_RGBA_S3TC_DXT5,     GL_NONE, GL_NONE},
+    {GL_COMPRESSED_RED_RGTC1,       GL_NONE, GL_NONE},
+    {GL_COMPRESSED_RG_RGTC2,        GL_NONE, GL_NONE},
+    {GL_COMPRESSED_RGBA_BPTC_UNORM, GL_NONE, GL_NONE}
+}};
+
+bool TextureCompressionSupported()
+{
+    // RGTC (BC4/5) and BPTC (BC7) are core,
+    // S3TC (BC1/3) is an extension
+    static const bool hasS3TC = []()
     {
-        case 1: internalFormatSized = (is16Bit) ? GL_R16    : GL_R8;
-                internalFormat      = GL_RED;
-                break;
-        case 2: internalFormatSized = (is16Bit) ? GL_RG16   : GL_RG8;
-                internalFormat      = GL_RG;
-                break;
-        case 3: internalFormatSized = (is16Bit) ? GL_RGB16  : GL_RGB8;
-                internalFormat      = GL_RGB;
-                break;
-        case 4: internalFormatSized = (is16Bit) ? GL_RGBA16 : GL_RGBA8;
-                internalFormat      = GL_RGBA;
-                break;
-        default:
+        GLint extCount = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extCount);
+        for(GLint i = 0; i < extCount; i++)
         {
-            stbi_image_free(rawPixels);
-            std::fprintf(stderr, "Unkown image type!\n");
-            std::exit(EXIT_FAILURE);
+            const char* ext = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, GLuint(i)));
+            if(std::strcmp(ext, "GL_EXT_texture_compression_s3tc") == 0)
+                return true;
         }
+        return false;
+    }();
+    return hasS3TC;
+}
+
+GLenum GLInternalFormat(TextureLayout::PixelFormat format)
+{
+    return GLFormats[format][0];
+}
+
+// Level "i" of a chain whose levels start at "levelBase", a pointer
+// or an offset into the bound unpack buffer
+static const void* LevelSource(uintptr_t levelBase, const TextureLayout& layout, uint32_t i)
+{
+    return reinterpret_cast<const void*>(levelBase + uintptr_t(layout.levelOffsets[i]));
+}
+
+static void SetSampling(GLenum target, TextureGL::SampleMode sampleMode,
+                        TextureGL::EdgeResolve edgeResolveMode, uint32_t mipCount)
+{
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, GLint(mipCount - 1));
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, edgeResolveMode);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, edgeResolveMode);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, sampleMode);
+    if(sampleMode == TextureGL::NEAREST)
+        glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    else
+        glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+void TextureGL::Upload(const TextureCache& cache,
+                       SampleMode sampleMode, EdgeResolve edgeResolveMode)
+{
+    Upload(cache.header.layout, reinterpret_cast<uintptr_t>(cache.data),
+           sampleMode, edgeResolveMode);
+}
+
+void TextureGL::Upload(const TextureLayout& layout, uintptr_t levelBase,
+                       SampleMode sampleMode, EdgeResolve edgeResolveMode,
+                       uint32_t baseLevel)
+{
+    assert(baseLevel < layout.mipCount);
+    const std::array<GLenum, 3>& glFormat = GLFormats[layout.format];
+    width = int(layout.width);
+    height = int(layout.height);
+    channelCount = int(ChannelCount(layout.format));
+
+    uint32_t levelCount = layout.mipCount - baseLevel;
+    glBindTexture(GL_TEXTURE_2D, textureId);
+    glTexStorage2D(GL_TEXTURE_2D, GLsizei(levelCount), glFormat[0],
+                   std::max(1, width >> baseLevel), std::max(1, height >> baseLevel));
+    // Levels are tightly packed
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for(uint32_t i = baseLevel; i < layout.mipCount; i++)
+    {
+        GLint level = GLint(i - baseLevel);
+        GLsizei w = std::max(1, width >> i);
+        GLsizei h = std::max(1, height >> i);
+        if(IsBlockCompressed(layout.format))
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, w, h, glFormat[0],
+                                      GLsizei(layout.levelSizes[i]),
+                                      LevelSource(levelBase, layout, i));
+        else
+            glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, w, h,
+                            glFormat[1], glFormat[2], LevelSource(levelBase, layout, i));
     }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    SetSampling(GL_TEXTURE_2D, sampleMode, edgeResolveMode, levelCount);
+}
 
+TextureArrayGL::TextureArrayGL(const glm::u8vec4& placeholderColor, int layers)
+    : layerCount(layers)
+{
+    // Mutable storage (see "TextureGL")
+    std::vector<glm::u8vec4> texels(size_t(layerCount), placeholderColor);
     glGenTextures(1, &textureId);
-    glBindTexture(GL_TEXTURE_2D, textureId);
-    glTexStorage2D(GL_TEXTURE_2D, GLsizei(mipCount), internalFormatSized, width, height);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, internalFormat,
-                    pixType, rawPixels);
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, edgeResolveMode);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, edgeResolveMode);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, sampleMode);
-    if(sampleMode == NEAREST)
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    else
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textureId);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, 1, 1, layerCount, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, texels.data());
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+}
+
+void TextureArrayGL::UploadLayer(int layer, const TextureLayout& layout, uintptr_t levelBase,
+                                 TextureGL::SampleMode sampleMode,
+                                 TextureGL::EdgeResolve edgeResolveMode,
+                                 uint32_t base)
+{
+    assert(layer < layerCount);
+    assert(base < layout.mipCount);
+    const std::array<GLenum, 3>& glFormat = GLFormats[layout.format];
+    if(stagingTextureId == 0)
+    {
+        width = int(layout.width);
+        height = int(layout.height);
+        format = layout.format;
+        mipCount = layout.mipCount;
+        baseLevel = base;
+        uploadedLayers = 0;
+        glGenTextures(1, &stagingTextureId);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, stagingTextureId);
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, GLsizei(mipCount - baseLevel), glFormat[0],
+                       std::max(1, width >> baseLevel), std::max(1, height >> baseLevel),
+                       layerCount);
+        SetSampling(GL_TEXTURE_2D_ARRAY, sampleMode, edgeResolveMode, mipCount - baseLevel);
+    }
+    else if(layout.format != format || int(layout.width) != width ||
+            int(layout.height) != height || layout.mipCount != mipCount ||
+            base != baseLevel)
+    {
+        std::fprintf(stderr, "Texture array layers differ (%s %dx%d, %s %ux%u)\n",
+                     PixelFormatName(format), width, height,
+                     PixelFormatName(layout.format), layout.width, layout.height);
+        std::exit(EXIT_FAILURE);
+    }
 
-    stbi_image_free(rawPixels);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, stagingTextureId);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for(uint32_t i = baseLevel; i < mipCount; i++)
+    {
+        GLint level = GLint(i - baseLevel);
+        GLsizei w = std::max(1, width >> i);
+        GLsizei h = std::max(1, height >> i);
+        if(IsBlockCompressed(layout.format))
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, w, h, 1,
+                                      glFormat[0], GLsizei(layout.levelSizes[i]),
+                                      LevelSource(levelBase, layout, i));
+        else
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, w, h, 1,
+                            glFormat[1], glFormat[2], LevelSource(levelBase, layout, i));
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    // Complete, replaces the placeholder
+    if(++uploadedLayers == layerCount)
+    {
+        glDeleteTextures(1, &textureId);
+        textureId = stagingTextureId;
+        stagingTextureId = 0;
+    }
 }
 
 void SetupGLFWErrorCallback()
@@ -1,11 +1,17 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include <cassert>
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "meshcache.h"
+#include "meshlet.h"
+#include "texcache.h"
+#include "shadersource.h"
+
 struct GLFWwindow;
 using GLFWcursorposfun       = void (*)(GLFWwindow*, double, double);
 using GLFWmousebuttonfun     = void (*)(GLFWwindow*, int, int, int);
@@ -85,8 +91,17 @@ struct ShaderGL
     };
 
     GLuint      shaderId = 0;
+    // Source it is built from (see "ShaderReloader"),
+    // "files" are the path and its includes
+    Type        type     = VERTEX;
+    std::string path;
+    ShaderDefines defines;
+    std::vector<std::string> files;
     // Constructors, Movement & Destructor
-                ShaderGL(Type t, const std::string& path);
+                ShaderGL() = default;
+                // Compiled on its own, see "ShaderBatch"
+                ShaderGL(Type t, const std::string& shaderPath,
+                         const ShaderDefines& shaderDefines = {});
                 ShaderGL(const ShaderGL&) = delete;
                 ShaderGL(ShaderGL&&);
     ShaderGL&   operator=(const ShaderGL&) = delete;
@@ -94,6 +109,57 @@ struct ShaderGL
                 ~ShaderGL();
 };
 
+// Builds a set of shaders together. "Add" expands the source of a shader
+// (see "ExpandShaderSource", the stage is defined as "VERTEX_SHADER" or
+// "FRAGMENT_SHADER"), then issues its compile and link (or loads the
+// program binary of the permutation) without waiting on the result,
+// the statuses are checked in "Finish". The driver compiles them
+// concurrently (on its own threads with KHR_parallel_shader_compile)
+// while the caller prepares the rest. The shaders must not be used or
+// destroyed before "Finish" (the destructor finishes the rest).
+class ShaderBatch
+{
+    private:
+    struct Pending
+    {
+        GLuint          programId;
+        // Zero when the program is loaded from its binary
+        GLuint          stageId;
+        ShaderGL::Type  type;
+        std::string     path;
+        // Permutation, see "PermutationKey"
+        std::string     key;
+        std::vector<std::string> files;
+        // Hash of the expanded source
+        uint64_t        sourceHash;
+        bool            readable;
+        // Render thread time spent on it
+        double          ms;
+    };
+    std::vector<Pending>    pending;
+
+    static bool     Resolve(Pending&, bool exitOnError);
+
+    public:
+    // Constructors, Movement & Destructor
+                    ShaderBatch() = default;
+                    ShaderBatch(const ShaderBatch&) = delete;
+                    ShaderBatch(ShaderBatch&&) = delete;
+    ShaderBatch&    operator=(const ShaderBatch&) = delete;
+    ShaderBatch&    operator=(ShaderBatch&&) = delete;
+                    ~ShaderBatch();
+
+    ShaderGL        Add(ShaderGL::Type, const std::string& path,
+                        const ShaderDefines& defines = {});
+    // Does not wait; true when "Finish" would not wait either
+    // (always true without KHR_parallel_shader_compile)
+    bool            IsReady() const;
+    // Waits for the shaders, ready ones first. Exits on a compile or link
+    // error like "ShaderGL" does, otherwise the error is printed, the
+    // failed program is left to its "ShaderGL" and false is returned
+    bool            Finish(bool exitOnError = true);
+};
+
 struct MeshGL
 {
     // These intake Ids must match to the vertex shader
@@ -103,19 +169,52 @@ struct MeshGL
     static constexpr GLuint IN_UV       = 2;
     static constexpr GLuint IN_COLOR    = 3;
 
-    GLuint vBufferId  = 0;
-    GLuint iBufferId  = 0;
-    GLuint vaoId      = 0;
-    GLuint indexCount = 0;
+    GLuint      vBufferId   = 0;
+    GLuint      iBufferId   = 0;
+    GLuint      vaoId       = 0;
+    GLuint      indexCount  = 0;
+    // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT,
+    // draw calls must use this
+    GLenum      indexType   = GL_UNSIGNED_INT;
+    MeshLayout::VertexFormat format = MeshLayout::FLOAT32;
+    glm::vec3   posScale    = glm::vec3(1.0f);
+    glm::vec3   posOffset   = glm::vec3(0.0f);
+    glm::vec2   uvScale     = glm::vec2(1.0f);
+    glm::vec2   uvOffset    = glm::vec2(0.0f);
+    // Clusters of the index buffer for culling (see meshlet.h)
+    std::vector<Meshlet> meshlets;
     // Constructors, Movement & Destructor
-            MeshGL(const std::string& objPath);
+    // Optimization reorders the triangles and vertices for the
+    // post-transform cache, overdraw and vertex fetch (see meshopt.h),
+    // meshlets are always built.
+            MeshGL(const std::string& objPath,
+                   MeshLayout::VertexFormat format = MeshLayout::QUANTIZED,
+                   bool optimize = true);
+    // From an in-memory (i.e. procedural) mesh,
+    // "name" is only used for the log
+            MeshGL(MeshData&& mesh, const std::string& name,
+                   MeshLayout::VertexFormat format = MeshLayout::QUANTIZED,
+                   bool optimize = true);
             MeshGL(const MeshGL&) = delete;
             MeshGL(MeshGL&&);
     MeshGL& operator=(const MeshGL&) = delete;
     MeshGL& operator=(MeshGL&&);
             ~MeshGL();
+
+    // Vertex decode of the draw block ("DrawBlock::meshDecode"),
+    // vertex shaders that read this mesh need these.
+    // [0]: xyz position scale, w is 1 if normals are octahedral
+    // [1]: xyz position offset
+    // [2]: xy uv scale, zw uv offset
+    void    DecodeVectors(glm::vec4 (&out)[3]) const;
 };
 
+// Every "TextureLayout" block compressed format can be
+// uploaded (requires a current context)
+bool    TextureCompressionSupported();
+// Sized internal format of the layout format
+GLenum  GLInternalFormat(TextureLayout::PixelFormat);
+
 struct TextureGL
 {
     enum SampleMode
@@ -136,18 +235,68 @@ struct TextureGL
     int     height       = 0;
     int     channelCount = 0;
     //
+    // Loads through the texture cache (see texcache.h),
+    // compressed when it is supported
                 TextureGL(const std::string& texPath,
                           SampleMode, EdgeResolve);
+    // 1x1 texture of the given color, "Upload" replaces it
+    // with the actual image later (see TextureLoader)
+    explicit    TextureGL(const glm::u8vec4& placeholderColor);
                 TextureGL(const TextureGL&) = delete;
                 TextureGL(TextureGL&&);
     TextureGL&  operator=(const TextureGL&) = delete;
     TextureGL&  operator=(TextureGL&&);
                 ~TextureGL();
+
+    // Allocates and uploads the mip chain of the cache
+    void        Upload(const TextureCache&, SampleMode, EdgeResolve);
+    // Level "i" is read from "levelBase + layout.levelOffsets[i]", an
+    // offset into the GL_PIXEL_UNPACK_BUFFER when one is bound. Levels
+    // finer than "baseLevel" are left out (see TextureResidency).
+    void        Upload(const TextureLayout&, uintptr_t levelBase, SampleMode, EdgeResolve,
+                       uint32_t baseLevel = 0);
+};
+
+// Same sized images as the layers of a single array texture, bodies
+// drawn with the same shader select theirs with a layer index and
+// share one bind
+struct TextureArrayGL
+{
+    GLuint  textureId    = 0;
+    int     width        = 0;
+    int     height       = 0;
+    int     layerCount   = 0;
+    // Layers are uploaded into this one until all of them are
+    // there, then it replaces the placeholder
+    GLuint  stagingTextureId = 0;
+    int     uploadedLayers   = 0;
+    TextureLayout::PixelFormat format = TextureLayout::RGBA8;
+    uint32_t mipCount    = 0;
+    uint32_t baseLevel   = 0;
+    //
+    // "layerCount" 1x1 layers of the given color, "UploadLayer"
+    // replaces them with the actual images later
+                    TextureArrayGL(const glm::u8vec4& placeholderColor, int layerCount);
+                    TextureArrayGL(const TextureArrayGL&) = delete;
+                    TextureArrayGL(TextureArrayGL&&);
+    TextureArrayGL& operator=(const TextureArrayGL&) = delete;
+    TextureArrayGL& operator=(TextureArrayGL&&);
+                    ~TextureArrayGL();
+
+    // Uploads the mip chain of a layer (see "TextureGL::Upload"), the
+    // first one allocates the array and the rest must have its layout
+    void            UploadLayer(int layer, const TextureLayout&, uintptr_t levelBase,
+                                TextureGL::SampleMode, TextureGL::EdgeResolve,
+                                uint32_t baseLevel = 0);
 };
 
 // Inline Definitions
 inline ShaderGL::ShaderGL(ShaderGL&& other)
     : shaderId(other.shaderId)
+    , type(other.type)
+    , path(std::move(other.path))
+    , defines(std::move(other.defines))
+    , files(std::move(other.files))
 {
     other.shaderId = 0;
 }
@@ -155,7 +304,12 @@ inline ShaderGL::ShaderGL(ShaderGL&& other)
 inline ShaderGL& ShaderGL::operator=(ShaderGL&& other)
 {
     assert(this != &other);
+    if(shaderId) glDeleteProgram(shaderId);
     shaderId = other.shaderId;
+    type = other.type;
+    path = std::move(other.path);
+    defines = std::move(other.defines);
+    files = std::move(other.files);
     other.shaderId = 0;
     return *this;
 }
@@ -169,6 +323,14 @@ inline MeshGL::MeshGL(MeshGL&& other)
     : vBufferId(other.vBufferId)
     , iBufferId(other.iBufferId)
     , vaoId(other.vaoId)
+    , indexCount(other.indexCount)
+    , indexType(other.indexType)
+    , format(other.format)
+    , posScale(other.posScale)
+    , posOffset(other.posOffset)
+    , uvScale(other.uvScale)
+    , uvOffset(other.uvOffset)
+    , meshlets(std::move(other.meshlets))
 {
     other.vBufferId = 0;
     other.iBufferId = 0;
@@ -181,12 +343,28 @@ inline MeshGL& MeshGL::operator=(MeshGL&& other)
     vBufferId = other.vBufferId;
     iBufferId = other.iBufferId;
     vaoId = other.vaoId;
+    indexCount = other.indexCount;
+    indexType = other.indexType;
+    format = other.format;
+    posScale = other.posScale;
+    posOffset = other.posOffset;
+    uvScale = other.uvScale;
+    uvOffset = other.uvOffset;
+    meshlets = std::move(other.meshlets);
     other.vBufferId = 0;
     other.iBufferId = 0;
     other.vaoId = 0;
     return *this;
 }
 
+inline void MeshGL::DecodeVectors(glm::vec4 (&out)[3]) const
+{
+    float octNormals = (format == MeshLayout::QUANTIZED) ? 1.0f : 0.0f;
+    out[0] = glm::vec4(posScale, octNormals);
+    out[1] = glm::vec4(posOffset, 0.0f);
+    out[2] = glm::vec4(uvScale, uvOffset);
+}
+
 inline MeshGL::~MeshGL()
 {
     if(vaoId) glDeleteVertexArrays(1, &vaoId);
@@ -196,6 +374,9 @@ inline MeshGL::~MeshGL()
 
 inline TextureGL::TextureGL(TextureGL&& other)
     : textureId(other.textureId)
+    , width(other.width)
+    , height(other.height)
+    , channelCount(other.channelCount)
 {
     other.textureId = 0;
 }
@@ -204,6 +385,9 @@ inline TextureGL& TextureGL::operator=(TextureGL&& other)
 {
     assert(this != &other);
     textureId = other.textureId;
+    width = other.width;
+    height = other.height;
+    channelCount = other.channelCount;
     other.textureId = 0;
     return *this;
 }
@@ -213,6 +397,44 @@ inline TextureGL::~TextureGL()
     if(textureId) glDeleteTextures(1, &textureId);
 }
 
+inline TextureArrayGL::TextureArrayGL(TextureArrayGL&& other)
+    : textureId(other.textureId)
+    , width(other.width)
+    , height(other.height)
+    , layerCount(other.layerCount)
+    , stagingTextureId(other.stagingTextureId)
+    , uploadedLayers(other.uploadedLayers)
+    , format(other.format)
+    , mipCount(other.mipCount)
+    , baseLevel(other.baseLevel)
+{
+    other.textureId = 0;
+    other.stagingTextureId = 0;
+}
+
+inline TextureArrayGL& TextureArrayGL::operator=(TextureArrayGL&& other)
+{
+    assert(this != &other);
+    textureId = other.textureId;
+    width = other.width;
+    height = other.height;
+    layerCount = other.layerCount;
+    stagingTextureId = other.stagingTextureId;
+    uploadedLayers = other.uploadedLayers;
+    format = other.format;
+    mipCount = other.mipCount;
+    baseLevel = other.baseLevel;
+    other.textureId = 0;
+    other.stagingTextureId = 0;
+    return *this;
+}
+
+inline TextureArrayGL::~TextureArrayGL()
+{
+    if(textureId) glDeleteTextures(1, &textureId);
+    if(stagingTextureId) glDeleteTextures(1, &stagingTextureId);
+}
+
 // Shadow Framebuffer
 struct ShadowFBO
 {
@@ -0,0 +1,477 @@
+#include "virtualtexture.h"
+#include "texcompress.h"
+#include "utility.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+uint32_t VirtualTexture::PageKey(uint32_t level, uint32_t x, uint32_t y)
+{
+    // 14 bits per coordinate is 2M texels per side
+    return (level << 28) | (y << 14) | x;
+}
+
+void VirtualTexture::UnpackKey(uint32_t& level, uint32_t& x, uint32_t& y, uint32_t key)
+{
+    level = key >> 28;
+    y = (key >> 14) & 0x3FFF;
+    x = key & 0x3FFF;
+}
+
+VirtualTexture::VirtualTexture(const std::string& imgPath, uint32_t atlasSideIn)
+    : sourcePath(imgPath)
+    , compressedAtlas(TextureCompressionSupported())
+    , atlasSide(atlasSideIn)
+    , pool(1)
+{
+    // Cutting the pages decodes the whole image once,
+    // "TexturePrebuild" does it offline
+    pool.Submit([this]()
+    {
+        bool rebuilt = false;
+        bool loaded = LoadOrBuildVirtualTextureCache(cache, sourcePath, rebuilt);
+        if(loaded && rebuilt)
+            std::printf("Virtual texture \"%s\" pages are built.\n", sourcePath.c_str());
+
+        std::lock_guard<std::mutex> lock(resultMutex);
+        cacheLoaded = loaded;
+        cacheFailed = !loaded;
+    });
+}
+
+VirtualTexture::~VirtualTexture()
+{
+    glDeleteSync(feedbackFence);
+    glDeleteBuffers(1, &feedbackPBO);
+    glDeleteTextures(1, &feedbackTextureId);
+    glDeleteFramebuffers(1, &feedbackFBO);
+    glDeleteTextures(1, &indirectionTextureId);
+    glDeleteTextures(1, &atlasTextureId);
+}
+
+uint32_t VirtualTexture::CapacityForScreen(int width, int height)
+{
+    using L = VirtualTextureLayout;
+    // Pages of the screen at the finest level, +1 on each side for the
+    // partially covered ones; twice of it for the parents and the
+    // level transitions
+    uint32_t pagesX = uint32_t(width) / L::PAGE_SIZE + 2;
+    uint32_t pagesY = uint32_t(height) / L::PAGE_SIZE + 2;
+    uint32_t pageCount = 2 * pagesX * pagesY + 1;
+    uint32_t side = uint32_t(std::ceil(std::sqrt(double(pageCount))));
+    // Indirection stores the slot coordinates as 8-bit
+    return std::min(side, 255u);
+}
+
+void VirtualTexture::Initialize()
+{
+    using L = VirtualTextureLayout;
+    const L& layout = cache.header.layout;
+    uint32_t rootLevel = layout.levelCount - 1;
+    uint32_t rootPageCount = layout.pagesX[rootLevel] * layout.pagesY[rootLevel];
+
+    // Root pages are never evicted, leave room for the rest
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    uint32_t minSide = uint32_t(std::ceil(std::sqrt(double(2 * rootPageCount + 16))));
+    uint32_t maxSide = std::min(255u, uint32_t(maxSize) / L::PAGE_STRIDE);
+    atlasSide = std::clamp(atlasSide, std::min(minSide, maxSide), maxSide);
+
+    GLsizei atlasSize = GLsizei(atlasSide * L::PAGE_STRIDE);
+    glGenTextures(1, &atlasTextureId);
+    glBindTexture(GL_TEXTURE_2D, atlasTextureId);
+    glTexStorage2D(GL_TEXTURE_2D, 1,
+                   compressedAtlas ? GLInternalFormat(layout.format) : GL_RGBA8,
+                   atlasSize, atlasSize);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    // Levels are placed side by side, level 0 is the tallest
+    for(uint32_t i = 0; i < layout.levelCount; i++)
+    {
+        indirectionOffsets[i] = indirectionWidth;
+        indirectionWidth += layout.pagesX[i];
+    }
+    indirection.resize(size_t(indirectionWidth) * layout.pagesY[0]);
+    glGenTextures(1, &indirectionTextureId);
+    glBindTexture(GL_TEXTURE_2D, indirectionTextureId);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8UI,
+                   GLsizei(indirectionWidth), GLsizei(layout.pagesY[0]));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    indirectionDirty = true;
+
+    slots.resize(size_t(atlasSide) * atlasSide, Slot{INVALID_KEY, 0});
+    freeSlots.resize(slots.size());
+    // Popped from the back, fill the atlas in order
+    for(uint32_t i = 0; i < uint32_t(freeSlots.size()); i++)
+        freeSlots[i] = uint32_t(freeSlots.size()) - 1 - i;
+
+    // Root is requested until the first feedback arrives
+    for(uint32_t y = 0; y < layout.pagesY[rootLevel]; y++)
+    for(uint32_t x = 0; x < layout.pagesX[rootLevel]; x++)
+        requestedKeys.push_back(PageKey(rootLevel, x, y));
+
+    initialized = true;
+}
+
+void VirtualTexture::ReadFeedback()
+{
+    if(feedbackFence == nullptr) return;
+    GLenum status = glClientWaitSync(feedbackFence, 0, 0);
+    if(status == GL_TIMEOUT_EXPIRED) return;
+    glDeleteSync(feedbackFence);
+    feedbackFence = nullptr;
+
+    const VirtualTextureLayout& layout = cache.header.layout;
+    uint32_t rootLevel = layout.levelCount - 1;
+    requestedKeys.clear();
+
+    // Texels are (page x, page y, level, written)
+    size_t texelCount = size_t(feedbackWidth) * size_t(feedbackHeight);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, feedbackPBO);
+    const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                                          GLsizeiptr(texelCount * 4 * sizeof(uint16_t)),
+                                          GL_MAP_READ_BIT);
+    if(mapped)
+    {
+        const uint16_t* texels = static_cast<const uint16_t*>(mapped);
+        for(size_t i = 0; i < texelCount; i++)
+        {
+            const uint16_t* t = texels + i * 4;
+            if(t[3] == 0) continue;
+            uint32_t level = std::min(uint32_t(t[2]), rootLevel);
+            uint32_t x = std::min(uint32_t(t[0]), layout.pagesX[level] - 1);
+            uint32_t y = std::min(uint32_t(t[1]), layout.pagesY[level] - 1);
+            requestedKeys.push_back(PageKey(level, x, y));
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    std::sort(requestedKeys.begin(), requestedKeys.end());
+    requestedKeys.erase(std::unique(requestedKeys.begin(), requestedKeys.end()),
+                        requestedKeys.end());
+
+    // Ancestors are kept resident as well, these are shown
+    // while a page streams in and when the atlas is full
+    size_t visibleCount = requestedKeys.size();
+    for(size_t i = 0; i < visibleCount; i++)
+    {
+        uint32_t level, x, y;
+        UnpackKey(level, x, y, requestedKeys[i]);
+        while(level < rootLevel)
+        {
+            level++;
+            x = std::min(x >> 1, layout.pagesX[level] - 1);
+            y = std::min(y >> 1, layout.pagesY[level] - 1);
+            requestedKeys.push_back(PageKey(level, x, y));
+        }
+    }
+    for(uint32_t y = 0; y < layout.pagesY[rootLevel]; y++)
+    for(uint32_t x = 0; x < layout.pagesX[rootLevel]; x++)
+        requestedKeys.push_back(PageKey(rootLevel, x, y));
+    std::sort(requestedKeys.begin(), requestedKeys.end());
+    requestedKeys.erase(std::unique(requestedKeys.begin(), requestedKeys.end()),
+                        requestedKeys.end());
+}
+
+void VirtualTexture::RequestPages()
+{
+    const VirtualTextureLayout& layout = cache.header.layout;
+    uint32_t rootLevel = layout.levelCount - 1;
+
+    std::vector<uint32_t> missingKeys;
+    for(uint32_t key : requestedKeys)
+    {
+        auto it = residentSlots.find(key);
+        if(it != residentSlots.end())
+            slots[it->second].lastUsedFrame = frameIndex;
+        else if(loadsInFlight.count(key) == 0)
+            missingKeys.push_back(key);
+    }
+    if(missingKeys.empty()) return;
+
+    // Do not load more than what fits without evicting
+    // a page that is in use
+    uint32_t availableSlots = 0;
+    for(const Slot& s : slots)
+    {
+        if(s.key == INVALID_KEY ||
+           (s.lastUsedFrame != frameIndex && (s.key >> 28) != rootLevel))
+            availableSlots++;
+    }
+    uint32_t inFlight = uint32_t(loadsInFlight.size());
+    if(availableSlots <= inFlight || inFlight >= MAX_LOADS_IN_FLIGHT) return;
+    uint32_t loadCount = std::min(availableSlots - inFlight, MAX_LOADS_IN_FLIGHT - inFlight);
+
+    // Coarse pages first, these cover the most of the screen
+    std::sort(missingKeys.begin(), missingKeys.end(), std::greater<uint32_t>());
+    if(missingKeys.size() > loadCount) missingKeys.resize(loadCount);
+    for(uint32_t key : missingKeys)
+    {
+        loadsInFlight.insert(key);
+        pool.Submit([this, key]()
+        {
+            const VirtualTextureLayout& l = cache.header.layout;
+            uint32_t level, x, y;
+            UnpackKey(level, x, y, key);
+            const std::byte* page = cache.Page(l.firstPage[level] + y * l.pagesX[level] + x);
+
+            // Copy touches the mapping here instead of on the context thread
+            LoadedPage result = {key, {}};
+            if(compressedAtlas)
+                result.data.assign(page, page + l.pageBytes);
+            else
+            {
+                constexpr uint32_t STRIDE = VirtualTextureLayout::PAGE_STRIDE;
+                result.data.resize(size_t(STRIDE) * STRIDE * 4);
+                DecompressBC(reinterpret_cast<uint8_t*>(result.data.data()), page,
+                             STRIDE, STRIDE, l.format);
+            }
+
+            std::lock_guard<std::mutex> lock(resultMutex);
+            loadedPages.push_back(std::move(result));
+        });
+    }
+}
+
+uint32_t VirtualTexture::AcquireSlot()
+{
+    if(!freeSlots.empty())
+    {
+        uint32_t slot = freeSlots.back();
+        freeSlots.pop_back();
+        return slot;
+    }
+
+    // Least recently used page that is not on the screen
+    uint32_t rootLevel = cache.header.layout.levelCount - 1;
+    uint32_t victim = INVALID_KEY;
+    for(uint32_t i = 0; i < uint32_t(slots.size()); i++)
+    {
+        const Slot& s = slots[i];
+        if(s.lastUsedFrame == frameIndex || (s.key >> 28) == rootLevel) continue;
+        if(victim == INVALID_KEY || s.lastUsedFrame < slots[victim].lastUsedFrame)
+            victim = i;
+    }
+    if(victim == INVALID_KEY) return INVALID_KEY;
+
+    residentSlots.erase(slots[victim].key);
+    slots[victim].key = INVALID_KEY;
+    indirectionDirty = true;
+    return victim;
+}
+
+void VirtualTexture::UploadPages()
+{
+    using L = VirtualTextureLayout;
+    {
+        std::lock_guard<std::mutex> lock(resultMutex);
+        for(LoadedPage& p : loadedPages)
+            pendingUploads.push_back(std::move(p));
+        loadedPages.clear();
+    }
+    if(pendingUploads.empty()) return;
+
+    // Coarse pages first (see "RequestPages")
+    std::sort(pendingUploads.begin(), pendingUploads.end(),
+              [](const LoadedPage& a, const LoadedPage& b) { return a.key > b.key; });
+
+    const L& layout = cache.header.layout;
+    uint32_t uploadCount = std::min(uint32_t(pendingUploads.size()), UPLOADS_PER_FRAME);
+    glBindTexture(GL_TEXTURE_2D, atlasTextureId);
+    for(uint32_t i = 0; i < uploadCount; i++)
+    {
+        const LoadedPage& p = pendingUploads[i];
+        loadsInFlight.erase(p.key);
+        // Atlas is full of visible pages, the page is
+        // requested again once a slot is free
+        uint32_t slot = AcquireSlot();
+        if(slot == INVALID_KEY) continue;
+
+        GLint x = GLint((slot % atlasSide) * L::PAGE_STRIDE);
+        GLint y = GLint((slot / atlasSide) * L::PAGE_STRIDE);
+        if(compressedAtlas)
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, x, y, L::PAGE_STRIDE, L::PAGE_STRIDE,
+                                      GLInternalFormat(layout.format),
+                                      GLsizei(p.data.size()), p.data.data());
+        else
+            glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, L::PAGE_STRIDE, L::PAGE_STRIDE,
+                            GL_RGBA, GL_UNSIGNED_BYTE, p.data.data());
+
+        slots[slot] = Slot{p.key, frameIndex};
+        residentSlots.emplace(p.key, slot);
+        indirectionDirty = true;
+    }
+    pendingUploads.erase(pendingUploads.begin(), pendingUploads.begin() + uploadCount);
+}
+
+void VirtualTexture::RebuildIndirection()
+{
+    const VirtualTextureLayout& layout = cache.header.layout;
+    uint32_t rootLevel = layout.levelCount - 1;
+
+    // Coarse to fine, a page that is not resident
+    // takes the entry of its parent
+    for(uint32_t level = rootLevel + 1; level-- > 0;)
+    {
+        for(uint32_t y = 0; y < layout.pagesY[level]; y++)
+        for(uint32_t x = 0; x < layout.pagesX[level]; x++)
+        {
+            std::array<uint8_t, 4>& entry = indirection[y * indirectionWidth + indirectionOffsets[level] + x];
+            auto it = residentSlots.find(PageKey(level, x, y));
+            if(it != residentSlots.end())
+                entry = {uint8_t(it->second % atlasSide), uint8_t(it->second / atlasSide),
+                         uint8_t(level), 1};
+            else if(level == rootLevel)
+                entry = {0, 0, 0, 0};
+            else
+            {
+                uint32_t px = std::min(x >> 1, layout.pagesX[level + 1] - 1);
+                uint32_t py = std::min(y >> 1, layout.pagesY[level + 1] - 1);
+                entry = indirection[py * indirectionWidth + indirectionOffsets[level + 1] + px];
+            }
+        }
+    }
+
+    glBindTexture(GL_TEXTURE_2D, indirectionTextureId);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
+                    GLsizei(indirectionWidth), GLsizei(layout.pagesY[0]),
+                    GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, indirection.data());
+    indirectionDirty = false;
+}
+
+void VirtualTexture::Update()
+{
+    if(!initialized)
+    {
+        {
+            std::lock_guard<std::mutex> lock(resultMutex);
+            if(cacheFailed)
+            {
+                std::printf("[WARNING]: Unable to stream \"%s\", "
+                            "background stays at the fallback texture\n",
+                            sourcePath.c_str());
+                cacheFailed = false;
+            }
+            if(!cacheLoaded) return;
+        }
+        Initialize();
+    }
+
+    ReadFeedback();
+    RequestPages();
+    UploadPages();
+    if(indirectionDirty) RebuildIndirection();
+    frameIndex++;
+}
+
+VirtualTexture::Stats VirtualTexture::GetStats() const
+{
+    uint64_t atlasTexels = uint64_t(atlasSide) * atlasSide *
+                           VirtualTextureLayout::PAGE_STRIDE * VirtualTextureLayout::PAGE_STRIDE;
+    uint64_t atlasBytes = 0;
+    if(initialized)
+        atlasBytes = compressedAtlas
+                        ? uint64_t(atlasSide) * atlasSide * cache.header.layout.pageBytes
+                        : atlasTexels * 4;
+    return Stats
+    {
+        uint32_t(residentSlots.size()),
+        initialized ? uint32_t(slots.size()) : 0,
+        uint32_t(requestedKeys.size()),
+        atlasBytes
+    };
+}
+
+bool VirtualTexture::BeginFeedback(int screenWidth, int screenHeight)
+{
+    // Previous one is not read yet
+    if(feedbackFence != nullptr) return false;
+
+    int w = std::max(1, screenWidth / int(FEEDBACK_DIVISOR));
+    int h = std::max(1, screenHeight / int(FEEDBACK_DIVISOR));
+    if(w != feedbackWidth || h != feedbackHeight)
+    {
+        feedbackWidth = w;
+        feedbackHeight = h;
+        glDeleteTextures(1, &feedbackTextureId);
+        glDeleteFramebuffers(1, &feedbackFBO);
+        glDeleteBuffers(1, &feedbackPBO);
+
+        glGenTextures(1, &feedbackTextureId);
+        glBindTexture(GL_TEXTURE_2D, feedbackTextureId);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA16UI, w, h);
+
+        glGenFramebuffers(1, &feedbackFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, feedbackFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                               feedbackTextureId, 0);
+        if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::fprintf(stderr, "Virtual texture feedback framebuffer is not complete!\n");
+            std::exit(EXIT_FAILURE);
+        }
+
+        glGenBuffers(1, &feedbackPBO);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, feedbackPBO);
+        glBufferData(GL_PIXEL_PACK_BUFFER,
+                     GLsizeiptr(size_t(w) * size_t(h) * 4 * sizeof(uint16_t)),
+                     nullptr, GL_STREAM_READ);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, feedbackFBO);
+    glViewport(0, 0, feedbackWidth, feedbackHeight);
+    const GLuint clearValue[4] = {0, 0, 0, 0};
+    glClearBufferuiv(GL_COLOR, 0, clearValue);
+    return true;
+}
+
+void VirtualTexture::EndFeedback()
+{
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, feedbackPBO);
+    glReadPixels(0, 0, feedbackWidth, feedbackHeight,
+                 GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    feedbackFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void VirtualTexture::SetUniforms(GLuint program, bool feedback) const
+{
+    using L = VirtualTextureLayout;
+    const L& layout = cache.header.layout;
+    // Feedback target is smaller, its derivatives are larger
+    float lodBias = feedback ? -std::log2(float(FEEDBACK_DIVISOR)) : 0.0f;
+    glProgramUniform4f(program, GLint(U_VT_SIZE),
+                       float(layout.width), float(layout.height),
+                       float(L::PAGE_SIZE), float(layout.levelCount));
+    glProgramUniform4f(program, GLint(U_VT_ATLAS),
+                       float(atlasSide * L::PAGE_STRIDE), float(L::PAGE_STRIDE),
+                       float(L::PAGE_BORDER), lodBias);
+
+    std::array<float, 4 * L::MAX_LEVEL_COUNT> levels = {};
+    for(uint32_t i = 0; i < layout.levelCount; i++)
+    {
+        levels[i * 4 + 0] = float(std::max(1u, layout.width >> i));
+        levels[i * 4 + 1] = float(std::max(1u, layout.height >> i));
+        levels[i * 4 + 2] = float(indirectionOffsets[i]);
+        levels[i * 4 + 3] = float(layout.pagesX[i]);
+    }
+    glProgramUniform4fv(program, GLint(U_VT_LEVELS), GLsizei(layout.levelCount), levels.data());
+}
+
+void VirtualTexture::BindTextures(GLuint atlasUnit, GLuint indirectionUnit) const
+{
+    glActiveTexture(GL_TEXTURE0 + atlasUnit);
+    glBindTexture(GL_TEXTURE_2D, atlasTextureId);
+    glActiveTexture(GL_TEXTURE0 + indirectionUnit);
+    glBindTexture(GL_TEXTURE_2D, indirectionTextureId);
+}
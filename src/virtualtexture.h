@@ -0,0 +1,139 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "vtexcache.h"
+#include "threadpool.h"
+
+// Streams the pages of a ".vtex" file (see vtexcache.h) into a fixed size
+// page atlas. Each frame the background is drawn into a small feedback
+// target that records the page each texel wants, the result is read back
+// asynchronously and the missing pages are copied out of the mapping on a
+// worker. Atlas slots are recycled least recently used first; an
+// indirection texture maps every page of every level to the finest
+// resident page that covers it. Resident memory depends on the atlas
+// size (see "CapacityForScreen"), not on the size of the source.
+class VirtualTexture
+{
+    public:
+    // Shader interface, see "shaders/background_vt.frag"
+    static constexpr GLuint U_VT_SIZE     = 9;
+    static constexpr GLuint U_VT_ATLAS    = 10;
+    static constexpr GLuint U_VT_LEVELS   = 11;
+    // Feedback is rendered at 1/FEEDBACK_DIVISOR of the screen
+    static constexpr uint32_t FEEDBACK_DIVISOR  = 8;
+    static constexpr uint32_t UPLOADS_PER_FRAME = 16;
+    static constexpr uint32_t MAX_LOADS_IN_FLIGHT = 64;
+
+    struct Stats
+    {
+        uint32_t    residentPages;
+        uint32_t    capacity;
+        uint32_t    requestedPages;
+        uint64_t    atlasBytes;
+    };
+
+    private:
+    static constexpr uint32_t INVALID_KEY = 0xFFFFFFFF;
+
+    struct Slot
+    {
+        uint32_t    key;
+        uint32_t    lastUsedFrame;
+    };
+    struct LoadedPage
+    {
+        uint32_t                key;
+        std::vector<std::byte>  data;
+    };
+
+    std::string                 sourcePath;
+    VirtualTextureCache         cache;
+    bool                        compressedAtlas = false;
+    bool                        initialized     = false;
+    // GL resources, created once the cache is loaded
+    GLuint                      atlasTextureId       = 0;
+    GLuint                      indirectionTextureId = 0;
+    GLuint                      feedbackFBO          = 0;
+    GLuint                      feedbackTextureId    = 0;
+    GLuint                      feedbackPBO          = 0;
+    GLsync                      feedbackFence        = nullptr;
+    int                         feedbackWidth        = 0;
+    int                         feedbackHeight       = 0;
+    // Page residency
+    uint32_t                    atlasSide;
+    uint32_t                    frameIndex = 0;
+    std::vector<Slot>           slots;
+    std::vector<uint32_t>       freeSlots;
+    std::unordered_map<uint32_t, uint32_t> residentSlots;
+    std::unordered_set<uint32_t> loadsInFlight;
+    std::vector<uint32_t>       requestedKeys;
+    std::vector<LoadedPage>     pendingUploads;
+    // Level "l" is at column "indirectionOffsets[l]"
+    uint32_t                    indirectionWidth = 0;
+    std::array<uint32_t, VirtualTextureLayout::MAX_LEVEL_COUNT> indirectionOffsets = {};
+    std::vector<std::array<uint8_t, 4>> indirection;
+    bool                        indirectionDirty = false;
+    // Filled by the worker
+    std::mutex                  resultMutex;
+    bool                        cacheLoaded = false;
+    bool                        cacheFailed = false;
+    std::vector<LoadedPage>     loadedPages;
+    // Destroyed first, joins the worker
+    ThreadPool                  pool;
+
+    static uint32_t PageKey(uint32_t level, uint32_t x, uint32_t y);
+    static void     UnpackKey(uint32_t& level, uint32_t& x, uint32_t& y, uint32_t key);
+
+    void            Initialize();
+    void            ReadFeedback();
+    void            RequestPages();
+    void            UploadPages();
+    void            RebuildIndirection();
+    uint32_t        AcquireSlot();
+
+    public:
+    // Atlas is "atlasSide" x "atlasSide" pages
+                    VirtualTexture(const std::string& imgPath, uint32_t atlasSide);
+                    VirtualTexture(const VirtualTexture&) = delete;
+                    VirtualTexture(VirtualTexture&&) = delete;
+    VirtualTexture& operator=(const VirtualTexture&) = delete;
+    VirtualTexture& operator=(VirtualTexture&&) = delete;
+                    ~VirtualTexture();
+
+    // Atlas side that holds the pages of a screen of this size twice
+    // over (a level and its parent) and the coarsest levels
+    static uint32_t CapacityForScreen(int width, int height);
+
+    // Must be called on the context thread once per frame, before the
+    // feedback pass. Reads the previous feedback, streams pages in.
+    void            Update();
+    // False until the page file is loaded, the caller should draw
+    // with a regular texture until then
+    bool            Ready() const;
+    Stats           GetStats() const;
+
+    // Binds and clears the feedback target of the screen size, returns
+    // false when the previous feedback is still being read back
+    bool            BeginFeedback(int screenWidth, int screenHeight);
+    // Starts the asynchronous read back, binds the default framebuffer
+    void            EndFeedback();
+
+    // Uniforms of the given fragment program, "feedback" selects
+    // the level bias of the feedback pass
+    void            SetUniforms(GLuint program, bool feedback) const;
+    void            BindTextures(GLuint atlasUnit, GLuint indirectionUnit) const;
+};
+
+inline bool VirtualTexture::Ready() const
+{
+    return initialized;
+}
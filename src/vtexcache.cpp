@@ -0,0 +1,191 @@
+#include "vtexcache.h"
+#include "texcompress.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+static_assert(std::is_trivially_copyable_v<VirtualTextureCacheHeader>,
+              "Virtual texture header is written as raw bytes!");
+
+namespace
+{
+
+constexpr uint64_t AlignUp(uint64_t v, uint64_t alignment)
+{
+    return (v + alignment - 1) / alignment * alignment;
+}
+
+// Page of a level with its border, x wraps and y clamps
+void CutPage(uint8_t* out, const uint8_t* level, uint32_t width, uint32_t height,
+             uint32_t channelCount, uint32_t pageX, uint32_t pageY)
+{
+    using L = VirtualTextureLayout;
+    int64_t originX = int64_t(pageX) * L::PAGE_SIZE - L::PAGE_BORDER;
+    int64_t originY = int64_t(pageY) * L::PAGE_SIZE - L::PAGE_BORDER;
+    for(uint32_t y = 0; y < L::PAGE_STRIDE; y++)
+    {
+        int64_t sy = std::clamp(originY + y, int64_t(0), int64_t(height) - 1);
+        for(uint32_t x = 0; x < L::PAGE_STRIDE; x++)
+        {
+            int64_t sx = (originX + x) % int64_t(width);
+            if(sx < 0) sx += width;
+            std::memcpy(out + (size_t(y) * L::PAGE_STRIDE + x) * channelCount,
+                        level + (size_t(sy) * width + size_t(sx)) * channelCount,
+                        channelCount);
+        }
+    }
+}
+
+}
+
+std::string VirtualTextureCachePath(const std::string& sourcePath)
+{
+    return sourcePath + ".vtex";
+}
+
+bool LoadVirtualTextureCache(VirtualTextureCache& out, const std::string& cachePath,
+                             const std::string& sourcePath)
+{
+    FileStamp sourceStamp;
+    if(!GetFileStamp(sourceStamp, sourcePath)) return false;
+
+    MappedFile file(cachePath);
+    if(!file || file.size < sizeof(VirtualTextureCacheHeader)) return false;
+
+    VirtualTextureCacheHeader header;
+    std::memcpy(&header, file.data, sizeof(VirtualTextureCacheHeader));
+    MipSettings mips = ImageMipSettings(sourcePath);
+    if(std::memcmp(header.magic, VirtualTextureCacheHeader::MAGIC, sizeof(header.magic)) != 0 ||
+       header.version != VirtualTextureCacheHeader::VERSION ||
+       bool(header.flags & VirtualTextureCacheHeader::LINEAR_LIGHT) != mips.linearLight ||
+       header.mipFilter != mips.filter || header.mipAlphaCoverage != mips.alphaCoverage)
+        return false;
+
+    // Bounds check, file may be truncated
+    const VirtualTextureLayout& layout = header.layout;
+    if(!IsBlockCompressed(layout.format) || layout.format > TextureLayout::BC7 ||
+       layout.levelCount == 0 || layout.levelCount > VirtualTextureLayout::MAX_LEVEL_COUNT ||
+       layout.pageBytes != CompressedSize(layout.format, VirtualTextureLayout::PAGE_STRIDE,
+                                          VirtualTextureLayout::PAGE_STRIDE) ||
+       layout.dataOffset + uint64_t(layout.pageCount) * layout.pageBytes > file.size)
+        return false;
+    for(uint32_t i = 0; i < layout.levelCount; i++)
+    {
+        if(uint64_t(layout.firstPage[i]) + uint64_t(layout.pagesX[i]) * layout.pagesY[i] > layout.pageCount)
+            return false;
+    }
+
+    // Staleness check (see "LoadTextureCache")
+    if(header.sourceStamp.size != sourceStamp.size) return false;
+    if(header.sourceStamp.modifiedTime != sourceStamp.modifiedTime)
+    {
+        uint64_t sourceHash;
+        if(!HashFile(sourceHash, sourcePath) ||
+           sourceHash != header.sourceHash)
+            return false;
+
+        header.sourceStamp = sourceStamp;
+        WriteFileAtomic(cachePath,
+        {
+            FileChunk{&header, sizeof(VirtualTextureCacheHeader)},
+            FileChunk{file.data + sizeof(VirtualTextureCacheHeader),
+                      file.size - sizeof(VirtualTextureCacheHeader)}
+        });
+    }
+
+    out.header = header;
+    out.file = std::move(file);
+    return true;
+}
+
+bool BuildVirtualTextureCache(const std::string& sourcePath, const std::string& cachePath,
+                              ThreadPool* pool)
+{
+    using L = VirtualTextureLayout;
+    DecodedImage image;
+    if(!DecodeImage(image, sourcePath)) return false;
+    if(image.is16Bit || image.channelCount < 1 || image.channelCount > 4) return false;
+
+    VirtualTextureCacheHeader header = {};
+    std::memcpy(header.magic, VirtualTextureCacheHeader::MAGIC, sizeof(header.magic));
+    header.version = VirtualTextureCacheHeader::VERSION;
+    MipSettings mips = ImageMipSettings(sourcePath);
+    header.flags = mips.linearLight ? VirtualTextureCacheHeader::LINEAR_LIGHT : 0u;
+    header.mipFilter = mips.filter;
+    header.mipAlphaCoverage = mips.alphaCoverage;
+    if(!GetFileStamp(header.sourceStamp, sourcePath) ||
+       !HashFile(header.sourceHash, sourcePath))
+        return false;
+
+    TextureLayout levels;
+    std::vector<std::byte> levelData;
+    BuildMipChain(levels, levelData, image, mips, pool);
+    uint32_t channelCount = ChannelCount(levels.format);
+
+    static constexpr TextureLayout::PixelFormat CompressedFormats[4] =
+    {
+        TextureLayout::BC4, TextureLayout::BC5,
+        TextureLayout::BC1, TextureLayout::BC7
+    };
+    L& layout = header.layout;
+    layout.format = CompressedFormats[channelCount - 1];
+    layout.width = levels.width;
+    layout.height = levels.height;
+    layout.pageBytes = uint32_t(CompressedSize(layout.format, L::PAGE_STRIDE, L::PAGE_STRIDE));
+    for(uint32_t i = 0; i < std::min(levels.mipCount, L::MAX_LEVEL_COUNT); i++)
+    {
+        uint32_t w = std::max(1u, levels.width >> i);
+        uint32_t h = std::max(1u, levels.height >> i);
+        layout.pagesX[i] = (w + L::PAGE_SIZE - 1) / L::PAGE_SIZE;
+        layout.pagesY[i] = (h + L::PAGE_SIZE - 1) / L::PAGE_SIZE;
+        layout.firstPage[i] = layout.pageCount;
+        layout.pageCount += layout.pagesX[i] * layout.pagesY[i];
+        layout.levelCount++;
+        if(layout.pagesX[i] == 1 && layout.pagesY[i] == 1) break;
+    }
+    layout.dataOffset = AlignUp(sizeof(VirtualTextureCacheHeader), 256);
+
+    // Pages are independent, a task compresses one of them
+    std::vector<std::byte> pages(size_t(layout.pageCount) * layout.pageBytes);
+    auto CompressPage = [&](uint32_t pageIndex)
+    {
+        uint32_t level = 0;
+        while(level + 1 < layout.levelCount && layout.firstPage[level + 1] <= pageIndex) level++;
+        uint32_t localIndex = pageIndex - layout.firstPage[level];
+        uint32_t pageX = localIndex % layout.pagesX[level];
+        uint32_t pageY = localIndex / layout.pagesX[level];
+
+        uint8_t texels[L::PAGE_STRIDE * L::PAGE_STRIDE * 4];
+        CutPage(texels, reinterpret_cast<const uint8_t*>(levelData.data() + levels.levelOffsets[level]),
+                std::max(1u, levels.width >> level), std::max(1u, levels.height >> level),
+                channelCount, pageX, pageY);
+        CompressBC(pages.data() + size_t(pageIndex) * layout.pageBytes, texels,
+                   L::PAGE_STRIDE, L::PAGE_STRIDE, channelCount, layout.format);
+    };
+    if(pool) pool->ParallelFor(layout.pageCount, CompressPage);
+    else for(uint32_t i = 0; i < layout.pageCount; i++) CompressPage(i);
+
+    return WriteFileAtomic(cachePath,
+    {
+        FileChunk{&header, sizeof(VirtualTextureCacheHeader)},
+        FileChunk{nullptr, size_t(layout.dataOffset - sizeof(VirtualTextureCacheHeader))},
+        FileChunk{pages.data(), pages.size()}
+    });
+}
+
+bool LoadOrBuildVirtualTextureCache(VirtualTextureCache& out,
+                                    const std::string& sourcePath,
+                                    bool& rebuilt)
+{
+    rebuilt = false;
+    std::string cachePath = VirtualTextureCachePath(sourcePath);
+    if(LoadVirtualTextureCache(out, cachePath, sourcePath)) return true;
+
+    if(!BuildVirtualTextureCache(sourcePath, cachePath)) return false;
+    rebuilt = true;
+    return LoadVirtualTextureCache(out, cachePath, sourcePath);
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+#include "filemap.h"
+#include "texcache.h"
+
+class ThreadPool;
+
+// ======================= //
+//  VIRTUAL TEXTURE PAGES  //
+// ======================= //
+// ".vtex" file holds the mip chain of an (equirectangular) image cut into
+// fixed size pages. Every page carries a border of its neighbours so that
+// it can be bilinearly filtered on its own; borders wrap horizontally and
+// clamp vertically. Pages are block compressed one by one (as in
+// ".texbin") and are stored back to back, a page is streamed with a single
+// copy from the mapping. Levels stop at the first one that fits a page.
+struct VirtualTextureLayout
+{
+    static constexpr uint32_t MAX_LEVEL_COUNT = 16;
+    static constexpr uint32_t PAGE_SIZE       = 128;
+    static constexpr uint32_t PAGE_BORDER     = 4;
+    // Stored texels per side of a page
+    static constexpr uint32_t PAGE_STRIDE     = PAGE_SIZE + 2 * PAGE_BORDER;
+
+    TextureLayout::PixelFormat format = TextureLayout::BC1;
+    uint32_t    width       = 0;
+    uint32_t    height      = 0;
+    uint32_t    levelCount  = 0;
+    uint32_t    pageCount   = 0;
+    uint32_t    pageBytes   = 0;
+    uint64_t    dataOffset  = 0;
+    // Page grid of the levels, pages of a level are row major
+    uint32_t    pagesX[MAX_LEVEL_COUNT]    = {};
+    uint32_t    pagesY[MAX_LEVEL_COUNT]    = {};
+    uint32_t    firstPage[MAX_LEVEL_COUNT] = {};
+};
+
+struct VirtualTextureCacheHeader
+{
+    static constexpr char     MAGIC[8] = {'V', 'T', 'E', 'X', 'B', 'I', 'N', '\0'};
+    static constexpr uint32_t VERSION  = 2;
+    // Flags
+    // "MipSettings::linearLight"
+    static constexpr uint32_t LINEAR_LIGHT = 0x1;
+
+    char                    magic[8];
+    uint32_t                version;
+    uint32_t                flags;
+    FileStamp               sourceStamp;
+    uint64_t                sourceHash;
+    // Rest of the "MipSettings" of the chain
+    uint32_t                mipFilter;
+    float                   mipAlphaCoverage;
+    VirtualTextureLayout    layout;
+};
+
+struct VirtualTextureCache
+{
+    MappedFile                  file;
+    VirtualTextureCacheHeader   header = {};
+
+    const std::byte* Page(uint32_t pageIndex) const;
+};
+
+// "textures/a.jpg" -> "textures/a.jpg.vtex"
+std::string VirtualTextureCachePath(const std::string& sourcePath);
+
+// Returns false when the cache does not exist, is corrupted or stale
+// (pages are built with "ImageMipSettings" of the source)
+bool    LoadVirtualTextureCache(VirtualTextureCache& out, const std::string& cachePath,
+                                const std::string& sourcePath);
+// Decodes the 8-bit source, cuts and compresses its pages and writes
+// the file. Pages are compressed on the pool when it is given.
+bool    BuildVirtualTextureCache(const std::string& sourcePath,
+                                 const std::string& cachePath,
+                                 ThreadPool* pool = nullptr);
+// "rebuilt" is set when the source is decoded
+bool    LoadOrBuildVirtualTextureCache(VirtualTextureCache& out,
+                                       const std::string& sourcePath,
+                                       bool& rebuilt);
+
+// Inline Definitions
+inline const std::byte* VirtualTextureCache::Page(uint32_t pageIndex) const
+{
+    const VirtualTextureLayout& layout = header.layout;
+    return reinterpret_cast<const std::byte*>(file.data) + layout.dataOffset +
+           uint64_t(pageIndex) * layout.pageBytes;
+}
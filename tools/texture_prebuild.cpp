@@ -0,0 +1,190 @@
+/*
+    Builds the ".texbin" caches of every jpg / png in a directory
+    so that the renderer never decodes images on startup. Sky images
+    ("*stars*") also get their octahedral cache, 8k and wider ones get
+    the ".vtex" pages of the streaming path instead. Layers of the body
+    array ("BodyArray") that are not of its size get their resized cache.
+    Usage: TexturePrebuild [directory = "textures"] [--force] [--raw]
+    --raw: do not block compress (the renderer then rebuilds the cache
+           unless the GL implementation lacks S3TC)
+    Run from the "working_dir".
+*/
+#include "texcache.h"
+#include "threadpool.h"
+#include "texcompress.h"
+#include "vtexcache.h"
+#include "imagedecode.h"
+#include "bodyarray.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+int main(int argc, const char* argv[])
+{
+    std::string texDir = "textures";
+    bool force = false;
+    bool compress = true;
+    for(int i = 1; i < argc; i++)
+    {
+        if(std::strcmp(argv[i], "--force") == 0) force = true;
+        else if(std::strcmp(argv[i], "--raw") == 0) compress = false;
+        else texDir = argv[i];
+    }
+
+    std::vector<std::string> texPaths;
+    std::error_code err;
+    for(const auto& entry : std::filesystem::directory_iterator(texDir, err))
+    {
+        std::string ext = entry.path().extension().string();
+        if(ext == ".jpg" || ext == ".jpeg" || ext == ".png")
+            texPaths.push_back(entry.path().string());
+    }
+    std::sort(texPaths.begin(), texPaths.end());
+    if(texPaths.empty())
+    {
+        std::fprintf(stderr, "No images found in \"%s\"\n", texDir.c_str());
+        return EXIT_FAILURE;
+    }
+
+    // Only the caches that the renderer loads are built: the sky is drawn
+    // from the octahedral map, or streamed when it is large, and layers of
+    // the body array from caches of the array size
+    constexpr uint32_t VIRTUAL_MIN_WIDTH = 8192;
+    struct Job
+    {
+        std::string path;
+        bool        octahedral;
+        // Resampled size, zero keeps the source size
+        uint32_t    width  = 0;
+        uint32_t    height = 0;
+    };
+    std::vector<Job> jobs;
+    for(const std::string& path : texPaths)
+    {
+        // Unreadable ones are reported by the build
+        ImageInfo info;
+        if(!ReadImageInfo(info, path))
+        {
+            jobs.push_back(Job{path, false});
+            continue;
+        }
+
+        std::string name = std::filesystem::path(path).filename().string();
+        bool isLayer = std::find_if(BodyArray::LAYERS.begin(), BodyArray::LAYERS.end(),
+                                    [&](const char* l) { return name == l; }) != BodyArray::LAYERS.end();
+        if(name.find("stars") != std::string::npos)
+        {
+            // Pages are built below
+            if(info.width < VIRTUAL_MIN_WIDTH) jobs.push_back(Job{path, true});
+        }
+        // Same sized layers are served by the source sized cache
+        else if(isLayer && (info.width != BodyArray::WIDTH || info.height != BodyArray::HEIGHT))
+            jobs.push_back(Job{path, false, BodyArray::WIDTH, BodyArray::HEIGHT});
+        else
+            jobs.push_back(Job{path, false});
+    }
+
+    // Images are built one by one, mip rows and
+    // blocks are distributed over all cores
+    using Clock = std::chrono::steady_clock;
+    auto start = Clock::now();
+    uint32_t failCount = 0;
+    ThreadPool pool;
+    std::printf("%-40s %11s %6s %10s %10s %10s %9s\n", "image", "size",
+                "format", "MiB", "raw MiB", "build ms", "PSNR dB");
+    for(const Job& job : jobs)
+    {
+        const std::string& path = job.path;
+        TextureBuildSettings build;
+        build.compress = compress;
+        build.octahedral = job.octahedral;
+        build.width = job.width;
+        build.height = job.height;
+        std::string cachePath = TextureCachePath(path, build);
+        std::string label = job.octahedral ? path + " (oct)" : path;
+        if(job.width != 0)
+            label += " (" + std::to_string(job.width) + "x" + std::to_string(job.height) + ")";
+        MipSettings mips = ImageMipSettings(path);
+        TextureCache cache;
+        if(!force && LoadTextureCache(cache, cachePath, path, build, mips))
+        {
+            std::printf("%-40s up to date\n", label.c_str());
+            continue;
+        }
+        auto t0 = Clock::now();
+        if(!BuildTextureCache(cache, path, build, mips, &pool) ||
+           !WriteTextureCache(cache, cachePath))
+        {
+            std::fprintf(stderr, "Unable to build texture cache of \"%s\"\n", label.c_str());
+            failCount++;
+            continue;
+        }
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+
+        // Size if it was not compressed and the error of the top level
+        // (octahedral / resampled maps are not comparable to the source)
+        const TextureLayout& layout = cache.header.layout;
+        uint32_t channelCount = ChannelCount(layout.format);
+        uint64_t rawSize = 0;
+        for(uint32_t i = 0; i < layout.mipCount; i++)
+            rawSize += uint64_t(std::max(1u, layout.width >> i)) *
+                       std::max(1u, layout.height >> i) * channelCount;
+        // "-" when it is not computed
+        char psnr[16] = "-";
+        DecodedImage source;
+        if(IsBlockCompressed(layout.format) && !job.octahedral && job.width == 0 &&
+           DecodeImage(source, path))
+        {
+            std::vector<uint8_t> rgba(size_t(layout.width) * layout.height * 4);
+            DecompressBC(rgba.data(), static_cast<const std::byte*>(cache.Level(0)),
+                         layout.width, layout.height, layout.format);
+            std::snprintf(psnr, sizeof(psnr), "%.2f",
+                          ComputePSNR(static_cast<const uint8_t*>(source.pixels.get()),
+                                      channelCount, rgba.data(), layout.width, layout.height));
+        }
+        std::string size = std::to_string(layout.width) + "x" + std::to_string(layout.height);
+        std::printf("%-40s %11s %6s %10.2f %10.2f %10.1f %9s\n", label.c_str(),
+                    size.c_str(), PixelFormatName(layout.format),
+                    double(TextureDataSize(layout)) / (1024.0 * 1024.0),
+                    double(rawSize) / (1024.0 * 1024.0), ms, psnr);
+    }
+
+    // Virtual texture pages, sources are decoded again; these
+    // are the few large ones
+    for(const std::string& path : texPaths)
+    {
+        ImageInfo info;
+        if(!ReadImageInfo(info, path) || info.width < VIRTUAL_MIN_WIDTH) continue;
+
+        std::string cachePath = VirtualTextureCachePath(path);
+        VirtualTextureCache cache;
+        if(!force && LoadVirtualTextureCache(cache, cachePath, path))
+        {
+            std::printf("%-40s pages up to date\n", path.c_str());
+            continue;
+        }
+        auto t0 = Clock::now();
+        if(!BuildVirtualTextureCache(path, cachePath, &pool) ||
+           !LoadVirtualTextureCache(cache, cachePath, path))
+        {
+            std::fprintf(stderr, "Unable to build virtual texture of \"%s\"\n", path.c_str());
+            failCount++;
+            continue;
+        }
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+        const VirtualTextureLayout& layout = cache.header.layout;
+        std::printf("%-40s %u pages (%u levels, %s), %.2f MiB in %.1f ms\n", path.c_str(),
+                    layout.pageCount, layout.levelCount, PixelFormatName(layout.format),
+                    double(cache.file.size) / (1024.0 * 1024.0), ms);
+    }
+
+    double total = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    std::printf("%zu textures in %.1f ms\n", jobs.size(), total);
+    return (failCount == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
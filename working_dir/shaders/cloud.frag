@@ -5,16 +5,8 @@
 */
 
 // Definitions
-#define IN_UV           layout(location = 0)
-#define IN_NORMAL       layout(location = 1)
-#define IN_WORLD_POS    layout(location = 2)
-
-#define OUT_COLOR       layout(location = 0)
-
-#define T_CLOUD         layout(binding = 0)
-
-#define U_LIGHT_DIR     layout(location = 4)
-#define U_LIGHT_COLOR   layout(location = 6)
+#include "include/locations.glsl"
+#include "include/frame.glsl"
 
 // Input
 IN_UV  in          vec2 fUV;
@@ -24,10 +16,6 @@ IN_WORLD_POS  in   vec3 fWorldPos;
 // Output
 OUT_COLOR out vec4 fragColor;
 
-// Uniforms
-U_LIGHT_DIR     uniform vec3 uLightDir;
-U_LIGHT_COLOR   uniform vec3 uLightColor;
-
 // Textures
 T_CLOUD uniform sampler2D tCloudMap;
 
@@ -38,11 +26,11 @@ void main(void)
     
     // Normalize vectors
     vec3 normal = normalize(fNormal);
-    vec3 lightDir = normalize(-uLightDir);
+    vec3 lightDir = normalize(-uLightDir.xyz);
     
     // Simple diffuse lighting for clouds
     float diff = max(dot(normal, lightDir), 0.0);
-    vec3 cloudColor = cloudSample.rgb * (0.3 + 0.7 * diff) * uLightColor;
+    vec3 cloudColor = cloudSample.rgb * (0.3 + 0.7 * diff) * uLightColor.rgb;
     
     fragColor = vec4(cloudColor, cloudSample.a);
 }
@@ -0,0 +1,45 @@
+/*
+    Interface Locations
+    Shared by every shader, these must match "MeshGL" (mesh attributes)
+    and the uniform / texture unit constants of "main.cpp".
+    Stage is defined by "ShaderBatch".
+*/
+
+#ifdef VERTEX_SHADER
+    // Mesh attributes
+    #define IN_POS          layout(location = 0)
+    #define IN_NORMAL       layout(location = 1)
+    #define IN_UV           layout(location = 2)
+
+    #define OUT_UV          layout(location = 0)
+    #define OUT_NORMAL      layout(location = 1)
+    #define OUT_WORLD_POS   layout(location = 2)
+    #define OUT_RAY         layout(location = 0)
+#else
+    #define IN_UV           layout(location = 0)
+    #define IN_NORMAL       layout(location = 1)
+    #define IN_WORLD_POS    layout(location = 2)
+    #define IN_RAY          layout(location = 0)
+
+    #define OUT_COLOR       layout(location = 0)
+    #define OUT_PAGE        layout(location = 0)
+#endif
+
+// Uniform blocks (see "frame.glsl")
+#define B_FRAME             layout(std140, binding = 0)
+#define B_DRAW              layout(std140, binding = 1)
+
+// Uniforms
+// Virtual texture programs (see "VirtualTexture::SetUniforms")
+#define U_VT_SIZE           layout(location = 9)
+#define U_VT_ATLAS          layout(location = 10)
+#define U_VT_LEVELS         layout(location = 11)
+
+// Textures
+#define T_ALBEDO            layout(binding = 0)
+#define T_CLOUD             layout(binding = 0)
+#define T_SHADOW            layout(binding = 1)
+#define T_SPECULAR          layout(binding = 2)
+#define T_NIGHT             layout(binding = 3)
+#define T_VT_PAGES          layout(binding = 4)
+#define T_VT_INDIRECTION    layout(binding = 5)
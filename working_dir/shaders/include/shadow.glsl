@@ -0,0 +1,57 @@
+/*
+    Shadow Mapping
+    Shadow of a world position from the light's depth map
+    SHADOW_PCF: 3x3 percentage closer filtering, softens the edges
+*/
+
+#ifndef SHADOW_PCF
+    #define SHADOW_PCF 0
+#endif
+
+#include "locations.glsl"
+#include "frame.glsl"
+
+T_SHADOW    uniform sampler2D tShadowMap;
+
+float calculateShadow(vec3 worldPos)
+{
+    // Transform world position to light space
+    vec4 lightSpacePos = uLightVP * vec4(worldPos, 1.0);
+    
+    // Perspective divide
+    vec3 projCoords = lightSpacePos.xyz / lightSpacePos.w;
+    
+    // Transform to [0,1] range
+    projCoords = projCoords * 0.5 + 0.5;
+    
+    // Check if outside shadow map bounds
+    if(projCoords.z > 1.0 || projCoords.x < 0.0 || projCoords.x > 1.0 || 
+       projCoords.y < 0.0 || projCoords.y > 1.0)
+        return 0.0;
+    
+    float currentDepth = projCoords.z;
+    
+    // Shadow bias to prevent shadow acne
+    float bias = 0.005;
+    
+#if SHADOW_PCF
+    // Average of the neighbouring depth tests
+    vec2 texelSize = 1.0 / vec2(textureSize(tShadowMap, 0));
+    float shadow = 0.0;
+    for(int y = -1; y <= 1; y++)
+    for(int x = -1; x <= 1; x++)
+    {
+        float closestDepth = texture(tShadowMap, projCoords.xy + vec2(x, y) * texelSize).r;
+        shadow += (currentDepth - bias) > closestDepth ? 1.0 : 0.0;
+    }
+    return shadow / 9.0;
+#else
+    // Get depth from shadow map
+    float closestDepth = texture(tShadowMap, projCoords.xy).r;
+    
+    // Check if in shadow
+    float shadow = (currentDepth - bias) > closestDepth ? 1.0 : 0.0;
+    
+    return shadow;
+#endif
+}
@@ -0,0 +1,24 @@
+#version 430
+/*
+    Sky Vertex Shader
+    Full screen triangle on the far plane (no vertex buffer),
+    outputs the world space view ray of each corner
+*/
+
+#include "include/locations.glsl"
+#include "include/frame.glsl"
+
+// Output
+out gl_PerVertex {vec4 gl_Position;};
+out OUT_RAY vec3 fRay;
+
+void main(void)
+{
+    // (-1, -1), (3, -1), (-1, 3) covers the screen
+    vec2 ndc = vec2((gl_VertexID & 1) * 4 - 1, (gl_VertexID >> 1) * 4 - 1);
+    // Depth is 1, drawn with GL_LEQUAL so that
+    // covered pixels fail the early depth test
+    gl_Position = vec4(ndc, 1.0, 1.0);
+    vec3 viewRay = vec3(ndc.x / uProjection[0][0], ndc.y / uProjection[1][1], -1.0);
+    fRay = transpose(mat3(uView)) * viewRay;
+}